@@ -0,0 +1,1231 @@
+#include "amuse/amuse.hpp"
+#include "amuse/AudioGroupLoader.hpp"
+#include "amuse/DSPCodec.hpp"
+#include "amuse/N64MusyXCodec.hpp"
+#include "amuse/OfflineBackend.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+/* Micro-benchmarks for amuse hot paths. Each stage decodes or processes a fixed, seeded
+ * synthetic workload so runs are comparable across machines and commits; dispatched SIMD
+ * stages are checked against the output of their scalar reference.
+ *
+ * Engine stages drive an Engine on the offline backend with a group and song from a sample
+ * corpus (the repository's test/ data by default) and time one hot path each in isolation:
+ * the SoundMacro VM, sample decoding per SampleFormat, bus routing, song sequencing and the
+ * effects. Every run restarts the workload from the same state, including the engine PRNG. */
+
+/* Global allocation functions count heap allocations on every thread while AllocationCounting is set,
+ * so stages can check that a hot path stays off the heap */
+static std::atomic<bool> AllocationCounting{false};
+static std::atomic<uint64_t> AllocationCount{0};
+
+void* operator new(size_t size) {
+  if (AllocationCounting.load(std::memory_order_relaxed))
+    AllocationCount.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = malloc(size ? size : 1))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+/* Kept out of line: inlined into a caller, free() on a new-expression's result trips -Wmismatched-new-delete */
+[[gnu::noinline]] void operator delete(void* ptr) noexcept { free(ptr); }
+[[gnu::noinline]] void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+using namespace std::literals;
+
+#ifdef AMUSE_BENCH_CORPUS_DIR
+constexpr const char* DefaultGroupPath = AMUSE_BENCH_CORPUS_DIR "/starfoxm.pro";
+constexpr const char* DefaultSongsPath = AMUSE_BENCH_CORPUS_DIR "/midi.wad";
+#else
+constexpr const char* DefaultGroupPath = "test/starfoxm.pro";
+constexpr const char* DefaultSongsPath = "test/midi.wad";
+#endif
+
+/** Engine stages run at the native rate in 5ms periods, as the offline renderer does */
+constexpr double EngineSampleRate = 32000.0;
+constexpr size_t EnginePeriodFrames = 160;
+
+struct BenchConfig {
+  unsigned m_iterations = 20;
+  unsigned m_samples = 1 << 20;
+  std::string m_groupPath = DefaultGroupPath;
+  std::string m_songsPath = DefaultSongsPath;
+  unsigned m_song = 0;
+  std::string m_jsonPath;
+  std::vector<std::string> m_filters;
+
+  /** 5ms engine periods covering m_samples samples */
+  unsigned periods() const { return std::max(1u, unsigned(m_samples / EnginePeriodFrames)); }
+};
+
+struct BenchStage {
+  std::string m_name;
+  std::string m_isa;
+  /** Unit of the items processed per run (e.g. "smp" for samples, "frame", "tick" for 5ms periods) */
+  std::string m_unit;
+  double m_items;
+  /** Processes m_items items once */
+  std::function<void()> m_run;
+  /** Compares the output of the last run against the scalar reference, or for stages without an ISA checks the
+   *  behavior the measured path must keep; empty for unverified stages */
+  std::function<bool()> m_verify;
+  /** Restores the starting state of the workload before each run; not timed */
+  std::function<void()> m_prepare = {};
+};
+
+struct BenchResult {
+  double m_bestSecs;
+  double m_meanSecs;
+};
+
+BenchResult RunStage(const BenchStage& stage, const BenchConfig& cfg) {
+  if (stage.m_prepare)
+    stage.m_prepare();
+  stage.m_run(); /* warm caches and dispatch tables */
+  double best = 1e300;
+  double total = 0.0;
+  for (unsigned i = 0; i < cfg.m_iterations; ++i) {
+    if (stage.m_prepare)
+      stage.m_prepare();
+    const auto start = Clock::now();
+    stage.m_run();
+    const double secs = std::chrono::duration<double>(Clock::now() - start).count();
+    best = std::min(best, secs);
+    total += secs;
+  }
+  return {best, total / cfg.m_iterations};
+}
+
+/** Seeded DSP-ADPCM stream with valid frame headers and moderate predictor coefficients */
+struct DSPWorkload {
+  int16_t m_coefs[8][2];
+  std::vector<uint8_t> m_data;
+  unsigned m_samples;
+
+  DSPWorkload(unsigned samples, uint32_t seed) : m_samples(samples) {
+    std::mt19937 rng(seed);
+    for (auto& pair : m_coefs) {
+      pair[0] = int16_t(rng() % 4096);
+      pair[1] = int16_t(-int(rng() % 2048));
+    }
+    m_data.resize((samples + 13) / 14 * 8);
+    for (size_t i = 0; i < m_data.size(); ++i)
+      m_data[i] = (i % 8) ? uint8_t(rng()) : uint8_t((rng() % 8) << 4 | rng() % 12);
+  }
+};
+
+/** Seeded N64 VADPCM stream with a random codebook */
+struct N64Workload {
+  int16_t m_coefs[8][2][8];
+  std::vector<uint8_t> m_data;
+  unsigned m_samples;
+
+  N64Workload(unsigned samples, uint32_t seed) : m_samples(samples) {
+    std::mt19937 rng(seed);
+    for (auto& pred : m_coefs)
+      for (auto& book : pred)
+        for (int16_t& c : book)
+          c = int16_t(int(rng() % 4096) - 2048);
+    m_data.resize((samples + 63) / 64 * 40);
+    for (uint8_t& b : m_data)
+      b = uint8_t(rng());
+  }
+};
+
+void AddCodecStages(std::vector<BenchStage>& stages, const BenchConfig& cfg) {
+  auto dsp = std::make_shared<DSPWorkload>(cfg.m_samples, 1);
+  auto dspRef = std::make_shared<std::vector<int16_t>>(cfg.m_samples);
+  auto dspOut = std::make_shared<std::vector<int16_t>>(cfg.m_samples);
+  {
+    /* The multi-frame decoders must match the per-frame decoder they replace */
+    int16_t prev1 = 0, prev2 = 0;
+    for (unsigned s = 0; s < dsp->m_samples; s += 14)
+      DSPDecompressFrame(dspRef->data() + s, dsp->m_data.data() + 8 * (s / 14), dsp->m_coefs, &prev1, &prev2,
+                         dsp->m_samples - s);
+  }
+  stages.push_back({"dsp-decode", "scalar", "smp", double(cfg.m_samples), [=]() {
+                      int16_t prev1 = 0, prev2 = 0;
+                      DSPDecompressFramesScalar(dspOut->data(), dsp->m_data.data(), dsp->m_coefs, &prev1, &prev2, 0,
+                                                dsp->m_samples);
+                    }, [=]() { return *dspRef == *dspOut; }});
+  if (strcmp(DSPDecompressFramesISA(), "scalar") != 0)
+    stages.push_back({"dsp-decode", DSPDecompressFramesISA(), "smp", double(cfg.m_samples), [=]() {
+                        int16_t prev1 = 0, prev2 = 0;
+                        DSPDecompressFrames(dspOut->data(), dsp->m_data.data(), dsp->m_coefs, &prev1, &prev2, 0,
+                                            dsp->m_samples);
+                      }, [=]() { return *dspRef == *dspOut; }});
+
+  auto n64 = std::make_shared<N64Workload>(cfg.m_samples, 2);
+  auto n64Ref = std::make_shared<std::vector<int16_t>>(cfg.m_samples);
+  auto n64Out = std::make_shared<std::vector<int16_t>>(cfg.m_samples);
+  stages.push_back({"n64-decode", "scalar", "smp", double(cfg.m_samples), [=]() {
+                      N64MusyXDecompressFramesScalar(n64Ref->data(), n64->m_data.data(), n64->m_coefs, 0,
+                                                     n64->m_samples);
+                    }, {}});
+  stages.push_back({"n64-decode", N64MusyXDecompressFramesISA(), "smp", double(cfg.m_samples), [=]() {
+                      N64MusyXDecompressFrames(n64Out->data(), n64->m_data.data(), n64->m_coefs, 0,
+                                               n64->m_samples);
+                    }, [=]() { return *n64Ref == *n64Out; }});
+}
+
+const char* SampleFormatName(amuse::SampleFormat fmt) {
+  switch (fmt) {
+  case amuse::SampleFormat::DSP:
+    return "dsp";
+  case amuse::SampleFormat::DSP_DRUM:
+    return "dsp-drum";
+  case amuse::SampleFormat::PCM:
+    return "pcm";
+  case amuse::SampleFormat::N64:
+    return "n64";
+  case amuse::SampleFormat::PCM_PC:
+    return "pcm-pc";
+  default:
+    return "unknown";
+  }
+}
+
+std::unique_ptr<unsigned char[]> ReadWholeFile(const std::string& path, size_t& sizeOut) {
+  sizeOut = 0;
+  FILE* fp = fopen(path.c_str(), "rb");
+  if (!fp)
+    return {};
+  fseek(fp, 0, SEEK_END);
+  const long len = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  std::unique_ptr<unsigned char[]> ret;
+  if (len > 0) {
+    ret.reset(new unsigned char[len]);
+    if (fread(ret.get(), 1, len, fp) == size_t(len))
+      sizeOut = size_t(len);
+    else
+      ret.reset();
+  }
+  fclose(fp);
+  return ret;
+}
+
+/** Fill with bytes that are each a valid DSP-ADPCM frame header, so decoding costs match real data */
+void FillSeededSampleData(unsigned char* data, size_t size, std::mt19937& rng) {
+  for (size_t i = 0; i < size; ++i)
+    data[i] = uint8_t((rng() % 8) << 4 | rng() % 12);
+}
+
+/** Loose .pro/.poo/.sdi chunks whose sample chunk is not distributed (as with the repository's test/ data)
+ *  are paired with a seeded sample chunk covering every sample directory entry. Every byte is a valid
+ *  DSP-ADPCM frame header, so decoding costs match real data while the output is noise. */
+std::vector<std::pair<std::string, amuse::IntrusiveAudioGroupData>>
+SynthesizeSampleChunk(const std::string& groupPath) {
+  /* Chunk storage, kept alive by the groups borrowing it */
+  struct LooseChunks {
+    std::unique_ptr<unsigned char[]> m_proj, m_pool, m_sdir, m_samp;
+    size_t m_projSz = 0, m_poolSz = 0, m_sdirSz = 0, m_sampSz = 0;
+
+    amuse::IntrusiveAudioGroupData makeGroup(const std::shared_ptr<LooseChunks>& self) {
+      return amuse::ContainerRegistry::MakeRawGroupData(self, m_proj.get(), m_projSz, m_pool.get(), m_poolSz,
+                                                        m_sdir.get(), m_sdirSz, m_samp.get(), m_sampSz);
+    }
+  };
+
+  std::vector<std::pair<std::string, amuse::IntrusiveAudioGroupData>> ret;
+  const std::string base = groupPath.substr(0, groupPath.rfind('.'));
+  auto readChunk = [&](std::initializer_list<const char*> exts, size_t& sizeOut) {
+    std::unique_ptr<unsigned char[]> data;
+    for (const char* ext : exts)
+      if ((data = ReadWholeFile(base + ext, sizeOut)))
+        break;
+    return data;
+  };
+  auto chunks = std::make_shared<LooseChunks>();
+  chunks->m_proj = readChunk({".pro", ".proj"}, chunks->m_projSz);
+  chunks->m_pool = readChunk({".poo", ".pool"}, chunks->m_poolSz);
+  chunks->m_sdir = readChunk({".sdi", ".sdir"}, chunks->m_sdirSz);
+  if (!chunks->m_proj || !chunks->m_pool || !chunks->m_sdir || chunks->m_sdirSz < 12)
+    return ret;
+
+  /* Two bytes per sample bounds every format's encoded size */
+  size_t sampSz = 0;
+  {
+    const amuse::IntrusiveAudioGroupData sizing = chunks->makeGroup(chunks);
+    const auto sdirParsed = amuse::AudioGroupSampleDirectory::CreateAudioGroupSampleDirectory(sizing);
+    for (const auto& [id, entry] : sdirParsed.sampleEntries())
+      sampSz = std::max(sampSz, size_t(entry->m_data->m_sampleOff) + entry->m_data->getNumSamples() * 2 + 256);
+  }
+  if (!sampSz)
+    return ret;
+  chunks->m_samp.reset(new unsigned char[sampSz]);
+  chunks->m_sampSz = sampSz;
+  std::mt19937 rng(5);
+  FillSeededSampleData(chunks->m_samp.get(), sampSz, rng);
+
+  ret.emplace_back(base.substr(base.find_last_of("/\\") + 1), chunks->makeGroup(chunks));
+  return ret;
+}
+
+/** Every sample format; each gets a supply-audio stage whatever formats the corpus holds */
+constexpr std::array<amuse::SampleFormat, 5> SampleFormats{amuse::SampleFormat::DSP, amuse::SampleFormat::N64,
+                                                          amuse::SampleFormat::PCM, amuse::SampleFormat::PCM_PC,
+                                                          amuse::SampleFormat::DSP_DRUM};
+constexpr uint32_t FormatSampleLength = 14 * 4096;
+/* Room for 16-bit PCM, the largest encoding, plus the 256-byte codebook N64 data starts with */
+constexpr size_t FormatSampleBytes = FormatSampleLength * 2 + 256;
+
+/** Rebuild GameCube-format group data around a copy of its sample chunk followed by one seeded
+ *  FormatSampleBytes region per SampleFormats entry, which AddFormatSamples turns into samples.
+ *  Data in other formats is returned unchanged. */
+amuse::IntrusiveAudioGroupData AppendFormatRegions(amuse::IntrusiveAudioGroupData data) {
+  if (data.getDataFormat() != amuse::DataFormat::GCN || !data)
+    return data;
+  /* The original data keeps its proj, pool and sdir chunks alive for the rebuilt group to borrow */
+  struct ExtendedChunks {
+    amuse::IntrusiveAudioGroupData m_data;
+    std::unique_ptr<unsigned char[]> m_samp;
+  };
+  const size_t origSz = data.getSampSize();
+  const size_t sampSz = origSz + SampleFormats.size() * FormatSampleBytes;
+  auto chunks = std::make_shared<ExtendedChunks>(ExtendedChunks{std::move(data), nullptr});
+  chunks->m_samp.reset(new unsigned char[sampSz]);
+  memcpy(chunks->m_samp.get(), chunks->m_data.getSamp(), origSz);
+  std::mt19937 rng(9);
+  FillSeededSampleData(chunks->m_samp.get() + origSz, sampSz - origSz, rng);
+  amuse::IntrusiveAudioGroupData& orig = chunks->m_data;
+  return amuse::ContainerRegistry::MakeRawGroupData(chunks, orig.getProj(), orig.getProjSize(), orig.getPool(),
+                                                    orig.getPoolSize(), orig.getSdir(), orig.getSdirSize(),
+                                                    chunks->m_samp.get(), sampSz);
+}
+
+/** Give a group parsed from AppendFormatRegions data one unlooped sample of every format, read from the
+ *  seeded regions at its sample chunk's tail. Codec coefficients are zero; decoding costs do not depend on them. */
+void AddFormatSamples(amuse::AudioGroup& group, size_t sampSz) {
+  auto& entries = group.getSdir().sampleEntries();
+  uint16_t nextId = 0;
+  for (const auto& [id, entry] : entries)
+    nextId = std::max(nextId, uint16_t(id.id + 1));
+  size_t sampleOff = sampSz - SampleFormats.size() * FormatSampleBytes;
+  for (amuse::SampleFormat fmt : SampleFormats) {
+    auto entry = amuse::MakeObj<amuse::SampleEntry>();
+    amuse::SampleEntryData& data = *entry->m_data;
+    data.m_sampleOff = uint32_t(sampleOff);
+    data.m_pitch = 60;
+    data.m_sampleRate = 32000;
+    data.m_numSamples = FormatSampleLength | uint32_t(fmt) << 24;
+    memset(&data.m_ADPCMParms, 0, sizeof(data.m_ADPCMParms));
+    data.m_ADPCMParms.dsp.m_bytesPerFrame = 8;
+    entries[amuse::SampleId(nextId++)] = std::move(entry);
+    sampleOff += FormatSampleBytes;
+  }
+}
+
+/** Engine on the offline backend with one song group of the corpus loaded */
+struct CorpusWorkload {
+  amuse::AudioGroupLoader::LoadedContainer m_container;
+  std::vector<std::pair<std::string, amuse::ContainerRegistry::SongData>> m_songs;
+  amuse::OfflineBackendVoiceAllocator m_backend{EngineSampleRate, 2};
+  amuse::Engine m_engine{m_backend};
+  std::vector<float> m_mixBuf = std::vector<float>(m_backend.get5MsFrames() * m_backend.getChannelCount());
+
+  const amuse::AudioGroup* m_group = nullptr;
+  amuse::GroupId m_groupId;
+  amuse::SongId m_setupId;
+  const unsigned char* m_song = nullptr;
+  std::vector<amuse::SoundMacroId> m_macros; /**< Every SoundMacro of the group, by ID */
+  std::vector<amuse::SFXId> m_sfx;           /**< Every SFX of the group, by ID */
+  bool m_syntheticSamples = false;          /**< Sample chunk was synthesized by SynthesizeSampleChunk */
+
+  /* Entities of the current stage; released before the engine */
+  std::vector<amuse::ObjToken<amuse::Voice>> m_voices;
+  amuse::ObjToken<amuse::Sequencer> m_seq;
+  std::vector<amuse::ObjToken<amuse::Emitter>> m_emitters;
+  amuse::ObjToken<amuse::Listener> m_listener;
+
+  /** Load the group used by song `songIdx` (or the first song group without songs); false on failure */
+  bool load(const BenchConfig& cfg) {
+    m_container = amuse::AudioGroupLoader::LoadContainer(cfg.m_groupPath.c_str());
+    if (m_container.m_data.empty()) {
+      m_container.m_data = SynthesizeSampleChunk(cfg.m_groupPath);
+      if (m_container.m_data.empty())
+        return false;
+      m_container.m_groups = amuse::AudioGroupLoader::ParseGroups(m_container.m_data);
+      m_syntheticSamples = true;
+    }
+    m_songs = amuse::ContainerRegistry::LoadSongs(cfg.m_songsPath.c_str());
+
+    /* Resolve the song's group through its MIDI setup when it names none */
+    int groupId = -1;
+    int setupId = -1;
+    if (cfg.m_song < m_songs.size()) {
+      groupId = m_songs[cfg.m_song].second.m_groupId;
+      setupId = m_songs[cfg.m_song].second.m_setupId;
+    }
+    size_t groupIdx = SIZE_MAX;
+    for (size_t i = 0; i < m_container.m_groups.size() && groupIdx == SIZE_MAX; ++i) {
+      for (const auto& [id, index] : m_container.m_groups[i]->getProj().songGroups()) {
+        if ((groupId == -1 && setupId == -1) || id.id == groupId ||
+            (groupId == -1 && index->m_midiSetups.find(setupId) != index->m_midiSetups.cend())) {
+          groupIdx = i;
+          groupId = id.id;
+          if (setupId == -1 && !index->m_midiSetups.empty())
+            setupId = index->m_midiSetups.cbegin()->first.id;
+          break;
+        }
+      }
+    }
+    if (groupIdx == SIZE_MAX)
+      return false;
+
+    /* Reparse the group around sample data extended with every format */
+    {
+      std::vector<std::pair<std::string, amuse::IntrusiveAudioGroupData>> extended;
+      auto& [name, data] = m_container.m_data[groupIdx];
+      if (data.getDataFormat() == amuse::DataFormat::GCN) {
+        extended.emplace_back(name, AppendFormatRegions(std::move(data)));
+        m_container.m_groups[groupIdx] = std::move(amuse::AudioGroupLoader::ParseGroups(extended).front());
+        data = std::move(extended.front().second);
+        AddFormatSamples(*m_container.m_groups[groupIdx], data.getSampSize());
+      }
+    }
+
+    /* Corpora without SFX groups get one playing every SoundMacro, so emitter stages have sounds to place */
+    amuse::AudioGroupProject& proj = m_container.m_groups[groupIdx]->getProj();
+    if (proj.sfxGroups().empty()) {
+      std::vector<amuse::SoundMacroId> macros;
+      for (const auto& [id, macro] : m_container.m_groups[groupIdx]->getPool().soundMacros())
+        macros.push_back(id);
+      std::sort(macros.begin(), macros.end(),
+                [](amuse::SoundMacroId a, amuse::SoundMacroId b) { return a.id < b.id; });
+      auto sfxGroup = amuse::MakeObj<amuse::SFXGroupIndex>();
+      for (size_t i = 0; i < macros.size(); ++i)
+        sfxGroup->m_sfxEntries[amuse::SFXId(uint16_t(i))].objId = macros[i];
+      uint16_t sfxGroupId = 0;
+      for (const auto& [id, index] : proj.songGroups())
+        sfxGroupId = std::max(sfxGroupId, uint16_t(id.id + 1));
+      proj.sfxGroups()[amuse::GroupId(sfxGroupId)] = std::move(sfxGroup);
+    }
+
+    /* Stream every sample from its compressed data so decoding is what gets measured */
+    m_engine.setDecodedSampleBudget(0);
+    /* Effects have stages of their own; the default studio's would carry tails (and the chorus its modulation
+     * phase) from one workload run into the next */
+    m_engine.getDefaultStudio()->getAuxA().clearEffects();
+    m_engine.getDefaultStudio()->getAuxB().clearEffects();
+    m_group = m_engine.addAudioGroup(m_container.m_data[groupIdx].second, std::move(m_container.m_groups[groupIdx]));
+    if (!m_group)
+      return false;
+    m_groupId = groupId;
+    m_setupId = setupId;
+    if (cfg.m_song < m_songs.size())
+      m_song = m_songs[cfg.m_song].second.m_data.get();
+
+    for (const auto& [id, macro] : m_group->getPool().soundMacros())
+      m_macros.push_back(id);
+    std::sort(m_macros.begin(), m_macros.end(),
+              [](amuse::SoundMacroId a, amuse::SoundMacroId b) { return a.id < b.id; });
+    for (const auto& [id, index] : m_group->getProj().sfxGroups())
+      for (const auto& [sfxId, entry] : index->m_sfxEntries)
+        m_sfx.push_back(sfxId);
+    std::sort(m_sfx.begin(), m_sfx.end(), [](amuse::SFXId a, amuse::SFXId b) { return a.id < b.id; });
+    return !m_macros.empty();
+  }
+
+  /** Kill every sequencer and voice and reap them, leaving an idle engine with a fixed PRNG state */
+  void reset() {
+    m_voices.clear();
+    m_seq.reset();
+    m_emitters.clear();
+    for (amuse::ObjToken<amuse::Sequencer>& seq : m_engine.getActiveSequencers()) {
+      seq->allOff(true);
+      seq->kill();
+    }
+    for (amuse::ObjToken<amuse::Voice>& vox : m_engine.getActiveVoices())
+      vox->kill();
+    m_backend.pumpAndMixVoices(m_mixBuf.data());
+    m_engine.setVirtualEmitterThreshold(-1.f);
+    m_engine.setMaxVoices(0);
+    m_engine.seedRandom(1);
+  }
+
+  /** reset() and place an emitter for each of the first `count` SFX in a row in front of the listener */
+  void placeEmitters(size_t count) {
+    reset();
+    if (!m_listener) {
+      const float pos[3] = {0.f, 0.f, 0.f}, dir[3] = {0.f, 0.f, 0.f}, heading[3] = {0.f, 1.f, 0.f};
+      const float up[3] = {0.f, 0.f, 1.f};
+      m_listener = m_engine.addListener(pos, dir, heading, up, 5.f, 8.f, 343.f, 1.f);
+    }
+    for (size_t i = 0; i < std::min(count, m_sfx.size()); ++i) {
+      const float pos[3] = {float(i % 7) - 3.f, 2.f, 0.f}, dir[3] = {0.1f, 0.f, 0.f};
+      if (auto emitter = m_engine.addEmitter(pos, dir, 50.f, 0.f, m_sfx[i], 0.f, 1.f, true))
+        m_emitters.push_back(std::move(emitter));
+    }
+  }
+
+  /** reset() and start `song` from its beginning on m_seq */
+  void playSong(const unsigned char* song, bool loop) {
+    reset();
+    m_seq = m_engine.seqPlay(m_group, m_groupId, m_setupId, song, loop);
+  }
+
+  /** Pump period `period` of an eight-channel arpeggio on m_seq: each channel releases its previous note and
+   *  strikes the next, and the channels move to new programs every 50 periods */
+  void arpeggioPeriod(unsigned period) {
+    static constexpr std::array<uint8_t, 8> Notes{48, 52, 55, 60, 64, 67, 72, 76};
+    for (uint8_t ch = 0; ch < 8; ++ch) {
+      m_seq->keyOff(ch, Notes[(period + ch + 7) % 8], 0);
+      m_seq->keyOn(ch, Notes[(period + ch) % 8], 100);
+    }
+    if (period % 50 == 0)
+      for (uint8_t ch = 0; ch < 8; ++ch)
+        m_seq->setChanProgram(ch, int8_t((period / 50 + ch) % 16));
+    m_backend.pumpAndMixVoices(m_mixBuf.data());
+  }
+
+  /** Pump `periods` engine periods, appending their mixes to `out` */
+  void render(unsigned periods, std::vector<float>& out) {
+    for (unsigned p = 0; p < periods; ++p) {
+      m_backend.pumpAndMixVoices(m_mixBuf.data());
+      out.insert(out.end(), m_mixBuf.cbegin(), m_mixBuf.cend());
+    }
+  }
+};
+
+/** SNG converted from a type 0 SMF at 384 ticks per quarter-note: program changes on channel 0 at the given
+ *  ticks and loop markers (CC 0x66/0x67) at `loopStart` and `loopEnd` */
+std::vector<uint8_t> MakeLoopingSong(const std::vector<std::pair<uint32_t, uint8_t>>& programs, uint32_t loopStart,
+                                     uint32_t loopEnd) {
+  std::vector<std::pair<uint32_t, std::vector<uint8_t>>> events = {{0, {0xff, 0x51, 0x03, 0x07, 0xa1, 0x20}}};
+  for (const auto& [tick, prog] : programs)
+    events.push_back({tick, {0xc0, prog}});
+  events.push_back({loopStart, {0xb0, 0x66, 0}});
+  events.push_back({loopEnd, {0xb0, 0x67, 0}});
+  std::stable_sort(events.begin(), events.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+  events.push_back({events.back().first, {0xff, 0x2f, 0x00}});
+
+  std::vector<uint8_t> track;
+  uint32_t lastTick = 0;
+  for (const auto& [tick, bytes] : events) {
+    uint32_t delta = tick - lastTick;
+    lastTick = tick;
+    uint8_t vlq[5];
+    int len = 0;
+    do {
+      vlq[len++] = uint8_t(delta & 0x7f);
+      delta >>= 7;
+    } while (delta);
+    while (len--)
+      track.push_back(vlq[len] | (len ? 0x80 : 0));
+    track.insert(track.end(), bytes.cbegin(), bytes.cend());
+  }
+
+  std::vector<uint8_t> midi = {'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, 384 >> 8, 384 & 0xff, 'M', 'T', 'r', 'k'};
+  for (int shift = 24; shift >= 0; shift -= 8)
+    midi.push_back(uint8_t(track.size() >> shift));
+  midi.insert(midi.end(), track.cbegin(), track.cend());
+  return amuse::SongConverter::MIDIToSong(midi, 1, false);
+}
+
+/** Checks that virtual emitter voices resume where voices that kept playing are. Two engines place the same
+ *  emitters; one runs them virtual for a while, then brings them back. Each resumed voice must be within the
+ *  two samples of resampler phase a virtual voice gives up, and voices at the same offset must decode the
+ *  same audio, which streamed DSP voices only do if their decoder history was kept current while virtual. */
+bool VerifyVirtualResume(const BenchConfig& cfg) {
+  constexpr size_t EmitterCount = 64;
+  constexpr unsigned VirtualPeriods = 100;
+  constexpr size_t CompareFrames = 64;
+  auto played = std::make_unique<CorpusWorkload>();
+  auto resumed = std::make_unique<CorpusWorkload>();
+  if (!played->load(cfg) || !resumed->load(cfg))
+    return false;
+
+  std::vector<float> mix;
+  played->placeEmitters(EmitterCount);
+  resumed->placeEmitters(EmitterCount);
+  resumed->m_engine.setVirtualEmitterThreshold(2.f);
+  played->render(VirtualPeriods, mix);
+  resumed->render(VirtualPeriods, mix);
+  bool ok = resumed->m_engine.getNumVirtualEmitters() == resumed->m_emitters.size();
+  resumed->m_engine.setVirtualEmitterThreshold(-1.f);
+  played->render(1, mix);
+  resumed->render(1, mix);
+  ok &= resumed->m_engine.getNumVirtualEmitters() == 0 && played->m_emitters.size() == resumed->m_emitters.size();
+
+  for (size_t i = 0; ok && i < played->m_emitters.size(); ++i) {
+    amuse::Voice& ref = *played->m_emitters[i]->getVoice();
+    amuse::Voice& vox = *resumed->m_emitters[i]->getVoice();
+    ok &= ref.state() == vox.state();
+    ok &= std::abs(int64_t(ref.getSamplePos()) - int64_t(vox.getSamplePos())) <= 2;
+    if (ref.state() != amuse::VoiceState::Dead && ref.getSamplePos() == vox.getSamplePos()) {
+      int16_t refAudio[CompareFrames], voxAudio[CompareFrames];
+      ref.supplyAudio(CompareFrames, refAudio);
+      vox.supplyAudio(CompareFrames, voxAudio);
+      ok &= std::equal(std::begin(refAudio), std::end(refAudio), std::begin(voxAudio));
+    }
+  }
+  for (CorpusWorkload* corpus : {played.get(), resumed.get()})
+    corpus->reset();
+  return ok;
+}
+
+/** Checks Sequencer::seekSong on the corpus song and on a synthetic looping song:
+ *  - building a seek index while the song plays leaves its playback untouched;
+ *  - seeking backward, through a seek index, or in steps renders the same audio as one seek from the start;
+ *  - ticks past the loop end land where repeated passes of the loop reach them, with that point's program. */
+bool VerifySongSeek(CorpusWorkload& corpus, const std::vector<uint32_t>& regionTicks) {
+  constexpr unsigned RenderPeriods = 64;
+  bool ok = true;
+
+  std::vector<float> played, indexed;
+  corpus.playSong(corpus.m_song, true);
+  corpus.render(RenderPeriods * 2, played);
+  corpus.playSong(corpus.m_song, true);
+  corpus.render(RenderPeriods, indexed);
+  const amuse::Sequencer::SeekIndex index = corpus.m_seq->buildSeekIndex();
+  corpus.render(RenderPeriods, indexed);
+  ok &= played == indexed;
+
+  /* Region starts, the ticks around them and past the last one, seeking back from beyond the last region */
+  const uint32_t lastRegion = regionTicks.empty() ? 0 : regionTicks.back();
+  const uint32_t late = lastRegion + 384 * 4;
+  std::vector<uint32_t> targets = {lastRegion + 384, lastRegion * 2 + 1, lastRegion * 3 + 385};
+  for (uint32_t tick : regionTicks)
+    targets.insert(targets.end(), {tick ? tick - 1 : 0, tick, tick + 1, tick + 192});
+  auto renderAfter = [&](auto&& seek) {
+    corpus.playSong(corpus.m_song, true);
+    seek(*corpus.m_seq);
+    std::vector<float> out = {float(corpus.m_seq->getSongTick())};
+    corpus.render(RenderPeriods, out);
+    return out;
+  };
+  for (uint32_t tick : targets) {
+    const std::vector<float> ref = renderAfter([&](amuse::Sequencer& seq) { seq.seekSong(tick); });
+    ok &= ref == renderAfter([&](amuse::Sequencer& seq) {
+      seq.seekSong(late);
+      seq.seekSong(tick);
+    });
+    ok &= ref == renderAfter([&](amuse::Sequencer& seq) {
+      seq.seekSong(late, &index);
+      seq.seekSong(tick, &index);
+    });
+    ok &= ref == renderAfter([&](amuse::Sequencer& seq) {
+      seq.seekSong(tick / 2, &index);
+      seq.seekSong(tick, &index);
+    });
+  }
+
+  /* Program changes at both loop points and inside the loop; unrolling the loop gives the expected state */
+  std::vector<uint8_t> programs;
+  if (auto search = corpus.m_group->getProj().songGroups().find(corpus.m_groupId);
+      search != corpus.m_group->getProj().songGroups().cend())
+    for (const auto& [prog, page] : search->second->m_normPages)
+      programs.push_back(prog);
+  std::sort(programs.begin(), programs.end());
+  if (programs.size() < 3)
+    return ok;
+  constexpr uint32_t LoopStart = 1536;
+  constexpr uint32_t LoopEnd = 6144;
+  constexpr uint32_t LoopLen = LoopEnd - LoopStart;
+  const std::vector<std::pair<uint32_t, uint8_t>> changes = {
+      {0, programs[0]}, {LoopStart, programs[1]}, {3072, programs[2]}, {LoopEnd - 1, programs[0]}};
+  const std::vector<uint8_t> loopSong = MakeLoopingSong(changes, LoopStart, LoopEnd);
+  corpus.playSong(loopSong.data(), true);
+  const amuse::Sequencer::SeekIndex loopIndex = corpus.m_seq->buildSeekIndex();
+  for (uint32_t tick : {0u, LoopStart - 1, LoopStart, LoopStart + 1, 3072u, LoopEnd - 2, LoopEnd - 1, LoopEnd,
+                        LoopEnd + 1, LoopEnd + LoopLen - 1, LoopEnd + LoopLen, LoopEnd + LoopLen + 1,
+                        LoopEnd + LoopLen * 7 + 100}) {
+    uint32_t expectTick = tick;
+    while (expectTick > LoopEnd)
+      expectTick -= LoopLen;
+    /* As in playback, a region's first events fire once the song moves past its start tick */
+    uint8_t expectProg = 0;
+    for (const auto& [changeTick, prog] : changes)
+      if (changeTick < expectTick || (changeTick == expectTick && changeTick != 0 && changeTick != LoopStart))
+        expectProg = prog;
+    for (const amuse::Sequencer::SeekIndex* idx : {(const amuse::Sequencer::SeekIndex*)nullptr, &loopIndex}) {
+      corpus.playSong(loopSong.data(), true);
+      corpus.m_seq->seekSong(LoopEnd + LoopLen * 3, idx);
+      ok &= corpus.m_seq->seekSong(tick, idx);
+      ok &= corpus.m_seq->getSongTick() == expectTick && corpus.m_seq->getChanProgram(0) == int8_t(expectProg);
+    }
+  }
+  return ok;
+}
+
+void AddEngineStages(std::vector<BenchStage>& stages, const BenchConfig& cfg,
+                     const std::shared_ptr<CorpusWorkload>& corpus) {
+  const unsigned periods = cfg.periods();
+  const double dt = EnginePeriodFrames / EngineSampleRate;
+
+  /* Single-voice stages play on a voice of the first SoundMacro that starts */
+  auto startVoice = [=]() {
+    corpus->reset();
+    for (amuse::SoundMacroId id : corpus->m_macros)
+      if (amuse::ObjToken<amuse::Voice> vox = corpus->m_engine.macroStart(corpus->m_group, id, 60, 100, 0)) {
+        corpus->m_voices.push_back(vox);
+        break;
+      }
+  };
+  startVoice();
+  if (corpus->m_voices.empty())
+    return;
+  auto voice = [=]() -> amuse::Voice& { return *corpus->m_voices.front(); };
+
+  /* Emitter voices held virtual: the SoundMacro and the sample position advance without a backend voice */
+  if (!corpus->m_sfx.empty()) {
+    stages.push_back({"emitter-virtual", "-", "tick", double(periods), [=]() {
+                        for (unsigned p = 0; p < periods; ++p)
+                          corpus->m_backend.pumpAndMixVoices(corpus->m_mixBuf.data());
+                      }, [=]() { return VerifyVirtualResume(cfg); }, [=]() {
+                        corpus->placeEmitters(64);
+                        corpus->m_engine.setVirtualEmitterThreshold(2.f);
+                      }});
+  }
+
+  /* SoundMacroState::advance (with the rest of the per-period voice control) for one voice of every macro */
+  stages.push_back({"macro-advance", "-", "tick", double(periods), [=]() {
+                      for (unsigned p = 0; p < periods; ++p)
+                        for (const amuse::ObjToken<amuse::Voice>& vox : corpus->m_voices)
+                          if (vox->state() != amuse::VoiceState::Dead)
+                            vox->preSupplyAudio(dt);
+                    }, {}, [=]() {
+                      corpus->reset();
+                      for (amuse::SoundMacroId id : corpus->m_macros)
+                        if (auto vox = corpus->m_engine.macroStart(corpus->m_group, id, 60, 100, 0))
+                          corpus->m_voices.push_back(vox);
+                    }});
+
+  /* Note-on/note-off churn at a 64-voice polyphony limit, past a warm-up that reaches peak polyphony and cycles
+   * every program once; verified to make no heap allocation on any thread */
+  constexpr unsigned ArpeggioWarmup = 400;
+  auto arpeggio = std::make_shared<std::pair<unsigned, uint64_t>>(); /* next period, allocations of last run */
+  stages.push_back({"voice-churn", "-", "tick", double(periods), [=]() {
+                      AllocationCount = 0;
+                      AllocationCounting = true;
+                      for (unsigned p = 0; p < periods; ++p)
+                        corpus->arpeggioPeriod(arpeggio->first++);
+                      AllocationCounting = false;
+                      arpeggio->second = AllocationCount;
+                    }, [=]() {
+                      if (arpeggio->second)
+                        fmt::print(stderr, FMT_STRING("voice-churn: {} heap allocations over {} periods\n"),
+                                   arpeggio->second, periods);
+                      return arpeggio->second == 0;
+                    }, [=]() {
+                      corpus->reset();
+                      corpus->m_engine.setMaxVoices(64);
+                      corpus->m_seq = corpus->m_engine.seqPlay(corpus->m_group, corpus->m_groupId,
+                                                               corpus->m_setupId, nullptr, false);
+                      for (arpeggio->first = 0; arpeggio->first < ArpeggioWarmup; ++arpeggio->first)
+                        corpus->arpeggioPeriod(arpeggio->first);
+                    }});
+
+  /* Voice::supplyAudio per sample format, cycling through the group's samples of that format */
+  std::map<amuse::SampleFormat, std::vector<std::pair<amuse::SampleId, uint32_t>>> formatSamples;
+  for (const auto& [id, entry] : corpus->m_group->getSdir().sampleEntries())
+    if (const uint32_t numSamples = entry->m_data->getNumSamples())
+      formatSamples[entry->m_data->getSampleFormat()].emplace_back(id, numSamples);
+  for (amuse::SampleFormat fmt : SampleFormats)
+    if (!formatSamples.contains(fmt))
+      fmt::print(stderr, FMT_STRING("supply-audio/{}: skipped, the group has no samples of this format\n"),
+                 SampleFormatName(fmt));
+  for (auto& [fmt, samples] : formatSamples) {
+    std::sort(samples.begin(), samples.end(), [](const auto& a, const auto& b) { return a.first.id < b.first.id; });
+    auto plan = std::make_shared<std::vector<std::pair<amuse::SampleId, uint32_t>>>();
+    for (size_t remaining = cfg.m_samples, i = 0; remaining; ++i) {
+      const auto& [id, numSamples] = samples[i % samples.size()];
+      plan->emplace_back(id, uint32_t(std::min<size_t>(numSamples, remaining)));
+      remaining -= plan->back().second;
+    }
+    stages.push_back({fmt::format(FMT_STRING("supply-audio/{}"), SampleFormatName(fmt)), "-", "smp",
+                      double(cfg.m_samples), [=]() {
+                        int16_t buf[EnginePeriodFrames];
+                        for (const auto& [id, count] : *plan) {
+                          voice().startSample(id, 0);
+                          for (uint32_t done = 0; done < count; done += EnginePeriodFrames)
+                            voice().supplyAudio(std::min<size_t>(EnginePeriodFrames, count - done), buf);
+                        }
+                      }, {}, startVoice});
+  }
+
+  /* Voice::routeAudio to the master and both aux buses */
+  auto routeIn = std::make_shared<std::vector<float>>(EnginePeriodFrames);
+  std::mt19937 rng(3);
+  for (float& f : *routeIn)
+    f = std::uniform_real_distribution<float>(-1.f, 1.f)(rng);
+  stages.push_back({"route-audio/float", "-", "frame", double(periods) * EnginePeriodFrames * 3, [=]() {
+                      float out[EnginePeriodFrames];
+                      for (unsigned p = 0; p < periods; ++p)
+                        for (int bus = 0; bus < 3; ++bus)
+                          voice().routeAudio(EnginePeriodFrames, dt, bus, routeIn->data(), out);
+                    }, {}, startVoice});
+  auto routeIn16 = std::make_shared<std::vector<int16_t>>(EnginePeriodFrames);
+  for (size_t i = 0; i < EnginePeriodFrames; ++i)
+    (*routeIn16)[i] = int16_t((*routeIn)[i] * 32767.f);
+  stages.push_back({"route-audio/int16", "-", "frame", double(periods) * EnginePeriodFrames * 3, [=]() {
+                      int16_t out[EnginePeriodFrames];
+                      for (unsigned p = 0; p < periods; ++p)
+                        for (int bus = 0; bus < 3; ++bus)
+                          voice().routeAudio(EnginePeriodFrames, dt, bus, routeIn16->data(), out);
+                    }, {}, startVoice});
+
+  /* SongState::advance through the sequencer, including the note-ons and note-offs it dispatches */
+  if (corpus->m_song) {
+    stages.push_back({"song-advance", "-", "tick", double(periods), [=]() {
+                        for (unsigned p = 0; p < periods; ++p)
+                          corpus->m_seq->advance(dt);
+                      }, {}, [=]() {
+                        corpus->reset();
+                        corpus->m_seq = corpus->m_engine.seqPlay(corpus->m_group, corpus->m_groupId, corpus->m_setupId,
+                                                        corpus->m_song, false);
+                      }});
+
+    /* Sequencer::seekSong through a seek index, forward and backward across the looping song */
+    auto song = std::make_unique<amuse::SongState>();
+    song->initialize(corpus->m_song, true);
+    const std::vector<uint32_t> regionTicks = song->getRegionTicks();
+    const uint32_t lastRegion = regionTicks.empty() ? 0 : regionTicks.back();
+    auto targets = std::make_shared<std::vector<uint32_t>>(256);
+    std::mt19937 seekRng(7);
+    for (uint32_t& tick : *targets)
+      tick = seekRng() % (lastRegion * 2 + 384 * 16);
+    auto index = std::make_shared<amuse::Sequencer::SeekIndex>();
+    stages.push_back({"song-seek", "-", "seek", double(targets->size()), [=]() {
+                        for (uint32_t tick : *targets)
+                          corpus->m_seq->seekSong(tick, index.get());
+                      }, [=]() { return VerifySongSeek(*corpus, regionTicks); }, [=]() {
+                        corpus->playSong(corpus->m_song, true);
+                        *index = corpus->m_seq->buildSeekIndex();
+                      }});
+  }
+}
+
+/** The per-channel, per-sample reverb that preceded the SIMD lane kernels, kept as their reference.
+ *  Steps one ReverbDelayLine per channel and tap with a wrap check on every access, operation for
+ *  operation as EffectReverbStdImp (two combs) or, for `hi`, EffectReverbHiImp (three combs, per-channel
+ *  low-pass and crosstalk) did. Parameters are expected in range. */
+template <typename T>
+class ReverbReference {
+  static constexpr std::array<size_t, 3> CTapDelays{1789, 1999, 2333};
+  static constexpr std::array<size_t, 2> APTapDelays{433, 149};
+  static constexpr std::array<size_t, 8> LPTapDelays{47, 73, 67, 57, 43, 57, 83, 73};
+
+  struct Channel {
+    std::array<amuse::ReverbDelayLine, 3> m_comb;
+    std::array<float, 3> m_combCoef{};
+    std::array<amuse::ReverbDelayLine, 2> m_allPass;
+    amuse::ReverbDelayLine m_lowPass;
+    float m_lpLastOut = 0.f;
+    std::unique_ptr<float[]> m_preDelayLine;
+    int32_t m_preDelayPos = 0;
+  };
+
+  bool m_hi;
+  std::array<Channel, amuse::NumChannels> m_channels;
+  float m_allPassCoef;
+  float m_level;
+  float m_damping;
+  float m_crosstalk;
+  int32_t m_preDelayTime = 0;
+
+  static void Push(amuse::ReverbDelayLine& line, float in) {
+    line.xc_inputs[line.x0_inPoint] = in;
+    if (++line.x0_inPoint == line.x8_length)
+      line.x0_inPoint = 0;
+  }
+  static void Pop(amuse::ReverbDelayLine& line) {
+    line.x10_lastInput = line.xc_inputs[line.x4_outPoint];
+    if (++line.x4_outPoint == line.x8_length)
+      line.x4_outPoint = 0;
+  }
+
+  float reverb(Channel& ch, float sample) {
+    float sample2 = sample;
+    if (m_preDelayTime != 0) {
+      sample2 = ch.m_preDelayLine[ch.m_preDelayPos];
+      ch.m_preDelayLine[ch.m_preDelayPos] = sample;
+      if (++ch.m_preDelayPos == std::max(m_preDelayTime - 1, 1))
+        ch.m_preDelayPos = 0;
+    }
+
+    const size_t combs = m_hi ? 3 : 2;
+    for (size_t t = 0; t < combs; ++t)
+      Push(ch.m_comb[t], ch.m_combCoef[t] * ch.m_comb[t].x10_lastInput + sample2);
+    for (size_t t = 0; t < combs; ++t)
+      Pop(ch.m_comb[t]);
+
+    auto& ap = ch.m_allPass;
+    const float coef = m_allPassCoef;
+    if (!m_hi) {
+      const float ap0In = coef * ap[0].x10_lastInput + ch.m_comb[0].x10_lastInput + ch.m_comb[1].x10_lastInput;
+      const float lowPass = -(coef * ap0In - ap[0].x10_lastInput);
+      Push(ap[0], ap0In);
+      Pop(ap[0]);
+
+      ch.m_lpLastOut = m_damping * ch.m_lpLastOut + lowPass * 0.3f;
+      const float ap1In = coef * ap[1].x10_lastInput + ch.m_lpLastOut;
+      const float allPass = -(coef * ap1In - ap[1].x10_lastInput);
+      Push(ap[1], ap1In);
+      Pop(ap[1]);
+      return allPass;
+    }
+
+    const float ap0In = coef * ap[0].x10_lastInput + ch.m_comb[0].x10_lastInput + ch.m_comb[1].x10_lastInput +
+                        ch.m_comb[2].x10_lastInput;
+    const float ap1In = coef * ap[1].x10_lastInput - (coef * ap0In - ap[0].x10_lastInput);
+    const float lowPass = -(coef * ap1In - ap[1].x10_lastInput);
+    Push(ap[0], ap0In);
+    Push(ap[1], ap1In);
+    Pop(ap[0]);
+    Pop(ap[1]);
+
+    ch.m_lpLastOut = m_damping * ch.m_lpLastOut + lowPass * 0.3f;
+    amuse::ReverbDelayLine& lp = ch.m_lowPass;
+    const float lpIn = coef * lp.x10_lastInput + ch.m_lpLastOut;
+    const float allPass = -(coef * lpIn - lp.x10_lastInput);
+    Push(lp, lpIn);
+    Pop(lp);
+    return allPass;
+  }
+
+public:
+  ReverbReference(bool hi, float coloration, float mix, float time, float damping, float preDelay, float crosstalk,
+                  double sampleRate)
+  : m_hi(hi), m_allPassCoef(coloration), m_level(mix), m_crosstalk(hi ? crosstalk : 0.f) {
+    const float timeSamples = time * sampleRate;
+    const double rateRatio = sampleRate / NativeSampleRate;
+    for (size_t c = 0; c < amuse::NumChannels; ++c) {
+      Channel& ch = m_channels[c];
+      for (size_t t = 0; t < ch.m_comb.size(); ++t) {
+        const size_t tapDelay = CTapDelays[t] * rateRatio;
+        ch.m_comb[t].allocate(tapDelay);
+        ch.m_comb[t].setdelay(tapDelay);
+        ch.m_combCoef[t] = std::pow(10.f, tapDelay * -3.f / timeSamples);
+      }
+      for (size_t t = 0; t < ch.m_allPass.size(); ++t) {
+        const size_t tapDelay = APTapDelays[t] * rateRatio;
+        ch.m_allPass[t].allocate(tapDelay);
+        ch.m_allPass[t].setdelay(tapDelay);
+      }
+      const size_t tapDelay = LPTapDelays[c] * rateRatio;
+      ch.m_lowPass.allocate(tapDelay);
+      ch.m_lowPass.setdelay(tapDelay);
+    }
+
+    m_damping = std::max(damping, 0.05f);
+    m_damping = 1.f - (m_damping * 0.8f + 0.05);
+
+    if (preDelay != 0.f) {
+      m_preDelayTime = sampleRate * preDelay;
+      for (Channel& ch : m_channels)
+        ch.m_preDelayLine = std::make_unique<float[]>(m_preDelayTime);
+    }
+  }
+
+  void apply(T* audio, size_t frameCount, unsigned chanCount) {
+    if (m_crosstalk != 0.f) {
+      const float crossWet = m_crosstalk * 0.5;
+      const float crossDry = 1.f - crossWet;
+      for (size_t f = 0; f < frameCount; ++f) {
+        T* base = &audio[chanCount * f];
+        float allWet = 0;
+        for (unsigned c = 0; c < chanCount; ++c) {
+          allWet += base[c] * crossWet;
+          base[c] *= crossDry;
+        }
+        for (unsigned c = 0; c < chanCount; ++c)
+          base[c] = amuse::ClampFull<T>(base[c] + allWet);
+      }
+    }
+
+    const float dampWet = m_level * 0.6f;
+    const float dampDry = 0.6f - dampWet;
+    for (unsigned c = 0; c < chanCount; ++c) {
+      for (size_t f = 0; f < frameCount; ++f) {
+        const float sample = audio[f * chanCount + c];
+        const float allPass = reverb(m_channels[c], sample);
+        audio[f * chanCount + c] = amuse::ClampFull<T>(dampWet * allPass + dampDry * sample);
+      }
+    }
+  }
+};
+
+/** Reverb parameters of the effect stages; pre-delay and crosstalk are on so every stage is exercised */
+constexpr float ReverbColoration = 0.5f;
+constexpr float ReverbMix = 0.5f;
+constexpr float ReverbTime = 3.f;
+constexpr float ReverbDamping = 0.5f;
+constexpr float ReverbPreDelay = 0.05f;
+constexpr float ReverbCrosstalk = 0.5f;
+
+template <typename T>
+std::unique_ptr<amuse::EffectBase<T>> MakeReverb(bool hi) {
+  if (hi)
+    return std::make_unique<amuse::EffectReverbHiImp<T>>(ReverbColoration, ReverbMix, ReverbTime, ReverbDamping,
+                                                         ReverbPreDelay, ReverbCrosstalk, EngineSampleRate);
+  return std::make_unique<amuse::EffectReverbStdImp<T>>(ReverbColoration, ReverbMix, ReverbTime, ReverbDamping,
+                                                        ReverbPreDelay, EngineSampleRate);
+}
+
+template <typename T>
+ReverbReference<T> MakeReverbReference(bool hi) {
+  return {hi, ReverbColoration, ReverbMix, ReverbTime, ReverbDamping, ReverbPreDelay, ReverbCrosstalk,
+          EngineSampleRate};
+}
+
+/** Runs the lane reverb and its reference over one second of seeded noise on `chanCount` channels, in uneven
+ *  blocks so delay lines wrap mid-block. Every sample must agree within 1e-5 of full scale (at least 1 LSB). */
+template <typename T>
+bool ReverbMatchesReference(bool hi, unsigned chanCount) {
+  amuse::ChannelMap chanMap;
+  chanMap.m_channelCount = chanCount;
+  for (unsigned c = 0; c < chanCount; ++c)
+    chanMap.m_channels[c] = amuse::AudioChannel(c);
+  const double fullScale = std::is_floating_point_v<T> ? 1.0 : double(std::numeric_limits<T>::max());
+  const double tolerance = std::max(std::is_floating_point_v<T> ? 0.0 : 1.0, fullScale * 1e-5);
+
+  std::unique_ptr<amuse::EffectBase<T>> lanes = MakeReverb<T>(hi);
+  ReverbReference<T> reference = MakeReverbReference<T>(hi);
+  std::mt19937 rng(6);
+  std::uniform_real_distribution<double> noise(-0.5, 0.5);
+  constexpr size_t BlockFrames[] = {160, 37, 160, 101, 1};
+  std::vector<T> out, ref;
+  for (size_t done = 0, b = 0; done < size_t(EngineSampleRate); done += out.size() / chanCount, ++b) {
+    out.resize(BlockFrames[b % std::size(BlockFrames)] * chanCount);
+    for (T& s : out)
+      s = T(noise(rng) * fullScale);
+    ref = out;
+    lanes->applyEffect(out.data(), out.size() / chanCount, chanMap);
+    reference.apply(ref.data(), ref.size() / chanCount, chanCount);
+    for (size_t i = 0; i < out.size(); ++i)
+      if (std::fabs(double(out[i]) - double(ref[i])) > tolerance)
+        return false;
+  }
+  return true;
+}
+
+template <typename T>
+bool ReverbMatchesReference(bool hi) {
+  return ReverbMatchesReference<T>(hi, 2) && ReverbMatchesReference<T>(hi, 4) && ReverbMatchesReference<T>(hi, 8);
+}
+
+/** Effects on seeded stereo noise, processed in 5ms periods from a fresh effect state each run.
+ *  The reverbs are timed against their per-sample reference and verified against it for int16, int32
+ *  and float samples on 2, 4 and 8 channels. */
+void AddEffectStages(std::vector<BenchStage>& stages, const BenchConfig& cfg) {
+  using EffectFactory = std::function<std::unique_ptr<amuse::EffectBase<float>>()>;
+  const std::pair<const char*, EffectFactory> effects[] = {
+      {"effect/delay", [] { return std::make_unique<amuse::EffectDelayImp<float>>(250, 50, 100, EngineSampleRate); }},
+      {"effect/chorus", [] { return std::make_unique<amuse::EffectChorusImp<float>>(10, 3, 1000, EngineSampleRate); }},
+  };
+
+  const amuse::ChannelMap chanMap = {2, {amuse::AudioChannel::FrontLeft, amuse::AudioChannel::FrontRight}};
+  auto input = std::make_shared<std::vector<float>>(EnginePeriodFrames * chanMap.m_channelCount);
+  std::mt19937 rng(4);
+  for (float& f : *input)
+    f = std::uniform_real_distribution<float>(-0.5f, 0.5f)(rng);
+  const unsigned periods = cfg.periods();
+
+  for (const bool hi : {false, true}) {
+    const char* name = hi ? "effect/reverb-hi" : "effect/reverb-std";
+    auto reference = std::make_shared<std::unique_ptr<ReverbReference<float>>>();
+    stages.push_back({name, "scalar", "frame", double(periods) * EnginePeriodFrames, [=]() {
+                        float buf[EnginePeriodFrames * 2];
+                        for (unsigned p = 0; p < periods; ++p) {
+                          std::copy(input->cbegin(), input->cend(), buf);
+                          (*reference)->apply(buf, EnginePeriodFrames, chanMap.m_channelCount);
+                        }
+                      }, {}, [=]() {
+                        *reference = std::make_unique<ReverbReference<float>>(MakeReverbReference<float>(hi));
+                      }});
+    auto effect = std::make_shared<std::unique_ptr<amuse::EffectBase<float>>>();
+    stages.push_back({name, amuse::ReverbKernelsISA(), "frame", double(periods) * EnginePeriodFrames, [=]() {
+                        float buf[EnginePeriodFrames * 2];
+                        for (unsigned p = 0; p < periods; ++p) {
+                          std::copy(input->cbegin(), input->cend(), buf);
+                          (*effect)->applyEffect(buf, EnginePeriodFrames, chanMap);
+                        }
+                      }, [=]() {
+                        return ReverbMatchesReference<float>(hi) && ReverbMatchesReference<int16_t>(hi) &&
+                               ReverbMatchesReference<int32_t>(hi);
+                      }, [=]() { *effect = MakeReverb<float>(hi); }});
+  }
+
+  for (const auto& [name, factory] : effects) {
+    auto effect = std::make_shared<std::unique_ptr<amuse::EffectBase<float>>>();
+    stages.push_back({name, "-", "frame", double(periods) * EnginePeriodFrames, [=]() {
+                        float buf[EnginePeriodFrames * 2];
+                        for (unsigned p = 0; p < periods; ++p) {
+                          std::copy(input->cbegin(), input->cend(), buf);
+                          (*effect)->applyEffect(buf, EnginePeriodFrames, chanMap);
+                        }
+                      }, {}, [=]() { *effect = factory(); }});
+  }
+}
+
+std::string JsonString(const std::string& str) {
+  std::string ret = "\"";
+  for (const char c : str) {
+    if (c == '"' || c == '\\')
+      ret += '\\';
+    if (uint8_t(c) < 0x20)
+      ret += fmt::format(FMT_STRING("\\u{:04x}"), int(c));
+    else
+      ret += c;
+  }
+  return ret + '"';
+}
+
+struct StageReport {
+  const BenchStage* m_stage;
+  BenchResult m_result;
+  int m_verified; /**< 1 matched, 0 mismatched, -1 unverified */
+};
+
+/** Schema version 1: one object per stage with best and mean seconds per run and items per second */
+void WriteJson(FILE* fp, const BenchConfig& cfg, const CorpusWorkload& corpus,
+               const std::vector<StageReport>& reports) {
+  fmt::print(fp, FMT_STRING("{{\n  \"version\": 1,\n  \"iterations\": {},\n  \"samples\": {},\n"
+                            "  \"corpus\": {{\"group\": {}, \"songs\": {}, \"song\": {}, \"loaded\": {}, "
+                            "\"synthetic_samples\": {}}},\n"
+                            "  \"stages\": ["),
+             cfg.m_iterations, cfg.m_samples, JsonString(cfg.m_groupPath), JsonString(cfg.m_songsPath), cfg.m_song,
+             corpus.m_group != nullptr, corpus.m_syntheticSamples);
+  for (size_t i = 0; i < reports.size(); ++i) {
+    const StageReport& rep = reports[i];
+    const BenchStage& stage = *rep.m_stage;
+    fmt::print(fp,
+               FMT_STRING("{}\n    {{\"name\": {}, \"isa\": {}, \"unit\": {}, \"items\": {}, \"best_s\": {:.9g}, "
+                          "\"mean_s\": {:.9g}, \"best_per_s\": {:.9g}, \"mean_per_s\": {:.9g}, \"verified\": {}}}"),
+               i ? "," : "", JsonString(stage.m_name), JsonString(stage.m_isa), JsonString(stage.m_unit),
+               stage.m_items, rep.m_result.m_bestSecs, rep.m_result.m_meanSecs,
+               stage.m_items / rep.m_result.m_bestSecs, stage.m_items / rep.m_result.m_meanSecs,
+               rep.m_verified < 0 ? "null" : rep.m_verified ? "true" : "false");
+  }
+  fmt::print(fp, FMT_STRING("\n  ]\n}}\n"));
+}
+
+bool MatchesFilters(const BenchStage& stage, const BenchConfig& cfg) {
+  if (cfg.m_filters.empty())
+    return true;
+  return std::any_of(cfg.m_filters.cbegin(), cfg.m_filters.cend(),
+                     [&](const std::string& f) { return stage.m_name.find(f) != std::string::npos; });
+}
+
+void PrintUsage() {
+  fmt::print(FMT_STRING("Usage: amuse-bench [-i <iterations>] [-n <samples>] [-g <group-file>] [-s <songs-file>]\n"
+                        "                   [--song <index>] [--json <out.json|->] [<stage-filter>...]\n"
+                        "  -i      timed iterations per stage (default 20)\n"
+                        "  -n      samples processed per iteration (default 1048576); engine stages cover the\n"
+                        "          same length of audio in 5ms periods at 32kHz\n"
+                        "  -g, -s  corpus for the engine stages (default {} and {})\n"
+                        "  --song  index of the song driving song-advance (default 0)\n"
+                        "  --json  also write results as JSON; '-' writes JSON to stdout instead of the table\n"
+                        "  Stages whose name contains any filter are run; all stages by default\n"),
+             DefaultGroupPath, DefaultSongsPath);
+}
+
+/** Parses the value of option `opt` from its own or the next argument */
+const char* OptionValue(int argc, char** argv, int& i, const char* opt) {
+  const size_t len = strlen(opt);
+  if (argv[i][len])
+    return &argv[i][len];
+  return argc > (i + 1) ? argv[++i] : "";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  BenchConfig cfg;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+      PrintUsage();
+      return 0;
+    } else if (!strcmp(argv[i], "--json")) {
+      cfg.m_jsonPath = OptionValue(argc, argv, i, "--json");
+    } else if (!strcmp(argv[i], "--song")) {
+      cfg.m_song = strtoul(OptionValue(argc, argv, i, "--song"), nullptr, 0);
+    } else if (!strncmp(argv[i], "-i", 2)) {
+      cfg.m_iterations = strtoul(OptionValue(argc, argv, i, "-i"), nullptr, 0);
+    } else if (!strncmp(argv[i], "-n", 2)) {
+      cfg.m_samples = strtoul(OptionValue(argc, argv, i, "-n"), nullptr, 0);
+    } else if (!strncmp(argv[i], "-g", 2)) {
+      cfg.m_groupPath = OptionValue(argc, argv, i, "-g");
+    } else if (!strncmp(argv[i], "-s", 2)) {
+      cfg.m_songsPath = OptionValue(argc, argv, i, "-s");
+    } else {
+      cfg.m_filters.emplace_back(argv[i]);
+    }
+  }
+  cfg.m_iterations = std::max(1u, cfg.m_iterations);
+  cfg.m_samples = std::max(1u, cfg.m_samples);
+
+  std::vector<BenchStage> stages;
+  AddCodecStages(stages, cfg);
+  auto corpus = std::make_shared<CorpusWorkload>();
+  if (corpus->load(cfg))
+    AddEngineStages(stages, cfg, corpus);
+  else
+    fmt::print(stderr, FMT_STRING("unable to load a song group from {}; skipping engine stages\n"), cfg.m_groupPath);
+  AddEffectStages(stages, cfg);
+
+  const bool table = cfg.m_jsonPath != "-";
+  if (table)
+    fmt::print(FMT_STRING("{:<24} {:<8} {:<6} {:>11} {:>11} {:>10}\n"), "stage", "isa", "unit", "best M/s", "mean M/s",
+               "vs scalar");
+  bool failed = false;
+  double scalarBest = 0.0;
+  std::vector<StageReport> reports;
+  for (const BenchStage& stage : stages) {
+    if (!MatchesFilters(stage, cfg))
+      continue;
+    const BenchResult res = RunStage(stage, cfg);
+    if (stage.m_isa == "scalar")
+      scalarBest = res.m_bestSecs;
+    const int verified = stage.m_verify ? int(stage.m_verify()) : -1;
+    failed |= verified == 0;
+    reports.push_back({&stage, res, verified});
+    if (!table)
+      continue;
+    const double mitems = stage.m_items / 1e6;
+    fmt::print(FMT_STRING("{:<24} {:<8} {:<6} {:>11.2f} {:>11.2f}"), stage.m_name, stage.m_isa, stage.m_unit,
+               mitems / res.m_bestSecs, mitems / res.m_meanSecs);
+    if (stage.m_verify && stage.m_isa != "-" && stage.m_isa != "scalar")
+      fmt::print(FMT_STRING(" {:>9.2f}x"), scalarBest / res.m_bestSecs);
+    else if (stage.m_verify)
+      fmt::print(FMT_STRING(" {:>10}"), "");
+    if (verified == 0)
+      fmt::print(FMT_STRING("  MISMATCH"));
+    fmt::print(FMT_STRING("\n"));
+  }
+
+  if (!cfg.m_jsonPath.empty()) {
+    FILE* fp = table ? fopen(cfg.m_jsonPath.c_str(), "w") : stdout;
+    if (!fp) {
+      fmt::print(stderr, FMT_STRING("unable to open {} for writing\n"), cfg.m_jsonPath);
+      return 1;
+    }
+    WriteJson(fp, cfg, *corpus, reports);
+    if (fp != stdout)
+      fclose(fp);
+  }
+
+  return failed ? 1 : 0;
+}
@@ -1,7 +1,13 @@
 #include "amuse/amuse.hpp"
+#include "amuse/DirectoryEnumerator.hpp"
+#include "amuse/WorkerPool.hpp"
 #include <fmt/format.h>
+#include <atomic>
+#include <chrono>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <functional>
 
 #if _WIN32
 #include <nowide/args.hpp>
@@ -24,7 +30,61 @@ static void ReportConvType(ConvType tp) {
   }
 }
 
-static bool BuildAudioGroup(std::string_view groupBase, std::string_view targetPath) { return true; }
+/** SNG revision and byte order written for each target format */
+static void SongFormat(ConvType tp, int& version, bool& big) {
+  version = tp == ConvN64 ? 0 : 1;
+  big = tp != ConvPC;
+}
+
+static bool ReadFile(const std::string& path, std::vector<uint8_t>& data) {
+  FILE* fp = amuse::FOpen(path.c_str(), "rb");
+  if (!fp)
+    return false;
+
+  fseek(fp, 0, SEEK_END);
+  long sz = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  data.resize(sz);
+  bool good = fread(data.data(), 1, sz, fp) == size_t(sz);
+  fclose(fp);
+  return good;
+}
+
+static bool WriteFile(const std::string& path, const std::vector<uint8_t>& data) {
+  FILE* fp = amuse::FOpen(path.c_str(), "wb");
+  if (!fp) {
+    fmt::print(stderr, "amuseconv: unable to open {} for writing\n", path);
+    return false;
+  }
+  fwrite(data.data(), 1, data.size(), fp);
+  fclose(fp);
+  return true;
+}
+
+static bool BuildAudioGroup(std::string_view groupBase, std::string_view targetPath, ConvType type,
+                            unsigned threads) {
+  if (type != ConvGCN) {
+    fmt::print(stderr, "amuseconv: only GameCube format can be built from a project\n");
+    return false;
+  }
+
+  amuse::ProjectDatabase projDb;
+  projDb.setIdDatabases();
+  amuse::AudioGroupDatabase group(groupBase);
+
+  /* Loose WAVs newer than their DSP are re-encoded concurrently while building the sample directory */
+  amuse::WorkerPool pool(threads);
+  const auto encodeStart = std::chrono::steady_clock::now();
+  auto sdirSamp = group.getSdir().toGCNData(group, &pool);
+  fmt::print("amuseconv: built sample directory in {:.2f} s on {} threads\n",
+             std::chrono::duration<double>(std::chrono::steady_clock::now() - encodeStart).count(),
+             pool.getThreadCount());
+
+  std::string basePath(targetPath);
+  return WriteFile(basePath + ".proj", group.getProj().toGCNData(group.getPool(), group.getSdir())) &&
+         WriteFile(basePath + ".pool", group.getPool().toData<std::endian::big>()) &&
+         WriteFile(basePath + ".sdir", sdirSamp.first) && WriteFile(basePath + ".samp", sdirSamp.second);
+}
 
 static bool ExtractAudioGroup(std::string_view inPath, std::string_view targetPath) {
   amuse::ContainerRegistry::Type type;
@@ -66,52 +126,154 @@ static bool ExtractAudioGroup(std::string_view inPath, std::string_view targetPa
   return true;
 }
 
-static bool BuildSNG(std::string_view inPath, std::string_view targetPath, int version, bool big) {
-  FILE* fp = amuse::FOpen(inPath.data(), "rb");
-  if (!fp)
+static bool BuildSNG(std::string_view inPath, std::string_view targetPath, ConvType type) {
+  std::vector<uint8_t> data;
+  if (!ReadFile(std::string(inPath), data))
     return false;
 
-  fseek(fp, 0, SEEK_END);
-  long sz = ftell(fp);
-  fseek(fp, 0, SEEK_SET);
-  std::vector<uint8_t> data(sz, 0);
-  fread(&data[0], 1, sz, fp);
-  fclose(fp);
-
+  int version;
+  bool big;
+  SongFormat(type, version, big);
   std::vector<uint8_t> out = amuse::SongConverter::MIDIToSong(data, version, big);
   if (out.empty())
     return false;
 
-  fp = amuse::FOpen(targetPath.data(), "wb");
-  fwrite(out.data(), 1, out.size(), fp);
-  fclose(fp);
-
-  return true;
+  return WriteFile(std::string(targetPath), out);
 }
 
 static bool ExtractSNG(std::string_view inPath, std::string_view targetPath) {
-  FILE* fp = amuse::FOpen(inPath.data(), "rb");
-  if (!fp)
+  std::vector<uint8_t> data;
+  if (!ReadFile(std::string(inPath), data))
     return false;
 
-  fseek(fp, 0, SEEK_END);
-  long sz = ftell(fp);
-  fseek(fp, 0, SEEK_SET);
-  std::vector<uint8_t> data(sz, 0);
-  fread(&data[0], 1, sz, fp);
-  fclose(fp);
-
   int extractedVersion;
   bool isBig;
   std::vector<uint8_t> out = amuse::SongConverter::SongToMIDI(data.data(), extractedVersion, isBig);
   if (out.empty())
     return false;
 
-  fp = amuse::FOpen(targetPath.data(), "wb");
-  fwrite(out.data(), 1, out.size(), fp);
-  fclose(fp);
+  return WriteFile(std::string(targetPath), out);
+}
 
-  return true;
+static bool HasExtension(std::string_view path, std::initializer_list<const char*> exts) {
+  size_t dotPos = path.rfind('.');
+  if (dotPos == std::string_view::npos)
+    return false;
+  std::string dot(path.substr(dotPos));
+  for (const char* ext : exts)
+    if (!amuse::CompareCaseInsensitive(dot.c_str(), ext))
+      return true;
+  return false;
+}
+
+static std::string StripExtension(std::string_view name) {
+  size_t dotPos = name.rfind('.');
+  return std::string(name.substr(0, dotPos));
+}
+
+/** One song conversion of a batch; MIDI files become songs, everything else becomes MIDI */
+struct BatchJob {
+  std::string m_name;
+  std::string m_outPath;
+  std::vector<uint8_t> m_fileData;     /**< Contents of a loose input file */
+  const uint8_t* m_songData = nullptr; /**< Song inside a container, or m_fileData */
+  bool m_toSong = false;
+  size_t m_inSize = 0;
+  size_t m_outSize = 0;
+  bool m_good = false;
+};
+
+using SongList = std::vector<std::pair<std::string, amuse::ContainerRegistry::SongData>>;
+
+static void AddContainerSongs(std::vector<BatchJob>& jobs, std::vector<SongList>& containers, const std::string& path,
+                              const std::string& outDir) {
+  auto songs = amuse::ContainerRegistry::LoadSongs(path.c_str());
+  if (songs.empty())
+    return;
+  amuse::Mkdir(outDir.c_str(), 0755);
+  for (auto& [name, song] : songs) {
+    BatchJob& job = jobs.emplace_back();
+    job.m_name = name;
+    job.m_outPath = outDir + '/' + name + ".mid";
+    job.m_songData = song.m_data.get();
+    job.m_inSize = song.m_size;
+  }
+  containers.push_back(std::move(songs));
+}
+
+/** Convert every song of a container, or of all containers and loose song/MIDI files in a directory */
+static bool BatchConvert(std::string_view inPath, std::string_view targetPath, ConvType type, unsigned threads) {
+  std::string outDir(targetPath);
+  amuse::Mkdir(outDir.c_str(), 0755);
+
+  std::vector<BatchJob> jobs;
+  std::vector<SongList> containers;
+  amuse::Sstat theStat;
+  if (!amuse::Stat(inPath.data(), &theStat) && S_ISDIR(theStat.st_mode)) {
+    amuse::DirectoryEnumerator de(inPath, amuse::DirectoryEnumerator::Mode::FilesSorted);
+    for (const amuse::DirectoryEnumerator::Entry& ent : de) {
+      if (HasExtension(ent.m_name, {".mid", ".midi"}) || HasExtension(ent.m_name, {".son", ".sng"})) {
+        BatchJob job;
+        job.m_toSong = HasExtension(ent.m_name, {".mid", ".midi"});
+        if (!ReadFile(ent.m_path, job.m_fileData)) {
+          fmt::print(stderr, "amuseconv: unable to read {}\n", ent.m_path);
+          continue;
+        }
+        job.m_name = ent.m_name;
+        job.m_outPath = outDir + '/' + StripExtension(ent.m_name) + (job.m_toSong ? ".son" : ".mid");
+        job.m_songData = job.m_fileData.data();
+        job.m_inSize = job.m_fileData.size();
+        jobs.push_back(std::move(job));
+      } else {
+        AddContainerSongs(jobs, containers, ent.m_path, outDir + '/' + StripExtension(ent.m_name));
+      }
+    }
+  } else {
+    AddContainerSongs(jobs, containers, std::string(inPath), outDir);
+  }
+
+  if (jobs.empty()) {
+    fmt::print(stderr, "amuseconv: no songs found in {}\n", inPath);
+    return false;
+  }
+
+  int version;
+  bool big;
+  SongFormat(type, version, big);
+  std::atomic<size_t> inBytes = 0;
+  amuse::WorkerPool pool(threads);
+  const auto convStart = std::chrono::steady_clock::now();
+  pool.parallelFor(jobs.size(), [&](size_t i) {
+    BatchJob& job = jobs[i];
+    std::vector<uint8_t> out;
+    if (job.m_toSong) {
+      out = amuse::SongConverter::MIDIToSong(job.m_fileData, version, big);
+    } else {
+      int extractedVersion;
+      bool isBig;
+      out = amuse::SongConverter::SongToMIDI(job.m_songData, extractedVersion, isBig);
+    }
+    job.m_outSize = out.size();
+    job.m_good = !out.empty() && WriteFile(job.m_outPath, out);
+    inBytes += job.m_inSize;
+  });
+  const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - convStart).count();
+
+  size_t converted = 0;
+  size_t outBytes = 0;
+  for (const BatchJob& job : jobs) {
+    if (job.m_good) {
+      ++converted;
+      outBytes += job.m_outSize;
+    } else {
+      fmt::print(stderr, "amuseconv: unable to convert {}\n", job.m_name);
+    }
+  }
+  fmt::print("amuseconv: converted {} of {} songs ({:.1f} KiB in, {:.1f} KiB out) in {:.3f} s on {} threads; "
+             "{:.0f} songs/s, {:.2f} MiB/s\n",
+             converted, jobs.size(), inBytes / 1024.0, outBytes / 1024.0, secs, pool.getThreadCount(),
+             jobs.size() / secs, inBytes / secs / (1024.0 * 1024.0));
+  return converted == jobs.size();
 }
 
 int main(int argc, char** argv) {
@@ -119,60 +281,78 @@ int main(int argc, char** argv) {
   nowide::args _(argc, argv);
 #endif
 
-  if (argc < 3) {
-    fmt::print(FMT_STRING("Usage: amuseconv <in-file> <out-file> [n64|pc|gcn]\n"));
+  /* -j <threads> may appear anywhere; everything else is positional */
+  unsigned threads = 0;
+  std::vector<char*> args;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-j") && i + 1 < argc)
+      threads = unsigned(strtoul(argv[++i], nullptr, 10));
+    else
+      args.push_back(argv[i]);
+  }
+
+  /* batch <in-dir|container> <out-dir> converts every song found, in parallel */
+  const bool batch = !args.empty() && !strcmp(args[0], "batch");
+  if (batch)
+    args.erase(args.begin());
+
+  if (args.size() < 2) {
+    fmt::print(FMT_STRING("Usage: amuseconv [-j <threads>] <in-file> <out-file> [n64|pc|gcn]\n"
+                          "       amuseconv [-j <threads>] batch <in-dir|container> <out-dir> [n64|pc|gcn]\n"));
     return 0;
   }
 
   ConvType type = ConvGCN;
-  if (argc >= 4) {
-    if (!amuse::CompareCaseInsensitive(argv[3], "n64"))
+  if (args.size() >= 3) {
+    if (!amuse::CompareCaseInsensitive(args[2], "n64"))
       type = ConvN64;
-    else if (!amuse::CompareCaseInsensitive(argv[3], "gcn"))
+    else if (!amuse::CompareCaseInsensitive(args[2], "gcn"))
       type = ConvGCN;
-    else if (!amuse::CompareCaseInsensitive(argv[3], "pc"))
+    else if (!amuse::CompareCaseInsensitive(args[2], "pc"))
       type = ConvPC;
     else {
-      fmt::print(stderr, "amuseconv: unrecognized format: {}\n", argv[3]);
+      fmt::print(stderr, "amuseconv: unrecognized format: {}\n", args[2]);
       return 1;
     }
   }
 
+  if (batch) {
+    ReportConvType(type);
+    return BatchConvert(args[0], args[1], type, threads) ? 0 : 1;
+  }
+
   bool good = false;
-  FILE* fin = amuse::FOpen(argv[1], "rb");
-  if (fin) {
+  amuse::Sstat theStat;
+  if (!amuse::Stat(args[0], &theStat) && S_ISDIR(theStat.st_mode)) {
+    std::string projectPath(args[0]);
+    projectPath += "/!project.yaml";
+    FILE* fin = amuse::FOpen(projectPath.c_str(), "rb");
+    if (fin) {
+      fclose(fin);
+      ReportConvType(type);
+      good = BuildAudioGroup(args[0], args[1], type, threads);
+    }
+  } else if (FILE* fin = amuse::FOpen(args[0], "rb")) {
     fclose(fin);
-    std::string barePath(argv[1]);
+    std::string barePath(args[0]);
     size_t dotPos = barePath.rfind('.');
     const char* dot = barePath.c_str() + dotPos;
     if (dotPos != std::string::npos) {
       if (!amuse::CompareCaseInsensitive(dot, ".mid") ||
           !amuse::CompareCaseInsensitive(dot, ".midi")) {
         ReportConvType(type);
-        good = BuildSNG(barePath, argv[2], 1, true);
+        good = BuildSNG(barePath, args[1], type);
       } else if (!amuse::CompareCaseInsensitive(dot, ".son") ||
                  !amuse::CompareCaseInsensitive(dot, ".sng")) {
-        good = ExtractSNG(argv[1], argv[2]);
+        good = ExtractSNG(args[0], args[1]);
       } else {
-        good = ExtractAudioGroup(argv[1], argv[2]);
-      }
-    }
-  } else {
-    amuse::Sstat theStat;
-    if (!amuse::Stat(argv[1], &theStat) && S_ISDIR(theStat.st_mode)) {
-      std::string projectPath(argv[1]);
-      projectPath += "/project.yaml";
-      fin = amuse::FOpen(projectPath.c_str(), "rb");
-      if (fin) {
-        fclose(fin);
-        ReportConvType(type);
-        good = BuildAudioGroup(argv[1], argv[2]);
+        good = ExtractAudioGroup(args[0], args[1]);
       }
     }
   }
 
   if (!good) {
-    fmt::print(stderr, "amuseconv: unable to convert {} to {}\n", argv[1], argv[2]);
+    fmt::print(stderr, "amuseconv: unable to convert {} to {}\n", args[0], args[1]);
     return 1;
   }
 
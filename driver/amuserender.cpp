@@ -1,10 +1,9 @@
 #include "amuse/amuse.hpp"
-#include "amuse/BooBackend.hpp"
+#include "amuse/OfflineBackend.hpp"
 #include "athena/FileReader.hpp"
-#include "boo/boo.hpp"
-#include "boo/audiodev/IAudioVoiceEngine.hpp"
 #include "logvisor/logvisor.hpp"
 #include <optional>
+#include <chrono>
 #include <cstdio>
 #include <cstring>
 #include <signal.h>
@@ -77,6 +76,11 @@ int main(int argc, char** argv) {
   double rate = NativeSampleRate;
   int chCount = 2;
   double volume = 1.0;
+  unsigned renderThreads = 1;
+  size_t sampleCacheKiB = amuse::DecodedSampleCache::DefaultBudget / 1024;
+  size_t maxVoices = 0;
+  amuse::AmplitudeMode ampMode = amuse::AmplitudeMode::PerSample;
+  std::string pathOut;
   for (int i = 1; i < argc; ++i) {
     if (!strncmp(argv[i], "-r", 2)) {
       if (argv[i][2])
@@ -99,6 +103,48 @@ int main(int argc, char** argv) {
         volume = strtod(argv[i + 1], nullptr);
         ++i;
       }
+    } else if (!strncmp(argv[i], "-j", 2)) {
+      if (argv[i][2])
+        renderThreads = strtoul(&argv[i][2], nullptr, 0);
+      else if (argc > (i + 1)) {
+        renderThreads = strtoul(argv[i + 1], nullptr, 0);
+        ++i;
+      }
+    } else if (!strncmp(argv[i], "-m", 2)) {
+      if (argv[i][2])
+        sampleCacheKiB = strtoul(&argv[i][2], nullptr, 0);
+      else if (argc > (i + 1)) {
+        sampleCacheKiB = strtoul(argv[i + 1], nullptr, 0);
+        ++i;
+      }
+    } else if (!strncmp(argv[i], "-p", 2)) {
+      if (argv[i][2])
+        maxVoices = strtoul(&argv[i][2], nullptr, 0);
+      else if (argc > (i + 1)) {
+        maxVoices = strtoul(argv[i + 1], nullptr, 0);
+        ++i;
+      }
+    } else if (!strncmp(argv[i], "-a", 2)) {
+      const char* mode = nullptr;
+      if (argv[i][2])
+        mode = &argv[i][2];
+      else if (argc > (i + 1)) {
+        mode = argv[i + 1];
+        ++i;
+      }
+      if (mode && !strcmp(mode, "block"))
+        ampMode = amuse::AmplitudeMode::BlockCurve;
+      else if (mode && !strcmp(mode, "linear"))
+        ampMode = amuse::AmplitudeMode::BlockLinearized;
+      else
+        ampMode = amuse::AmplitudeMode::PerSample;
+    } else if (!strncmp(argv[i], "-o", 2)) {
+      if (argv[i][2])
+        pathOut = &argv[i][2];
+      else if (argc > (i + 1)) {
+        pathOut = argv[i + 1];
+        ++i;
+      }
     } else
       m_args.push_back(argv[i]);
   }
@@ -107,7 +153,9 @@ int main(int argc, char** argv) {
   if (m_args.size() < 1) {
     Log.report(logvisor::Error,
                FMT_STRING("Usage: amuserender <group-file> [<songs-file>] [-r <sample-rate>] [-c <channel-count>] [-v <volume "
-                   "0.0-1.0>]"));
+                   "0.0-1.0>] [-o <out.wav|out.raw>] [-j <render-threads, 0 for all>] "
+                   "[-a <sample|linear|block amplitude mode>] [-m <decoded-sample cache KiB, 0 to disable>] "
+                   "[-p <max voices, 0 for unlimited>]"));
     return 1;
   }
 
@@ -118,12 +166,21 @@ int main(int argc, char** argv) {
   }
   Log.report(logvisor::Info, FMT_STRING("Found '{}' Audio Group data"), amuse::ContainerRegistry::TypeToName(cType));
 
-  std::vector<std::pair<std::string, amuse::IntrusiveAudioGroupData>> data =
-      amuse::ContainerRegistry::LoadContainer(m_args[0].c_str());
+  /* Parse every group's project, pool and sample directory concurrently */
+  amuse::AudioGroupLoader::Timing loadTiming;
+  amuse::AudioGroupLoader::LoadedContainer loaded =
+      amuse::AudioGroupLoader::LoadContainer(m_args[0].c_str(), nullptr, &loadTiming);
+  std::vector<std::pair<std::string, amuse::IntrusiveAudioGroupData>>& data = loaded.m_data;
   if (data.empty()) {
     Log.report(logvisor::Error, FMT_STRING("invalid/no data at path argument"));
     return 1;
   }
+  Log.report(logvisor::Info,
+             FMT_STRING("Loaded {} groups in {:.2f} ms: container {:.2f} ms, parse {:.2f} ms on {} threads "
+                        "(proj {:.2f} ms, pool {:.2f} ms, sdir {:.2f} ms summed)"),
+             loadTiming.m_groups, (loadTiming.m_container + loadTiming.m_parse) * 1000.0,
+             loadTiming.m_container * 1000.0, loadTiming.m_parse * 1000.0, loadTiming.m_threads,
+             loadTiming.m_proj * 1000.0, loadTiming.m_pool * 1000.0, loadTiming.m_sdir * 1000.0);
 
   int m_groupId = -1;
   int m_setupId = -1;
@@ -132,7 +189,6 @@ int main(int argc, char** argv) {
   amuse::ContainerRegistry::SongData* m_arrData = nullptr;
   bool m_sfxGroup = false;
 
-  std::list<amuse::AudioGroupProject> m_projs;
   std::map<amuse::GroupId, std::pair<std::pair<std::string, amuse::IntrusiveAudioGroupData>*,
                            amuse::ObjToken<amuse::SongGroupIndex>>>
       allSongGroups;
@@ -141,10 +197,10 @@ int main(int argc, char** argv) {
       allSFXGroups;
   size_t totalGroups = 0;
 
-  for (auto& grp : data) {
-    /* Load project to assemble group list */
-    m_projs.push_back(amuse::AudioGroupProject::CreateAudioGroupProject(grp.second));
-    amuse::AudioGroupProject& proj = m_projs.back();
+  for (size_t i = 0; i < data.size(); ++i) {
+    /* Assemble group list from the parsed projects */
+    auto& grp = data[i];
+    const amuse::AudioGroupProject& proj = loaded.m_groups[i]->getProj();
     totalGroups += proj.sfxGroups().size() + proj.songGroups().size();
 
     for (auto it = proj.songGroups().begin(); it != proj.songGroups().end(); ++it)
@@ -316,12 +372,12 @@ int main(int argc, char** argv) {
   }
 
   /* Make final group selection */
-  amuse::IntrusiveAudioGroupData* selData = nullptr;
+  std::pair<std::string, amuse::IntrusiveAudioGroupData>* selData = nullptr;
   amuse::ObjToken<amuse::SongGroupIndex> songIndex;
   amuse::ObjToken<amuse::SFXGroupIndex> sfxIndex;
   auto songSearch = allSongGroups.find(m_groupId);
   if (songSearch != allSongGroups.end()) {
-    selData = &songSearch->second.first->second;
+    selData = songSearch->second.first;
     songIndex = songSearch->second.second;
     std::set<amuse::SongId> sortSetups;
     for (auto& pair : songIndex->m_midiSetups)
@@ -346,7 +402,7 @@ int main(int argc, char** argv) {
   } else {
     auto sfxSearch = allSFXGroups.find(m_groupId);
     if (sfxSearch != allSFXGroups.end()) {
-      selData = &sfxSearch->second.first->second;
+      selData = sfxSearch->second.first;
       sfxIndex = sfxSearch->second.second;
     }
   }
@@ -361,18 +417,33 @@ int main(int argc, char** argv) {
     return 1;
   }
 
-  /* WAV out path */
-  std::string pathOut = fmt::format(FMT_STRING("{}-{}.wav"), *m_groupName, *m_songName);
+  if (!m_arrData) {
+    Log.report(logvisor::Error, FMT_STRING("no song selected for rendering"));
+    return 1;
+  }
+
+  /* WAV out path; .raw/.pcm extensions select headerless PCM */
+  if (pathOut.empty())
+    pathOut = fmt::format(FMT_STRING("{}-{}.wav"), *m_groupName, *m_songName);
+  const bool rawOut = pathOut.ends_with(".raw") || pathOut.ends_with(".pcm");
   Log.report(logvisor::Info, FMT_STRING("Writing to {}"), pathOut);
 
-  /* Build voice engine */
-  std::unique_ptr<boo::IAudioVoiceEngine> voxEngine = boo::NewWAVAudioVoiceEngine(pathOut.c_str(), rate, chCount);
-  amuse::BooBackendVoiceAllocator booBackend(*voxEngine);
-  amuse::Engine engine(booBackend, amuse::AmplitudeMode::PerSample);
+  /* Build voice engine; mixing happens in-process so rendering runs as fast as the CPU allows */
+  amuse::OfflineBackendVoiceAllocator offlineBackend(rate, chCount);
+  offlineBackend.setRenderThreads(renderThreads);
+  amuse::OfflinePCMWriter writer;
+  if (!writer.open(pathOut.c_str(), uint32_t(rate), uint16_t(offlineBackend.getChannelCount()), rawOut)) {
+    Log.report(logvisor::Error, FMT_STRING("unable to open {} for writing"), pathOut);
+    return 1;
+  }
+  amuse::Engine engine(offlineBackend, ampMode);
   engine.setVolume(float(std::clamp(0.0, volume, 1.0)));
+  engine.setDecodedSampleBudget(sampleCacheKiB * 1024);
+  engine.setMaxVoices(maxVoices);
 
   /* Load group into engine */
-  const amuse::AudioGroup* group = engine.addAudioGroup(*selData);
+  const amuse::AudioGroup* group =
+      engine.addAudioGroup(selData->second, std::move(loaded.m_groups[selData - data.data()]));
   if (!group) {
     Log.report(logvisor::Error, FMT_STRING("unable to add audio group"));
     return 1;
@@ -380,16 +451,36 @@ int main(int argc, char** argv) {
 
   /* Enter playback loop */
   amuse::ObjToken<amuse::Sequencer> seq = engine.seqPlay(m_groupId, m_setupId, m_arrData->m_data.get(), false);
+  std::vector<int16_t> mixBuf(offlineBackend.get5MsFrames() * offlineBackend.getChannelCount());
   size_t wroteFrames = 0;
   signal(SIGINT, SIGINTHandler);
+  auto startTime = std::chrono::steady_clock::now();
   do {
-    voxEngine->pumpAndMixVoices();
-    wroteFrames += voxEngine->get5MsFrames();
-    fmt::print(FMT_STRING("\rFrame {}"), wroteFrames);
-    fflush(stdout);
+    offlineBackend.pumpAndMixVoices(mixBuf.data());
+    writer.write(mixBuf.data(), offlineBackend.get5MsFrames());
+    wroteFrames += offlineBackend.get5MsFrames();
+    if ((wroteFrames / offlineBackend.get5MsFrames()) % 200 == 0) {
+      fmt::print(FMT_STRING("\rFrame {}"), wroteFrames);
+      fflush(stdout);
+    }
   } while (!g_BreakLoop && (seq->state() == amuse::SequencerState::Playing || seq->getVoiceCount() != 0));
-
-  fmt::print(FMT_STRING("\n"));
+  writer.close();
+
+  const double wallSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  const double audioSecs = double(wroteFrames) / rate;
+  fmt::print(FMT_STRING("\rFrame {}\n"), wroteFrames);
+  fmt::print(FMT_STRING("Rendered {:.2f}s of audio in {:.2f}s ({:.1f}x realtime)\n"), audioSecs, wallSecs,
+             wallSecs > 0.0 ? audioSecs / wallSecs : 0.0);
+  const amuse::DecodedSampleCache::Stats cacheStats = engine.getDecodedSampleCache().getStats();
+  fmt::print(FMT_STRING("Sample cache: {} hits, {} misses, {} filled, {} streamed, {} evictions, {} KiB resident\n"),
+             cacheStats.m_hits, cacheStats.m_misses, cacheStats.m_fills, cacheStats.m_bypasses,
+             cacheStats.m_evictions, cacheStats.m_residentBytes / 1024);
+  const amuse::VoicePool::Stats poolStats = engine.getVoicePoolStats();
+  fmt::print(FMT_STRING("Voice pool: {} peak of {} slots, {} heap allocations\n"), poolStats.m_peakInUse,
+             poolStats.m_capacity, poolStats.m_heapAllocations);
+  const amuse::Engine::VoiceStealStats& stealStats = engine.getVoiceStealStats();
+  fmt::print(FMT_STRING("Voice stealing: {} for max voices, {} for object limits, {} refused\n"), stealStats.m_steals,
+             stealStats.m_limitSteals, stealStats.m_rejections);
   return 0;
 }
 
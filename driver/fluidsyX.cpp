@@ -8,16 +8,17 @@
  */
 
 #include "amuse/ContainerRegistry.hpp"
+#include "amuse/AudioGroupLoader.hpp"
 #include "amuse/AudioGroupPool.hpp"
 #include "amuse/AudioGroupProject.hpp"
 #include "amuse/AudioGroupData.hpp"
 #include "amuse/AudioGroupSampleDirectory.hpp"
-#include "amuse/DSPCodec.hpp"
-#include "amuse/N64MusyXCodec.hpp"
+#include "amuse/DecodedSampleCache.hpp"
 #include "amuse/Envelope.hpp"
 #include "amuse/Common.hpp"
 #include "amuse/SongState.hpp"
 #include "amuse/FluidsyXMacroContext.hpp"
+#include "amuse/OfflineBackend.hpp"
 
 #include <fluidsynth.h>
 
@@ -37,6 +38,7 @@
 #include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <random>
 #include <string>
 #include <thread>
@@ -593,6 +595,72 @@ static bool parseSngEvents(const unsigned char* sngData, bool bigEndian,
   return true;
 }
 
+/* ── Incremental SNG event stream ──
+ * Produces the parsed events followed by each looping track's repetitions
+ * (and the tempo table's, see scheduleSongEvents) in tick order, a window at
+ * a time, so only the look-ahead window ever sits in the sequencer queue. */
+
+struct SngEventStream {
+  /** One tick-ordered run of events, optionally repeated every loopLen ticks */
+  struct Source {
+    std::vector<const SngEvent*> events;
+    uint32_t loopStart = 0; /* repetitions emit absTick - loopStart + iterBase */
+    uint32_t loopLen = 0;   /* 0 = emitted once at absTick */
+    uint32_t firstBase = 0; /* iterBase of the first repetition */
+    int trackIdx = -1;
+    uint8_t channel = 0;
+    size_t pos = 0;
+    uint32_t iter = 0;
+    uint32_t lastTick = 0; /* tick of the last emitted event */
+    bool done = false;
+  };
+
+  std::vector<SngEvent> events;
+  std::vector<Source> sources;
+  uint32_t maxTick = 0; /* repetitions stop here */
+
+  /** Emit every remaining event with tick < endTick as emit(event, tick),
+   *  source by source.  Returns false once all sources are exhausted. */
+  template <class Emit>
+  bool advance(uint32_t endTick, Emit&& emit) {
+    bool more = false;
+    for (auto& src : sources) {
+      while (!src.done) {
+        if (src.pos == src.events.size()) {
+          if (src.loopLen == 0) {
+            src.done = true;
+            break;
+          }
+          src.pos = 0;
+          ++src.iter;
+        }
+        uint32_t tick = src.events[src.pos]->absTick;
+        if (src.loopLen != 0) {
+          uint64_t iterBase = uint64_t(src.firstBase) + uint64_t(src.loopLen) * src.iter;
+          uint64_t t = iterBase + (tick - src.loopStart);
+          if (iterBase >= maxTick || t >= maxTick) {
+            src.done = true;
+            break;
+          }
+          tick = static_cast<uint32_t>(t);
+        }
+        if (tick >= endTick)
+          break;
+        emit(*src.events[src.pos], tick);
+        src.lastTick = tick;
+        ++src.pos;
+      }
+      more |= !src.done;
+    }
+    return more;
+  }
+
+  void clear() {
+    sources.clear();
+    events.clear();
+  }
+};
+
 /* ═══════════════ Custom SoundFont loader for MusyX samples ═══════════════
  *
  * We decode MusyX compressed samples (DSP ADPCM, N64 VADPCM, PCM) to
@@ -610,26 +678,30 @@ static bool parseSngEvents(const unsigned char* sngData, bool bigEndian,
  *   - One preset per program number (bank 0 only).
  * ═════════════════════════════════════════════════════════════════════════ */
 
-/** Decoded PCM sample data kept alive for the lifetime of the soundfont. */
+/** Sample metadata; PCM is decoded and handed to FluidSynth on first use. */
 struct DecodedSample {
   SampleId id;
   std::string name;
-  std::vector<int16_t> pcmData;   /**< 16-bit signed mono PCM */
+  const AudioGroupSampleDirectory::EntryData* entry = nullptr;
+  const unsigned char* data = nullptr; /**< Start of the (possibly compressed) sample data */
   uint32_t sampleRate = 32000;
   uint8_t rootKey = 60;           /**< MIDI root key */
   bool looped = false;
   uint32_t loopStart = 0;
   uint32_t loopEnd = 0;
-  fluid_sample_t* flSample = nullptr; /**< Owned by FluidSynth after loading */
+  fluid_sample_t* flSample = nullptr; /**< Owned by FluidSynth after loading; null until first played */
 };
 
+struct MusyXSoundFontData;
+
 /** Per-preset data: which fluid_sample to play for a given MIDI note. */
 struct MusyXPresetData {
   int bank = 0;
   int program = 0;
+  MusyXSoundFontData* owner = nullptr;
   /** Default sample for this preset (from the first CmdStartSample in the
-   *  macro associated with this program number).  May be null. */
-  fluid_sample_t* defaultSample = nullptr;
+   *  macro associated with this program number), as an index into owner->samples. */
+  size_t defaultSample = 0;
   uint8_t rootKey = 60;
   bool looped = false;
   uint32_t loopStart = 0;
@@ -647,52 +719,29 @@ struct MusyXSoundFontData {
   /** fluid_preset_t objects kept alive */
   std::vector<fluid_preset_t*> flPresets;
   int iterIdx = 0; /**< for iteration */
+  /** Guards lazy sample creation (sequencer callbacks and synth noteons may race) */
+  std::mutex sampleLock;
 };
 
 /* ── Decode helpers ── */
 
-/** Decode a single MusyX sample entry to 16-bit PCM. */
+/** Decode a single MusyX sample entry to 16-bit PCM.  ADPCM goes through the
+ *  engine's decoder so FluidSynth hears the same first pass as amuse voices. */
 static std::vector<int16_t> decodeSampleToPCM(
     const AudioGroupSampleDirectory::EntryData& ent,
-    const unsigned char* sampBase)
+    const unsigned char* samp)
 {
-  const unsigned char* samp = sampBase + ent.m_sampleOff;
   SampleFormat fmt = ent.getSampleFormat();
   uint32_t numSamples = ent.getNumSamples();
-  std::vector<int16_t> out(numSamples);
 
-  if (fmt == SampleFormat::DSP || fmt == SampleFormat::DSP_DRUM) {
-    uint32_t remSamples = numSamples;
-    const unsigned char* cur = samp;
-    int16_t prev1 = ent.m_ADPCMParms.dsp.m_hist1;
-    int16_t prev2 = ent.m_ADPCMParms.dsp.m_hist2;
-    size_t outOff = 0;
-    while (remSamples > 0) {
-      int16_t decomp[kDSPFrameSamples] = {};
-      unsigned thisSamples = std::min(remSamples, kDSPFrameSamples);
-      DSPDecompressFrame(decomp, cur, ent.m_ADPCMParms.dsp.m_coefs,
-                         &prev1, &prev2, thisSamples);
-      std::memcpy(&out[outOff], decomp, thisSamples * sizeof(int16_t));
-      outOff += thisSamples;
-      remSamples -= thisSamples;
-      cur += kDSPFrameBytes;
-    }
-  } else if (fmt == SampleFormat::N64) {
-    uint32_t remSamples = numSamples;
-    /* N64: codebook is at the beginning of the sample data */
-    const unsigned char* cur = samp + sizeof(AudioGroupSampleDirectory::ADPCMParms::VADPCMParms);
-    size_t outOff = 0;
-    while (remSamples > 0) {
-      int16_t decomp[kN64FrameSamples] = {};
-      unsigned thisSamples = std::min(remSamples, kN64FrameSamples);
-      N64MusyXDecompressFrame(decomp, cur, ent.m_ADPCMParms.vadpcm.m_coefs,
-                              thisSamples);
-      std::memcpy(&out[outOff], decomp, thisSamples * sizeof(int16_t));
-      outOff += thisSamples;
-      remSamples -= thisSamples;
-      cur += kN64FrameBytes;
-    }
-  } else if (fmt == SampleFormat::PCM) {
+  if (fmt == SampleFormat::DSP || fmt == SampleFormat::DSP_DRUM || fmt == SampleFormat::N64) {
+    std::vector<int16_t> out = std::move(DecodedSampleCache::Decode(ent, samp)->m_pcm);
+    out.resize(numSamples);
+    return out;
+  }
+
+  std::vector<int16_t> out(numSamples);
+  if (fmt == SampleFormat::PCM) {
     /* Big-endian 16-bit PCM */
     const uint8_t* cur = samp;
     for (uint32_t i = 0; i < numSamples; ++i) {
@@ -707,6 +756,39 @@ static std::vector<int16_t> decodeSampleToPCM(
   return out;
 }
 
+/** Fetch the FluidSynth sample for `idx`, decoding it on first use.  Samples no
+ *  song ever starts are never decoded. */
+static fluid_sample_t* getFluidSample(MusyXSoundFontData& sf, size_t idx) {
+  std::lock_guard lk(sf.sampleLock);
+  DecodedSample& ds = sf.samples[idx];
+  if (ds.flSample)
+    return ds.flSample;
+
+  std::vector<int16_t> pcm = decodeSampleToPCM(*ds.entry, ds.data);
+  fluid_sample_t* flSamp = new_fluid_sample();
+  fluid_sample_set_name(flSamp, ds.name.c_str());
+  fluid_sample_set_sound_data(
+      flSamp,
+      pcm.data(),
+      nullptr,                          /* no 24-bit extension */
+      static_cast<unsigned int>(pcm.size()),
+      ds.sampleRate,
+      1 /* copy_data */);
+  /* Set sample root key.  fine_tune is 0 because MusyX samples do not
+   * carry per-sample sub-semitone tuning; fine-tuning is applied at the
+   * SoundMacro command level via SetNote/AddNote/LastNote/RndNote detune
+   * fields (±99 cents) and SetPitch (absolute Hz).  Those detune values
+   * are sent to FluidSynth as pitch bend events at playback time.
+   * SF2 allows ±100 cents fine-tune per sample, but MusyX has no
+   * equivalent stored metadata. */
+  fluid_sample_set_pitch(flSamp, ds.rootKey, 0);
+  if (ds.looped) {
+    fluid_sample_set_loop(flSamp, ds.loopStart, ds.loopEnd);
+  }
+  ds.flSample = flSamp;
+  return flSamp;
+}
+
 /* ── FluidSynth SoundFont loader callbacks ── */
 
 /* -- sfont callbacks -- */
@@ -769,10 +851,10 @@ static int musyx_preset_get_num(fluid_preset_t* preset) {
 static int musyx_preset_noteon(fluid_preset_t* preset, fluid_synth_t* synth,
                                 int chan, int key, int vel) {
   auto* d = static_cast<MusyXPresetData*>(fluid_preset_get_data(preset));
-  if (!d || !d->defaultSample)
+  if (!d || !d->owner)
     return FLUID_FAILED;
 
-  fluid_voice_t* voice = fluid_synth_alloc_voice(synth, d->defaultSample,
+  fluid_voice_t* voice = fluid_synth_alloc_voice(synth, getFluidSample(*d->owner, d->defaultSample),
                                                   chan, key, vel);
   if (!voice)
     return FLUID_FAILED;
@@ -888,10 +970,8 @@ struct FluidsyXApp {
   float volume = 0.8f;
 
   /* Active macro execution contexts (for timer-driven processing).
-   * Uses a map with stable integer IDs so that vector reallocation
-   * cannot invalidate references stored in timer events. */
-  std::map<int, MacroExecContext> activeMacros;
-  int nextMacroId = 0;
+   * Timer events and macro variables refer to them by their store ID. */
+  MacroContextStore activeMacros;
 
   /* Monotonic counter for unique voice IDs (passed to fluid_synth_start).
    * 0 is reserved as "not started". */
@@ -910,7 +990,7 @@ struct FluidsyXApp {
    *  so that voices receive a proper unique ID (set via nextVoiceId). */
   fluid_preset_t* dummyPreset = nullptr;
 
-  /* RNG */
+  /* RNG; reseeded from --seed (or a fixed seed when rendering) for reproducible output */
   std::mt19937 rng{std::random_device{}()};
 
   /* Selected song data (set from main() when a song is chosen) */
@@ -948,7 +1028,8 @@ struct FluidsyXApp {
   std::array<ChannelAdsrMapping, 16> channelAdsrMap = {};
 
   /* Pending SNG events dispatched via timer callbacks.
-   * Timer data encodes a negative index into this vector: data = -(1 + idx). */
+   * Timer data encodes a negative index into this vector: data = -(1 + idx).
+   * Slots are recycled through freeSngSlots once dispatched. */
   struct PendingSngNoteEvent {
     enum Type { NoteOn, NoteOff, ProgramChange, CC, WarmReset };
     Type     type;
@@ -957,10 +1038,21 @@ struct FluidsyXApp {
     uint8_t  velocity; /* also: CC value for Type::CC */
   };
   std::vector<PendingSngNoteEvent> pendingSngEvents;
+  std::vector<size_t> freeSngSlots;
+
+  /* The song is fed to the sequencer kSngLookaheadSec at a time; a refill
+   * timer (data = kSngRefillTimer) tops the window up before it drains, so
+   * the sequencer queue stays bounded regardless of song length or loops. */
+  static constexpr double kSngLookaheadSec = 0.5;
+  static constexpr intptr_t kSngRefillTimer = INTPTR_MIN;
+  SngEventStream sngStream;
+  unsigned int sngBaseTick = 0;
+  FluidEventPtr sngSchedEvt{nullptr, &delete_fluid_event};
 
   /* ── lifecycle helpers ── */
 
-  [[nodiscard]] bool initFluidSynth();
+  /** Create the synth and sequencer; \p audioDriver is false when rendering offline */
+  [[nodiscard]] bool initFluidSynth(bool audioDriver = true);
   void initCCDefault(const std::array<uint8_t, 134>& defaults);
   void shutdownFluidSynth();
 
@@ -968,12 +1060,22 @@ struct FluidsyXApp {
   [[nodiscard]] int selectGroup();
   const AudioGroupPool* findPoolForGroup();
 
+  /** Program the FluidSynth channels from the song's MIDI setup */
+  void applyMidiSetup(const SongGroupIndex& index);
   void songLoop(const SongGroupIndex& index);
   void sfxLoop(const SFXGroupIndex& index);
+  /** Render the selected song to \p writer without an audio driver, as fast as the CPU allows */
+  [[nodiscard]] bool renderSong(const SongGroupIndex& index, OfflinePCMWriter& writer);
 
-  /** Parse SNG song data and schedule all events on the FluidSynth sequencer.
+  /** Parse SNG song data and start streaming its events to the FluidSynth sequencer.
    *  Returns the total duration in SNG ticks, or 0 on failure. */
   [[nodiscard]] double scheduleSongEvents(const uint8_t* sngData, size_t sngSize);
+  /** Queue one SNG event on the sequencer at absolute tick \p tick */
+  void scheduleSngEvent(const SngEvent& e, unsigned int tick);
+  /** Queue the stream's events up to one look-ahead window past now and arm the next refill */
+  void refillSngWindow();
+  /** Drop the song stream and its pending events (sequencer events must be removed separately) */
+  void resetSngStream();
 
   /** Build a custom MusyX SoundFont from the parsed sample directory
    *  and pool, register it with FluidSynth. */
@@ -1153,7 +1255,7 @@ static void dummy_preset_free(fluid_preset_t* preset) {
 
 /* ═══════════════════ FluidSynth init / shutdown ═══════════════════ */
 
-bool FluidsyXApp::initFluidSynth() {
+bool FluidsyXApp::initFluidSynth(bool audioDriver) {
     modBlueprintADSR.reset(new_fluid_mod());
 
     /* VelToAttack modulator: velocity (GC) → GEN_VOLENVATTACK.
@@ -1218,6 +1320,9 @@ bool FluidsyXApp::initFluidSynth() {
   callbackSeqId = fluid_sequencer_register_client(
       sequencer.get(), "fluidsyX", &FluidsyXApp::timerCallback, this);
 
+  /* Offline rendering advances the sequencer from fluid_synth_write_float instead */
+  if (!audioDriver)
+    return true;
   adriver.reset(new_fluid_audio_driver(settings.get(), synth.get()));
   if (!adriver) {
     fmt::print(stderr, "fluidsyX: failed to create FluidSynth audio driver\n");
@@ -1250,14 +1355,24 @@ bool FluidsyXApp::loadMusyXData(const char* path) {
   fmt::print("fluidsyX: found '{}' Audio Group data\n",
          ContainerRegistry::TypeToName(cType));
 
-  data = ContainerRegistry::LoadContainer(path);
+  /* Parse every group's project, pool and sample directory concurrently */
+  AudioGroupLoader::Timing timing;
+  AudioGroupLoader::LoadedContainer loaded = AudioGroupLoader::LoadContainer(path, nullptr, &timing);
+  data = std::move(loaded.m_data);
   if (data.empty()) {
     fmt::print(stderr, "fluidsyX: no groups loaded from '{}'\n", path);
     return false;
   }
+  fmt::print("fluidsyX: loaded {} groups in {:.2f} ms (container {:.2f} ms, parse {:.2f} ms on {} threads; "
+             "proj {:.2f} ms, pool {:.2f} ms, sdir {:.2f} ms summed)\n",
+             timing.m_groups, (timing.m_container + timing.m_parse) * 1000.0, timing.m_container * 1000.0,
+             timing.m_parse * 1000.0, timing.m_threads, timing.m_proj * 1000.0, timing.m_pool * 1000.0,
+             timing.m_sdir * 1000.0);
 
-  for (auto& grp : data) {
-    projs.push_back(AudioGroupProject::CreateAudioGroupProject(grp.second));
+  for (size_t i = 0; i < data.size(); ++i) {
+    auto& grp = data[i];
+    AudioGroup& parsed = *loaded.m_groups[i];
+    projs.push_back(std::move(parsed.getProj()));
     AudioGroupProject& proj = projs.back();
     totalGroups += proj.sfxGroups().size() + proj.songGroups().size();
 
@@ -1267,11 +1382,9 @@ bool FluidsyXApp::loadMusyXData(const char* path) {
     for (const auto& [gid, entry] : proj.sfxGroups())
       allSFXGroups[gid] = std::make_pair(&grp, entry);
 
-    /* Also parse the pool so we can access SoundMacro commands */
-    pools.push_back(AudioGroupPool::CreateAudioGroupPool(grp.second));
-
-    /* Parse the sample directory */
-    sdirs.push_back(AudioGroupSampleDirectory::CreateAudioGroupSampleDirectory(grp.second));
+    /* Keep the pool so we can access SoundMacro commands, and the sample directory */
+    pools.push_back(std::move(parsed.getPool()));
+    sdirs.push_back(std::move(parsed.getSdir()));
   }
 
   return true;
@@ -1401,11 +1514,14 @@ bool FluidsyXApp::buildMusyXSoundFont() {
   const unsigned char* sampBase = selData->getSamp();
   if (!sampBase)
     return false;
+  /* Lazily decompressed N64 samples carry the codebooks the directory was parsed without */
+  if (selData->getLazySamp() && selData->getDataFormat() == DataFormat::N64)
+    sdir.loadN64ADPCMParms(sampBase);
 
   auto* sfData = new MusyXSoundFontData;
   sfData->name = "MusyX:" + data[dataIdx].first;
 
-  /* 1. Decode all samples to PCM and create fluid_sample_t objects */
+  /* 1. Index all samples; PCM is decoded when a voice first plays one */
   for (const auto& [sampleId, entry] : sdir.sampleEntries()) {
     if (!entry || !entry->m_data)
       continue;
@@ -1417,7 +1533,8 @@ bool FluidsyXApp::buildMusyXSoundFont() {
     DecodedSample ds;
     ds.id = sampleId;
     ds.name = "sample_" + std::to_string(sampleId.id);
-    ds.pcmData = decodeSampleToPCM(ent, sampBase);
+    ds.entry = &ent;
+    ds.data = sampBase + ent.m_sampleOff;
     ds.sampleRate = ent.m_sampleRate ? ent.m_sampleRate : 32000;
     ds.rootKey = ent.getPitch();
     ds.looped = ent.isLooped();
@@ -1425,75 +1542,48 @@ bool FluidsyXApp::buildMusyXSoundFont() {
       ds.loopStart = ent.getLoopStartSample();
       ds.loopEnd = ent.getLoopEndSample();
     }
-
-    /* Create FluidSynth sample */
-    fluid_sample_t* flSamp = new_fluid_sample();
-    fluid_sample_set_name(flSamp, ds.name.c_str());
-    fluid_sample_set_sound_data(
-        flSamp,
-        ds.pcmData.data(),
-        nullptr,                          /* no 24-bit extension */
-        static_cast<unsigned int>(ds.pcmData.size()),
-        ds.sampleRate,
-        1 /* copy_data */);
-    /* Set sample root key.  fine_tune is 0 because MusyX samples do not
-     * carry per-sample sub-semitone tuning; fine-tuning is applied at the
-     * SoundMacro command level via SetNote/AddNote/LastNote/RndNote detune
-     * fields (±99 cents) and SetPitch (absolute Hz).  Those detune values
-     * are sent to FluidSynth as pitch bend events at playback time.
-     * SF2 allows ±100 cents fine-tune per sample, but MusyX has no
-     * equivalent stored metadata. */
-    fluid_sample_set_pitch(flSamp, ds.rootKey, 0);
-    if (ds.looped) {
-      fluid_sample_set_loop(flSamp, ds.loopStart, ds.loopEnd);
-    }
-    ds.flSample = flSamp;
     sfData->sampleIndex[sampleId.id] = sfData->samples.size();
     sfData->samples.push_back(std::move(ds));
   }
 
-  fmt::print("fluidsyX: decoded {} samples from MusyX data\n",
+  fmt::print("fluidsyX: indexed {} samples from MusyX data (decoded on first use)\n",
          sfData->samples.size());
 
   /* 2. Build presets from the group's page entries or SFX entries.
    *    For each program number, find the SoundMacro, scan for the first
-   *    CmdStartSample, and map it to the decoded fluid_sample_t. */
+   *    CmdStartSample, and map it to the indexed sample. */
 
-  auto findFirstSampleInMacro = [&](const SoundMacro* sm) -> fluid_sample_t* {
+  auto findFirstSampleInMacro = [&](const SoundMacro* sm) -> std::optional<size_t> {
     if (!sm)
-      return nullptr;
+      return std::nullopt;
     for (const auto& cmd : sm->m_cmds) {
       if (cmd->Isa() == SoundMacro::CmdOp::StartSample) {
         auto& startCmd = static_cast<const SoundMacro::CmdStartSample&>(*cmd);
         auto sIt = sfData->sampleIndex.find(startCmd.sample.id.id);
         if (sIt != sfData->sampleIndex.end())
-          return sfData->samples[sIt->second].flSample;
+          return sIt->second;
       }
     }
-    return nullptr;
+    return std::nullopt;
   };
 
   auto addPresetForMacro = [&](int program, const SoundMacro* sm) {
-    fluid_sample_t* flSamp = findFirstSampleInMacro(sm);
-    if (!flSamp)
+    std::optional<size_t> sampleIdx = findFirstSampleInMacro(sm);
+    if (!sampleIdx)
       return;
 
-    /* Find sample metadata for loop info */
     MusyXPresetData pd;
     pd.bank = 0;
     pd.program = program;
-    pd.defaultSample = flSamp;
-
-    /* Look up decoded sample for metadata */
-    for (const auto& ds : sfData->samples) {
-      if (ds.flSample == flSamp) {
-        pd.rootKey = ds.rootKey;
-        pd.looped = ds.looped;
-        pd.loopStart = ds.loopStart;
-        pd.loopEnd = ds.loopEnd;
-        break;
-      }
-    }
+    pd.owner = sfData;
+    pd.defaultSample = *sampleIdx;
+
+    /* Sample metadata for loop info */
+    const DecodedSample& ds = sfData->samples[*sampleIdx];
+    pd.rootKey = ds.rootKey;
+    pd.looped = ds.looped;
+    pd.loopStart = ds.loopStart;
+    pd.loopEnd = ds.loopEnd;
     sfData->presets.push_back(pd);
   };
 
@@ -2142,9 +2232,8 @@ unsigned int SoundMacro::CmdStartSample::DoFluid(MacroExecContext& ctx, fluid_vo
   if (app->musyxSfData) {
     auto sIt = app->musyxSfData->sampleIndex.find(sample.id.id);
     if (sIt != app->musyxSfData->sampleIndex.end()) {
-      auto& ds = app->musyxSfData->samples[sIt->second];
-      flSamp = ds.flSample;
-      looped = ds.looped;
+      flSamp = getFluidSample(*app->musyxSfData, sIt->second);
+      looped = app->musyxSfData->samples[sIt->second].looped;
     }
   }
   if (flSamp && app->dummyPreset) {
@@ -2200,12 +2289,12 @@ unsigned int SoundMacro::CmdSendKeyOff::DoFluid(MacroExecContext& ctx, fluid_voi
     targetMacroId = ctx.vars[variable & 0x1f];
   }
   if (targetMacroId >= 0) {
-    auto childIt = app->activeMacros.find(targetMacroId);
-    if (childIt != app->activeMacros.end() && !childIt->second.ended) {
+    MacroExecContext* child = app->activeMacros.find(targetMacroId);
+    if (child && !child->ended) {
       fmt::print(stderr, "fluidsyX: sending key off to foreign macro ID {} on ch {} (lastStarted={}, var={})\n",
               targetMacroId, ctx.channel, lastStarted, variable & 0x1f);
-      releaseVoice(app->synth.get(), childIt->second);
-      childIt->second.keyoffReceived = true;
+      releaseVoice(app->synth.get(), *child);
+      child->keyoffReceived = true;
     } else {
       fmt::print(stderr, "fluidsyX: warning: SendKeyOff target macro ID {} not found or already ended (lastStarted={}, var={})\n",
               targetMacroId, lastStarted, variable & 0x1f);
@@ -2806,6 +2895,8 @@ unsigned int FluidsyXApp::processMacroCmd(MacroExecContext& ctx,
                cmd.formatMacroCmd(curTick));
 
   fluid_voice_t* v = getActiveVoice(synth.get(), ctx);
+  if (const SoundMacro::Program* prog = ctx.macro->program())
+    return prog->execFluid(ctx.pc, ctx, v);
   return cmd.DoFluid(ctx, v);
 }
 
@@ -2902,16 +2993,20 @@ int FluidsyXApp::enqueueSoundMacro(const SoundMacro* sm, int step,
     if (ctx.inIndefiniteWait) {
       /* Indefinite wait – store context but do NOT schedule a timer.
        * The macro will be resumed by an external event (keyoff, sampleEnd). */
-      int macroId = nextMacroId++;
-      activeMacros[macroId] = ctx;
+      int macroId = activeMacros.insert(ctx);
+      if (macroId < 0)
+        fmt::print(stderr, "fluidsyX: warning: too many active macros, dropping macro state\n");
       return macroId;
     }
     tick += d;
     safetyCounter++;
     if (d > 0 && !ctx.ended) {
-      /* Store context in the stable map and schedule a timer callback */
-      int macroId = nextMacroId++;
-      activeMacros[macroId] = ctx;
+      /* Store context in the slot store and schedule a timer callback */
+      int macroId = activeMacros.insert(ctx);
+      if (macroId < 0) {
+        fmt::print(stderr, "fluidsyX: warning: too many active macros, dropping macro state\n");
+        return -1;
+      }
 
       FluidEventPtr tevt(new_fluid_event(), &delete_fluid_event);
       fluid_event_set_source(tevt.get(), callbackSeqId);
@@ -2936,13 +3031,19 @@ void FluidsyXApp::timerCallback(unsigned int time, fluid_event_t* event,
 
   intptr_t rawData = reinterpret_cast<intptr_t>(fluid_event_get_data(event));
 
+  if (rawData == kSngRefillTimer) {
+    app->refillSngWindow();
+    return;
+  }
+
   if (rawData < 0) {
     /* ── SNG event dispatch ── */
     size_t idx = static_cast<size_t>(-(rawData + 1));
     if (idx >= app->pendingSngEvents.size())
       return;
 
-    const auto& sngEvt = app->pendingSngEvents[idx];
+    const PendingSngNoteEvent sngEvt = app->pendingSngEvents[idx];
+    app->freeSngSlots.push_back(idx);
     switch (sngEvt.type) {
     case PendingSngNoteEvent::NoteOn:
       app->resolveAndEnqueueNote(sngEvt.channel, sngEvt.note,
@@ -2961,44 +3062,42 @@ void FluidsyXApp::timerCallback(unsigned int time, fluid_event_t* event,
        * If no trap: _macroKeyOff() → _doKeyOff() → ADSR release +
        * keyoffNotify (sets m_keyoff flag so waiting macros can resume). */
       uint8_t ch = sngEvt.channel;
-      uint8_t note = sngEvt.note;
-      for (auto& [id, mctx] : app->activeMacros) {
-        if (mctx.channel == ch && mctx.triggerNote == note && !mctx.ended && !mctx.keyoffReceived) {
-          if (mctx.keyoffTrap.isSet()) {
-            /* musyx macSetExternalKeyoff sets cFlags|=8 (keyoff received) BEFORE
-             * calling ExecuteTrap, so the trap macro has full awareness. */
-            mctx.keyoffReceived = true;
-            /* Trap is registered — redirect execution instead of releasing. */
-            if (app->executeTrap(mctx, mctx.keyoffTrap, time)) {
-              /* Schedule timer to continue macro execution from trap target */
-              FluidEventPtr resumeEvt(new_fluid_event(), &delete_fluid_event);
-              fluid_event_set_source(resumeEvt.get(), app->callbackSeqId);
-              fluid_event_set_dest(resumeEvt.get(), app->callbackSeqId);
-              fluid_event_timer(resumeEvt.get(), reinterpret_cast<void*>(
-                  static_cast<intptr_t>(id)));
-              fluid_sequencer_send_now(app->sequencer.get(), resumeEvt.get());
-            }
-          } else {
-            /* No trap — normal keyoff behavior. */
-            releaseVoice(app->synth.get(), mctx);
-            mctx.keyoffReceived = true;
-
-            /* If the macro is waiting for keyoff (either indefinite or timed),
-             * schedule a timer to resume it now so it can break out of the
-             * wait early (original amuse: m_keyoff → m_inWait = false). */
-            if (mctx.waitingKeyoff) {
-              mctx.inIndefiniteWait = false;
-              mctx.waitingKeyoff = false;
-              FluidEventPtr resumeEvt(new_fluid_event(), &delete_fluid_event);
-              fluid_event_set_source(resumeEvt.get(), app->callbackSeqId);
-              fluid_event_set_dest(resumeEvt.get(), app->callbackSeqId);
-              fluid_event_timer(resumeEvt.get(), reinterpret_cast<void*>(
-                  static_cast<intptr_t>(id)));
-              fluid_sequencer_send_now(app->sequencer.get(), resumeEvt.get());
-            }
+      uint8_t note = static_cast<uint8_t>(sngEvt.note);
+      int id = -1;
+      if (MacroExecContext* target = app->activeMacros.findNoteOffTarget(ch, note, id)) {
+        MacroExecContext& mctx = *target;
+        if (mctx.keyoffTrap.isSet()) {
+          /* musyx macSetExternalKeyoff sets cFlags|=8 (keyoff received) BEFORE
+           * calling ExecuteTrap, so the trap macro has full awareness. */
+          mctx.keyoffReceived = true;
+          /* Trap is registered — redirect execution instead of releasing. */
+          if (app->executeTrap(mctx, mctx.keyoffTrap, time)) {
+            /* Schedule timer to continue macro execution from trap target */
+            FluidEventPtr resumeEvt(new_fluid_event(), &delete_fluid_event);
+            fluid_event_set_source(resumeEvt.get(), app->callbackSeqId);
+            fluid_event_set_dest(resumeEvt.get(), app->callbackSeqId);
+            fluid_event_timer(resumeEvt.get(), reinterpret_cast<void*>(
+                static_cast<intptr_t>(id)));
+            fluid_sequencer_send_now(app->sequencer.get(), resumeEvt.get());
+          }
+        } else {
+          /* No trap — normal keyoff behavior. */
+          releaseVoice(app->synth.get(), mctx);
+          mctx.keyoffReceived = true;
+
+          /* If the macro is waiting for keyoff (either indefinite or timed),
+           * schedule a timer to resume it now so it can break out of the
+           * wait early (original amuse: m_keyoff → m_inWait = false). */
+          if (mctx.waitingKeyoff) {
+            mctx.inIndefiniteWait = false;
+            mctx.waitingKeyoff = false;
+            FluidEventPtr resumeEvt(new_fluid_event(), &delete_fluid_event);
+            fluid_event_set_source(resumeEvt.get(), app->callbackSeqId);
+            fluid_event_set_dest(resumeEvt.get(), app->callbackSeqId);
+            fluid_event_timer(resumeEvt.get(), reinterpret_cast<void*>(
+                static_cast<intptr_t>(id)));
+            fluid_sequencer_send_now(app->sequencer.get(), resumeEvt.get());
           }
-          // key off processed for this macro, stop processing here
-          break;
         }
       }
       break;
@@ -3031,13 +3130,13 @@ void FluidsyXApp::timerCallback(unsigned int time, fluid_event_t* event,
 
   /* ── Macro timer resume (existing behavior) ── */
   int macroId = static_cast<int>(rawData);
-  auto it = app->activeMacros.find(macroId);
-  if (it == app->activeMacros.end())
+  MacroExecContext* found = app->activeMacros.find(macroId);
+  if (!found)
     return;
 
-  MacroExecContext& ctx = it->second;
+  MacroExecContext& ctx = *found;
   if (ctx.ended) {
-    app->activeMacros.erase(it);
+    app->activeMacros.erase(macroId);
     return;
   }
 
@@ -3065,7 +3164,7 @@ void FluidsyXApp::timerCallback(unsigned int time, fluid_event_t* event,
 
   /* If the macro ended, clean it up */
   if (ctx.ended)
-    app->activeMacros.erase(it);
+    app->activeMacros.erase(macroId);
 }
 
 /* ═══════════════════ SNG → FluidSynth sequencer scheduling ═══════════════════ */
@@ -3080,7 +3179,8 @@ double FluidsyXApp::scheduleSongEvents(const uint8_t* sngData, size_t /*sngSize*
   fmt::print("fluidsyX: SNG version {} ({}-endian)\n", sngVersion,
          bigEndian ? "big" : "little");
 
-  std::vector<SngEvent> events;
+  resetSngStream();
+  std::vector<SngEvent>& events = sngStream.events;
   double initialScale = 1000.0;
   std::vector<SngTrackLoop> trackLoops;
   if (!parseSngEvents(sngData, bigEndian, sngVersion, events, initialScale,
@@ -3106,69 +3206,12 @@ double FluidsyXApp::scheduleSongEvents(const uint8_t* sngData, size_t /*sngSize*
    * scheduling FLUID_SEQ_SCALE events that adjust the time-scale. */
   fluid_sequencer_set_time_scale(sequencer.get(), initialScale);
 
-  unsigned int baseTick = fluid_sequencer_get_tick(sequencer.get());
-
-  /* Clear any pending SNG events from a previous playback */
-  pendingSngEvents.clear();
-
-  FluidEventPtr evt(new_fluid_event(), &delete_fluid_event);
-  fluid_event_set_source(evt.get(), -1);
-
-  /* Helper: schedule a single SngEvent at (baseTick + tickOffset). */
-  auto scheduleOne = [&](const SngEvent& e, uint32_t tickOffset) {
-    unsigned int schedTick = baseTick + tickOffset;
-
-    switch (e.type) {
-    case SngEvent::NoteOn:
-    case SngEvent::NoteOff:
-    case SngEvent::CC:
-    case SngEvent::WarmReset:
-    case SngEvent::Program: {
-      /* Route through timer callback */
-      PendingSngNoteEvent::Type t;
-      uint16_t d1 = e.data1;
-      uint8_t  d2 = e.data2;
-      switch (e.type) {
-      case SngEvent::NoteOn:  t = PendingSngNoteEvent::NoteOn; break;
-      case SngEvent::NoteOff: t = PendingSngNoteEvent::NoteOff; d2 = 0; break;
-      case SngEvent::CC:      t = PendingSngNoteEvent::CC; break;
-      case SngEvent::WarmReset: t = PendingSngNoteEvent::WarmReset; d1 = d2 = 0; break;
-      default:                t = PendingSngNoteEvent::ProgramChange; d2 = 0; break;
-      }
-      size_t idx = pendingSngEvents.size();
-      pendingSngEvents.push_back({t, e.channel, d1, d2});
-      intptr_t timerData = -(static_cast<intptr_t>(idx) + 1);
-
-      fluid_event_set_dest(evt.get(), callbackSeqId);
-      fluid_event_timer(evt.get(), reinterpret_cast<void*>(timerData));
-      fluid_sequencer_send_at(sequencer.get(), evt.get(), schedTick, /*absolute=*/1);
-      break;
-    }
-
-    case SngEvent::PitchBend:
-      fluid_event_set_dest(evt.get(), synthSeqId);
-      fluid_event_pitch_bend(evt.get(), e.channel, e.pitchBend14);
-      fluid_sequencer_send_at(sequencer.get(), evt.get(), schedTick, /*absolute=*/1);
-      break;
-
-    case SngEvent::Tempo:
-      fluid_event_set_dest(evt.get(), synthSeqId);
-      fluid_event_scale(evt.get(), e.tempoScale);
-      fluid_sequencer_send_at(sequencer.get(), evt.get(), schedTick, /*absolute=*/1);
-      break;
-    case SngEvent::AllNotesOff:
-      fluid_event_set_dest(evt.get(), synthSeqId);
-      fluid_event_all_notes_off(evt.get(), e.channel);
-      fluid_sequencer_send_at(sequencer.get(), evt.get(), schedTick, /*absolute=*/1);
-      break;
-    }
-  };
-
+  /* All parsed events play once at their native tick positions */
   uint32_t lastTick = 0;
-
-  /* Schedule all parsed events at their native tick positions */
+  SngEventStream::Source& base = sngStream.sources.emplace_back();
+  base.events.reserve(events.size());
   for (const auto& e : events) {
-    scheduleOne(e, e.absTick);
+    base.events.push_back(&e);
     if (e.absTick > lastTick)
       lastTick = e.absTick;
   }
@@ -3179,14 +3222,15 @@ double FluidsyXApp::scheduleSongEvents(const uint8_t* sngData, size_t /*sngSize*
    *
    * In amuse, Track::advance() calls resetTempo() when a track loops,
    * causing the tempo table to be re-traversed on each loop iteration.
-   * We mirror this by also rescheduling tempo events (trackIdx == -1)
+   * We mirror this by also repeating tempo events (trackIdx == -1)
    * within each loop iteration — using the longest loop period so that
    * tempo changes are replayed consistently.
    *
    * This mirrors amuse's SongState::Track::advance() where each track
-   * checks its own loop marker independently. */
+   * checks its own loop marker independently.  Repetitions are generated
+   * by the stream as playback reaches them, up to maxDurationTicks. */
   if (!trackLoops.empty() && maxDurationTicks > 0 && lastTick < maxDurationTicks) {
-    /* Collect global tempo events for rescheduling with loop iterations. */
+    sngStream.maxTick = maxDurationTicks;
     uint32_t maxLoopEndTick = 0;
     uint32_t maxLoopStartTick = 0;
     for (const auto& tl : trackLoops) {
@@ -3196,90 +3240,167 @@ double FluidsyXApp::scheduleSongEvents(const uint8_t* sngData, size_t /*sngSize*
       }
     }
     uint32_t maxLoopLen = maxLoopEndTick - maxLoopStartTick;
+    std::optional<uint32_t> tempoLastTick;
 
-    std::vector<const SngEvent*> tempoEvents;
-    if (maxLoopLen > 0) {
-      for (const auto& e : events) {
-        if (e.trackIdx == -1 && e.type == SngEvent::Tempo &&
-            e.absTick >= maxLoopStartTick && e.absTick < maxLoopEndTick)
-          tempoEvents.push_back(&e);
-      }
-    }
+    /* Number of loop bodies starting before maxDurationTicks */
+    auto iterationsFrom = [&](uint32_t firstBase, uint32_t loopLen) -> uint32_t {
+      if (firstBase >= maxDurationTicks)
+        return 0;
+      return (maxDurationTicks - firstBase + loopLen - 1) / loopLen;
+    };
 
-    /* For each track with a loop, collect its events and re-schedule */
     for (const auto& tl : trackLoops) {
       uint32_t loopLen = tl.loopEndTick - tl.loopStartTick;
       if (loopLen == 0)
         continue;
+      if (tl.loopEndTick > lastTick)
+        lastTick = tl.loopEndTick;
 
-      /* Collect events belonging to this track within the loop body */
-      std::vector<const SngEvent*> loopEvents;
+      /* This track's events within the loop body */
+      SngEventStream::Source src;
       for (const auto& e : events) {
         if (e.trackIdx == tl.trackIdx &&
             e.absTick >= tl.loopStartTick &&
             e.absTick < tl.loopEndTick)
-          loopEvents.push_back(&e);
-      }
-
-      /* Re-schedule this track's loop body independently */
-      unsigned int loopIter = 0;
-      uint32_t trackLastTick = tl.loopEndTick;
-      while (trackLastTick < maxDurationTicks) {
-        uint32_t iterBase = tl.loopEndTick + loopLen * loopIter;
-        if (iterBase >= maxDurationTicks)
-          break;
-        for (const auto* ep : loopEvents) {
-          uint32_t relTick = ep->absTick - tl.loopStartTick;
-          uint32_t newTick = iterBase + relTick;
-          if (newTick >= maxDurationTicks)
-            break;
-          scheduleOne(*ep, newTick);
-          if (newTick > trackLastTick)
-            trackLastTick = newTick;
-        }
-        ++loopIter;
+          src.events.push_back(&e);
       }
-      if (trackLastTick > lastTick)
-        lastTick = trackLastTick;
-      fmt::print("fluidsyX: track {} (ch {}): looped {} iterations to {} ticks "
-                 "(body {} ticks)\n",
-             tl.trackIdx, tl.channel, loopIter, trackLastTick, loopLen);
+      fmt::print("fluidsyX: track {} (ch {}): looping {} iterations (body {} ticks)\n",
+             tl.trackIdx, tl.channel, iterationsFrom(tl.loopEndTick, loopLen), loopLen);
+      if (src.events.empty())
+        continue;
+      src.loopStart = tl.loopStartTick;
+      src.loopLen = loopLen;
+      src.firstBase = tl.loopEndTick;
+      src.trackIdx = tl.trackIdx;
+      src.channel = tl.channel;
+      sngStream.sources.push_back(std::move(src));
     }
 
-    /* Reschedule tempo events at the longest loop period.  In amuse,
+    /* Repeat tempo events at the longest loop period.  In amuse,
      * resetTempo() resets the tempo pointer so changes replay on each
-     * loop iteration.  We reschedule them at maxLoopLen intervals. */
-    if (maxLoopLen > 0 && !tempoEvents.empty()) {
-      unsigned int tempoIter = 0;
-      uint32_t tempoLastTick = maxLoopEndTick;
-      while (tempoLastTick < maxDurationTicks) {
-        uint32_t iterBase = maxLoopEndTick + maxLoopLen * tempoIter;
-        if (iterBase >= maxDurationTicks)
-          break;
-        for (const auto* ep : tempoEvents) {
-          uint32_t relTick = ep->absTick - maxLoopStartTick;
-          uint32_t newTick = iterBase + relTick;
-          if (newTick >= maxDurationTicks)
-            break;
-          scheduleOne(*ep, newTick);
-        }
-        /* Advance trackLastTick by one full loop body regardless of how many
-         * events were actually scheduled, ensuring the while-loop terminates
-         * even if no tempo events fall below maxDurationTicks. */
-        tempoLastTick = iterBase + maxLoopLen;
-        ++tempoIter;
+     * loop iteration. */
+    if (maxLoopLen > 0) {
+      SngEventStream::Source src;
+      for (const auto& e : events) {
+        if (e.trackIdx == -1 && e.type == SngEvent::Tempo &&
+            e.absTick >= maxLoopStartTick && e.absTick < maxLoopEndTick)
+          src.events.push_back(&e);
+      }
+      if (!src.events.empty()) {
+        /* Tempo repetitions extend the song by whole loop bodies */
+        tempoLastTick = maxLoopEndTick + maxLoopLen * iterationsFrom(maxLoopEndTick, maxLoopLen);
+        src.loopStart = maxLoopStartTick;
+        src.loopLen = maxLoopLen;
+        src.firstBase = maxLoopEndTick;
+        sngStream.sources.push_back(std::move(src));
       }
-      if (tempoLastTick > lastTick)
-        lastTick = std::min(tempoLastTick, maxDurationTicks);
     }
+
+    /* The last repetition of each track bounds the song length */
+    SngEventStream dryRun;
+    dryRun.sources = sngStream.sources;
+    dryRun.maxTick = sngStream.maxTick;
+    dryRun.advance(UINT32_MAX, [](const SngEvent&, uint32_t) {});
+    for (const auto& src : dryRun.sources)
+      if (src.loopLen != 0 && src.trackIdx != -1 && src.lastTick > lastTick)
+        lastTick = src.lastTick;
+    if (tempoLastTick && *tempoLastTick > lastTick)
+      lastTick = std::min(*tempoLastTick, maxDurationTicks);
   }
 
-  fmt::print("fluidsyX: scheduled {} SNG ticks of song data ({} SNG events, "
-         "{} routed through SoundMacro)\n",
-         lastTick, events.size(), pendingSngEvents.size());
+  if (!sngSchedEvt)
+    sngSchedEvt.reset(new_fluid_event());
+  fluid_event_set_source(sngSchedEvt.get(), -1);
+  sngBaseTick = fluid_sequencer_get_tick(sequencer.get());
+  refillSngWindow();
+
+  fmt::print("fluidsyX: streaming {} SNG ticks of song data ({} SNG events, {:.0f} ms look-ahead)\n",
+         lastTick, events.size(), kSngLookaheadSec * 1000.0);
   return static_cast<double>(lastTick);
 }
 
+void FluidsyXApp::scheduleSngEvent(const SngEvent& e, unsigned int schedTick) {
+  fluid_event_t* evt = sngSchedEvt.get();
+
+  switch (e.type) {
+  case SngEvent::NoteOn:
+  case SngEvent::NoteOff:
+  case SngEvent::CC:
+  case SngEvent::WarmReset:
+  case SngEvent::Program: {
+    /* Route through timer callback */
+    PendingSngNoteEvent::Type t;
+    uint16_t d1 = e.data1;
+    uint8_t  d2 = e.data2;
+    switch (e.type) {
+    case SngEvent::NoteOn:  t = PendingSngNoteEvent::NoteOn; break;
+    case SngEvent::NoteOff: t = PendingSngNoteEvent::NoteOff; d2 = 0; break;
+    case SngEvent::CC:      t = PendingSngNoteEvent::CC; break;
+    case SngEvent::WarmReset: t = PendingSngNoteEvent::WarmReset; d1 = d2 = 0; break;
+    default:                t = PendingSngNoteEvent::ProgramChange; d2 = 0; break;
+    }
+    size_t idx;
+    if (!freeSngSlots.empty()) {
+      idx = freeSngSlots.back();
+      freeSngSlots.pop_back();
+      pendingSngEvents[idx] = {t, e.channel, d1, d2};
+    } else {
+      idx = pendingSngEvents.size();
+      pendingSngEvents.push_back({t, e.channel, d1, d2});
+    }
+    intptr_t timerData = -(static_cast<intptr_t>(idx) + 1);
+
+    fluid_event_set_dest(evt, callbackSeqId);
+    fluid_event_timer(evt, reinterpret_cast<void*>(timerData));
+    fluid_sequencer_send_at(sequencer.get(), evt, schedTick, /*absolute=*/1);
+    break;
+  }
+
+  case SngEvent::PitchBend:
+    fluid_event_set_dest(evt, synthSeqId);
+    fluid_event_pitch_bend(evt, e.channel, e.pitchBend14);
+    fluid_sequencer_send_at(sequencer.get(), evt, schedTick, /*absolute=*/1);
+    break;
+
+  case SngEvent::Tempo:
+    fluid_event_set_dest(evt, synthSeqId);
+    fluid_event_scale(evt, e.tempoScale);
+    fluid_sequencer_send_at(sequencer.get(), evt, schedTick, /*absolute=*/1);
+    break;
+  case SngEvent::AllNotesOff:
+    fluid_event_set_dest(evt, synthSeqId);
+    fluid_event_all_notes_off(evt, e.channel);
+    fluid_sequencer_send_at(sequencer.get(), evt, schedTick, /*absolute=*/1);
+    break;
+  }
+}
+
+void FluidsyXApp::refillSngWindow() {
+  /* The window is measured at the current tempo; refilling at its midpoint
+   * leaves headroom for tempo increases inside it */
+  double scale = fluid_sequencer_get_time_scale(sequencer.get());
+  auto windowTicks = static_cast<uint32_t>(std::max(2.0, scale * kSngLookaheadSec));
+  unsigned int now = fluid_sequencer_get_tick(sequencer.get());
+  uint32_t endTick = (now - sngBaseTick) + windowTicks;
+
+  bool more = sngStream.advance(endTick, [this](const SngEvent& e, uint32_t tick) {
+    scheduleSngEvent(e, sngBaseTick + tick);
+  });
+  if (!more)
+    return;
+
+  fluid_event_t* evt = sngSchedEvt.get();
+  fluid_event_set_dest(evt, callbackSeqId);
+  fluid_event_timer(evt, reinterpret_cast<void*>(kSngRefillTimer));
+  fluid_sequencer_send_at(sequencer.get(), evt, sngBaseTick + endTick - windowTicks / 2, /*absolute=*/1);
+}
+
+void FluidsyXApp::resetSngStream() {
+  sngStream.clear();
+  pendingSngEvents.clear();
+  freeSngSlots.clear();
+}
+
 /* ═══════════════════ Song playback loop ═══════════════════ */
 
 void FluidsyXApp::initCCDefault(const std::array<uint8_t, 134>& defaults)
@@ -3548,6 +3669,25 @@ private:
 
 /* ═══════════════════ Song playback loop ═══════════════════ */
 
+void FluidsyXApp::applyMidiSetup(const SongGroupIndex& index) {
+  auto setupIt = index.m_midiSetups.find(setupId);
+  if (setupIt == index.m_midiSetups.end())
+    return;
+  const auto& midiSetup = setupIt->second;
+
+  // Init all CCs to their default "cold" values
+  initCCDefault(inpColdMIDIDefaults);
+
+  for (int ch = 0; ch < 16; ++ch) {
+    channelPrograms[ch] = midiSetup[ch].programNo;
+    fluid_synth_program_change(synth.get(), ch, midiSetup[ch].programNo);
+    fluid_synth_cc(synth.get(), ch, 7, midiSetup[ch].volume);
+    fluid_synth_cc(synth.get(), ch, 10, midiSetup[ch].panning);
+    fluid_synth_cc(synth.get(), ch, 91, midiSetup[ch].reverb);
+    fluid_synth_cc(synth.get(), ch, 93, midiSetup[ch].chorus);
+  }
+}
+
 void FluidsyXApp::songLoop(const SongGroupIndex& index) {
   /* Store a reference to the SongGroupIndex so that timer callbacks can
    * resolve note events through the page→keymap/layer→SoundMacro chain. */
@@ -3571,25 +3711,7 @@ void FluidsyXApp::songLoop(const SongGroupIndex& index) {
 
     /* Apply the MIDI setup for the selected song to FluidSynth channels */
     setupId = ui.currentId();
-    std::map<SongId, std::array<SongGroupIndex::MIDISetup, 16>> sortEntries(
-        index.m_midiSetups.cbegin(), index.m_midiSetups.cend());
-
-    auto setupIt = sortEntries.find(setupId);
-    if (setupIt != sortEntries.end()) {
-      const auto& midiSetup = setupIt->second;
-
-      // Init all CCs to their default "cold" values
-      initCCDefault(inpColdMIDIDefaults);
-
-      for (int ch = 0; ch < 16; ++ch) {
-        channelPrograms[ch] = midiSetup[ch].programNo;
-        fluid_synth_program_change(synth.get(), ch, midiSetup[ch].programNo);
-        fluid_synth_cc(synth.get(), ch, 7, midiSetup[ch].volume);
-        fluid_synth_cc(synth.get(), ch, 10, midiSetup[ch].panning);
-        fluid_synth_cc(synth.get(), ch, 91, midiSetup[ch].reverb);
-        fluid_synth_cc(synth.get(), ch, 93, midiSetup[ch].chorus);
-      }
-    }
+    applyMidiSetup(index);
 
     /* Schedule all song events on the FluidSynth sequencer */
     if (!selectedSong) {
@@ -3643,7 +3765,7 @@ void FluidsyXApp::songLoop(const SongGroupIndex& index) {
         for (int c = 0; c < 16; ++c)
           fluid_synth_all_notes_off(synth.get(), c);
         activeMacros.clear();
-        pendingSngEvents.clear();
+        resetSngStream();
         setupId = ui.currentId();
         songFinished = false;
         break;
@@ -3663,11 +3785,71 @@ void FluidsyXApp::songLoop(const SongGroupIndex& index) {
   for (int c = 0; c < 16; ++c)
     fluid_synth_all_notes_off(synth.get(), c);
   activeMacros.clear();
-  pendingSngEvents.clear();
+  resetSngStream();
   activeSongGroup = nullptr;
   fmt::print("\n");
 }
 
+/* ═══════════════════ Offline song rendering ═══════════════════ */
+
+bool FluidsyXApp::renderSong(const SongGroupIndex& index, OfflinePCMWriter& writer) {
+  activeSongGroup = &index;
+  for (auto& m : channelAdsrMap)
+    m = {};
+  applyMidiSetup(index);
+
+  double totalTicks = scheduleSongEvents(selectedSong->m_data.get(), selectedSong->m_size);
+  if (totalTicks <= 0.0) {
+    fmt::print(stderr, "fluidsyX: no events to play\n");
+    activeSongGroup = nullptr;
+    return false;
+  }
+
+  /* Same end condition as songLoop: the song plus a two second tail */
+  unsigned int startTick = fluid_sequencer_get_tick(sequencer.get());
+  unsigned int endTick = startTick + static_cast<unsigned int>(totalTicks);
+  unsigned int tailEnd = endTick + static_cast<unsigned int>(fluid_sequencer_get_time_scale(sequencer.get()) * 2.0);
+
+  double sampleRate = 44100.0;
+  fluid_settings_getnum(settings.get(), "synth.sample-rate", &sampleRate);
+
+  /* Rendering the synth runs its sample timer, which processes the sequencer
+   * (and with it timerCallback) exactly as the audio driver would */
+  constexpr int kBlockFrames = 512;
+  std::vector<float> floatBuf(kBlockFrames * 2);
+  std::vector<int16_t> pcmBuf(kBlockFrames * 2);
+  uint64_t frames = 0;
+  auto startTime = std::chrono::steady_clock::now();
+  while (g_running.load() && fluid_sequencer_get_tick(sequencer.get()) < tailEnd) {
+    if (fluid_synth_write_float(synth.get(), kBlockFrames, floatBuf.data(), 0, 2, floatBuf.data(), 1, 2) !=
+        FLUID_OK) {
+      fmt::print(stderr, "fluidsyX: synthesis failed\n");
+      break;
+    }
+    for (size_t i = 0; i < floatBuf.size(); ++i)
+      pcmBuf[i] = static_cast<int16_t>(std::lround(std::clamp(floatBuf[i], -1.f, 1.f) * 32767.f));
+    writer.write(pcmBuf.data(), kBlockFrames);
+    frames += kBlockFrames;
+    if ((frames / kBlockFrames) % 200 == 0) {
+      fmt::print("\rFrame {}", frames);
+      fflush(stdout);
+    }
+  }
+
+  const double wallSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  const double audioSecs = static_cast<double>(frames) / sampleRate;
+  fmt::print("\rFrame {}\n", frames);
+  fmt::print("fluidsyX: rendered {:.2f}s of audio in {:.2f}s ({:.1f}x realtime)\n", audioSecs, wallSecs,
+             wallSecs > 0.0 ? audioSecs / wallSecs : 0.0);
+
+  for (int c = 0; c < 16; ++c)
+    fluid_synth_all_notes_off(synth.get(), c);
+  activeMacros.clear();
+  resetSngStream();
+  activeSongGroup = nullptr;
+  return true;
+}
+
 /* ═══════════════════ SFX playback loop ═══════════════════ */
 
 void FluidsyXApp::sfxLoop(const SFXGroupIndex& index) {
@@ -3756,7 +3938,8 @@ int main(int argc, char** argv) {
 
   if (argc < 2) {
     fmt::print(stderr,
-            "Usage: fluidsyX [--verbose] [--duration <ticks>] <musyx-group-path> [<songs-file>] [soundfont.sf2]\n"
+            "Usage: fluidsyX [--verbose] [--duration <ticks>] [--render <out.wav>] [--seed <n>]\n"
+            "                <musyx-group-path> [<songs-file>] [soundfont.sf2]\n"
             "\n"
             "  Plays MusyX SoundMacro data using FluidSynth.\n"
             "  MusyX samples are decoded and loaded as a virtual SoundFont.\n"
@@ -3771,7 +3954,12 @@ int main(int argc, char** argv) {
             "                      commands are always logged regardless.\n"
             "  --duration <ticks>  Total playback duration in SNG ticks.\n"
             "                      When specified, the song loops until the\n"
-            "                      given tick count is reached.\n");
+            "                      given tick count is reached.\n"
+            "  --render <out.wav>  Render the selected song offline, faster than\n"
+            "                      realtime, without an audio device.  A .raw or\n"
+            "                      .pcm extension writes headerless PCM.\n"
+            "  --seed <n>          Seed for SoundMacro randomness (default: random\n"
+            "                      when playing, fixed when rendering).\n");
     return 1;
   }
 
@@ -3783,6 +3971,8 @@ int main(int argc, char** argv) {
   const char* groupPath = nullptr;
   const char* songsPath = nullptr;
   const char* sf2Path   = nullptr;
+  const char* renderPath = nullptr;
+  std::optional<uint32_t> seed;
 
   for (int i = 1; i < argc; ++i) {
     if (strcmp(argv[i], "--verbose") == 0) {
@@ -3801,6 +3991,25 @@ int main(int argc, char** argv) {
         fmt::print(stderr, "fluidsyX: --duration requires a value\n");
         return 1;
       }
+    } else if (strcmp(argv[i], "--render") == 0) {
+      if (i + 1 >= argc) {
+        fmt::print(stderr, "fluidsyX: --render requires an output path\n");
+        return 1;
+      }
+      renderPath = argv[++i];
+    } else if (strcmp(argv[i], "--seed") == 0) {
+      if (i + 1 >= argc) {
+        fmt::print(stderr, "fluidsyX: --seed requires a value\n");
+        return 1;
+      }
+      const char* arg = argv[++i];
+      char* end = nullptr;
+      unsigned long val = strtoul(arg, &end, 10);
+      if (end == arg || *end != '\0') {
+        fmt::print(stderr, "fluidsyX: --seed requires an unsigned integer (got '{}')\n", arg);
+        return 1;
+      }
+      seed = static_cast<uint32_t>(val);
     } else if (!groupPath) {
       groupPath = argv[i];
     } else if (fluid_is_soundfont(argv[i])) {
@@ -3903,8 +4112,19 @@ int main(int argc, char** argv) {
          app.groupId, app.sfxGroup ? "SFX" : "Song",
          app.activePool->soundMacros().size());
 
+  if (renderPath && (app.sfxGroup || !app.selectedSong)) {
+    fmt::print(stderr, "fluidsyX: --render requires a song to be selected\n");
+    return 1;
+  }
+  if (renderPath && !seed)
+    seed = std::mt19937::default_seed;
+  if (seed) {
+    app.rng.seed(*seed);
+    fmt::print("fluidsyX: RNG seed {}\n", *seed);
+  }
+
   /* 7. Initialise FluidSynth */
-  if (!app.initFluidSynth())
+  if (!app.initFluidSynth(!renderPath))
     return 1;
 
   /* 7a. Optionally load a SoundFont for audible output */
@@ -3930,7 +4150,28 @@ int main(int argc, char** argv) {
             "playback will use external SoundFont if available\n");
   }
 
-  /* 8. Enter playback loop */
+  /* 8. Render offline, or enter playback loop */
+  if (renderPath) {
+    std::string_view outPath(renderPath);
+    const bool rawOut = outPath.ends_with(".raw") || outPath.ends_with(".pcm");
+    double sampleRate = 44100.0;
+    fluid_settings_getnum(app.settings.get(), "synth.sample-rate", &sampleRate);
+    OfflinePCMWriter writer;
+    if (!writer.open(renderPath, static_cast<uint32_t>(sampleRate), 2, rawOut)) {
+      fmt::print(stderr, "fluidsyX: unable to open {} for writing\n", renderPath);
+      app.shutdownFluidSynth();
+      return 1;
+    }
+    fmt::print("fluidsyX: rendering to {}\n", renderPath);
+    bool rendered = false;
+    auto songIt = app.allSongGroups.find(app.groupId);
+    if (songIt != app.allSongGroups.end())
+      rendered = app.renderSong(*songIt->second.second, writer);
+    writer.close();
+    app.shutdownFluidSynth();
+    return rendered ? 0 : 1;
+  }
+
   if (app.sfxGroup) {
     auto sfxIt = app.allSFXGroups.find(app.groupId);
     if (sfxIt != app.allSFXGroups.end())
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "amuse/AudioGroupPool.hpp"
 #include "amuse/AudioGroupProject.hpp"
@@ -10,20 +13,28 @@
 
 namespace amuse {
 class AudioGroupData;
+class LazySampleChunk;
 class ProjectDatabase;
+class WorkerPool;
 
 /** Runtime audio group index container */
 class AudioGroup {
   friend class AudioGroupSampleDirectory;
+  friend class AudioGroupLoader;
 
 protected:
   AudioGroupProject m_proj;
   AudioGroupPool m_pool;
   AudioGroupSampleDirectory m_sdir;
-  const unsigned char* m_samp = nullptr;
+  mutable const unsigned char* m_samp = nullptr;
+  std::shared_ptr<LazySampleChunk> m_lazySamp; /* Compressed sample chunk, resolved into m_samp on first use */
+  mutable std::shared_ptr<unsigned char[]> m_sampHold;
+  bool m_lazyN64Parms = false;
   std::string m_groupPath; /* Typically only set by editor */
   bool m_valid;
 
+  void _assignSamp(const AudioGroupData& data);
+
 public:
   std::string getSampleBasePath(SampleId sfxId) const;
   explicit operator bool() const { return m_valid; }
@@ -37,13 +48,23 @@ public:
   void assign(const AudioGroup& data, std::string_view groupPath);
   void setGroupPath(std::string_view groupPath) { m_groupPath = groupPath; }
 
+  /** Sample chunk of a group built from AudioGroupData. Groups from AudioGroupLoader leave compressed
+   *  chunks compressed until this is first called (Engine::addAudioGroup or the first sample lookup),
+   *  then keep them resident for the lifetime of the group. */
+  const unsigned char* getSampData() const;
+
   const SampleEntry* getSample(SampleId sfxId) const;
   std::pair<ObjToken<SampleEntryData>, const unsigned char*> getSampleData(SampleId sfxId,
                                                                            const SampleEntry* sample) const;
   SampleFileState getSampleFileState(SampleId sfxId, const SampleEntry* sample, std::string* pathOut = nullptr) const;
   void patchSampleMetadata(SampleId sfxId, const SampleEntry* sample) const;
   void makeWAVVersion(SampleId sfxId, const SampleEntry* sample) const;
-  void makeCompressedVersion(SampleId sfxId, const SampleEntry* sample) const;
+  void makeCompressedVersion(SampleId sfxId, const SampleEntry* sample, WorkerPool* pool = nullptr) const;
+  /** Compress many samples concurrently on pool (a temporary pool when null); long samples in small
+   *  batches also spread their coefficient analysis across the pool. Files are identical to calling
+   *  makeCompressedVersion on each sample in turn. */
+  void makeCompressedVersions(const std::vector<std::pair<SampleId, const SampleEntry*>>& samples,
+                              WorkerPool* pool = nullptr) const;
   const AudioGroupProject& getProj() const { return m_proj; }
   const AudioGroupPool& getPool() const { return m_pool; }
   const AudioGroupSampleDirectory& getSdir() const { return m_sdir; }
@@ -1,11 +1,48 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 
 #include "amuse/Common.hpp"
 
 namespace amuse {
 
+/** Sample chunk kept compressed inside its container until its data is first needed.
+ *  Decompression runs once per residency, optionally ahead of time on a background thread, and the
+ *  decompressed buffer may be released again while no acquire() result holds it. */
+class LazySampleChunk {
+public:
+  using Decompressor = std::function<void(unsigned char* out, size_t outSz)>;
+
+private:
+  mutable std::mutex m_lock;
+  size_t m_size;
+  Decompressor m_decompress;
+  std::shared_ptr<unsigned char[]> m_data;
+  std::future<void> m_prefetch;
+
+public:
+  LazySampleChunk(size_t size, Decompressor decompress) : m_size(size), m_decompress(std::move(decompress)) {}
+  ~LazySampleChunk();
+  LazySampleChunk(const LazySampleChunk&) = delete;
+  LazySampleChunk& operator=(const LazySampleChunk&) = delete;
+
+  /** Decompressed chunk, decompressing it (or waiting on a prefetch) first; stays resident while held */
+  std::shared_ptr<unsigned char[]> acquire();
+  /** Decompressed chunk without holding it; valid until the next release() */
+  unsigned char* data() { return acquire().get(); }
+  /** Begin decompressing on a background thread; prefetch and release are called from the owning thread */
+  void prefetch();
+  /** Free the decompressed data unless an acquire() result still holds it; true if no longer resident */
+  bool release();
+  bool isResident() const;
+  size_t size() const { return m_size; }
+};
+
 /** Simple pointer-container of the four Audio Group chunks */
 class AudioGroupData {
   friend class Engine;
@@ -23,6 +60,8 @@ protected:
   DataFormat m_fmt;
   bool m_absOffs;
 
+  std::shared_ptr<LazySampleChunk> m_lazySamp; /**< Set instead of m_samp for compressed sample chunks */
+
   AudioGroupData(unsigned char* proj, size_t projSz, unsigned char* pool, size_t poolSz, unsigned char* sdir,
                  size_t sdirSz, unsigned char* samp, size_t sampSz, DataFormat fmt, bool absOffs)
   : m_proj(proj)
@@ -77,12 +116,13 @@ public:
   const unsigned char* getProj() const { return m_proj; }
   const unsigned char* getPool() const { return m_pool; }
   const unsigned char* getSdir() const { return m_sdir; }
-  const unsigned char* getSamp() const { return m_samp; }
+  /** Sample chunk; lazily loaded chunks are decompressed here if not resident */
+  const unsigned char* getSamp() const { return m_lazySamp ? m_lazySamp->data() : m_samp; }
 
   unsigned char* getProj() { return m_proj; }
   unsigned char* getPool() { return m_pool; }
   unsigned char* getSdir() { return m_sdir; }
-  unsigned char* getSamp() { return m_samp; }
+  unsigned char* getSamp() { return m_lazySamp ? m_lazySamp->data() : m_samp; }
 
   size_t getProjSize() const { return m_projSz; }
   size_t getPoolSize() const { return m_poolSz; }
@@ -90,18 +130,38 @@ public:
   size_t getSampSize() const { return m_sampSz; }
 
   explicit operator bool() const {
-    return m_proj != nullptr && m_pool != nullptr && m_sdir != nullptr && m_samp != nullptr;
+    return m_proj != nullptr && m_pool != nullptr && m_sdir != nullptr && (m_samp != nullptr || m_lazySamp);
   }
 
   DataFormat getDataFormat() const { return m_fmt; }
   bool getAbsoluteProjOffsets() const { return m_absOffs; }
+
+  /** Compressed sample chunk decompressed on demand, or null when the chunk is always resident */
+  const std::shared_ptr<LazySampleChunk>& getLazySamp() const { return m_lazySamp; }
+  bool isSampResident() const { return !m_lazySamp || m_lazySamp->isResident(); }
+  /** Start decompressing a lazily loaded sample chunk on a background thread */
+  void prefetchSamp() const {
+    if (m_lazySamp)
+      m_lazySamp->prefetch();
+  }
+  /** Free a lazily loaded sample chunk once no AudioGroup uses it (e.g. after Engine::removeAudioGroup);
+   *  true if it is no longer resident */
+  bool releaseSamp() const { return !m_lazySamp || m_lazySamp->release(); }
 };
 
-/** A buffer-owning version of AudioGroupData */
+/** A buffer-owning version of AudioGroupData.
+ *  Chunks may instead borrow storage held alive by a backing object (such as a MappedFile or a shared
+ *  decompression buffer); borrowed chunks are released with the backing rather than freed individually. */
 class IntrusiveAudioGroupData : public AudioGroupData {
   bool m_owns = true;
+  uint8_t m_borrowed = 0; /**< ChunkBits of chunks pointing into m_backing */
+  std::shared_ptr<const void> m_backing;
+
+  void _freeChunks();
 
 public:
+  enum ChunkBits : uint8_t { ProjChunk = 1, PoolChunk = 2, SdirChunk = 4, SampChunk = 8 };
+
   using AudioGroupData::AudioGroupData;
   ~IntrusiveAudioGroupData();
 
@@ -111,6 +171,19 @@ public:
   IntrusiveAudioGroupData(IntrusiveAudioGroupData&& other) noexcept;
   IntrusiveAudioGroupData& operator=(IntrusiveAudioGroupData&& other) noexcept;
 
+  /** Mark the chunks in borrowedChunks (ChunkBits) as pointing into backing, which is kept alive in their place */
+  void setBacking(std::shared_ptr<const void> backing, uint8_t borrowedChunks) {
+    m_backing = std::move(backing);
+    m_borrowed = borrowedChunks;
+  }
+  bool isChunkBorrowed(ChunkBits chunk) const { return (m_borrowed & chunk) != 0; }
+
+  /** Replace the sample chunk with one decompressed on demand */
+  void setLazySamp(std::shared_ptr<LazySampleChunk> samp) {
+    m_sampSz = samp->size();
+    m_lazySamp = std::move(samp);
+  }
+
   void dangleOwnership() { m_owns = false; }
 };
 } // namespace amuse
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "amuse/AudioGroup.hpp"
+#include "amuse/AudioGroupData.hpp"
+
+namespace amuse {
+class WorkerPool;
+
+/** Builds runtime AudioGroups for every group of a container, parsing the project,
+ *  pool and sample directory chunks of all groups as independent jobs on a WorkerPool */
+class AudioGroupLoader {
+public:
+  /** Seconds spent in each loading stage; per-chunk stages are summed over all groups and threads */
+  struct Timing {
+    double m_container = 0.0; /**< Reading and unpacking the container file (serial) */
+    double m_proj = 0.0;
+    double m_pool = 0.0;
+    double m_sdir = 0.0;
+    double m_parse = 0.0; /**< Wall-clock time of the concurrent parse */
+    unsigned m_threads = 1;
+    size_t m_groups = 0;
+  };
+
+  struct LoadedContainer {
+    std::vector<std::pair<std::string, IntrusiveAudioGroupData>> m_data;
+    std::vector<std::unique_ptr<AudioGroup>> m_groups; /**< Parsed groups, 1:1 with m_data */
+  };
+
+  /** Parse already-loaded container data; returns one AudioGroup per entry of `data`, referencing it.
+   *  A null pool parses with a temporary pool of HardwareThreads(). When the calling thread has ID name
+   *  databases installed (as the editor does), parsing runs serially so names register on that thread.
+   *  Lazily loaded sample chunks stay compressed until a group is added to an Engine or queried for samples.
+   *  SoundMacros are compiled for playback, so edit them through a separately loaded AudioGroupDatabase. */
+  static std::vector<std::unique_ptr<AudioGroup>>
+  ParseGroups(const std::vector<std::pair<std::string, IntrusiveAudioGroupData>>& data, WorkerPool* pool = nullptr,
+              Timing* timing = nullptr);
+
+  /** ContainerRegistry::LoadContainer followed by ParseGroups; empty on failure */
+  static LoadedContainer LoadContainer(const char* path, WorkerPool* pool = nullptr, Timing* timing = nullptr);
+};
+
+} // namespace amuse
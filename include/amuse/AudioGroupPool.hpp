@@ -92,8 +92,8 @@ struct SoundMacro {
     SetAgeCount,        /* unimplemented */
     SendFlag,           /* unimplemented */
     PitchWheelR,
-    SetPriority = 0x36, /* unimplemented */
-    AddPriority,        /* unimplemented */
+    SetPriority = 0x36,
+    AddPriority,
     AgeCntSpeed,        /* unimplemented */
     AgeCntVel,          /* unimplemented */
     VolSelect = 0x40,
@@ -1011,21 +1011,61 @@ struct SoundMacro {
   static std::string_view CmdOpToStr(CmdOp op);
   static CmdOp CmdStrToOp(std::string_view op);
 
+  /** Flat, devirtualized form of m_cmds built by compile() for the interpreters.
+   *  Commands are copied into one contiguous arena beside their opcodes, so stepping a macro walks
+   *  sequential memory and dispatches with a switch on the opcode instead of a virtual call. */
+  class Program {
+  public:
+    struct Instr {
+      CmdOp m_op;
+      const ICmd* m_cmd; /**< Copy of the command inside m_arena */
+    };
+
+  private:
+    friend struct SoundMacro;
+    std::vector<Instr> m_instrs;
+    std::unique_ptr<std::max_align_t[]> m_arena;
+
+  public:
+    Program() = default;
+    ~Program();
+    Program(const Program&) = delete;
+    Program& operator=(const Program&) = delete;
+
+    size_t size() const { return m_instrs.size(); }
+    const Instr& instr(int pc) const { return m_instrs[pc]; }
+    /** Perform the command at pc for the engine; equivalent to getCmd(pc).Do(st, vox) */
+    bool exec(int pc, SoundMacroState& st, Voice& vox) const;
+    /** Perform the command at pc for fluidsyX; equivalent to getCmd(pc).DoFluid(ctx, v) */
+    unsigned int execFluid(int pc, MacroExecContext& ctx, fluid_voice_t* v) const;
+  };
+
   std::vector<std::unique_ptr<ICmd>> m_cmds;
+  std::unique_ptr<Program> m_program; /**< Set by compile(); dropped whenever the command list changes */
   int assertPC(int pc) const;
 
   const ICmd& getCmd(int i) const { return *m_cmds[assertPC(i)]; }
 
+  /** Lower m_cmds into a Program (see AudioGroupPool::compileSoundMacros).
+   *  Commands edited in place afterwards are not seen by the program until compile() runs again. */
+  void compile();
+  const Program* program() const { return m_program.get(); }
+
   template <std::endian DNAE>
   void readCmds(athena::io::IStreamReader& r, uint32_t size);
   template <std::endian DNAE>
   void writeCmds(athena::io::IStreamWriter& w) const;
 
-  ICmd* insertNewCmd(int idx, CmdOp op) { return m_cmds.insert(m_cmds.begin() + idx, MakeCmd(op))->get(); }
+  ICmd* insertNewCmd(int idx, CmdOp op) {
+    m_program.reset();
+    return m_cmds.insert(m_cmds.begin() + idx, MakeCmd(op))->get();
+  }
   ICmd* insertCmd(int idx, std::unique_ptr<ICmd>&& cmd) {
+    m_program.reset();
     return m_cmds.insert(m_cmds.begin() + idx, std::move(cmd))->get();
   }
   std::unique_ptr<ICmd> deleteCmd(int idx) {
+    m_program.reset();
     std::unique_ptr<ICmd> ret = std::move(m_cmds[idx]);
     m_cmds.erase(m_cmds.begin() + idx);
     return ret;
@@ -1033,6 +1073,7 @@ struct SoundMacro {
   void swapPositions(int a, int b) {
     if (a == b)
       return;
+    m_program.reset();
     std::swap(m_cmds[a], m_cmds[b]);
   }
   void buildFromPrototype(const SoundMacro& other);
@@ -1280,6 +1321,9 @@ public:
   const ADSRDLS* tableAsAdsrDLS(ObjectId id) const;
   const Curve* tableAsCurves(ObjectId id) const;
 
+  /** Compile every SoundMacro into its flat Program; playback-only loaders call this once after parsing */
+  void compileSoundMacros();
+
   std::vector<uint8_t> toYAML() const;
   template <std::endian DNAE>
   std::vector<uint8_t> toData() const;
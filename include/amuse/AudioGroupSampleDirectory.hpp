@@ -11,6 +11,7 @@
 namespace amuse {
 class AudioGroupData;
 class AudioGroupDatabase;
+class WorkerPool;
 
 struct DSPADPCMHeader : BigDNA {
   AT_DECL_DNA
@@ -349,7 +350,7 @@ private:
   static void _extractWAV(SampleId id, const EntryData& ent, std::string_view destDir,
                           const unsigned char* samp);
   static void _extractCompressed(SampleId id, const EntryData& ent, std::string_view destDir,
-                                 const unsigned char* samp, bool compressWAV = false);
+                                 const unsigned char* samp, bool compressWAV = false, WorkerPool* pool = nullptr);
 
 public:
   AudioGroupSampleDirectory() = default;
@@ -359,6 +360,10 @@ public:
   static AudioGroupSampleDirectory CreateAudioGroupSampleDirectory(const AudioGroupData& data);
   static AudioGroupSampleDirectory CreateAudioGroupSampleDirectory(std::string_view groupPath);
 
+  /** Read each entry's VADPCM codebook from the head of its sample; N64 directories parsed without
+   *  their sample chunk (lazily decompressed containers) call this once the chunk is resident */
+  void loadN64ADPCMParms(const unsigned char* sampData) const;
+
   const std::unordered_map<SampleId, ObjToken<Entry>>& sampleEntries() const { return m_entries; }
   std::unordered_map<SampleId, ObjToken<Entry>>& sampleEntries() { return m_entries; }
 
@@ -369,7 +374,9 @@ public:
 
   void reloadSampleData(std::string_view groupPath);
 
-  std::pair<std::vector<uint8_t>, std::vector<uint8_t>> toGCNData(const AudioGroupDatabase& group) const;
+  /** Out-of-date samples are re-encoded as one batch on pool (a temporary pool when null) */
+  std::pair<std::vector<uint8_t>, std::vector<uint8_t>> toGCNData(const AudioGroupDatabase& group,
+                                                                  WorkerPool* pool = nullptr) const;
 
   AudioGroupSampleDirectory(const AudioGroupSampleDirectory&) = delete;
   AudioGroupSampleDirectory& operator=(const AudioGroupSampleDirectory&) = delete;
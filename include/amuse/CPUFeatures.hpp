@@ -0,0 +1,39 @@
+#pragma once
+
+/* Support for runtime-dispatched SIMD kernels. Kernels are compiled per instruction set
+ * with AMUSE_TARGET and selected once at runtime from GetCPUFeatures(). */
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define AMUSE_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#define AMUSE_TARGET(isa)
+#define AMUSE_FORCEINLINE __forceinline
+#else
+#define AMUSE_TARGET(isa) __attribute__((target(isa)))
+#define AMUSE_FORCEINLINE inline __attribute__((always_inline))
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AMUSE_SSE2 1 /**< SSE2 is part of the compilation baseline and needs no dispatch */
+#else
+#define AMUSE_SSE2 0
+#endif
+#else
+#define AMUSE_X86 0
+#define AMUSE_SSE2 0
+#define AMUSE_TARGET(isa)
+#define AMUSE_FORCEINLINE inline
+#endif
+
+namespace amuse {
+
+/** Instruction set extensions usable on the running CPU and OS */
+struct CPUFeatures {
+  bool sse41 = false;
+  bool avx2 = false;
+};
+
+/** Queried on first call and cached */
+const CPUFeatures& GetCPUFeatures();
+
+} // namespace amuse
@@ -37,5 +37,13 @@ public:
   static std::vector<std::pair<std::string, IntrusiveAudioGroupData>> LoadContainer(const char* path,
                                                                                      Type& typeOut);
   static std::vector<std::pair<std::string, SongData>> LoadSongs(const char* path);
+
+  /** Group over four raw chunks (as in .pro/.poo/.sdi/.sam files) borrowed from `backing`, which the group
+   *  keeps alive in place of freeing them. The data format is detected from the sample directory as
+   *  LoadContainer does for raw chunk files. */
+  static IntrusiveAudioGroupData MakeRawGroupData(std::shared_ptr<const void> backing, unsigned char* proj,
+                                                  size_t projSz, unsigned char* pool, size_t poolSz,
+                                                  unsigned char* sdir, size_t sdirSz, unsigned char* samp,
+                                                  size_t sampSz);
 };
 } // namespace amuse
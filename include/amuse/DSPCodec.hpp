@@ -2,6 +2,10 @@
 
 #include <cstdint>
 
+namespace amuse {
+class WorkerPool;
+}
+
 constexpr int16_t DSPSampClamp(int32_t val) {
   if (val < -32768)
     val = -32768;
@@ -26,6 +30,23 @@ unsigned DSPDecompressFrameStateOnly(const uint8_t* in, const int16_t coefs[8][2
 unsigned DSPDecompressFrameRangedStateOnly(const uint8_t* in, const int16_t coefs[8][2], int16_t* prev1, int16_t* prev2,
                                            unsigned firstSample, unsigned lastSample);
 
+/** Decode sampleCount samples from contiguous frames, starting at sample firstSample of the frame at in.
+ *  Equivalent to DSPDecompressFrameRanged followed by DSPDecompressFrame on each subsequent frame,
+ *  using the fastest implementation registered for the running CPU */
+unsigned DSPDecompressFrames(int16_t* out, const uint8_t* in, const int16_t coefs[8][2], int16_t* prev1,
+                             int16_t* prev2, unsigned firstSample, unsigned sampleCount);
+
+/** Portable implementation of DSPDecompressFrames and the reference for any SIMD path */
+unsigned DSPDecompressFramesScalar(int16_t* out, const uint8_t* in, const int16_t coefs[8][2], int16_t* prev1,
+                                   int16_t* prev2, unsigned firstSample, unsigned sampleCount);
+
+/** Name of the instruction set DSPDecompressFrames dispatches to (currently always "scalar") */
+const char* DSPDecompressFramesISA();
+
 void DSPCorrelateCoefs(const short* source, int samples, short coefsOut[8][2]);
 
+/** DSPCorrelateCoefs with the per-frame analysis and record classification spread across pool;
+ *  coefficients are identical to the single-threaded version */
+void DSPCorrelateCoefs(const short* source, int samples, short coefsOut[8][2], amuse::WorkerPool* pool);
+
 void DSPEncodeFrame(short pcmInOut[16], int sampleCount, unsigned char adpcmOut[8], const short coefsIn[8][2]);
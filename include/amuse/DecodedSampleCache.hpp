@@ -0,0 +1,134 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "amuse/AudioGroupSampleDirectory.hpp"
+#include "amuse/Common.hpp"
+
+namespace amuse {
+
+/** 16-bit PCM decoded once from an ADPCM sample */
+struct DecodedSamplePCM {
+  /** Whole sample decoded from the start with zeroed predictor history, as a voice streams it */
+  std::vector<int16_t> m_pcm;
+  /** DSP loop region decoded from the stored loop history, indexed from the loop start.
+   *  Empty when the sample is not looped or the loop decodes identically to the first pass */
+  std::vector<int16_t> m_loopPcm;
+  uint32_t m_loopStart = 0;
+
+  /** Samples to play once playback has turned over at the loop end at least once */
+  const int16_t* getLoopPass() const { return m_loopPcm.empty() ? m_pcm.data() + m_loopStart : m_loopPcm.data(); }
+  size_t getByteSize() const { return (m_pcm.size() + m_loopPcm.size()) * sizeof(int16_t); }
+};
+
+/** Budgeted LRU cache of decoded ADPCM samples shared by all voices of an engine.
+ *  Entries are handed out by shared pointer, so evicting never invalidates a sample that is still playing.
+ *  Lookups run on the engine's thread without locking. A miss never decodes there: the voice streams the
+ *  sample while a background fill thread decodes it, and the result serves the starts that follow. */
+class DecodedSampleCache {
+public:
+  struct Stats {
+    uint64_t m_hits = 0;
+    uint64_t m_misses = 0;
+    uint64_t m_fills = 0; /**< Misses decoded by the fill thread and added to the cache */
+    uint64_t m_evictions = 0;
+    uint64_t m_bypasses = 0; /**< Requests for samples too large for the budget */
+    size_t m_residentBytes = 0;
+    size_t m_entryCount = 0;
+  };
+
+  static constexpr size_t DefaultBudget = 8 * 1024 * 1024;
+  /** Misses queued for the fill thread at once; later misses stream until a slot frees up */
+  static constexpr size_t MaxPendingFills = 16;
+
+private:
+  struct Key {
+    const unsigned char* m_data;
+    SampleId m_id;
+    bool operator==(const Key& other) const { return m_data == other.m_data && m_id == other.m_id; }
+  };
+  struct KeyHash {
+    size_t operator()(const Key& key) const noexcept {
+      return std::hash<const unsigned char*>()(key.m_data) ^ (size_t(key.m_id.id) << 1);
+    }
+  };
+  using LRUList = std::list<std::pair<Key, std::shared_ptr<const DecodedSamplePCM>>>;
+  using Index = std::unordered_map<Key, LRUList::iterator, KeyHash>;
+
+  struct FillRequest {
+    Key m_key;
+    ObjToken<SampleEntryData> m_ent;
+  };
+  /* A decoded sample with its LRU and index nodes already built, so publishing it only splices them in */
+  struct FilledSample {
+    LRUList m_lru;
+    Index::node_type m_indexNode;
+  };
+
+  /* Engine-thread state */
+  size_t m_budget;
+  LRUList m_lru; /**< Most recently used at front */
+  Index m_index;
+  Stats m_stats;
+  std::array<Key, MaxPendingFills> m_pending{}; /**< Keys queued or being decoded, not yet published */
+  size_t m_numPending = 0;
+
+  /* Handoff with the fill thread */
+  std::mutex m_fillLock;
+  std::condition_variable m_fillCv;     /**< Wakes the fill thread */
+  std::condition_variable m_fillDoneCv; /**< Signals the end of each decode */
+  std::vector<FillRequest> m_requests;
+  std::vector<FilledSample> m_filled;
+  std::atomic_bool m_hasFilled = false;
+  const unsigned char* m_fillingData = nullptr; /**< Sample data the fill thread is reading */
+  Key m_fillingKey{};
+  bool m_fillRunning = true;
+  std::thread m_fillThread; /**< Started on the first miss */
+
+  void _evictToBudget();
+  void _requestFill(const Key& key, const ObjToken<SampleEntryData>& ent);
+  void _publishFills();
+  void _dropPending(const unsigned char* begin, const unsigned char* end);
+  void _fillProc();
+
+public:
+  explicit DecodedSampleCache(size_t budgetBytes = DefaultBudget);
+  ~DecodedSampleCache();
+  DecodedSampleCache(const DecodedSampleCache&) = delete;
+  DecodedSampleCache& operator=(const DecodedSampleCache&) = delete;
+
+  /** True for compressed formats worth caching; PCM formats and editor-loaded samples are streamed directly */
+  static bool IsCacheable(const SampleEntryData& ent);
+
+  /** Decode ent (whose data starts at `data`, as returned by AudioGroup::getSampleData) to PCM without caching */
+  static std::shared_ptr<DecodedSamplePCM> Decode(const SampleEntryData& ent, const unsigned char* data);
+
+  /** Look up a sample; returns null when it is not cacheable, exceeds the per-entry limit (1/8th of the
+   *  budget) or is not decoded yet, in which case the caller should stream it. A miss queues the sample
+   *  for the fill thread, which holds `ent` until it is done. */
+  std::shared_ptr<const DecodedSamplePCM> acquire(SampleId id, const ObjToken<SampleEntryData>& ent,
+                                                  const unsigned char* data);
+
+  /** Drop entries and queued fills whose data lies within [begin, end), e.g. when an audio group is removed;
+   *  waits for the fill thread if it is decoding from that range */
+  void purge(const unsigned char* begin, const unsigned char* end);
+  void clear();
+
+  /** A budget of 0 disables caching */
+  void setBudget(size_t budgetBytes);
+  size_t getBudget() const { return m_budget; }
+
+  Stats getStats() const;
+};
+
+} // namespace amuse
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
 #include <memory>
@@ -37,6 +38,9 @@ struct EffectReverbHiInfo {
   : coloration(coloration), mix(mix), time(time), damping(damping), preDelay(preDelay), crosstalk(crosstalk) {}
 };
 
+/** One value per output channel; reverb kernels process every channel in parallel SIMD lanes */
+using ReverbLanes = std::array<float, NumChannels>;
+
 /** Delay state for one 'tap' of the reverb effect */
 struct ReverbDelayLine {
   int32_t x0_inPoint = 0;
@@ -49,6 +53,33 @@ struct ReverbDelayLine {
   void setdelay(int32_t delay);
 };
 
+/** Delay state for one 'tap' of the reverb effect with the same delay on every channel;
+ *  the channels are interleaved at each position and share in/out points */
+struct ReverbDelayLanes {
+  int32_t x0_inPoint = 0;
+  int32_t x4_outPoint = 0;
+  int32_t x8_length = 0;
+  std::unique_ptr<ReverbLanes[]> xc_inputs;
+  ReverbLanes x10_lastInput{};
+
+  void allocate(int32_t delay);
+  void setdelay(int32_t delay);
+
+  /** Frames, up to `count`, that may be processed before the in- or out-point wraps */
+  int32_t contiguous(int32_t count) const { return std::min({count, x8_length - x0_inPoint, x8_length - x4_outPoint}); }
+  void advance(int32_t count) {
+    x0_inPoint += count;
+    if (x0_inPoint == x8_length)
+      x0_inPoint = 0;
+    x4_outPoint += count;
+    if (x4_outPoint == x8_length)
+      x4_outPoint = 0;
+  }
+};
+
+/** Name of the instruction set the reverb lane kernels dispatch to ("avx2" or "scalar") */
+const char* ReverbKernelsISA();
+
 template <typename T>
 class EffectReverbStdImp;
 
@@ -146,20 +177,19 @@ public:
 /** Standard-quality 2-stage reverb */
 template <typename T>
 class EffectReverbStdImp : public EffectBase<T>, public EffectReverbStd {
-  using CombCoeffArray = std::array<std::array<float, 2>, NumChannels>;
-  using ReverbDelayArray = std::array<std::array<ReverbDelayLine, 2>, NumChannels>;
-  using PreDelayArray = std::array<std::unique_ptr<float[]>, NumChannels>;
-
-  ReverbDelayArray x0_AP{};                           /**< All-pass delay lines */
-  ReverbDelayArray x78_C{};                           /**< Comb delay lines */
-  float xf0_allPassCoef = 0.f;                        /**< All-pass mix coefficient */
-  CombCoeffArray xf4_combCoef{};                      /**< Comb mix coefficients */
-  std::array<float, NumChannels> x10c_lpLastout{};    /**< Last low-pass results */
-  float x118_level = 0.f;                             /**< Internal wet/dry mix factor */
-  float x11c_damping = 0.f;                           /**< Low-pass damping */
-  int32_t x120_preDelayTime = 0;                      /**< Sample count of pre-delay */
-  PreDelayArray x124_preDelayLine;                    /**< Dedicated pre-delay buffers */
-  std::array<float*, NumChannels> x130_preDelayPtr{}; /**< Current pre-delay pointers */
+  using CombCoeffArray = std::array<ReverbLanes, 2>;
+  using ReverbDelayArray = std::array<ReverbDelayLanes, 2>;
+
+  ReverbDelayArray x0_AP{};                         /**< All-pass delay lines */
+  ReverbDelayArray x78_C{};                         /**< Comb delay lines */
+  float xf0_allPassCoef = 0.f;                      /**< All-pass mix coefficient */
+  CombCoeffArray xf4_combCoef{};                    /**< Comb mix coefficients, per tap */
+  ReverbLanes x10c_lpLastout{};                     /**< Last low-pass results */
+  float x118_level = 0.f;                           /**< Internal wet/dry mix factor */
+  float x11c_damping = 0.f;                         /**< Low-pass damping */
+  int32_t x120_preDelayTime = 0;                    /**< Sample count of pre-delay */
+  std::unique_ptr<ReverbLanes[]> x124_preDelayLine; /**< Pre-delay buffer of all channels */
+  int32_t x130_preDelayPos = 0;                     /**< Current pre-delay position */
 
   double m_sampleRate; /**< copy of sample rate */
   void _setup(double sampleRate);
@@ -179,29 +209,28 @@ public:
 /** High-quality 3-stage reverb with per-channel low-pass and crosstalk */
 template <typename T>
 class EffectReverbHiImp : public EffectBase<T>, public EffectReverbHi {
-  using AllPassDelayLines = std::array<std::array<ReverbDelayLine, 2>, NumChannels>;
-  using CombCoefficients = std::array<std::array<float, 3>, NumChannels>;
-  using CombDelayLines = std::array<std::array<ReverbDelayLine, 3>, NumChannels>;
-  using LowPassDelayLines = std::array<ReverbDelayLine, 8>;
-  using PreDelayLines = std::array<std::unique_ptr<float[]>, 8>;
-
-  AllPassDelayLines x0_AP{};                          /**< All-pass delay lines */
-  LowPassDelayLines x78_LP{};                         /**< Per-channel low-pass delay-lines */
-  CombDelayLines xb4_C{};                             /**< Comb delay lines */
-  float x168_allPassCoef = 0.f;                       /**< All-pass mix coefficient */
-  CombCoefficients x16c_combCoef{};                   /**< Comb mix coefficients */
-  std::array<float, 8> x190_lpLastout{};              /**< Last low-pass results */
-  float x19c_level = 0.f;                             /**< Internal wet/dry mix factor */
-  float x1a0_damping = 0.f;                           /**< Low-pass damping */
-  int32_t x1a4_preDelayTime = 0;                      /**< Sample count of pre-delay */
-  PreDelayLines x1ac_preDelayLine;                    /**< Dedicated pre-delay buffers */
-  std::array<float*, NumChannels> x1b8_preDelayPtr{}; /**< Current pre-delay pointers */
+  using AllPassDelayLines = std::array<ReverbDelayLanes, 2>;
+  using CombCoefficients = std::array<ReverbLanes, 3>;
+  using CombDelayLines = std::array<ReverbDelayLanes, 3>;
+  using LowPassDelayLines = std::array<ReverbDelayLine, NumChannels>;
+
+  AllPassDelayLines x0_AP{};                        /**< All-pass delay lines */
+  LowPassDelayLines x78_LP{};                       /**< Per-channel low-pass delay-lines */
+  CombDelayLines xb4_C{};                           /**< Comb delay lines */
+  float x168_allPassCoef = 0.f;                     /**< All-pass mix coefficient */
+  CombCoefficients x16c_combCoef{};                 /**< Comb mix coefficients, per tap */
+  ReverbLanes x190_lpLastout{};                     /**< Last low-pass results */
+  float x19c_level = 0.f;                           /**< Internal wet/dry mix factor */
+  float x1a0_damping = 0.f;                         /**< Low-pass damping */
+  int32_t x1a4_preDelayTime = 0;                    /**< Sample count of pre-delay */
+  std::unique_ptr<ReverbLanes[]> x1ac_preDelayLine; /**< Pre-delay buffer of all channels */
+  int32_t x1b8_preDelayPos = 0;                     /**< Current pre-delay position */
   float x1a8_internalCrosstalk = 0.f;
 
   double m_sampleRate; /**< copy of sample rate */
   void _setup(double sampleRate);
   void _update();
-  void _handleReverb(T* audio, int chanIdx, int chanCount, int sampleCount);
+  void _handleReverb(T* audio, int chanCount, int sampleCount);
   void _doCrosstalk(T* audio, float wet, float dry, int chanCount, int sampleCount);
 
 public:
@@ -3,12 +3,18 @@
 #include <array>
 #include <cfloat>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
 
 #include "amuse/Common.hpp"
 #include "amuse/Entity.hpp"
+#include "amuse/IBackendVoiceAllocator.hpp"
+#include "amuse/SlotMap.hpp"
 #include "amuse/Voice.hpp"
 
 namespace amuse {
+class Emitter;
 class Listener;
 
 using Vector3f = std::array<float, 3>;
@@ -31,24 +37,56 @@ inline Vector3f Normalize(const Vector3f& in) {
   return {in[0] / dist, in[1] / dist, in[2] / dist};
 }
 
+/** Structure-of-arrays store of the positional parameters of every live Emitter of an Engine.
+ *  Each 5ms tick spatializes emitters against all listeners in one vectorized pass; while no listener
+ *  changed, only the emitters queued by setVectors/setMaxVol since the last tick are recomputed. */
+class EmitterBatch {
+public:
+  enum Column { PosX, PosY, PosZ, DirX, DirY, DirZ, MaxDist, MaxVol, MinVol, Falloff, NumColumns };
+  using Columns = std::array<std::vector<float>, NumColumns>;
+
+  /** Per-emitter results of spatializing against one listener */
+  enum Term { Attenuation, FrontPan, BackPan, Span, Doppler, NumTerms };
+
+private:
+  friend class Emitter;
+  friend class Engine;
+
+  std::vector<Emitter*> m_emitters; /**< Emitter of each slot */
+  Columns m_columns;
+  std::vector<Emitter*> m_dirty; /**< Emitters queued since the last update */
+  std::vector<Emitter*> m_virtual; /**< Emitters whose voices currently run without a backend voice */
+  float m_virtualThreshold = -1.f; /**< Loudest level at or below which an emitter goes virtual (negative: never) */
+
+  /* Scratch of _update(), retained so steady-state ticks stay off the heap */
+  Columns m_gathered;
+  std::array<std::vector<float>, NumTerms> m_terms;
+  std::array<std::vector<float>, 8> m_coefs;
+  std::vector<double> m_dopplerSums;
+
+  void _add(Emitter& em, float maxDist, float minVol, float falloff);
+  void _remove(Emitter& em);
+  void _markDirty(Emitter& em);
+  void _update(const SlotMap<ObjToken<Listener>>& listeners, AudioChannelSet set);
+  void _virtualize(Emitter& em);
+  void _materialize(Emitter& em, const std::array<float, 8>& coefs);
+  void _advanceVirtual(double dt);
+  void _setVirtualThreshold(float level);
+};
+
 /** Voice wrapper with positional-3D level control */
 class Emitter : public Entity {
   friend class Engine;
+  friend class EmitterBatch;
 
   ObjToken<Voice> m_vox;
-  Vector3f m_pos = {};
-  Vector3f m_dir = {};
-  float m_maxDist;
-  float m_maxVol = 1.f;
-  float m_minVol;
-  float m_falloff;
+  size_t m_batchSlot = 0; /**< Index of this emitter's parameters in the engine's EmitterBatch */
   bool m_doppler;
-  bool m_dirty = true;
-  Voice::VolumeCache m_attCache;
+  bool m_dirty = false; /**< Queued in the EmitterBatch for the next update */
+  size_t m_virtualIdx = SIZE_MAX; /**< Position in the EmitterBatch's virtual list (SIZE_MAX while audible) */
 
   void _destroy();
-  float _attenuationCurve(float dist) const;
-  void _update();
+  void _setLevels(const std::array<float, 8>& coefs, double dopplerRatio);
 
 public:
   ~Emitter() override;
@@ -56,10 +94,7 @@ public:
           bool doppler);
 
   void setVectors(const float* pos, const float* dir);
-  void setMaxVol(float maxVol) {
-    m_maxVol = std::clamp(maxVol, 0.f, 1.f);
-    m_dirty = true;
-  }
+  void setMaxVol(float maxVol);
 
   ObjToken<Voice> getVoice() const { return m_vox; }
 };
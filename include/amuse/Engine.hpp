@@ -6,13 +6,17 @@
 #include <memory>
 #include <random>
 #include <unordered_map>
+#include <vector>
 
 #include "amuse/AudioGroupSampleDirectory.hpp"
+#include "amuse/DecodedSampleCache.hpp"
 #include "amuse/Emitter.hpp"
 #include "amuse/IBackendVoiceAllocator.hpp"
 #include "amuse/Listener.hpp"
 #include "amuse/Sequencer.hpp"
+#include "amuse/SlotMap.hpp"
 #include "amuse/Studio.hpp"
+#include "amuse/VoicePool.hpp"
 
 namespace amuse {
 class AudioGroup;
@@ -24,12 +28,24 @@ class Submix;
 class Voice;
 
 enum class AmplitudeMode {
-  PerSample,      /**< Per-sample amplitude evaluation (dt = 1.0 / sampleRate, rather CPU demanding) */
-  BlockLinearized /**< Per-block lerp amplitude evaluation (dt = 160.0 / sampleRate) */
+  PerSample,       /**< Per-sample amplitude evaluation (dt = 1.0 / sampleRate, rather CPU demanding) */
+  BlockLinearized, /**< Per-block lerp amplitude evaluation (dt = 160.0 / sampleRate) */
+  BlockCurve       /**< Per-block gain curve evaluated every 32 samples and applied with a vectorized multiply.
+                    *   Levels match PerSample at each control point and are interpolated linearly between
+                    *   them, so output deviates only around slope changes inside a period (ADSR phase or
+                    *   slew endpoints, tremolo); roughly 50dB SNR relative to PerSample on typical songs */
 };
 
 /** Main audio playback system for a single audio output */
 class Engine {
+public:
+  struct VoiceStealStats {
+    uint64_t m_steals = 0;      /**< Voices stolen to stay within the polyphony limit */
+    uint64_t m_limitSteals = 0; /**< Voices stolen to honor an object's max-voices setting */
+    uint64_t m_rejections = 0;  /**< Voice starts refused because every playing voice outranked them */
+  };
+
+private:
   friend class Emitter;
   friend class Sequencer;
   friend class Studio;
@@ -40,34 +56,62 @@ class Engine {
   AmplitudeMode m_ampMode;
   std::unique_ptr<IMIDIReader> m_midiReader;
   std::unordered_map<const AudioGroupData*, std::unique_ptr<AudioGroup>> m_audioGroups;
-  std::list<ObjToken<Voice>> m_activeVoices;
-  std::list<ObjToken<Emitter>> m_activeEmitters;
-  std::list<ObjToken<Listener>> m_activeListeners;
-  std::list<ObjToken<Sequencer>> m_activeSequencers;
+  SlotMap<ObjToken<Voice>> m_activeVoices;
+  SlotMap<ObjToken<Emitter>> m_activeEmitters;
+  SlotMap<ObjToken<Listener>> m_activeListeners;
+  EmitterBatch m_emitterBatch; /**< Positional parameters of m_activeEmitters, spatialized each 5ms tick */
+  SlotMap<ObjToken<Sequencer>> m_activeSequencers;
   bool m_defaultStudioReady = false;
   ObjToken<Studio> m_defaultStudio;
   std::unordered_map<SFXId, std::tuple<AudioGroup*, GroupId, const SFXGroupIndex::SFXEntry*>> m_sfxLookup;
   std::linear_congruential_engine<uint32_t, 0x41c64e6d, 0x3039, UINT32_MAX> m_random;
-  int m_nextVid = 0;
+  std::vector<ObjToken<Voice>> m_voicesByVid; /**< Every undestroyed voice (including children) by VoiceId */
+  std::vector<int> m_freeVids;
+  size_t m_numVoices = 0;
   float m_masterVolume = 1.f;
   AudioChannelSet m_channelSet = AudioChannelSet::Unknown;
+  DecodedSampleCache m_sampleCache;
+  std::shared_ptr<VoicePool> m_voicePool;
+  std::list<ObjToken<Voice>> m_voiceNodeSpares; /**< Emptied voice list nodes kept for reuse */
+  uint64_t m_voiceNodeMisses = 0;
+  uint64_t m_pumpPoolMissBase = 0;
+  uint64_t m_lastPumpPoolMisses = 0;
+  size_t m_maxVoices = 0;           /**< Polyphony limit over all voices, 0 for unlimited */
+  std::vector<Voice*> m_stealQueue; /**< Min-heap of playing voices, next victim at front */
+  uint64_t m_nextStartSerial = 0;
+  VoiceStealStats m_stealStats;
 
   AudioGroup* _addAudioGroup(const AudioGroupData& data, std::unique_ptr<AudioGroup>&& grp);
   std::pair<AudioGroup*, const SongGroupIndex*> _findSongGroup(GroupId groupId) const;
   std::pair<AudioGroup*, const SFXGroupIndex*> _findSFXGroup(GroupId groupId) const;
 
-  std::list<ObjToken<Voice>>::iterator _allocateVoice(const AudioGroup& group, GroupId groupId, double sampleRate,
-                                                      bool dynamicPitch, bool emitter, ObjToken<Studio> studio);
-  std::list<ObjToken<Sequencer>>::iterator _allocateSequencer(const AudioGroup& group, GroupId groupId, SongId setupId,
-                                                              ObjToken<Studio> studio);
+  ObjToken<Voice> _makeVoice(const AudioGroup& group, GroupId groupId, bool emitter, ObjToken<Studio> studio);
+  void _releaseVoiceId(int vid);
+  std::list<ObjToken<Voice>>::iterator _emplaceVoice(std::list<ObjToken<Voice>>& list, ObjToken<Voice>&& vox);
+  std::list<ObjToken<Voice>>::iterator _eraseVoice(std::list<ObjToken<Voice>>& list,
+                                                   std::list<ObjToken<Voice>>::iterator it);
+  static bool _StealsBefore(const Voice* a, const Voice* b);
+  void _siftStealQueue(size_t idx);
+  bool _admitVoice(const AudioGroup& group, const VoicePriority& prio, const Voice* parent = nullptr);
+  void _trackVoice(Voice& vox, const VoicePriority& prio);
+  void _untrackVoice(Voice& vox);
+  void _updateVoicePriority(Voice& vox);
+
+  /** Returns null if the voice was refused by the polyphony limit */
+  ObjToken<Voice> _allocateVoice(const AudioGroup& group, GroupId groupId, double sampleRate, bool dynamicPitch,
+                                 bool emitter, ObjToken<Studio> studio, const VoicePriority& prio = {});
+  ObjToken<Sequencer> _allocateSequencer(const AudioGroup& group, GroupId groupId, SongId setupId,
+                                         ObjToken<Studio> studio);
   ObjToken<Studio> _allocateStudio(bool mainOut);
-  std::list<ObjToken<Voice>>::iterator _destroyVoice(std::list<ObjToken<Voice>>::iterator it);
-  std::list<ObjToken<Sequencer>>::iterator _destroySequencer(std::list<ObjToken<Sequencer>>::iterator it);
+  void _destroyVoice(Voice& vox);
+  SlotMap<ObjToken<Voice>>::iterator _destroyVoice(SlotMap<ObjToken<Voice>>::iterator it);
+  SlotMap<ObjToken<Sequencer>>::iterator _destroySequencer(SlotMap<ObjToken<Sequencer>>::iterator it);
   void _bringOutYourDead();
 
 public:
   ~Engine();
-  Engine(IBackendVoiceAllocator& backend, AmplitudeMode ampMode = AmplitudeMode::PerSample);
+  Engine(IBackendVoiceAllocator& backend, AmplitudeMode ampMode = AmplitudeMode::PerSample,
+         size_t voicePoolCapacity = VoicePool::DefaultCapacity);
 
   /** Access voice backend of engine */
   IBackendVoiceAllocator& getBackend() { return m_backend; }
@@ -78,6 +122,9 @@ public:
   /** Add audio group data pointers to engine; must remain resident! */
   const AudioGroup* addAudioGroup(const AudioGroupData& data);
 
+  /** Adopt a group already parsed from data (e.g. by AudioGroupLoader); data must remain resident! */
+  const AudioGroup* addAudioGroup(const AudioGroupData& data, std::unique_ptr<AudioGroup>&& group);
+
   /** Remove audio group from engine */
   void removeAudioGroup(const AudioGroupData& data);
 
@@ -152,6 +199,12 @@ public:
   /** Set total volume of engine */
   void setVolume(float vol);
 
+  /** Access the decoded-sample cache shared by this engine's voices */
+  DecodedSampleCache& getDecodedSampleCache() { return m_sampleCache; }
+
+  /** Memory budget for decoded ADPCM samples; 0 streams every sample from its compressed data */
+  void setDecodedSampleBudget(size_t budgetBytes) { m_sampleCache.setBudget(budgetBytes); }
+
   /** Find voice from VoiceId */
   ObjToken<Voice> findVoice(int vid);
 
@@ -164,14 +217,43 @@ public:
   /** Obtain next random number from engine's PRNG */
   uint32_t nextRandom() { return m_random(); }
 
+  /** Restart engine's PRNG sequence from `seed` (for reproducible playback) */
+  void seedRandom(uint32_t seed) { m_random.seed(seed); }
+
   /** Obtain list of active voices */
-  std::list<ObjToken<Voice>>& getActiveVoices() { return m_activeVoices; }
+  SlotMap<ObjToken<Voice>>& getActiveVoices() { return m_activeVoices; }
 
   /** Obtain total active voice count (including child voices) */
-  size_t getNumTotalActiveVoices() const;
+  size_t getNumTotalActiveVoices() const { return m_numVoices; }
+
+  /** Limit the number of playing voices (including child voices); 0 removes the limit.
+   *  Once full, starting a voice steals the lowest-priority (then oldest) voice with a 5ms fade,
+   *  or fails if every playing voice has a higher priority. Stolen voices fading out are not counted. */
+  void setMaxVoices(size_t maxVoices);
+  size_t getMaxVoices() const { return m_maxVoices; }
+
+  /** Virtualize emitters whose loudest spatialized channel level is at or below `level`; negative disables.
+   *  A virtual emitter releases its backend voice but keeps its SoundMacro clock and sample position,
+   *  and resumes at the matching sample offset once it rises above the threshold again. */
+  void setVirtualEmitterThreshold(float level) { m_emitterBatch._setVirtualThreshold(level); }
+  float getVirtualEmitterThreshold() const { return m_emitterBatch.m_virtualThreshold; }
+
+  /** Obtain number of emitters currently virtual */
+  size_t getNumVirtualEmitters() const { return m_emitterBatch.m_virtual.size(); }
+
+  /** Counters of voices stolen or refused since the engine was created */
+  const VoiceStealStats& getVoiceStealStats() const { return m_stealStats; }
+
+  /** Occupancy of the preallocated voice pool */
+  VoicePool::Stats getVoicePoolStats() const { return m_voicePool->getStats(); }
+
+  /** Voice storage and voice list nodes that missed the voice pool and its spare nodes during the last
+   *  completed pump cycle. Per-voice state is inline or recycled and the backend is asked to reserve
+   *  as many voices as the pool holds; amuse-bench voice-churn counts any heap allocation that remains. */
+  uint64_t getPumpVoicePoolMisses() const { return m_lastPumpPoolMisses; }
 
   /** Obtain list of active sequencers */
-  std::list<ObjToken<Sequencer>>& getActiveSequencers() { return m_activeSequencers; }
+  SlotMap<ObjToken<Sequencer>>& getActiveSequencers() { return m_activeSequencers; }
 
   /** All mixing occurs in virtual 5ms intervals;
    *  this is called at the start of each interval for all mixable entities */
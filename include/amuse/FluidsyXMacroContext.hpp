@@ -4,6 +4,8 @@
 #include <optional>
 #include <array>
 #include <cstdint>
+#include <deque>
+#include <unordered_map>
 #include <vector>
 
 /* ────────────── Runtime state for a single SoundMacro VM ────────────── */
@@ -95,4 +97,117 @@ struct MacroExecContext {
   EventTrap messageTrap;
 };
 
+/** Slot-indexed store of the active MacroExecContexts.
+ *  IDs pack a slot index with a generation counter, so timer events and macro variables referencing a
+ *  finished macro never resolve to a later one reusing its slot. Contexts stay at a fixed address while
+ *  stored (macros may spawn children mid-execution), and a (channel, triggerNote) index lets note-off
+ *  dispatch reach its voice without visiting every active macro. */
+class MacroContextStore {
+  static constexpr int kSlotBits = 20;
+  static constexpr uint32_t kSlotMask = (1u << kSlotBits) - 1;
+  static constexpr uint32_t kGenMask = 0x7ff; /* IDs stay non-negative ints */
+
+  struct Slot {
+    MacroExecContext ctx;
+    uint32_t gen = 0;
+    bool live = false;
+  };
+  std::deque<Slot> m_slots;
+  std::vector<uint32_t> m_freeSlots;
+  size_t m_liveCount = 0;
+  /** IDs by (channel, triggerNote) in insertion order; stale IDs are pruned lazily */
+  std::unordered_map<uint32_t, std::vector<int>> m_noteIndex;
+
+  static uint32_t NoteKey(int channel, uint8_t note) { return (uint32_t(channel) << 8) | note; }
+  static int MakeId(uint32_t slot, uint32_t gen) { return int((gen << kSlotBits) | slot); }
+
+  Slot* _slot(int id) {
+    if (id < 0)
+      return nullptr;
+    const uint32_t slot = uint32_t(id) & kSlotMask;
+    if (slot >= m_slots.size())
+      return nullptr;
+    Slot& s = m_slots[slot];
+    return (s.live && s.gen == (uint32_t(id) >> kSlotBits)) ? &s : nullptr;
+  }
+
+public:
+  /** Store a copy of ctx; returns its ID, or -1 if every slot is in use */
+  int insert(const MacroExecContext& ctx) {
+    uint32_t slot;
+    if (!m_freeSlots.empty()) {
+      slot = m_freeSlots.back();
+      m_freeSlots.pop_back();
+    } else if (m_slots.size() <= kSlotMask) {
+      slot = uint32_t(m_slots.size());
+      m_slots.emplace_back();
+    } else {
+      return -1;
+    }
+    Slot& s = m_slots[slot];
+    s.ctx = ctx;
+    s.live = true;
+    ++m_liveCount;
+    const int id = MakeId(slot, s.gen);
+
+    std::vector<int>& ids = m_noteIndex[NoteKey(ctx.channel, ctx.triggerNote)];
+    std::erase_if(ids, [this](int other) { return !_slot(other); });
+    ids.push_back(id);
+    return id;
+  }
+
+  MacroExecContext* find(int id) {
+    Slot* s = _slot(id);
+    return s ? &s->ctx : nullptr;
+  }
+
+  void erase(int id) {
+    Slot* s = _slot(id);
+    if (!s)
+      return;
+    s->ctx = MacroExecContext{};
+    s->live = false;
+    s->gen = (s->gen + 1) & kGenMask;
+    --m_liveCount;
+    m_freeSlots.push_back(uint32_t(id) & kSlotMask);
+  }
+
+  /** Erase every context; IDs handed out before stay invalid */
+  void clear() {
+    for (uint32_t slot = 0; slot < m_slots.size(); ++slot)
+      if (m_slots[slot].live)
+        erase(MakeId(slot, m_slots[slot].gen));
+    m_noteIndex.clear();
+  }
+
+  /** Oldest running context triggered by (channel, note) that has not yet received a key-off,
+   *  or null. Key-offs are never withdrawn, so contexts past one leave the index here. */
+  MacroExecContext* findNoteOffTarget(int channel, uint8_t note, int& idOut) {
+    auto it = m_noteIndex.find(NoteKey(channel, note));
+    if (it == m_noteIndex.end())
+      return nullptr;
+    std::vector<int>& ids = it->second;
+    MacroExecContext* ret = nullptr;
+    size_t keep = 0;
+    for (size_t i = 0; i < ids.size(); ++i) {
+      MacroExecContext* ctx = find(ids[i]);
+      /* A generation-wrapped ID may name a newer context of another note */
+      if (!ctx || ctx->keyoffReceived || ctx->channel != channel || ctx->triggerNote != note)
+        continue;
+      if (!ret && !ctx->ended) {
+        ret = ctx;
+        idOut = ids[i];
+      }
+      ids[keep++] = ids[i];
+    }
+    ids.resize(keep);
+    if (ids.empty())
+      m_noteIndex.erase(it);
+    return ret;
+  }
+
+  size_t size() const { return m_liveCount; }
+  bool empty() const { return m_liveCount == 0; }
+};
+
 } // namespace amuse
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <memory>
 #include <vector>
 
@@ -28,6 +29,10 @@ public:
   /** Amuse obtains a new voice from the platform this way */
   virtual std::unique_ptr<IBackendVoice> allocateVoice(Voice& clientVox, double sampleRate, bool dynamicPitch) = 0;
 
+  /** Amuse announces the capacity of its voice pool this way, so the platform may preallocate the
+   *  resources of that many voices instead of allocating them on note-on */
+  virtual void reserveVoices(size_t count) {}
+
   /** Amuse obtains a new submix from the platform this way */
   virtual std::unique_ptr<IBackendSubmix> allocateSubmix(Submix& clientSmx, bool mainOut, int busId) = 0;
 
@@ -5,6 +5,7 @@
 namespace amuse {
 class Listener {
   friend class Emitter;
+  friend class EmitterBatch;
   friend class Engine;
   Vector3f m_pos = {};
   Vector3f m_dir = {};
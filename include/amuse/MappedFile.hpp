@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+
+namespace amuse {
+
+/** Private (copy-on-write) memory mapping of an entire open file.
+ *  Containers reference their uncompressed chunks directly inside the mapping instead of reading
+ *  them into heap buffers; pages are faulted in on first use and stay shared with the page cache. */
+class MappedFile {
+  unsigned char* m_data = nullptr;
+  size_t m_size = 0;
+#if _WIN32
+  void* m_mapping = nullptr;
+#endif
+
+  MappedFile() = default;
+
+public:
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  /** Map the whole of fp; null when the file is empty or cannot be mapped, leaving callers to fall back to reads */
+  static std::shared_ptr<MappedFile> Map(FILE* fp);
+
+  unsigned char* data() const { return m_data; }
+  size_t size() const { return m_size; }
+};
+
+} // namespace amuse
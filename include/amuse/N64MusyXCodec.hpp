@@ -14,3 +14,16 @@ unsigned N64MusyXDecompressFrame(int16_t* out, const uint8_t* in, const int16_t
 
 unsigned N64MusyXDecompressFrameRanged(int16_t* out, const uint8_t* in, const int16_t coefs[8][2][8],
                                        unsigned firstSample, unsigned lastSample);
+
+/** Decode sampleCount samples from contiguous 40-byte frames, starting at sample firstSample of the frame at in.
+ *  Equivalent to N64MusyXDecompressFrameRanged followed by N64MusyXDecompressFrame on each subsequent frame,
+ *  using the widest SIMD path the running CPU supports */
+unsigned N64MusyXDecompressFrames(int16_t* out, const uint8_t* in, const int16_t coefs[8][2][8],
+                                  unsigned firstSample, unsigned sampleCount);
+
+/** Portable reference implementation of N64MusyXDecompressFrames */
+unsigned N64MusyXDecompressFramesScalar(int16_t* out, const uint8_t* in, const int16_t coefs[8][2][8],
+                                        unsigned firstSample, unsigned sampleCount);
+
+/** Name of the instruction set N64MusyXDecompressFrames dispatches to ("avx2", "sse4.1" or "scalar") */
+const char* N64MusyXDecompressFramesISA();
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "amuse/IBackendSubmix.hpp"
+#include "amuse/IBackendVoice.hpp"
+#include "amuse/IBackendVoiceAllocator.hpp"
+#include "amuse/VoicePool.hpp"
+#include "amuse/WorkerPool.hpp"
+
+namespace amuse {
+class OfflineBackendSubmix;
+class OfflineBackendVoiceAllocator;
+
+/** Backend voice implementation for the in-process offline mixer */
+class OfflineBackendVoice : public IBackendVoice {
+  friend class OfflineBackendVoiceAllocator;
+  OfflineBackendVoiceAllocator& m_parent;
+  Voice& m_clientVox;
+  double m_sampleRate;
+  double m_pitchRatio = 1.0;
+  bool m_dynamicPitch;
+  bool m_running = false;
+
+  /* Linear-interpolation resampler state (source samples straddling the read phase) */
+  double m_resampPhase = 0.0;
+  int16_t m_resampLast = 0;
+  int16_t m_resampNext = 0;
+  bool m_resampPrimed = false;
+
+  struct SubmixSend {
+    OfflineBackendSubmix* m_submix;
+    std::array<float, 8> m_curCoefs;
+    std::array<float, 8> m_targetCoefs;
+    std::vector<float> m_routeBuf;
+  };
+  static constexpr size_t MaxSends = 4; /**< Main, AuxA, AuxB and one studio send without reallocating */
+  std::vector<SubmixSend> m_sends;
+  std::vector<int16_t> m_srcBuf;
+  std::vector<float> m_resampBuf;
+  std::list<OfflineBackendVoice*>::iterator m_parentIt;
+
+  /* Mixing is split so the decode stage can run concurrently across voices:
+   * _pumpControl runs the macro VM (touches shared engine state, always serial),
+   * _renderAudio decodes, resamples and routes into voice-local buffers,
+   * _mixSends accumulates those buffers into the submixes (serial, in voice order) */
+  void _pumpControl(double dt);
+  void _renderAudio(size_t frames, double dt);
+  void _mixSends(size_t frames);
+
+public:
+  OfflineBackendVoice(OfflineBackendVoiceAllocator& parent, Voice& clientVox, double sampleRate, bool dynamicPitch);
+  ~OfflineBackendVoice() override;
+
+  /** Handles are carved from a shared block pool so steady-state note-ons stay off the heap */
+  static void* operator new(size_t sz);
+  static void operator delete(void* ptr, size_t sz);
+
+  void resetSampleRate(double sampleRate) override;
+
+  void resetChannelLevels() override;
+  void setChannelLevels(IBackendSubmix* submix, const std::array<float, 8>& coefs, bool slew) override;
+  void setPitchRatio(double ratio, bool slew) override;
+  void start() override;
+  void stop() override;
+};
+
+/** Backend submix implementation for the in-process offline mixer */
+class OfflineBackendSubmix : public IBackendSubmix {
+  friend class OfflineBackendVoiceAllocator;
+  friend class OfflineBackendVoice;
+  OfflineBackendVoiceAllocator& m_parent;
+  Submix& m_clientSmx;
+  bool m_mainOut;
+  int m_busId;
+  std::vector<float> m_buffer; /**< Interleaved mix accumulated during the current 5ms interval */
+  std::vector<std::pair<OfflineBackendSubmix*, float>> m_sends;
+  std::list<OfflineBackendSubmix*>::iterator m_parentIt;
+
+public:
+  OfflineBackendSubmix(OfflineBackendVoiceAllocator& parent, Submix& clientSmx, bool mainOut, int busId);
+  ~OfflineBackendSubmix() override;
+  void setSendLevel(IBackendSubmix* submix, float level, bool slew) override;
+  double getSampleRate() const override;
+  SubmixFormat getSampleFormat() const override;
+};
+
+/** Backend voice allocator implementation that mixes in-process without an audio device.
+ *  The client drives mixing explicitly with pumpAndMixVoices, as fast as it likes. */
+class OfflineBackendVoiceAllocator : public IBackendVoiceAllocator {
+  friend class OfflineBackendVoice;
+  friend class OfflineBackendSubmix;
+  Engine* m_cbInterface = nullptr;
+  double m_sampleRate;
+  ChannelMap m_chanMap;
+  AudioChannelSet m_chanSet;
+  size_t m_5msFrames;
+  float m_volume = 1.f;
+  bool m_mixing = false;
+  std::list<OfflineBackendVoice*> m_voices;
+  std::list<OfflineBackendSubmix*> m_submixes;
+
+  /* Storage retired by destroyed voices and reused by the next allocations */
+  struct SpareVoiceBuffers {
+    std::vector<OfflineBackendVoice::SubmixSend> m_sends;
+    std::vector<int16_t> m_srcBuf;
+    std::vector<float> m_resampBuf;
+  };
+  std::vector<SpareVoiceBuffers> m_spareBuffers;
+  std::vector<std::vector<float>> m_spareRouteBufs;
+  std::list<OfflineBackendVoice*> m_spareNodes;
+
+  std::vector<OfflineBackendVoice*> m_renderVoices;
+  std::unique_ptr<WorkerPool> m_renderPool;
+
+public:
+  /** chCount of 2, 4, 6 or 8 selects stereo, quad, 5.1 or 7.1 output in WAV speaker order */
+  OfflineBackendVoiceAllocator(double sampleRate = 32000.0, unsigned chCount = 2);
+  std::unique_ptr<IBackendVoice> allocateVoice(Voice& clientVox, double sampleRate, bool dynamicPitch) override;
+  void reserveVoices(size_t count) override;
+  std::unique_ptr<IBackendSubmix> allocateSubmix(Submix& clientSmx, bool mainOut, int busId) override;
+  std::vector<std::pair<std::string, std::string>> enumerateMIDIDevices() override;
+  std::unique_ptr<IMIDIReader> allocateMIDIReader(Engine& engine) override;
+  AudioChannelSet getAvailableSet() override;
+  void setVolume(float vol) override;
+  void setCallbackInterface(Engine* engine) override;
+
+  double getSampleRate() const { return m_sampleRate; }
+  unsigned getChannelCount() const { return m_chanMap.m_channelCount; }
+  const ChannelMap& getChannelMap() const { return m_chanMap; }
+
+  /** Opt-in parallel decode of voices across threadCount threads (including the mixing thread).
+   *  Output is bit-identical to the single-threaded path; 1 disables, 0 uses all hardware threads */
+  void setRenderThreads(unsigned threadCount);
+  unsigned getRenderThreads() const { return m_renderPool ? m_renderPool->getThreadCount() : 1; }
+
+  /** Number of frames mixed by one call to pumpAndMixVoices */
+  size_t get5MsFrames() const { return m_5msFrames; }
+
+  /** Advance the engine by one 5ms interval and write get5MsFrames() interleaved frames
+   *  (normalized to [-1, 1] before clipping) into dataOut */
+  void pumpAndMixVoices(float* dataOut);
+
+  /** Same as above, converting and clamping to 16-bit PCM */
+  void pumpAndMixVoices(int16_t* dataOut);
+};
+
+/** Streams interleaved 16-bit PCM to disk as a RIFF WAV or headerless raw file */
+class OfflinePCMWriter {
+  FILE* m_fp = nullptr;
+  bool m_raw = false;
+  uint32_t m_sampleRate = 0;
+  uint16_t m_channelCount = 0;
+  uint64_t m_dataBytes = 0;
+
+  void _writeHeader();
+
+public:
+  OfflinePCMWriter() = default;
+  OfflinePCMWriter(const OfflinePCMWriter&) = delete;
+  OfflinePCMWriter& operator=(const OfflinePCMWriter&) = delete;
+  ~OfflinePCMWriter() { close(); }
+
+  /** Open path for writing; raw omits the WAV header. Returns false if the file could not be created */
+  bool open(const char* path, uint32_t sampleRate, uint16_t channelCount, bool raw = false);
+
+  /** Append frameCount interleaved frames */
+  void write(const int16_t* data, size_t frameCount);
+
+  /** Patch WAV chunk sizes and close the file */
+  void close();
+
+  bool isOpen() const { return m_fp != nullptr; }
+  uint64_t getFrameCount() const { return m_channelCount ? m_dataBytes / (2 * m_channelCount) : 0; }
+};
+
+} // namespace amuse
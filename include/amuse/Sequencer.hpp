@@ -1,9 +1,10 @@
 #pragma once
 
+#include <array>
 #include <cstddef>
 #include <cstdint>
 #include <unordered_map>
-#include <unordered_set>
+#include <vector>
 
 #include "amuse/AudioGroupProject.hpp"
 #include "amuse/Common.hpp"
@@ -42,30 +43,44 @@ class Sequencer : public Entity {
   float m_stopFadeTime = 0.f;
   float m_stopFadeBeginVol = 0.f;
 
+  /** Controller state of a MIDI channel; everything a seek checkpoint needs to restore it */
+  struct ChannelControls {
+    const SongGroupIndex::PageEntry* m_page = nullptr;
+    std::array<int8_t, 134> m_ctrlVals{}; /**< MIDI controller values (134 to match MusyX extended CCs) */
+    float m_curPitchWheel = 0.f;          /**< MIDI pitch-wheel */
+    int8_t m_pitchWheelRange = -1;        /**< Pitch wheel range settable by RPN 0 */
+    int8_t m_curProgram = 0;              /**< MIDI program number */
+    float m_curVol = 1.f;                 /**< Current volume of channel */
+    float m_curPan = 0.f;                 /**< Current panning of channel */
+    uint16_t m_rpn = 0x3FFF;              /**< Current RPN; 0x3FFF = null (no parameter selected, matching MusyX cold defaults) */
+    double m_ticksPerSec = 1000.0;        /**< Current ticks per second (tempo) for channel */
+  };
+
   /** State of a single MIDI channel */
-  struct ChannelState {
+  struct ChannelState : ChannelControls {
     Sequencer* m_parent = nullptr;
     uint8_t m_chanId = 0;
     const SongGroupIndex::MIDISetup* m_setup = nullptr; /* Channel defaults to program 0 if null */
-    const SongGroupIndex::PageEntry* m_page = nullptr;
     ~ChannelState();
     ChannelState() = default;
     ChannelState(Sequencer& parent, uint8_t chanId);
+    ChannelState(ChannelState&&) = default;
+    ChannelState& operator=(ChannelState&&) = default;
     explicit operator bool() const { return m_parent != nullptr; }
 
     /** Voices corresponding to currently-pressed keys in channel */
     std::unordered_map<uint8_t, ObjToken<Voice>> m_chanVoxs;
-    std::unordered_set<ObjToken<Voice>> m_keyoffVoxs;
+    /** Released voices still sounding, in release order; a vector so key-offs reuse its capacity */
+    std::vector<ObjToken<Voice>> m_keyoffVoxs;
+    /* Nodes of finished notes, reinserted by later notes so key on/off does not allocate */
+    std::vector<std::unordered_map<uint8_t, ObjToken<Voice>>::node_type> m_spareVoxNodes;
     ObjToken<Voice> m_lastVoice;
-    std::array<int8_t, 134> m_ctrlVals{}; /**< MIDI controller values (134 to match MusyX extended CCs) */
-    float m_curPitchWheel = 0.f;          /**< MIDI pitch-wheel */
-    int8_t m_pitchWheelRange = -1;        /**< Pitch wheel range settable by RPN 0 */
-    int8_t m_curProgram = 0;              /**< MIDI program number */
-    float m_curVol = 1.f;                 /**< Current volume of channel */
-    float m_curPan = 0.f;                 /**< Current panning of channel */
-    uint16_t m_rpn = 0x3FFF;              /**< Current RPN; 0x3FFF = null (no parameter selected, matching MusyX cold defaults) */
-    double m_ticksPerSec = 1000.0;        /**< Current ticks per second (tempo) for channel */
 
+    void _setChanVox(uint8_t note, ObjToken<Voice> vox);
+    std::unordered_map<uint8_t, ObjToken<Voice>>::iterator
+    _eraseChanVox(std::unordered_map<uint8_t, ObjToken<Voice>>::iterator it);
+    void _addKeyoffVox(ObjToken<Voice> vox);
+    std::vector<ObjToken<Voice>>::iterator _eraseKeyoffVox(std::vector<ObjToken<Voice>>::iterator it);
     void _bringOutYourDead();
     size_t getVoiceCount() const;
     ObjToken<Voice> keyOn(uint8_t note, uint8_t velocity);
@@ -86,8 +101,27 @@ class Sequencer : public Entity {
 
   void _bringOutYourDead();
   void _destroy();
+  void _rewindSong();
 
 public:
+  /** Song checkpoints at the start of every track region, built by buildSeekIndex() for fast seeks */
+  class SeekIndex {
+    friend class Sequencer;
+    struct Checkpoint {
+      SongState::Checkpoint m_song;
+      std::array<ChannelControls, 16> m_chans;
+      std::array<bool, 16> m_chanAllocated{};
+    };
+    const unsigned char* m_arrData = nullptr;
+    bool m_loop = false;
+    std::vector<Checkpoint> m_checkpoints;
+    const Checkpoint* _find(const unsigned char* arrData, bool loop, uint32_t tick) const;
+
+  public:
+    size_t size() const { return m_checkpoints.size(); }
+    bool empty() const { return m_checkpoints.empty(); }
+  };
+
   ~Sequencer() override;
   Sequencer(Engine& engine, const AudioGroup& group, GroupId groupId, const SongGroupIndex* songGroup, SongId setupId,
             ObjToken<Studio> studio);
@@ -140,6 +174,22 @@ public:
   /** Play MIDI arrangement */
   void playSong(const unsigned char* arrData, bool loop = true, bool dieOnEnd = true);
 
+  /** Jump the current arrangement to `tick` (384 per quarter-note) without sounding the notes in between.
+   *  Active voices stop immediately; controllers, programs, pitch/mod wheels and tempo take the values they
+   *  have at `tick`. Seeking forward fast-forwards from the current position, seeking backward replays
+   *  from the closest checkpoint of `index` (built for this arrangement) or from the song start.
+   *  Positions resolve to whole ticks: playback resumes exactly on `tick`, dropping any fraction of a tick
+   *  the song had already advanced into, so the resolution in time is one tick at the current tempo.
+   *  @return false if no arrangement is playing or it ends before `tick` */
+  bool seekSong(uint32_t tick, const SeekIndex* index = nullptr);
+
+  /** Checkpoint the current arrangement at each of its regions. The arrangement is replayed on a scratch
+   *  sequencer, so the playing song keeps its position, controllers and voices. */
+  SeekIndex buildSeekIndex() const;
+
+  /** Current position of the playing arrangement in ticks */
+  uint32_t getSongTick() const { return m_songState.getTick(); }
+
   /** Stop current MIDI arrangement */
   void stopSong(float fadeTime = 0.f, bool now = false);
 
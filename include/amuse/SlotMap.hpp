@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace amuse {
+
+/** Stable reference to a SlotMap value; stops resolving once the value is erased */
+struct SlotHandle {
+  uint32_t m_index = UINT32_MAX;
+  uint32_t m_generation = 0;
+  explicit operator bool() const { return m_index != UINT32_MAX; }
+  bool operator==(const SlotHandle& other) const = default;
+};
+
+/** Dense container with stable handles.
+ *  Values are stored contiguously so per-pump sweeps walk a flat array. Erasing moves the last
+ *  value into the hole, making removal O(1) at the cost of iteration order; erase(iterator)
+ *  returns the same position so list-style sweeps visit every value exactly once. */
+template <class T>
+class SlotMap {
+  struct Slot {
+    uint32_t m_dense;      /**< Index of value, or next free slot while unused */
+    uint32_t m_generation; /**< Bumped on erase to invalidate outstanding handles */
+  };
+
+  std::vector<T> m_values;
+  std::vector<uint32_t> m_valueSlots; /**< Slot index of each value */
+  std::vector<Slot> m_slots;
+  uint32_t m_freeSlot = UINT32_MAX;
+
+  void _eraseDense(uint32_t dense) {
+    const uint32_t slot = m_valueSlots[dense];
+    const uint32_t last = uint32_t(m_values.size() - 1);
+    if (dense != last) {
+      m_values[dense] = std::move(m_values[last]);
+      m_valueSlots[dense] = m_valueSlots[last];
+      m_slots[m_valueSlots[dense]].m_dense = dense;
+    }
+    m_values.pop_back();
+    m_valueSlots.pop_back();
+    m_slots[slot].m_dense = m_freeSlot;
+    ++m_slots[slot].m_generation;
+    m_freeSlot = slot;
+  }
+
+public:
+  using iterator = typename std::vector<T>::iterator;
+  using const_iterator = typename std::vector<T>::const_iterator;
+
+  template <class... Args>
+  SlotHandle emplace(Args&&... args) {
+    uint32_t slot;
+    if (m_freeSlot != UINT32_MAX) {
+      slot = m_freeSlot;
+      m_freeSlot = m_slots[slot].m_dense;
+    } else {
+      slot = uint32_t(m_slots.size());
+      m_slots.push_back({0, 0});
+    }
+    m_slots[slot].m_dense = uint32_t(m_values.size());
+    m_values.emplace_back(std::forward<Args>(args)...);
+    m_valueSlots.push_back(slot);
+    return {slot, m_slots[slot].m_generation};
+  }
+
+  T* get(SlotHandle handle) {
+    if (handle.m_index >= m_slots.size() || m_slots[handle.m_index].m_generation != handle.m_generation)
+      return nullptr;
+    return &m_values[m_slots[handle.m_index].m_dense];
+  }
+
+  void erase(SlotHandle handle) {
+    if (get(handle))
+      _eraseDense(m_slots[handle.m_index].m_dense);
+  }
+
+  iterator erase(iterator it) {
+    const auto dense = uint32_t(it - m_values.begin());
+    _eraseDense(dense);
+    return m_values.begin() + dense;
+  }
+
+  SlotHandle handleOf(const_iterator it) const {
+    const uint32_t slot = m_valueSlots[it - m_values.begin()];
+    return {slot, m_slots[slot].m_generation};
+  }
+
+  void reserve(size_t count) {
+    m_values.reserve(count);
+    m_valueSlots.reserve(count);
+    m_slots.reserve(count);
+  }
+
+  iterator begin() { return m_values.begin(); }
+  iterator end() { return m_values.end(); }
+  const_iterator begin() const { return m_values.begin(); }
+  const_iterator end() const { return m_values.end(); }
+  T& back() { return m_values.back(); }
+  const T& back() const { return m_values.back(); }
+  size_t size() const { return m_values.size(); }
+  bool empty() const { return m_values.empty(); }
+};
+
+} // namespace amuse
@@ -2,6 +2,8 @@
 
 #include <array>
 #include <cstdint>
+#include <utility>
+#include <vector>
 
 #include "amuse/Entity.hpp"
 
@@ -55,24 +57,12 @@ class SongState {
   int m_sngVersion;                          /**< Detected song revision, 1 has RLE-compressed delta-times */
   bool m_bigEndian;                          /**< True if loaded song is big-endian data */
 
-  /** State of a single track within arrangement */
-  struct Track {
-    struct Header {
-      uint32_t m_type;
-      uint32_t m_pitchOff;
-      uint32_t m_modOff;
-      void swapBig();
-    };
-
-    SongState* m_parent = nullptr;
-    uint8_t m_midiChan = 0xff;                 /**< MIDI channel number of song channel */
-    const TrackRegion* m_initRegion = nullptr; /**< Pointer to first track region */
+  /** Position of a track within the arrangement; everything a seek checkpoint needs to resume the track */
+  struct TrackCursor {
     const TrackRegion* m_curRegion = nullptr;  /**< Pointer to currently-playing track region */
     const TrackRegion* m_nextRegion = nullptr; /**< Pointer to next-queued track region */
 
-    double m_remDt = 0.0;         /**< Remaining dt for keeping remainder between cycles */
-    uint32_t m_curTick = 0;       /**< Current playback position for this track */
-    uint32_t m_loopStartTick = 0; /**< Tick to loop back to */
+    uint32_t m_curTick = 0; /**< Current playback position for this track */
     /** Current pointer to tempo control, iterated over playback */
     const TempoChange* m_tempoPtr = nullptr;
     uint32_t m_tempo = 0; /**< Current tempo (beats per minute) */
@@ -86,18 +76,47 @@ class SongState {
     int32_t m_modVal = 0;                            /**< Accumulated value of mod */
     uint32_t m_nextModTick = 0;                      /**< Upcoming position of mod wheel change */
     int32_t m_nextModDelta = 0;                      /**< Upcoming delta value of mod */
-    std::array<int, 128> m_remNoteLengths = {};      /**< Remaining ticks per note */
 
     int32_t m_eventWaitCountdown = 0; /**< Current wait in ticks */
     int32_t m_lastN64EventTick =
         0; /**< Last command time on this channel (for computing delta times from absolute times in N64 songs) */
+  };
+
+  /** State of a single track within arrangement */
+  struct Track : TrackCursor {
+    struct Header {
+      uint32_t m_type;
+      uint32_t m_pitchOff;
+      uint32_t m_modOff;
+      void swapBig();
+    };
+
+    SongState* m_parent = nullptr;
+    uint8_t m_midiChan = 0xff;                 /**< MIDI channel number of song channel */
+    const TrackRegion* m_initRegion = nullptr; /**< Pointer to first track region */
+
+    double m_remDt = 0.0;         /**< Remaining dt for keeping remainder between cycles */
+    uint32_t m_loopStartTick = 0; /**< Tick to loop back to */
+    uint64_t m_noteClock = 0;     /**< Ticks advanced so far; keeps counting through loops, unlike m_curTick */
+    /** m_noteClock value releasing each held note, 0 if not held */
+    std::array<uint64_t, 128> m_noteOffTicks = {};
+    /** Min-heap of pending (release tick, note); entries superseded in m_noteOffTicks are skipped */
+    std::vector<std::pair<uint64_t, uint8_t>> m_noteOffHeap;
 
     Track() = default;
     Track(SongState& parent, uint8_t midiChan, uint32_t loopStart, const TrackRegion* regions, uint32_t tempo);
     explicit operator bool() const { return m_parent != nullptr; }
     void setRegion(const TrackRegion* region);
     void advanceRegion();
+    void scheduleNoteOff(uint8_t note, uint16_t length);
+    void clearNoteOffs();
     bool advance(Sequencer& seq, double dt);
+    /** Executes `ticks` worth of commands; `seeking` applies controllers but skips notes */
+    bool advanceTicks(Sequencer& seq, uint32_t ticks, bool seeking);
+    /** Silently advances from the current position to `tick`, which must not lie behind it */
+    bool seek(Sequencer& seq, uint32_t tick);
+    /** Maps `tick` past the loop end back into the loop, as repeated playback would reach it */
+    uint32_t wrapTick(uint32_t tick) const;
     void resetTempo();
   };
   std::array<Track, 64> m_tracks;
@@ -121,6 +140,36 @@ public:
    *  @return `true` if END reached
    */
   bool advance(Sequencer& seq, double dt);
+
+  bool isLooping() const { return m_loop; }
+
+  /** Furthest position of any track (song ticks, 384 per quarter-note) */
+  uint32_t getTick() const;
+
+  /** Start ticks of every track region in ascending order, without duplicates */
+  std::vector<uint32_t> getRegionTicks() const;
+
+  /** Earliest position any track lands on when seeking to `tick`, after wrapping looped tracks */
+  uint32_t wrapTick(uint32_t tick) const;
+
+  /** True if every track can reach `tick` by fast-forwarding from where it is now */
+  bool canFastForward(uint32_t tick) const;
+
+  /** Fast-forwards every track to `tick` without sounding notes. Program changes, controllers,
+   *  pitch/mod wheel streams and tempo changes passed on the way are applied to `seq`; notes still
+   *  held at `tick` are dropped. Ticks past a track's loop end wrap into its loop.
+   *  @return `true` if END reached
+   */
+  bool seek(Sequencer& seq, uint32_t tick);
+
+  /** Cursors of all tracks at a song position, restorable without replaying commands */
+  struct Checkpoint {
+    uint32_t m_tick = 0;
+    SongPlayState m_songState = SongPlayState::Playing;
+    std::array<TrackCursor, 64> m_tracks;
+  };
+  Checkpoint getCheckpoint() const;
+  void restoreCheckpoint(const Checkpoint& checkpoint);
 };
 
 
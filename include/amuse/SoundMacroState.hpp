@@ -1,7 +1,10 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 #include "amuse/AudioGroupPool.hpp"
@@ -17,8 +20,43 @@ class Voice;
 
 /** Real-time state of SoundMacro execution */
 struct SoundMacroState {
+  /** Stack of (macro, PC) frames; typical GOSUB depths live inline so starting a voice does not allocate */
+  class PCStack {
+  public:
+    using Entry = std::tuple<ObjectId, const SoundMacro*, int>;
+
+  private:
+    static constexpr size_t InlineDepth = 4;
+    std::array<Entry, InlineDepth> m_inline{};
+    std::vector<Entry> m_spill;
+    size_t m_size = 0;
+
+  public:
+    bool empty() const { return m_size == 0; }
+    size_t size() const { return m_size; }
+    Entry& back() { return m_size > InlineDepth ? m_spill.back() : m_inline[m_size - 1]; }
+    const Entry& back() const { return m_size > InlineDepth ? m_spill.back() : m_inline[m_size - 1]; }
+    void clear() {
+      m_spill.clear();
+      m_size = 0;
+    }
+    template <class... Args>
+    void emplace_back(Args&&... args) {
+      if (m_size < InlineDepth)
+        m_inline[m_size] = Entry(std::forward<Args>(args)...);
+      else
+        m_spill.emplace_back(std::forward<Args>(args)...);
+      ++m_size;
+    }
+    void pop_back() {
+      if (m_size > InlineDepth)
+        m_spill.pop_back();
+      --m_size;
+    }
+  };
+
   /** 'program counter' stack for the active SoundMacro */
-  std::vector<std::tuple<ObjectId, const SoundMacro*, int>> m_pc;
+  PCStack m_pc;
   void _setPC(int pc) { std::get<2>(m_pc.back()) = std::get<1>(m_pc.back())->assertPC(pc); }
 
   double m_ticksPerSec; /**< ratio for resolving ticks in commands that use them */
@@ -58,6 +96,20 @@ struct SoundMacroState {
   struct Evaluator {
     enum class Combine : uint8_t { Set, Add, Mult };
     enum class VarType : uint8_t { Ctrl, Var };
+    /** Where a component reads its value from; resolved once when the component is added */
+    enum class Source : uint8_t {
+      Ctrl,
+      PitchWheel,
+      Aftertouch,
+      LFO1,
+      LFO2,
+      SurroundPan,
+      InitKey,
+      InitVel,
+      ExecTime,
+      Var,
+      None
+    };
 
     /** Represents one term of the formula assembled via *_SELECT commands */
     struct Component {
@@ -65,20 +117,35 @@ struct SoundMacroState {
       float m_scale;
       Combine m_combine;
       VarType m_varType;
+      Source m_source;
 
-      Component(uint8_t midiCtrl, float scale, Combine combine, VarType varType)
-      : m_midiCtrl(midiCtrl), m_scale(scale), m_combine(combine), m_varType(varType) {}
+      Component() = default;
+      Component(uint8_t midiCtrl, float scale, Combine combine, VarType varType);
     };
-    std::vector<Component> m_comps; /**< Components built up by the macro */
 
-    /** Combine additional component(s) to formula */
+  private:
+    /** Typical formulas live inline so *_SELECT commands on a fresh voice do not allocate;
+     *  longer ones move every term to m_spill */
+    static constexpr size_t InlineComponents = 4;
+    std::array<Component, InlineComponents> m_inline{};
+    std::vector<Component> m_spill;
+    size_t m_numComps = 0;
+    bool m_timeVarying = false; /**< An LFO term makes the value change within a mixing block */
+
+    const Component* _components() const { return m_numComps > InlineComponents ? m_spill.data() : m_inline.data(); }
+
+  public:
+
+    /** Combine additional component(s) to formula; a Set term discards the terms before it */
     void addComponent(uint8_t midiCtrl, float scale, Combine combine, VarType varType);
 
     /** Calculate value */
     float evaluate(double time, const Voice& vox, const SoundMacroState& st) const;
 
     /** Determine if able to use */
-    explicit operator bool() const { return m_comps.size() != 0; }
+    explicit operator bool() const { return m_numComps != 0; }
+    /** When false the value only changes between mixing blocks, so it may be evaluated once per block */
+    bool isTimeVarying() const { return m_timeVarying; }
   };
 
   Evaluator m_volumeSel;
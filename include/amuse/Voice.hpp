@@ -5,12 +5,15 @@
 #include <cstdlib>
 #include <list>
 #include <memory>
-#include <queue>
+#include <vector>
 
 #include "amuse/AudioGroup.hpp"
 #include "amuse/AudioGroupSampleDirectory.hpp"
+#include "amuse/DecodedSampleCache.hpp"
 #include "amuse/Entity.hpp"
 #include "amuse/Envelope.hpp"
+#include "amuse/IBackendVoiceAllocator.hpp"
+#include "amuse/SlotMap.hpp"
 #include "amuse/SoundMacroState.hpp"
 #include "amuse/Studio.hpp"
 
@@ -33,9 +36,18 @@ enum class VoiceState {
   Dead     /**< Default state, causes Engine to remove voice at end of pump cycle */
 };
 
+/** Stealing parameters of a voice about to be started */
+struct VoicePriority {
+  uint8_t m_priority = 127; /**< Voices of lower priority are stolen first (oldest first among equals) */
+  ObjectId m_limitId;       /**< Sound object counted against m_maxVoices */
+  uint8_t m_maxVoices = 255; /**< Concurrent voices allowed for m_limitId (0 and 255 are unlimited) */
+  bool isLimited() const { return m_maxVoices != 0 && m_maxVoices != 255; }
+};
+
 /** Individual source of audio */
 class Voice : public Entity {
   friend class Emitter;
+  friend class EmitterBatch;
   friend class Engine;
   friend class Envelope;
   friend class Sequencer;
@@ -65,13 +77,46 @@ class Voice : public Entity {
     int8_t m_width; /**< delta pan value to target of PANNING command */
   };
 
+  /** FIFO of pending sweeps; typical depths live inline so queueing one does not allocate */
+  class PanningQueue {
+    static constexpr size_t InlineDepth = 4;
+    std::array<Panning, InlineDepth> m_inline{}; /**< Ring holding the oldest sweeps */
+    std::vector<Panning> m_spill;                /**< Sweeps queued behind a full ring, oldest first */
+    size_t m_head = 0;
+    size_t m_size = 0;
+
+  public:
+    bool empty() const { return m_size == 0; }
+    Panning& front() { return m_inline[m_head]; }
+    void push(const Panning& p) {
+      if (m_size < InlineDepth)
+        m_inline[(m_head + m_size++) % InlineDepth] = p;
+      else
+        m_spill.push_back(p);
+    }
+    void pop() {
+      m_head = (m_head + 1) % InlineDepth;
+      --m_size;
+      if (!m_spill.empty()) {
+        m_inline[(m_head + m_size++) % InlineDepth] = m_spill.front();
+        m_spill.erase(m_spill.begin());
+      }
+    }
+  };
+
   void _setObjectId(ObjectId id) { m_objectId = id; }
 
   int m_vid;                        /**< VoiceID of this voice instance */
+  SlotHandle m_engineSlot;          /**< Handle in Engine's active voices (top-level voices only) */
   bool m_emitter;                   /**< Voice is part of an Emitter */
   ObjToken<Studio> m_studio;        /**< Studio this voice outputs to */
 
-  std::unique_ptr<IBackendVoice> m_backendVoice; /**< Handle to client-implemented backend voice */
+  std::unique_ptr<IBackendVoice> m_backendVoice; /**< Handle to client-implemented backend voice (null while virtual) */
+  double m_backendSampleRate = NativeSampleRate; /**< Sample rate last given to the backend voice */
+  double m_backendPitchRatio = 1.0;              /**< Pitch ratio last given to the backend voice */
+  bool m_dynamicPitch = true;                    /**< Backend voice was allocated with dynamic pitch */
+  bool m_virtual = false;                        /**< Backend voice released while inaudible; decoding skipped */
+  double m_virtualPhase = 0.0;                   /**< Fractional source samples carried between virtual periods */
   SoundMacroState m_state;                       /**< State container for SoundMacro playback */
   SoundMacroState::EventTrap m_keyoffTrap;    /**< Trap for keyoff (SoundMacro overrides default envelope behavior) */
   SoundMacroState::EventTrap m_sampleEndTrap; /**< Trap for sampleend (SoundMacro overrides voice removal) */
@@ -79,9 +124,15 @@ class Voice : public Entity {
   int32_t m_latestMessage = 0;                /**< Latest message received on voice */
   std::list<ObjToken<Voice>> m_childVoices;   /**< Child voices for PLAYMACRO usage */
   uint8_t m_keygroup = 0;                     /**< Keygroup voice is a member of */
+  VoicePriority m_priority;                   /**< Stealing priority and per-object voice limit */
+  uint64_t m_startSerial = 0;                 /**< Engine-wide start order, used to steal the oldest voice */
+  size_t m_stealIdx = SIZE_MAX;               /**< Position in the Engine's steal queue (SIZE_MAX if untracked) */
+  bool m_stolen = false;                      /**< Voice was stolen and is fading out before its kill */
 
   ObjToken<SampleEntryData> m_curSample;          /**< Current sample entry playing */
   const unsigned char* m_curSampleData = nullptr; /**< Current sample data playing */
+  std::shared_ptr<const DecodedSamplePCM> m_curDecoded; /**< Cached PCM of current sample (null when streaming) */
+  bool m_decodedLoopPass = false;                 /**< Cached playback has turned over at the loop end */
   SampleFormat m_curFormat;                       /**< Current sample format playing */
   uint32_t m_curSamplePos = 0;                    /**< Current sample position */
   uint32_t m_lastSamplePos = 0;                   /**< Last sample position (or last loop sample) */
@@ -94,6 +145,7 @@ class Voice : public Entity {
   float m_lastLevel = 0.f;                /**< Last computed level ([0,1] mapped to [-10,0] clamped decibels) */
   float m_nextLevel = 0.f;                /**< Next computed level used for lerp-mode amplitude */
   VolumeCache m_nextLevelCache;
+  std::array<float, 32> m_gainCurve = {}; /**< Block-curve gain for each sample of the current control period */
   VolumeCache m_lerpedCache;
 
   VoiceState m_voxState = VoiceState::Dead; /**< Current high-level state of voice */
@@ -141,8 +193,8 @@ class Voice : public Entity {
   uint8_t m_pitchSweep1It = 0;    /**< Current iteration of PITCHSWEEP1 controller */
   uint8_t m_pitchSweep2It = 0;    /**< Current iteration of PITCHSWEEP2 controller */
 
-  std::queue<Panning> m_panningQueue;  /**< Queue of PANNING commands */
-  std::queue<Panning> m_spanningQueue; /**< Queue of SPANNING commands */
+  PanningQueue m_panningQueue;  /**< Queue of PANNING commands */
+  PanningQueue m_spanningQueue; /**< Queue of SPANNING commands */
 
   float m_vibratoTime = -1.f;     /**< time since last VIBRATO command, -1 for no active vibrato */
   int32_t m_vibratoLevel = 0;     /**< scale of vibrato effect (in cents) */
@@ -154,44 +206,54 @@ class Voice : public Entity {
   float m_tremoloModScale = 0.f; /**< minimum volume factor produced via LFO, scaled via mod wheel */
 
   std::array<float, 2> m_lfoPeriods{};      /**< time-periods for LFO1 and LFO2 */
-  std::unique_ptr<int8_t[]> m_ctrlValsSelf; /**< Self-owned MIDI Controller values */
+  std::array<int8_t, 134> m_ctrlValsSelf{}; /**< Self-owned MIDI Controller values (inline, so never allocated) */
   int8_t* m_extCtrlVals = nullptr;          /**< MIDI Controller values (external storage) */
 
   uint16_t m_rpn = 0x3FFF; /**< Current RPN; 0x3FFF = null (no parameter selected, matching MusyX cold defaults) */
 
   void _destroy();
+  void _steal();
   bool _checkSamplePos(bool& looped);
   void _doKeyOff();
   void _macroKeyOff();
   void _macroSampleEnd();
+  void _advanceLevel(double dt, uint32_t steps);
   void _procSamplePre(int16_t& samp);
+  void _procSamplesPre(int16_t* data, uint32_t count);
+  uint32_t _copyDecoded(int16_t* data, uint32_t count) const;
   VolumeCache m_masterCache;
-  template <typename T>
-  T _procSampleMaster(double time, T samp);
+  float _masterGain(double time);
   VolumeCache m_auxACache;
-  template <typename T>
-  T _procSampleAuxA(double time, T samp);
+  float _auxAGain(double time);
   VolumeCache m_auxBCache;
+  float _auxBGain(double time);
   template <typename T>
-  T _procSampleAuxB(double time, T samp);
+  void _routeAudio(size_t frames, double dt, int busId, const T* in, T* out);
   void _setTotalPitch(int32_t cents, bool slew);
   bool _isRecursivelyDead();
   void _bringOutYourDead();
   static uint32_t _GetBlockSampleCount(SampleFormat fmt);
   ObjToken<Voice> _findVoice(int vid, ObjToken<Voice> thisPtr);
-  std::unique_ptr<int8_t[]>& _ensureCtrlVals();
 
-  std::list<ObjToken<Voice>>::iterator _allocateVoice(double sampleRate, bool dynamicPitch);
+  void _allocateBackendVoice(double sampleRate, bool dynamicPitch);
+  void _virtualize();
+  void _materialize(const std::array<float, 8>& coefs);
+  void _advanceVirtual(double dt);
+  void _skipSamples(uint32_t count);
+
+  std::list<ObjToken<Voice>>::iterator _allocateVoice(double sampleRate, bool dynamicPitch, const VoicePriority& prio);
   std::list<ObjToken<Voice>>::iterator _destroyVoice(std::list<ObjToken<Voice>>::iterator it);
 
   bool _loadSoundMacro(SoundMacroId id, const SoundMacro* macroData, int macroStep, double ticksPerSec, uint8_t midiKey,
                        uint8_t midiVel, uint8_t midiMod, bool pushPc = false);
+  /** Priority a page object starts with: keymaps and layers add the mapped key's prioOffset */
+  static VoicePriority _PagePriority(const AudioGroup& group, ObjectId objectId, uint8_t midiKey, VoicePriority prio);
   bool _loadKeymap(const Keymap* keymap, double ticksPerSec, uint8_t midiKey, uint8_t midiVel, uint8_t midiMod,
                    bool pushPc = false);
   bool _loadLayer(const std::vector<LayerMapping>& layer, double ticksPerSec, uint8_t midiKey, uint8_t midiVel,
                   uint8_t midiMod, bool pushPc = false);
   ObjToken<Voice> _startChildMacro(ObjectId macroId, int macroStep, double ticksPerSec, uint8_t midiKey,
-                                   uint8_t midiVel, uint8_t midiMod, bool pushPc = false);
+                                   uint8_t midiVel, uint8_t midiMod, const VoicePriority& prio, bool pushPc = false);
 
   std::array<float, 8> _panLaw(float frontPan, float backPan, float totalSpan) const;
   void _setPan(float pan);
@@ -235,6 +297,9 @@ public:
   /** Allocate parallel macro and tie to voice for possible emitter influence */
   ObjToken<Voice> startChildMacro(int8_t addNote, ObjectId macroId, int macroStep);
 
+  /** Allocate parallel macro with its own stealing priority and voice limit (PLAYMACRO) */
+  ObjToken<Voice> startChildMacro(int8_t addNote, ObjectId macroId, int macroStep, const VoicePriority& prio);
+
   /** Load specified SoundMacro Object from within group into voice */
   bool loadMacroObject(SoundMacroId macroId, int macroStep, double ticksPerSec, uint8_t midiKey, uint8_t midiVel,
                        uint8_t midiMod, bool pushPc = false);
@@ -270,6 +335,9 @@ public:
   /** Set current voice channel coefficients immediately */
   void setChannelCoefs(const std::array<float, 8>& coefs);
 
+  /** -3dB panning law for the channels of `set` (Stereo when unknown) */
+  static std::array<float, 8> PanLaw(AudioChannelSet set, float frontPan, float backPan, float totalSpan);
+
   /** Start volume envelope to specified level */
   void startEnvelope(double dur, float vol, const Curve* envCurve);
 
@@ -336,6 +404,15 @@ public:
   /** Set aftertouch */
   void setAftertouch(uint8_t aftertouch);
 
+  /** Get stealing priority of voice */
+  uint8_t getPriority() const { return m_priority.m_priority; }
+
+  /** Set stealing priority of voice (clamped to [0,255]) */
+  void setPriority(int priority);
+
+  /** Voice was stolen by the Engine's polyphony limit and is fading out */
+  bool isStolen() const { return m_stolen; }
+
   /** Assign voice to keygroup for coordinated mass-silencing */
   void setKeygroup(uint8_t kg) { m_keygroup = kg; }
 
@@ -347,31 +424,25 @@ public:
 
   /** Get MIDI Controller value on voice */
   int8_t getCtrlValue(uint16_t ctrl) const {
-    if (!m_extCtrlVals) {
-      if (m_ctrlValsSelf && ctrl < 134)
-        return m_ctrlValsSelf[ctrl];
+    if (ctrl >= 134)
       return 0;
-    }
-    if (ctrl < 134)
-      return m_extCtrlVals[ctrl];
-    return 0;
+    return m_extCtrlVals ? m_extCtrlVals[ctrl] : m_ctrlValsSelf[ctrl];
   }
 
   /** Set MIDI Controller value on voice */
   void setCtrlValue(uint16_t ctrl, int8_t val) {
     if (ctrl >= 134)
       return;
-    if (!m_extCtrlVals) {
-      std::unique_ptr<int8_t[]>& vals = _ensureCtrlVals();
-      vals[ctrl] = val;
-    } else
+    if (!m_extCtrlVals)
+      m_ctrlValsSelf[ctrl] = val;
+    else
       m_extCtrlVals[ctrl] = val;
     _notifyCtrlChange(ctrl, val);
   }
 
   /** 'install' external MIDI controller storage */
   void installCtrlValues(int8_t* cvs) {
-    m_ctrlValsSelf.reset();
+    m_ctrlValsSelf.fill(0);
     m_extCtrlVals = cvs;
     for (ObjToken<Voice>& vox : m_childVoices)
       vox->installCtrlValues(cvs);
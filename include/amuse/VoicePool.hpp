@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace amuse {
+
+/** Fixed-capacity slab of equally sized blocks for voice storage.
+ *  Freed blocks are threaded onto an intrusive free list and handed out again on the next note-on,
+ *  so steady-state voice allocation never reaches the heap. The slab is sized on first use (the
+ *  block size is that of the shared_ptr control block holding a Voice); requests that do not fit
+ *  a block, or arrive while every block is in use, fall back to the heap and are counted. */
+class VoicePool {
+  struct FreeBlock {
+    FreeBlock* m_next;
+  };
+
+  mutable std::mutex m_lock; /**< Tokens may be released from client threads */
+  std::unique_ptr<std::byte[]> m_slab;
+  size_t m_capacity;
+  size_t m_blockSize = 0;
+  FreeBlock* m_freeList = nullptr;
+  size_t m_inUse = 0;
+  size_t m_peakInUse = 0;
+  uint64_t m_heapAllocations = 0;
+
+  bool _ownsBlock(const void* ptr) const;
+
+public:
+  struct Stats {
+    size_t m_capacity;
+    size_t m_inUse;
+    size_t m_peakInUse;
+    uint64_t m_heapAllocations; /**< Allocations that missed the slab */
+  };
+
+  static constexpr size_t DefaultCapacity = 256;
+
+  explicit VoicePool(size_t capacity = DefaultCapacity) : m_capacity(capacity) {}
+  VoicePool(const VoicePool&) = delete;
+  VoicePool& operator=(const VoicePool&) = delete;
+
+  void* allocate(size_t bytes);
+  void deallocate(void* ptr, size_t bytes);
+
+  uint64_t getHeapAllocations() const;
+  Stats getStats() const;
+
+  /** Standard allocator adapter for std::allocate_shared; shares ownership of the pool so
+   *  tokens the client still holds can be released after the engine is gone */
+  template <class T>
+  struct Allocator {
+    using value_type = T;
+    std::shared_ptr<VoicePool> m_pool;
+
+    explicit Allocator(std::shared_ptr<VoicePool> pool) : m_pool(std::move(pool)) {}
+    template <class U>
+    Allocator(const Allocator<U>& other) : m_pool(other.m_pool) {}
+
+    T* allocate(size_t n) {
+      static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned types are not supported");
+      return static_cast<T*>(m_pool->allocate(n * sizeof(T)));
+    }
+    void deallocate(T* ptr, size_t n) { m_pool->deallocate(ptr, n * sizeof(T)); }
+
+    template <class U>
+    bool operator==(const Allocator<U>& other) const {
+      return m_pool == other.m_pool;
+    }
+  };
+};
+
+} // namespace amuse
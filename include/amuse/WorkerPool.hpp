@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace amuse {
+
+/** Fixed set of worker threads for fanning out independent, index-addressed jobs.
+ *  The calling thread participates, so a pool of one thread runs everything inline. */
+class WorkerPool {
+  std::vector<std::thread> m_threads;
+  std::mutex m_lock;
+  std::condition_variable m_startCv;
+  std::condition_variable m_doneCv;
+  const std::function<void(size_t)>* m_job = nullptr;
+  size_t m_jobCount = 0;
+  std::atomic<size_t> m_nextIdx = 0;
+  size_t m_busyWorkers = 0;
+  uint64_t m_generation = 0;
+  bool m_running = true;
+  std::exception_ptr m_exception;
+
+  void _workerProc();
+  void _drainJobs();
+
+public:
+  /** threadCount includes the calling thread; 0 selects HardwareThreads() */
+  explicit WorkerPool(unsigned threadCount = 0);
+  ~WorkerPool();
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  unsigned getThreadCount() const { return unsigned(m_threads.size()) + 1; }
+
+  /** Invoke func(i) for every i in [0, count) and block until all calls return.
+   *  Calls may run in any order on any thread; the first exception thrown is rethrown here. */
+  void parallelFor(size_t count, const std::function<void(size_t)>& func);
+
+  static unsigned HardwareThreads();
+};
+
+} // namespace amuse
@@ -2,10 +2,12 @@
 
 #include "amuse/AudioGroup.hpp"
 #include "amuse/AudioGroupData.hpp"
+#include "amuse/AudioGroupLoader.hpp"
 #include "amuse/AudioGroupPool.hpp"
 #include "amuse/AudioGroupProject.hpp"
 #include "amuse/AudioGroupSampleDirectory.hpp"
 #include "amuse/ContainerRegistry.hpp"
+#include "amuse/DecodedSampleCache.hpp"
 #include "amuse/EffectChorus.hpp"
 #include "amuse/EffectDelay.hpp"
 #include "amuse/EffectReverb.hpp"
@@ -1,9 +1,11 @@
 #include "amuse/AudioGroup.hpp"
 
+#include <optional>
 #include <regex>
 #include <sstream>
 
 #include "amuse/AudioGroupData.hpp"
+#include "amuse/WorkerPool.hpp"
 
 #include <athena/FileReader.hpp>
 #include <fmt/ostream.h>
@@ -17,7 +19,8 @@ void AudioGroup::assign(const AudioGroupData& data) {
   m_pool = AudioGroupPool::CreateAudioGroupPool(data);
   m_proj = AudioGroupProject::CreateAudioGroupProject(data);
   m_sdir = AudioGroupSampleDirectory::CreateAudioGroupSampleDirectory(data);
-  m_samp = data.getSamp();
+  _assignSamp(data);
+  getSampData();
 }
 void AudioGroup::assign(std::string_view groupPath) {
   /* Reverse order when loading intermediates */
@@ -26,6 +29,8 @@ void AudioGroup::assign(std::string_view groupPath) {
   m_pool = AudioGroupPool::CreateAudioGroupPool(groupPath);
   m_proj = AudioGroupProject::CreateAudioGroupProject(groupPath);
   m_samp = nullptr;
+  m_lazySamp.reset();
+  m_sampHold.reset();
 }
 void AudioGroup::assign(const AudioGroup& data, std::string_view groupPath) {
   /* Reverse order when loading intermediates */
@@ -34,6 +39,26 @@ void AudioGroup::assign(const AudioGroup& data, std::string_view groupPath) {
   m_pool = AudioGroupPool::CreateAudioGroupPool(groupPath);
   m_proj = AudioGroupProject::CreateAudioGroupProject(data.getProj());
   m_samp = nullptr;
+  m_lazySamp.reset();
+  m_sampHold.reset();
+}
+
+void AudioGroup::_assignSamp(const AudioGroupData& data) {
+  m_lazySamp = data.getLazySamp();
+  m_lazyN64Parms = m_lazySamp && data.getDataFormat() == DataFormat::N64;
+  m_sampHold.reset();
+  m_samp = m_lazySamp ? nullptr : data.getSamp();
+}
+
+const unsigned char* AudioGroup::getSampData() const {
+  if (!m_samp && m_lazySamp) {
+    m_sampHold = m_lazySamp->acquire();
+    m_samp = m_sampHold.get();
+    /* N64 codebooks are stored with the samples, so they were not read with the directory */
+    if (m_lazyN64Parms)
+      m_sdir.loadN64ADPCMParms(m_samp);
+  }
+  return m_samp;
 }
 
 const SampleEntry* AudioGroup::getSample(SampleId sfxId) const {
@@ -54,7 +79,7 @@ std::pair<ObjToken<SampleEntryData>, const unsigned char*> AudioGroup::getSample
     const_cast<SampleEntry*>(sample)->loadLooseData(basePath);
     return {sample->m_data, sample->m_data->m_looseData.get()};
   }
-  return {sample->m_data, m_samp + sample->m_data->m_sampleOff};
+  return {sample->m_data, getSampData() + sample->m_data->m_sampleOff};
 }
 
 SampleFileState AudioGroup::getSampleFileState(SampleId sfxId, const SampleEntry* sample, std::string* pathOut) const {
@@ -80,12 +105,33 @@ void AudioGroup::makeWAVVersion(SampleId sfxId, const SampleEntry* sample) const
   }
 }
 
-void AudioGroup::makeCompressedVersion(SampleId sfxId, const SampleEntry* sample) const {
+void AudioGroup::makeCompressedVersion(SampleId sfxId, const SampleEntry* sample, WorkerPool* pool) const {
   if (sample->m_data->m_looseData) {
-    m_sdir._extractCompressed(sfxId, *sample->m_data, m_groupPath, sample->m_data->m_looseData.get(), true);
+    m_sdir._extractCompressed(sfxId, *sample->m_data, m_groupPath, sample->m_data->m_looseData.get(), true, pool);
   }
 }
 
+void AudioGroup::makeCompressedVersions(const std::vector<std::pair<SampleId, const SampleEntry*>>& samples,
+                                        WorkerPool* pool) const {
+  std::optional<WorkerPool> ownPool;
+  if (!pool && !samples.empty())
+    pool = &ownPool.emplace();
+  if (!pool || samples.size() < pool->getThreadCount()) {
+    /* Too few samples to occupy the pool; parallelize within each sample instead */
+    for (const auto& [sfxId, sample] : samples)
+      makeCompressedVersion(sfxId, sample, pool);
+    return;
+  }
+
+  /* Workers only read the sample NameDB to resolve file names */
+  NameDB* sampleDb = SampleId::CurNameDB;
+  pool->parallelFor(samples.size(), [&](size_t i) {
+    NameDB* prevDb = std::exchange(SampleId::CurNameDB, sampleDb);
+    makeCompressedVersion(samples[i].first, samples[i].second);
+    SampleId::CurNameDB = prevDb;
+  });
+}
+
 void AudioGroupDatabase::renameSample(SampleId id, std::string_view str) {
   std::string oldBasePath = getSampleBasePath(id);
   SampleId::CurNameDB->rename(id, str);
@@ -2,37 +2,84 @@
 
 namespace amuse {
 
-IntrusiveAudioGroupData::~IntrusiveAudioGroupData() {
-  if (m_owns) {
+LazySampleChunk::~LazySampleChunk() {
+  if (m_prefetch.valid())
+    m_prefetch.wait();
+}
+
+std::shared_ptr<unsigned char[]> LazySampleChunk::acquire() {
+  std::unique_lock lk(m_lock);
+  if (!m_data) {
+    std::shared_ptr<unsigned char[]> data(new unsigned char[m_size]);
+    m_decompress(data.get(), m_size);
+    m_data = std::move(data);
+  }
+  return m_data;
+}
+
+void LazySampleChunk::prefetch() {
+  if (isResident() || m_prefetch.valid())
+    return;
+  m_prefetch = std::async(std::launch::async, [this]() { acquire(); });
+}
+
+bool LazySampleChunk::release() {
+  if (m_prefetch.valid())
+    m_prefetch.get();
+  std::unique_lock lk(m_lock);
+  if (m_data.use_count() > 1)
+    return false;
+  m_data.reset();
+  return true;
+}
+
+bool LazySampleChunk::isResident() const {
+  std::unique_lock lk(m_lock);
+  return m_data != nullptr;
+}
+
+void IntrusiveAudioGroupData::_freeChunks() {
+  if (!m_owns)
+    return;
+  if (!(m_borrowed & PoolChunk))
     delete[] m_pool;
+  if (!(m_borrowed & ProjChunk))
     delete[] m_proj;
+  if (!(m_borrowed & SdirChunk))
     delete[] m_sdir;
+  if (!(m_borrowed & SampChunk))
     delete[] m_samp;
-  }
 }
 
+IntrusiveAudioGroupData::~IntrusiveAudioGroupData() { _freeChunks(); }
+
 IntrusiveAudioGroupData::IntrusiveAudioGroupData(IntrusiveAudioGroupData&& other) noexcept
 : AudioGroupData(other.m_proj, other.m_projSz, other.m_pool, other.m_poolSz, other.m_sdir, other.m_sdirSz, other.m_samp,
                  other.m_sampSz, other.m_fmt, other.m_absOffs) {
   m_owns = other.m_owns;
+  m_borrowed = other.m_borrowed;
+  m_backing = std::move(other.m_backing);
+  m_lazySamp = std::move(other.m_lazySamp);
   other.m_owns = false;
 }
 
 IntrusiveAudioGroupData& IntrusiveAudioGroupData::operator=(IntrusiveAudioGroupData&& other) noexcept {
-  if (m_owns) {
-    delete[] m_pool;
-    delete[] m_proj;
-    delete[] m_sdir;
-    delete[] m_samp;
-  }
+  _freeChunks();
 
   m_owns = other.m_owns;
+  m_borrowed = other.m_borrowed;
+  m_backing = std::move(other.m_backing);
+  m_lazySamp = std::move(other.m_lazySamp);
   other.m_owns = false;
 
   m_proj = other.m_proj;
+  m_projSz = other.m_projSz;
   m_pool = other.m_pool;
+  m_poolSz = other.m_poolSz;
   m_sdir = other.m_sdir;
+  m_sdirSz = other.m_sdirSz;
   m_samp = other.m_samp;
+  m_sampSz = other.m_sampSz;
   m_fmt = other.m_fmt;
   m_absOffs = other.m_absOffs;
 
@@ -0,0 +1,107 @@
+#include "amuse/AudioGroupLoader.hpp"
+
+#include <chrono>
+#include <functional>
+#include <optional>
+
+#include "amuse/ContainerRegistry.hpp"
+#include "amuse/WorkerPool.hpp"
+
+namespace amuse {
+
+using Clock = std::chrono::steady_clock;
+
+static double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/** Name registration writes into shared NameDBs; keep it on the thread that installed them */
+static bool NameDBsInstalled() {
+  return ObjectId::CurNameDB || SoundMacroId::CurNameDB || SampleId::CurNameDB || TableId::CurNameDB ||
+         KeymapId::CurNameDB || LayersId::CurNameDB || SongId::CurNameDB || SFXId::CurNameDB ||
+         GroupId::CurNameDB;
+}
+
+std::vector<std::unique_ptr<AudioGroup>>
+AudioGroupLoader::ParseGroups(const std::vector<std::pair<std::string, IntrusiveAudioGroupData>>& data,
+                              WorkerPool* pool, Timing* timing) {
+  const auto parseStart = Clock::now();
+  std::vector<std::unique_ptr<AudioGroup>> ret;
+  ret.reserve(data.size());
+  for (size_t i = 0; i < data.size(); ++i)
+    ret.push_back(std::make_unique<AudioGroup>());
+
+  /* Each group contributes three independent jobs (proj, pool, sdir) writing disjoint members */
+  enum Stage { StageProj, StagePool, StageSdir, StageCount };
+  const size_t jobCount = data.size() * StageCount;
+  std::vector<double> jobSecs(jobCount, 0.0);
+  const std::function<void(size_t)> job = [&](size_t i) {
+    const auto jobStart = Clock::now();
+    const AudioGroupData& groupData = data[i / StageCount].second;
+    AudioGroup& group = *ret[i / StageCount];
+    switch (i % StageCount) {
+    case StageProj:
+      group.m_proj = AudioGroupProject::CreateAudioGroupProject(groupData);
+      break;
+    case StagePool:
+      group.m_pool = AudioGroupPool::CreateAudioGroupPool(groupData);
+      group.m_pool.compileSoundMacros();
+      break;
+    default:
+      group.m_sdir = AudioGroupSampleDirectory::CreateAudioGroupSampleDirectory(groupData);
+      break;
+    }
+    jobSecs[i] = SecondsSince(jobStart);
+  };
+
+  unsigned threads = 1;
+  if (NameDBsInstalled() || jobCount <= 1) {
+    for (size_t i = 0; i < jobCount; ++i)
+      job(i);
+  } else {
+    std::optional<WorkerPool> ownPool;
+    if (!pool)
+      pool = &ownPool.emplace();
+    pool->parallelFor(jobCount, job);
+    threads = pool->getThreadCount();
+  }
+
+  for (size_t i = 0; i < data.size(); ++i)
+    ret[i]->_assignSamp(data[i].second);
+
+  if (timing) {
+    timing->m_proj = timing->m_pool = timing->m_sdir = 0.0;
+    for (size_t i = 0; i < jobCount; ++i) {
+      switch (i % StageCount) {
+      case StageProj:
+        timing->m_proj += jobSecs[i];
+        break;
+      case StagePool:
+        timing->m_pool += jobSecs[i];
+        break;
+      default:
+        timing->m_sdir += jobSecs[i];
+        break;
+      }
+    }
+    timing->m_parse = SecondsSince(parseStart);
+    timing->m_threads = threads;
+    timing->m_groups = data.size();
+  }
+  return ret;
+}
+
+AudioGroupLoader::LoadedContainer AudioGroupLoader::LoadContainer(const char* path, WorkerPool* pool,
+                                                                  Timing* timing) {
+  LoadedContainer ret;
+  const auto containerStart = Clock::now();
+  ret.m_data = ContainerRegistry::LoadContainer(path);
+  if (timing)
+    timing->m_container = SecondsSince(containerStart);
+  if (ret.m_data.empty())
+    return ret;
+  ret.m_groups = ParseGroups(ret.m_data, pool, timing);
+  return ret;
+}
+
+} // namespace amuse
@@ -4,6 +4,10 @@
 #include "amuse/Common.hpp"
 #include "amuse/Entity.hpp"
 
+#include <memory>
+#include <new>
+#include <utility>
+
 #include <athena/FileReader.hpp>
 #include <athena/FileWriter.hpp>
 #include <athena/MemoryWriter.hpp>
@@ -319,18 +323,22 @@ AudioGroupPool AudioGroupPool::CreateAudioGroupPool(std::string_view groupPath)
   return ret;
 }
 
+[[noreturn]] static void PCBoundsExceeded(int pc, size_t size) {
+  fmt::print(stderr, FMT_STRING("SoundMacro PC bounds exceeded [{}/{}]\n"), pc, int(size));
+  abort();
+}
+
 int SoundMacro::assertPC(int pc) const {
   if (pc < 0)
     return -1;
-  if (size_t(pc) >= m_cmds.size()) {
-    fmt::print(stderr, FMT_STRING("SoundMacro PC bounds exceeded [{}/{}]\n"), pc, int(m_cmds.size()));
-    abort();
-  }
+  if (size_t(pc) >= m_cmds.size())
+    PCBoundsExceeded(pc, m_cmds.size());
   return pc;
 }
 
 template <std::endian DNAE>
 void SoundMacro::readCmds(athena::io::IStreamReader& r, uint32_t size) {
+  m_program.reset();
   uint32_t numCmds = size / 8;
   m_cmds.reserve(numCmds);
   for (uint32_t i = 0; i < numCmds; ++i) {
@@ -357,6 +365,7 @@ template void SoundMacro::writeCmds<std::endian::big>(athena::io::IStreamWriter&
 template void SoundMacro::writeCmds<std::endian::little>(athena::io::IStreamWriter& w) const;
 
 void SoundMacro::buildFromPrototype(const SoundMacro& other) {
+  m_program.reset();
   m_cmds.reserve(other.m_cmds.size());
   for (auto& cmd : other.m_cmds)
     m_cmds.push_back(CmdDo<MakeCopyCmdOp, std::unique_ptr<SoundMacro::ICmd>>(*cmd));
@@ -373,6 +382,7 @@ void SoundMacro::toYAML(athena::io::YAMLDocWriter& w) const {
 }
 
 void SoundMacro::fromYAML(athena::io::YAMLDocReader& r, size_t cmdCount) {
+  m_program.reset();
   m_cmds.reserve(cmdCount);
   for (size_t c = 0; c < cmdCount; ++c)
     if (auto __r2 = r.enterSubRecord())
@@ -429,7 +439,15 @@ static SoundMacro::CmdOp _ReadCmdOp(athena::io::YAMLDocReader& r) {
 
 static SoundMacro::CmdOp _ReadCmdOp(SoundMacro::CmdOp& op) { return op; }
 
-static SoundMacro::CmdOp _ReadCmdOp(const SoundMacro::ICmd& op) { return op.Isa(); }
+template <class... _Rest>
+static SoundMacro::CmdOp _ReadCmdOp(const SoundMacro::ICmd& op, _Rest&&...) {
+  return op.Isa();
+}
+
+template <class... _Rest>
+static SoundMacro::CmdOp _ReadCmdOp(const SoundMacro::Program::Instr& instr, _Rest&&...) {
+  return instr.m_op;
+}
 
 template <class Op, class O, class... _Args>
 O SoundMacro::CmdDo(_Args&&... args) {
@@ -604,6 +622,86 @@ template std::unique_ptr<SoundMacro::ICmd> SoundMacro::CmdDo<MakeCmdOp>(athena::
 template std::unique_ptr<SoundMacro::ICmd> SoundMacro::CmdDo<MakeDefaultCmdOp>(SoundMacro::CmdOp& r);
 template const SoundMacro::CmdIntrospection* SoundMacro::CmdDo<IntrospectCmdOp>(SoundMacro::CmdOp& op);
 
+struct CmdLayoutOp {
+  template <class Tp>
+  static std::pair<size_t, size_t> Do(const SoundMacro::ICmd&) {
+    return {sizeof(Tp), alignof(Tp)};
+  }
+};
+
+struct PlaceCopyCmdOp {
+  template <class Tp>
+  static const SoundMacro::ICmd* Do(const SoundMacro::ICmd& cmd, void* where) {
+    return new (where) Tp(static_cast<const Tp&>(cmd));
+  }
+};
+
+/* Qualified calls bypass the vtable; the opcode switch in CmdDo has already picked the type */
+struct ExecCmdOp {
+  template <class Tp>
+  static bool Do(const SoundMacro::Program::Instr& instr, SoundMacroState& st, Voice& vox) {
+    return static_cast<const Tp&>(*instr.m_cmd).Tp::Do(st, vox);
+  }
+};
+
+struct ExecFluidCmdOp {
+  template <class Tp>
+  static unsigned int Do(const SoundMacro::Program::Instr& instr, MacroExecContext& ctx, fluid_voice_t* v) {
+    return static_cast<const Tp&>(*instr.m_cmd).Tp::DoFluid(ctx, v);
+  }
+};
+
+SoundMacro::Program::~Program() {
+  for (const Instr& instr : m_instrs)
+    std::destroy_at(const_cast<ICmd*>(instr.m_cmd));
+}
+
+bool SoundMacro::Program::exec(int pc, SoundMacroState& st, Voice& vox) const {
+  if (size_t(pc) >= m_instrs.size()) [[unlikely]]
+    PCBoundsExceeded(pc, m_instrs.size());
+  return CmdDo<ExecCmdOp, bool>(m_instrs[pc], st, vox);
+}
+
+unsigned int SoundMacro::Program::execFluid(int pc, MacroExecContext& ctx, fluid_voice_t* v) const {
+  if (size_t(pc) >= m_instrs.size()) [[unlikely]]
+    PCBoundsExceeded(pc, m_instrs.size());
+  return CmdDo<ExecFluidCmdOp, unsigned int>(m_instrs[pc], ctx, v);
+}
+
+void SoundMacro::compile() {
+  m_program.reset();
+
+  /* Lay every command out back-to-back at its natural alignment */
+  std::vector<size_t> offsets;
+  offsets.reserve(m_cmds.size());
+  size_t arenaSz = 0;
+  for (const auto& cmd : m_cmds) {
+    if (!cmd)
+      return; /* Unknown opcode in the source data; keep interpreting m_cmds */
+    const auto [size, align] = CmdDo<CmdLayoutOp, std::pair<size_t, size_t>>(*cmd);
+    if (size == 0)
+      return;
+    arenaSz = (arenaSz + align - 1) / align * align;
+    offsets.push_back(arenaSz);
+    arenaSz += size;
+  }
+
+  auto prog = std::make_unique<Program>();
+  prog->m_arena.reset(new std::max_align_t[(arenaSz + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t)]);
+  prog->m_instrs.reserve(m_cmds.size());
+  auto* arena = reinterpret_cast<unsigned char*>(prog->m_arena.get());
+  for (size_t i = 0; i < m_cmds.size(); ++i) {
+    void* where = arena + offsets[i];
+    prog->m_instrs.push_back({m_cmds[i]->Isa(), CmdDo<PlaceCopyCmdOp, const ICmd*>(*m_cmds[i], where)});
+  }
+  m_program = std::move(prog);
+}
+
+void AudioGroupPool::compileSoundMacros() {
+  for (auto& [id, macro] : m_soundMacros)
+    macro->compile();
+}
+
 std::unique_ptr<SoundMacro::ICmd> SoundMacro::MakeCmd(CmdOp op) {
   return CmdDo<MakeDefaultCmdOp, std::unique_ptr<SoundMacro::ICmd>>(op);
 }
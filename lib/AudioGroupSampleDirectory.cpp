@@ -8,6 +8,7 @@
 #include "amuse/DirectoryEnumerator.hpp"
 #include "amuse/DSPCodec.hpp"
 #include "amuse/N64MusyXCodec.hpp"
+#include "amuse/WorkerPool.hpp"
 
 #include <athena/FileReader.hpp>
 #include <athena/FileWriter.hpp>
@@ -80,6 +81,11 @@ AudioGroupSampleDirectory::AudioGroupSampleDirectory(athena::io::IStreamReader&
     }
   }
 
+  if (sampData)
+    loadN64ADPCMParms(sampData);
+}
+
+void AudioGroupSampleDirectory::loadN64ADPCMParms(const unsigned char* sampData) const {
   for (auto& p : m_entries) {
     memcpy(&p.second->m_data->m_ADPCMParms, sampData + p.second->m_data->m_sampleOff, sizeof(ADPCMParms::VADPCMParms));
     p.second->m_data->m_ADPCMParms.swapBigVADPCM();
@@ -117,7 +123,9 @@ AudioGroupSampleDirectory AudioGroupSampleDirectory::CreateAudioGroupSampleDirec
   default:
     return AudioGroupSampleDirectory(r, GCNDataTag{});
   case DataFormat::N64:
-    return AudioGroupSampleDirectory(r, data.getSamp(), data.getAbsoluteProjOffsets(), N64DataTag{});
+    /* Lazily decompressed samples stay compressed; AudioGroup reads the codebooks when it resolves them */
+    return AudioGroupSampleDirectory(r, data.getLazySamp() ? nullptr : data.getSamp(), data.getAbsoluteProjOffsets(),
+                                     N64DataTag{});
   case DataFormat::PC:
     return AudioGroupSampleDirectory(r, data.getAbsoluteProjOffsets(), PCDataTag{});
   }
@@ -695,7 +703,7 @@ void AudioGroupSampleDirectory::extractAllWAV(std::string_view destDir, const un
 }
 
 void AudioGroupSampleDirectory::_extractCompressed(SampleId id, const EntryData& ent, std::string_view destDir,
-                                                   const unsigned char* samp, bool compressWAV) {
+                                                   const unsigned char* samp, bool compressWAV, WorkerPool* pool) {
   SampleFormat fmt = ent.getSampleFormat();
   if (!compressWAV && (fmt == SampleFormat::PCM || fmt == SampleFormat::PCM_PC)) {
     _extractWAV(id, ent, destDir, samp);
@@ -767,7 +775,7 @@ void AudioGroupSampleDirectory::_extractCompressed(SampleId id, const EntryData&
       header.x10_loop_start_nibble = DSPSampleToNibble(loopStartSample);
       header.x14_loop_end_nibble = DSPSampleToNibble(loopEndSample);
     }
-    DSPCorrelateCoefs(samps, numSamples, header.x1c_coef);
+    DSPCorrelateCoefs(samps, numSamples, header.x1c_coef, pool);
 
     path += ".dsp";
     athena::io::FileWriter w(path);
@@ -859,7 +867,7 @@ void AudioGroupSampleDirectory::reloadSampleData(std::string_view groupPath) {
 }
 
 std::pair<std::vector<uint8_t>, std::vector<uint8_t>>
-AudioGroupSampleDirectory::toGCNData(const AudioGroupDatabase& group) const {
+AudioGroupSampleDirectory::toGCNData(const AudioGroupDatabase& group, WorkerPool* pool) const {
   constexpr std::endian DNAE = std::endian::big;
 
   athena::io::VectorWriter fo;
@@ -869,8 +877,13 @@ AudioGroupSampleDirectory::toGCNData(const AudioGroupDatabase& group) const {
   entries.reserve(m_entries.size());
   size_t sampleOffset = 0;
   size_t adpcmOffset = 0;
-  for (const auto& ent : SortUnorderedMap(m_entries)) {
-    std::string path = group.getSampleBasePath(ent.first);
+  /* Classify every sample first so out-of-date ones are encoded as a single concurrent batch */
+  const auto sortedEntries = SortUnorderedMap(m_entries);
+  std::vector<std::string> paths;
+  paths.reserve(sortedEntries.size());
+  std::vector<std::pair<SampleId, const Entry*>> staleEntries;
+  for (const auto& ent : sortedEntries) {
+    std::string& path = paths.emplace_back(group.getSampleBasePath(ent.first));
     path += ".dsp";
     SampleFileState state = group.getSampleFileState(ent.first, ent.second.get().get(), &path);
     switch (state) {
@@ -878,13 +891,19 @@ AudioGroupSampleDirectory::toGCNData(const AudioGroupDatabase& group) const {
     case SampleFileState::MemoryOnlyCompressed:
     case SampleFileState::WAVRecent:
     case SampleFileState::WAVNoCompressed:
-      group.makeCompressedVersion(ent.first, ent.second.get().get());
+      /* Read back the freshly encoded DSP rather than the WAV the state query pointed at */
+      path = group.getSampleBasePath(ent.first) + ".dsp";
+      staleEntries.emplace_back(ent.first, ent.second.get().get());
       break;
     default:
       break;
     }
+  }
+  group.makeCompressedVersions(staleEntries, pool);
 
-    athena::io::FileReader r(path);
+  for (size_t i = 0; i < sortedEntries.size(); ++i) {
+    const auto& ent = sortedEntries[i];
+    athena::io::FileReader r(paths[i]);
     if (!r.hasError()) {
       EntryDNA<DNAE> entryDNA = ent.second.get()->toDNA<DNAE>(ent.first);
 
@@ -0,0 +1,37 @@
+#include "amuse/CPUFeatures.hpp"
+
+#if AMUSE_X86 && defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace amuse {
+
+static CPUFeatures QueryCPUFeatures() {
+  CPUFeatures ret;
+#if AMUSE_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 0);
+  const int maxLeaf = info[0];
+  __cpuid(info, 1);
+  ret.sse41 = info[2] & (1 << 19);
+  const bool osAVX = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+  if (maxLeaf >= 7 && osAVX) {
+    __cpuidex(info, 7, 0);
+    ret.avx2 = info[1] & (1 << 5);
+  }
+#else
+  __builtin_cpu_init();
+  ret.sse41 = __builtin_cpu_supports("sse4.1");
+  ret.avx2 = __builtin_cpu_supports("avx2");
+#endif
+#endif
+  return ret;
+}
+
+const CPUFeatures& GetCPUFeatures() {
+  static const CPUFeatures Features = QueryCPUFeatures();
+  return Features;
+}
+
+} // namespace amuse
@@ -1,5 +1,6 @@
 #include "amuse/ContainerRegistry.hpp"
 
+#include <array>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -8,6 +9,7 @@
 #include <unordered_map>
 
 #include "amuse/Common.hpp"
+#include "amuse/MappedFile.hpp"
 
 #include <lzokay.hpp>
 #include <zlib.h>
@@ -139,6 +141,86 @@ static std::string ReadString(FILE* fp) {
   return ret;
 }
 
+/* One chunk of an audio group; either borrowed from the container's backing storage or owned */
+struct GroupChunk {
+  std::unique_ptr<uint8_t[]> m_owned;
+  unsigned char* m_data = nullptr;
+  size_t m_size = 0;
+};
+
+static GroupChunk OwnChunk(std::unique_ptr<uint8_t[]>&& buf, size_t size) {
+  GroupChunk ret;
+  ret.m_owned = std::move(buf);
+  ret.m_data = ret.m_owned.get();
+  ret.m_size = size;
+  return ret;
+}
+
+static GroupChunk CopyChunk(const unsigned char* src, size_t size) {
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[size]);
+  memcpy(buf.get(), src, size);
+  return OwnChunk(std::move(buf), size);
+}
+
+/* Reference size bytes at base + offset in place; the chunk parsers read words directly,
+ * so misaligned chunks are copied instead */
+static GroupChunk BorrowChunk(unsigned char* base, size_t offset, size_t size) {
+  if ((reinterpret_cast<uintptr_t>(base) + offset) % 4 != 0)
+    return CopyChunk(base + offset, size);
+  GroupChunk ret;
+  ret.m_data = base + offset;
+  ret.m_size = size;
+  return ret;
+}
+
+/* Read size bytes at the current position of fp, borrowing them from map when the file is mapped */
+static GroupChunk ReadChunk(FILE* fp, const MappedFile* map, size_t size) {
+  if (map) {
+    const int64_t pos = FTell(fp);
+    if (pos >= 0 && size_t(pos) + size <= map->size()) {
+      FSeek(fp, int64_t(size), SEEK_CUR);
+      return BorrowChunk(map->data(), size_t(pos), size);
+    }
+  }
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[size]);
+  fread(buf.get(), 1, size, fp);
+  return OwnChunk(std::move(buf), size);
+}
+
+/* Hand the chunks to a new group; borrowed ones keep backing alive in place of being freed */
+template <class... FormatArgs>
+static IntrusiveAudioGroupData MakeGroupData(std::shared_ptr<const void> backing, GroupChunk& proj, GroupChunk& pool,
+                                             GroupChunk& sdir, GroupChunk& samp, FormatArgs... format) {
+  uint8_t borrowed = 0;
+  if (proj.m_data && !proj.m_owned)
+    borrowed |= IntrusiveAudioGroupData::ProjChunk;
+  if (pool.m_data && !pool.m_owned)
+    borrowed |= IntrusiveAudioGroupData::PoolChunk;
+  if (sdir.m_data && !sdir.m_owned)
+    borrowed |= IntrusiveAudioGroupData::SdirChunk;
+  if (samp.m_data && !samp.m_owned)
+    borrowed |= IntrusiveAudioGroupData::SampChunk;
+
+  IntrusiveAudioGroupData ret{proj.m_data, proj.m_size, pool.m_data, pool.m_size, sdir.m_data,
+                              sdir.m_size, samp.m_data, samp.m_size, format...};
+  proj.m_owned.release();
+  pool.m_owned.release();
+  sdir.m_owned.release();
+  samp.m_owned.release();
+  ret.setBacking(borrowed ? std::move(backing) : nullptr, borrowed);
+  return ret;
+}
+
+/* SDIR-based format detection of four raw chunks */
+static IntrusiveAudioGroupData MakeDetectedGroupData(std::shared_ptr<const void> backing, GroupChunk& proj,
+                                                     GroupChunk& pool, GroupChunk& sdir, GroupChunk& samp) {
+  if (*reinterpret_cast<uint32_t*>(sdir.m_data + 8) == 0x0)
+    return MakeGroupData(std::move(backing), proj, pool, sdir, samp, GCNDataTag{});
+  if (sdir.m_data[9] == 0x0)
+    return MakeGroupData(std::move(backing), proj, pool, sdir, samp, false, N64DataTag{});
+  return MakeGroupData(std::move(backing), proj, pool, sdir, samp, false, PCDataTag{});
+}
+
 static bool IsChunkExtension(const char* path, const char*& dotOut) {
   const char* ext = StrRChr(path, '.');
   if (ext) {
@@ -221,6 +303,7 @@ static bool ValidateMP1(FILE* fp) {
 static std::vector<std::pair<std::string, IntrusiveAudioGroupData>> LoadMP1(FILE* fp) {
   std::vector<std::pair<std::string, IntrusiveAudioGroupData>> ret;
   FileLength(fp);
+  std::shared_ptr<MappedFile> map = MappedFile::Map(fp);
 
   uint32_t magic;
   fread(&magic, 1, 4, fp);
@@ -267,30 +350,24 @@ static std::vector<std::pair<std::string, IntrusiveAudioGroupData>> LoadMP1(FILE
             uint32_t poolLen;
             fread(&poolLen, 1, 4, fp);
             poolLen = SBig(poolLen);
-            std::unique_ptr<uint8_t[]> pool(new uint8_t[poolLen]);
-            fread(pool.get(), 1, poolLen, fp);
+            GroupChunk pool = ReadChunk(fp, map.get(), poolLen);
 
             uint32_t projLen;
             fread(&projLen, 1, 4, fp);
             projLen = SBig(projLen);
-            std::unique_ptr<uint8_t[]> proj(new uint8_t[projLen]);
-            fread(proj.get(), 1, projLen, fp);
+            GroupChunk proj = ReadChunk(fp, map.get(), projLen);
 
             uint32_t sampLen;
             fread(&sampLen, 1, 4, fp);
             sampLen = SBig(sampLen);
-            std::unique_ptr<uint8_t[]> samp(new uint8_t[sampLen]);
-            fread(samp.get(), 1, sampLen, fp);
+            GroupChunk samp = ReadChunk(fp, map.get(), sampLen);
 
             uint32_t sdirLen;
             fread(&sdirLen, 1, 4, fp);
             sdirLen = SBig(sdirLen);
-            std::unique_ptr<uint8_t[]> sdir(new uint8_t[sdirLen]);
-            fread(sdir.get(), 1, sdirLen, fp);
+            GroupChunk sdir = ReadChunk(fp, map.get(), sdirLen);
 
-            ret.emplace_back(std::move(name),
-                             IntrusiveAudioGroupData{proj.release(), projLen, pool.release(), poolLen, sdir.release(),
-                                                     sdirLen, samp.release(), sampLen, GCNDataTag{}});
+            ret.emplace_back(std::move(name), MakeGroupData(map, proj, pool, sdir, samp, GCNDataTag{}));
           }
         }
         FSeek(fp, origPos, SEEK_SET);
@@ -498,6 +575,7 @@ static bool ValidateMP2(FILE* fp) {
 static std::vector<std::pair<std::string, IntrusiveAudioGroupData>> LoadMP2(FILE* fp) {
   std::vector<std::pair<std::string, IntrusiveAudioGroupData>> ret;
   FileLength(fp);
+  std::shared_ptr<MappedFile> map = MappedFile::Map(fp);
 
   uint32_t magic;
   fread(&magic, 1, 4, fp);
@@ -542,8 +620,8 @@ static std::vector<std::pair<std::string, IntrusiveAudioGroupData>> LoadMP2(FILE
           fread(&decompSz, 1, 4, fp);
           decompSz = SBig(decompSz);
           uint8_t compBuf[0x8000];
-          uint8_t* buf = new uint8_t[decompSz];
-          uint8_t* bufCur = buf;
+          std::unique_ptr<uint8_t[]> buf(new uint8_t[decompSz]);
+          uint8_t* bufCur = buf.get();
           uint32_t rem = decompSz;
           while (rem) {
             uint16_t chunkSz;
@@ -558,7 +636,7 @@ static std::vector<std::pair<std::string, IntrusiveAudioGroupData>> LoadMP2(FILE
 
           fp = FOpen("amuse_tmp.dat", "rw");
           rewind(fp);
-          fwrite(buf, 1, decompSz, fp);
+          fwrite(buf.get(), 1, decompSz, fp);
           rewind(fp);
         }
         if (fread(testBuf, 1, 4, fp) == 4) {
@@ -584,21 +662,14 @@ static std::vector<std::pair<std::string, IntrusiveAudioGroupData>> LoadMP2(FILE
             sampSz = SBig(sampSz);
 
             if (projSz && poolSz && sdirSz && sampSz) {
-              std::unique_ptr<uint8_t[]> pool(new uint8_t[poolSz]);
-              fread(pool.get(), 1, poolSz, fp);
-
-              std::unique_ptr<uint8_t[]> proj(new uint8_t[projSz]);
-              fread(proj.get(), 1, projSz, fp);
-
-              std::unique_ptr<uint8_t[]> sdir(new uint8_t[sdirSz]);
-              fread(sdir.get(), 1, sdirSz, fp);
-
-              std::unique_ptr<uint8_t[]> samp(new uint8_t[sampSz]);
-              fread(samp.get(), 1, sampSz, fp);
-
-              ret.emplace_back(std::move(name),
-                               IntrusiveAudioGroupData{proj.release(), projSz, pool.release(), poolSz, sdir.release(),
-                                                       sdirSz, samp.release(), sampSz, GCNDataTag{}});
+              /* Decompressed resources are read back from the temporary file */
+              const MappedFile* chunkMap = compressed ? nullptr : map.get();
+              GroupChunk pool = ReadChunk(fp, chunkMap, poolSz);
+              GroupChunk proj = ReadChunk(fp, chunkMap, projSz);
+              GroupChunk sdir = ReadChunk(fp, chunkMap, sdirSz);
+              GroupChunk samp = ReadChunk(fp, chunkMap, sampSz);
+
+              ret.emplace_back(std::move(name), MakeGroupData(map, proj, pool, sdir, samp, GCNDataTag{}));
             }
           }
         }
@@ -632,16 +703,86 @@ struct RS1FSTEntry {
   }
 };
 
+static void SwapN64Rom32(void* data, size_t size) {
+  uint32_t* words = reinterpret_cast<uint32_t*>(data);
+  for (size_t i = 0; i < size / 4; ++i)
+    words[i] = SBig(words[i]);
+}
+
 static void SwapN64Rom16(void* data, size_t size) {
   uint16_t* words = reinterpret_cast<uint16_t*>(data);
   for (size_t i = 0; i < size / 2; ++i)
     words[i] = SBig(words[i]);
 }
 
-static void SwapN64Rom32(void* data, size_t size) {
-  uint32_t* words = reinterpret_cast<uint32_t*>(data);
-  for (size_t i = 0; i < size / 4; ++i)
-    words[i] = SBig(words[i]);
+/* N64 ROM contents in native (big-endian) byte order, read through a private mapping of the file.
+ * Byte-swapped dumps are swapped in place, which dirties every page, so chunks of those are copied out */
+struct N64RomImage {
+  std::shared_ptr<MappedFile> m_map;
+  std::unique_ptr<uint8_t[]> m_buf; /* Fallback when the file cannot be mapped */
+  uint8_t* m_data = nullptr;
+  size_t m_size = 0;
+  bool m_swapped = false;
+};
+
+static N64RomImage LoadN64Rom(FILE* fp) {
+  N64RomImage ret;
+  ret.m_size = FileLength(fp);
+  ret.m_map = MappedFile::Map(fp);
+  if (ret.m_map) {
+    ret.m_data = ret.m_map->data();
+  } else {
+    ret.m_buf.reset(new uint8_t[ret.m_size]);
+    fread(ret.m_buf.get(), 1, ret.m_size, fp);
+    ret.m_data = ret.m_buf.get();
+  }
+
+  if (ret.m_size >= 4) {
+    const uint8_t* data = ret.m_data;
+    if ((data[0] & 0x80) != 0x80 && (data[3] & 0x80) == 0x80) {
+      SwapN64Rom32(ret.m_data, ret.m_size);
+      ret.m_swapped = true;
+    } else if ((data[0] & 0x80) != 0x80 && (data[1] & 0x80) == 0x80) {
+      SwapN64Rom16(ret.m_data, ret.m_size);
+      ret.m_swapped = true;
+    }
+  }
+  return ret;
+}
+
+/* Uncompressed chunks of unswapped mapped ROMs are referenced in place; everything else is copied or inflated */
+static GroupChunk ReadN64RomChunk(const N64RomImage& rom, const uint8_t* dataSeg, const RS1FSTEntry& ent) {
+  if (ent.compSz == 0xffffffff) {
+    if (rom.m_map && !rom.m_swapped)
+      return BorrowChunk(rom.m_data, size_t(dataSeg - rom.m_data) + ent.offset, ent.decompSz);
+    return CopyChunk(dataSeg + ent.offset, ent.decompSz);
+  }
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[ent.decompSz]);
+  uLongf outSz = ent.decompSz;
+  uncompress(buf.get(), &outSz, dataSeg + ent.offset, ent.compSz);
+  return OwnChunk(std::move(buf), ent.decompSz);
+}
+
+/* Compressed sample chunks are inflated on first use, reading from the mapping when it holds them
+ * unmodified and from a copy of the (much smaller) compressed bytes otherwise */
+static std::shared_ptr<LazySampleChunk> MakeLazyN64RomChunk(const N64RomImage& rom, const uint8_t* dataSeg,
+                                                           const RS1FSTEntry& ent) {
+  const uint8_t* src = dataSeg + ent.offset;
+  std::shared_ptr<const void> backing;
+  if (rom.m_map && !rom.m_swapped) {
+    backing = rom.m_map;
+  } else {
+    std::shared_ptr<uint8_t[]> comp(new uint8_t[ent.compSz]);
+    memcpy(comp.get(), src, ent.compSz);
+    src = comp.get();
+    backing = std::move(comp);
+  }
+  const uLong compSz = ent.compSz;
+  return std::make_shared<LazySampleChunk>(ent.decompSz,
+                                           [backing, src, compSz](unsigned char* out, size_t outSz) {
+                                             uLongf destSz = outSz;
+                                             uncompress(out, &destSz, src, compSz);
+                                           });
 }
 
 static const struct RS1SongMapping {
@@ -753,43 +894,30 @@ static std::vector<std::pair<std::string, IntrusiveAudioGroupData>> LoadRS1PC(FI
       std::unique_ptr<RS1FSTEntry[]> entries(new RS1FSTEntry[elemCount]);
       fread(entries.get(), fstSz, 1, fp);
 
-      std::unique_ptr<uint8_t[]> proj;
-      size_t projSz = 0;
-      std::unique_ptr<uint8_t[]> pool;
-      size_t poolSz = 0;
-      std::unique_ptr<uint8_t[]> sdir;
-      size_t sdirSz = 0;
-      std::unique_ptr<uint8_t[]> samp;
-      size_t sampSz = 0;
+      std::shared_ptr<MappedFile> map = MappedFile::Map(fp);
+      GroupChunk proj;
+      GroupChunk pool;
+      GroupChunk sdir;
+      GroupChunk samp;
 
       for (uint32_t i = 0; i < elemCount; ++i) {
         RS1FSTEntry& entry = entries[i];
-        if (!strncmp("proj_SND", entry.name, 16)) {
-          projSz = entry.decompSz;
-          proj.reset(new uint8_t[entry.decompSz]);
-          FSeek(fp, entry.offset, SEEK_SET);
-          fread(proj.get(), 1, entry.decompSz, fp);
-        } else if (!strncmp("pool_SND", entry.name, 16)) {
-          poolSz = entry.decompSz;
-          pool.reset(new uint8_t[entry.decompSz]);
-          FSeek(fp, entry.offset, SEEK_SET);
-          fread(pool.get(), 1, entry.decompSz, fp);
-        } else if (!strncmp("sdir_SND", entry.name, 16)) {
-          sdirSz = entry.decompSz;
-          sdir.reset(new uint8_t[entry.decompSz]);
-          FSeek(fp, entry.offset, SEEK_SET);
-          fread(sdir.get(), 1, entry.decompSz, fp);
-        } else if (!strncmp("samp_SND", entry.name, 16)) {
-          sampSz = entry.decompSz;
-          samp.reset(new uint8_t[entry.decompSz]);
+        GroupChunk* chunk = nullptr;
+        if (!strncmp("proj_SND", entry.name, 16))
+          chunk = &proj;
+        else if (!strncmp("pool_SND", entry.name, 16))
+          chunk = &pool;
+        else if (!strncmp("sdir_SND", entry.name, 16))
+          chunk = &sdir;
+        else if (!strncmp("samp_SND", entry.name, 16))
+          chunk = &samp;
+        if (chunk) {
           FSeek(fp, entry.offset, SEEK_SET);
-          fread(samp.get(), 1, entry.decompSz, fp);
+          *chunk = ReadChunk(fp, map.get(), entry.decompSz);
         }
       }
 
-      ret.emplace_back("Group",
-                       IntrusiveAudioGroupData{proj.release(), projSz, pool.release(), poolSz, sdir.release(), sdirSz,
-                                               samp.release(), sampSz, false, PCDataTag{}});
+      ret.emplace_back("Group", MakeGroupData(map, proj, pool, sdir, samp, false, PCDataTag{}));
     }
   }
 
@@ -832,13 +960,8 @@ static bool ValidateRS1N64(FILE* fp) {
   if (endPos > 32 * 1024 * 1024)
     return false; /* N64 ROM definitely won't exceed 32MB */
 
-  std::unique_ptr<uint8_t[]> data(new uint8_t[endPos]);
-  fread(data.get(), 1, endPos, fp);
-
-  if ((data[0] & 0x80) != 0x80 && (data[3] & 0x80) == 0x80)
-    SwapN64Rom32(data.get(), endPos);
-  else if ((data[0] & 0x80) != 0x80 && (data[1] & 0x80) == 0x80)
-    SwapN64Rom16(data.get(), endPos);
+  N64RomImage rom = LoadN64Rom(fp);
+  uint8_t* data = rom.m_data;
 
 #if 0
     const uint32_t* gameId = reinterpret_cast<const uint32_t*>(&data[59]);
@@ -846,13 +969,13 @@ static bool ValidateRS1N64(FILE* fp) {
         return false; /* GameId not 'NRSE', 'NRSJ', or 'NRSP' */
 #endif
 
-  const uint8_t* dataSeg = reinterpret_cast<const uint8_t*>(memmem(data.get(), endPos, "dbg_data\0\0\0\0\0\0\0\0", 16));
+  const uint8_t* dataSeg = reinterpret_cast<const uint8_t*>(memmem(data, endPos, "dbg_data\0\0\0\0\0\0\0\0", 16));
   if (dataSeg) {
     dataSeg += 28;
     size_t fstEnd = SBig(*reinterpret_cast<const uint32_t*>(dataSeg));
     dataSeg += 4;
     size_t fstOff = SBig(*reinterpret_cast<const uint32_t*>(dataSeg));
-    if (endPos <= size_t(dataSeg - data.get()) + fstOff || endPos <= size_t(dataSeg - data.get()) + fstEnd)
+    if (endPos <= size_t(dataSeg - data) + fstOff || endPos <= size_t(dataSeg - data) + fstEnd)
       return false;
 
     const RS1FSTEntry* entry = reinterpret_cast<const RS1FSTEntry*>(dataSeg + fstOff);
@@ -881,85 +1004,49 @@ static std::vector<std::pair<std::string, IntrusiveAudioGroupData>> LoadRS1N64(F
   std::vector<std::pair<std::string, IntrusiveAudioGroupData>> ret;
   size_t endPos = FileLength(fp);
 
-  std::unique_ptr<uint8_t[]> data(new uint8_t[endPos]);
-  fread(data.get(), 1, endPos, fp);
-
-  if ((data[0] & 0x80) != 0x80 && (data[3] & 0x80) == 0x80)
-    SwapN64Rom32(data.get(), endPos);
-  else if ((data[0] & 0x80) != 0x80 && (data[1] & 0x80) == 0x80)
-    SwapN64Rom16(data.get(), endPos);
+  N64RomImage rom = LoadN64Rom(fp);
+  uint8_t* data = rom.m_data;
 
-  const uint8_t* dataSeg = reinterpret_cast<const uint8_t*>(memmem(data.get(), endPos, "dbg_data\0\0\0\0\0\0\0\0", 16));
+  const uint8_t* dataSeg = reinterpret_cast<const uint8_t*>(memmem(data, endPos, "dbg_data\0\0\0\0\0\0\0\0", 16));
   if (dataSeg) {
     dataSeg += 28;
     size_t fstEnd = SBig(*reinterpret_cast<const uint32_t*>(dataSeg));
     dataSeg += 4;
     size_t fstOff = SBig(*reinterpret_cast<const uint32_t*>(dataSeg));
-    if (endPos <= size_t(dataSeg - data.get()) + fstOff || endPos <= size_t(dataSeg - data.get()) + fstEnd)
+    if (endPos <= size_t(dataSeg - data) + fstOff || endPos <= size_t(dataSeg - data) + fstEnd)
       return ret;
 
     const RS1FSTEntry* entry = reinterpret_cast<const RS1FSTEntry*>(dataSeg + fstOff);
     const RS1FSTEntry* lastEnt = reinterpret_cast<const RS1FSTEntry*>(dataSeg + fstEnd);
 
-    std::unique_ptr<uint8_t[]> proj;
-    size_t projSz = 0;
-    std::unique_ptr<uint8_t[]> pool;
-    size_t poolSz = 0;
-    std::unique_ptr<uint8_t[]> sdir;
-    size_t sdirSz = 0;
-    std::unique_ptr<uint8_t[]> samp;
-    size_t sampSz = 0;
+    GroupChunk proj;
+    GroupChunk pool;
+    GroupChunk sdir;
+    GroupChunk samp;
+    std::shared_ptr<LazySampleChunk> lazySamp;
 
     for (; entry != lastEnt; ++entry) {
       RS1FSTEntry ent = *entry;
       ent.swapBig();
 
-      if (!strncmp("proj_SND", ent.name, 16)) {
-        if (ent.compSz == 0xffffffff) {
-          proj.reset(new uint8_t[ent.decompSz]);
-          memmove(proj.get(), dataSeg + ent.offset, ent.decompSz);
-        } else {
-          proj.reset(new uint8_t[ent.decompSz]);
-          uLongf outSz = ent.decompSz;
-          uncompress(proj.get(), &outSz, dataSeg + ent.offset, ent.compSz);
-        }
-        projSz = ent.decompSz;
-      } else if (!strncmp("pool_SND", ent.name, 16)) {
-        if (ent.compSz == 0xffffffff) {
-          pool.reset(new uint8_t[ent.decompSz]);
-          memmove(pool.get(), dataSeg + ent.offset, ent.decompSz);
-        } else {
-          pool.reset(new uint8_t[ent.decompSz]);
-          uLongf outSz = ent.decompSz;
-          uncompress(pool.get(), &outSz, dataSeg + ent.offset, ent.compSz);
-        }
-        poolSz = ent.decompSz;
-      } else if (!strncmp("sdir_SND", ent.name, 16)) {
-        if (ent.compSz == 0xffffffff) {
-          sdir.reset(new uint8_t[ent.decompSz]);
-          memmove(sdir.get(), dataSeg + ent.offset, ent.decompSz);
-        } else {
-          sdir.reset(new uint8_t[ent.decompSz]);
-          uLongf outSz = ent.decompSz;
-          uncompress(sdir.get(), &outSz, dataSeg + ent.offset, ent.compSz);
-        }
-        sdirSz = ent.decompSz;
-      } else if (!strncmp("samp_SND", ent.name, 16)) {
-        if (ent.compSz == 0xffffffff) {
-          samp.reset(new uint8_t[ent.decompSz]);
-          memmove(samp.get(), dataSeg + ent.offset, ent.decompSz);
-        } else {
-          samp.reset(new uint8_t[ent.decompSz]);
-          uLongf outSz = ent.decompSz;
-          uncompress(samp.get(), &outSz, dataSeg + ent.offset, ent.compSz);
-        }
-        sampSz = ent.decompSz;
+      if (!strncmp("proj_SND", ent.name, 16))
+        proj = ReadN64RomChunk(rom, dataSeg, ent);
+      else if (!strncmp("pool_SND", ent.name, 16))
+        pool = ReadN64RomChunk(rom, dataSeg, ent);
+      else if (!strncmp("sdir_SND", ent.name, 16))
+        sdir = ReadN64RomChunk(rom, dataSeg, ent);
+      else if (!strncmp("samp_SND", ent.name, 16)) {
+        if (ent.compSz != 0xffffffff)
+          lazySamp = MakeLazyN64RomChunk(rom, dataSeg, ent);
+        else
+          samp = ReadN64RomChunk(rom, dataSeg, ent);
       }
     }
 
-    ret.emplace_back("Group",
-                     IntrusiveAudioGroupData{proj.release(), projSz, pool.release(), poolSz, sdir.release(), sdirSz,
-                                             samp.release(), sampSz, false, N64DataTag{}});
+    IntrusiveAudioGroupData groupData = MakeGroupData(rom.m_map, proj, pool, sdir, samp, false, N64DataTag{});
+    if (lazySamp)
+      groupData.setLazySamp(std::move(lazySamp));
+    ret.emplace_back("Group", std::move(groupData));
   }
 
   return ret;
@@ -969,21 +1056,16 @@ static std::vector<std::pair<std::string, ContainerRegistry::SongData>> LoadRS1N
   std::vector<std::pair<std::string, ContainerRegistry::SongData>> ret;
   size_t endPos = FileLength(fp);
 
-  std::unique_ptr<uint8_t[]> data(new uint8_t[endPos]);
-  fread(data.get(), 1, endPos, fp);
-
-  if ((data[0] & 0x80) != 0x80 && (data[3] & 0x80) == 0x80)
-    SwapN64Rom32(data.get(), endPos);
-  else if ((data[0] & 0x80) != 0x80 && (data[1] & 0x80) == 0x80)
-    SwapN64Rom16(data.get(), endPos);
+  N64RomImage rom = LoadN64Rom(fp);
+  uint8_t* data = rom.m_data;
 
-  const uint8_t* dataSeg = reinterpret_cast<const uint8_t*>(memmem(data.get(), endPos, "dbg_data\0\0\0\0\0\0\0\0", 16));
+  const uint8_t* dataSeg = reinterpret_cast<const uint8_t*>(memmem(data, endPos, "dbg_data\0\0\0\0\0\0\0\0", 16));
   if (dataSeg) {
     dataSeg += 28;
     size_t fstEnd = SBig(*reinterpret_cast<const uint32_t*>(dataSeg));
     dataSeg += 4;
     size_t fstOff = SBig(*reinterpret_cast<const uint32_t*>(dataSeg));
-    if (endPos <= size_t(dataSeg - data.get()) + fstOff || endPos <= size_t(dataSeg - data.get()) + fstEnd)
+    if (endPos <= size_t(dataSeg - data) + fstOff || endPos <= size_t(dataSeg - data) + fstEnd)
       return ret;
 
     const RS1FSTEntry* entry = reinterpret_cast<const RS1FSTEntry*>(dataSeg + fstOff);
@@ -1018,13 +1100,8 @@ static bool ValidateFactor5N64Rev(FILE* fp) {
   if (endPos > 32 * 1024 * 1024)
     return false; /* N64 ROM definitely won't exceed 32MB */
 
-  std::unique_ptr<uint8_t[]> data(new uint8_t[endPos]);
-  fread(data.get(), 1, endPos, fp);
-
-  if ((data[0] & 0x80) != 0x80 && (data[3] & 0x80) == 0x80)
-    SwapN64Rom32(data.get(), endPos);
-  else if ((data[0] & 0x80) != 0x80 && (data[1] & 0x80) == 0x80)
-    SwapN64Rom16(data.get(), endPos);
+  N64RomImage rom = LoadN64Rom(fp);
+  uint8_t* data = rom.m_data;
 
 #if 0
     const uint32_t* gameId = reinterpret_cast<const uint32_t*>(&data[59]);
@@ -1032,13 +1109,13 @@ static bool ValidateFactor5N64Rev(FILE* fp) {
         return false; /* GameId not 'NRSE', 'NRSJ', or 'NRSP' */
 #endif
 
-  const uint8_t* dataSeg = reinterpret_cast<const uint8_t*>(memmem(data.get(), endPos, "dbg_data\0\0\0\0\0\0\0\0", 16));
+  const uint8_t* dataSeg = reinterpret_cast<const uint8_t*>(memmem(data, endPos, "dbg_data\0\0\0\0\0\0\0\0", 16));
   if (dataSeg) {
     dataSeg += 28;
     size_t fstEnd = SBig(*reinterpret_cast<const uint32_t*>(dataSeg));
     dataSeg += 4;
     size_t fstOff = SBig(*reinterpret_cast<const uint32_t*>(dataSeg));
-    if (endPos <= size_t(dataSeg - data.get()) + fstOff || endPos <= size_t(dataSeg - data.get()) + fstEnd)
+    if (endPos <= size_t(dataSeg - data) + fstOff || endPos <= size_t(dataSeg - data) + fstEnd)
       return false;
 
     const RS1FSTEntry* entry = reinterpret_cast<const RS1FSTEntry*>(dataSeg + fstOff);
@@ -1067,85 +1144,49 @@ static std::vector<std::pair<std::string, IntrusiveAudioGroupData>> LoadFactor5N
   std::vector<std::pair<std::string, IntrusiveAudioGroupData>> ret;
   size_t endPos = FileLength(fp);
 
-  std::unique_ptr<uint8_t[]> data(new uint8_t[endPos]);
-  fread(data.get(), 1, endPos, fp);
+  N64RomImage rom = LoadN64Rom(fp);
+  uint8_t* data = rom.m_data;
 
-  if ((data[0] & 0x80) != 0x80 && (data[3] & 0x80) == 0x80)
-    SwapN64Rom32(data.get(), endPos);
-  else if ((data[0] & 0x80) != 0x80 && (data[1] & 0x80) == 0x80)
-    SwapN64Rom16(data.get(), endPos);
-
-  const uint8_t* dataSeg = reinterpret_cast<const uint8_t*>(memmem(data.get(), endPos, "dbg_data\0\0\0\0\0\0\0\0", 16));
+  const uint8_t* dataSeg = reinterpret_cast<const uint8_t*>(memmem(data, endPos, "dbg_data\0\0\0\0\0\0\0\0", 16));
   if (dataSeg) {
     dataSeg += 28;
     size_t fstEnd = SBig(*reinterpret_cast<const uint32_t*>(dataSeg));
     dataSeg += 4;
     size_t fstOff = SBig(*reinterpret_cast<const uint32_t*>(dataSeg));
-    if (endPos <= size_t(dataSeg - data.get()) + fstOff || endPos <= size_t(dataSeg - data.get()) + fstEnd)
+    if (endPos <= size_t(dataSeg - data) + fstOff || endPos <= size_t(dataSeg - data) + fstEnd)
       return ret;
 
     const RS1FSTEntry* entry = reinterpret_cast<const RS1FSTEntry*>(dataSeg + fstOff);
     const RS1FSTEntry* lastEnt = reinterpret_cast<const RS1FSTEntry*>(dataSeg + fstEnd);
 
-    std::unique_ptr<uint8_t[]> proj;
-    size_t projSz = 0;
-    std::unique_ptr<uint8_t[]> pool;
-    size_t poolSz = 0;
-    std::unique_ptr<uint8_t[]> sdir;
-    size_t sdirSz = 0;
-    std::unique_ptr<uint8_t[]> samp;
-    size_t sampSz = 0;
+    GroupChunk proj;
+    GroupChunk pool;
+    GroupChunk sdir;
+    GroupChunk samp;
+    std::shared_ptr<LazySampleChunk> lazySamp;
 
     for (; entry != lastEnt; ++entry) {
       RS1FSTEntry ent = *entry;
       ent.swapBig();
 
-      if (!strncmp("proj", ent.name, 16)) {
-        if (ent.compSz == 0xffffffff) {
-          proj.reset(new uint8_t[ent.decompSz]);
-          memmove(proj.get(), dataSeg + ent.offset, ent.decompSz);
-        } else {
-          proj.reset(new uint8_t[ent.decompSz]);
-          uLongf outSz = ent.decompSz;
-          uncompress(proj.get(), &outSz, dataSeg + ent.offset, ent.compSz);
-        }
-        projSz = ent.decompSz;
-      } else if (!strncmp("pool", ent.name, 16)) {
-        if (ent.compSz == 0xffffffff) {
-          pool.reset(new uint8_t[ent.decompSz]);
-          memmove(pool.get(), dataSeg + ent.offset, ent.decompSz);
-        } else {
-          pool.reset(new uint8_t[ent.decompSz]);
-          uLongf outSz = ent.decompSz;
-          uncompress(pool.get(), &outSz, dataSeg + ent.offset, ent.compSz);
-        }
-        poolSz = ent.decompSz;
-      } else if (!strncmp("sdir", ent.name, 16)) {
-        if (ent.compSz == 0xffffffff) {
-          sdir.reset(new uint8_t[ent.decompSz]);
-          memmove(sdir.get(), dataSeg + ent.offset, ent.decompSz);
-        } else {
-          sdir.reset(new uint8_t[ent.decompSz]);
-          uLongf outSz = ent.decompSz;
-          uncompress(sdir.get(), &outSz, dataSeg + ent.offset, ent.compSz);
-        }
-        sdirSz = ent.decompSz;
-      } else if (!strncmp("samp", ent.name, 16)) {
-        if (ent.compSz == 0xffffffff) {
-          samp.reset(new uint8_t[ent.decompSz]);
-          memmove(samp.get(), dataSeg + ent.offset, ent.decompSz);
-        } else {
-          samp.reset(new uint8_t[ent.decompSz]);
-          uLongf outSz = ent.decompSz;
-          uncompress(samp.get(), &outSz, dataSeg + ent.offset, ent.compSz);
-        }
-        sampSz = ent.decompSz;
+      if (!strncmp("proj", ent.name, 16))
+        proj = ReadN64RomChunk(rom, dataSeg, ent);
+      else if (!strncmp("pool", ent.name, 16))
+        pool = ReadN64RomChunk(rom, dataSeg, ent);
+      else if (!strncmp("sdir", ent.name, 16))
+        sdir = ReadN64RomChunk(rom, dataSeg, ent);
+      else if (!strncmp("samp", ent.name, 16)) {
+        if (ent.compSz != 0xffffffff)
+          lazySamp = MakeLazyN64RomChunk(rom, dataSeg, ent);
+        else
+          samp = ReadN64RomChunk(rom, dataSeg, ent);
       }
     }
 
-    ret.emplace_back("Group",
-                     IntrusiveAudioGroupData{proj.release(), projSz, pool.release(), poolSz, sdir.release(), sdirSz,
-                                             samp.release(), sampSz, true, N64DataTag{}});
+    IntrusiveAudioGroupData groupData = MakeGroupData(rom.m_map, proj, pool, sdir, samp, true, N64DataTag{});
+    if (lazySamp)
+      groupData.setLazySamp(std::move(lazySamp));
+    ret.emplace_back("Group", std::move(groupData));
   }
 
   return ret;
@@ -1155,21 +1196,16 @@ static std::vector<std::pair<std::string, ContainerRegistry::SongData>> LoadFact
   std::vector<std::pair<std::string, ContainerRegistry::SongData>> ret;
   size_t endPos = FileLength(fp);
 
-  std::unique_ptr<uint8_t[]> data(new uint8_t[endPos]);
-  fread(data.get(), 1, endPos, fp);
-
-  if ((data[0] & 0x80) != 0x80 && (data[3] & 0x80) == 0x80)
-    SwapN64Rom32(data.get(), endPos);
-  else if ((data[0] & 0x80) != 0x80 && (data[1] & 0x80) == 0x80)
-    SwapN64Rom16(data.get(), endPos);
+  N64RomImage rom = LoadN64Rom(fp);
+  uint8_t* data = rom.m_data;
 
-  const uint8_t* dataSeg = reinterpret_cast<const uint8_t*>(memmem(data.get(), endPos, "dbg_data\0\0\0\0\0\0\0\0", 16));
+  const uint8_t* dataSeg = reinterpret_cast<const uint8_t*>(memmem(data, endPos, "dbg_data\0\0\0\0\0\0\0\0", 16));
   if (dataSeg) {
     dataSeg += 28;
     size_t fstEnd = SBig(*reinterpret_cast<const uint32_t*>(dataSeg));
     dataSeg += 4;
     size_t fstOff = SBig(*reinterpret_cast<const uint32_t*>(dataSeg));
-    if (endPos <= size_t(dataSeg - data.get()) + fstOff || endPos <= size_t(dataSeg - data.get()) + fstEnd)
+    if (endPos <= size_t(dataSeg - data) + fstOff || endPos <= size_t(dataSeg - data) + fstEnd)
       return ret;
 
     const RS1FSTEntry* entry = reinterpret_cast<const RS1FSTEntry*>(dataSeg + fstOff);
@@ -1312,37 +1348,38 @@ static std::vector<std::pair<std::string, IntrusiveAudioGroupData>> LoadRS2(FILE
     fread(&entry, 1, 64, fp);
     entry.swapBig();
     if (!strncmp("data", entry.name, 32)) {
-      FSeek(fp, int64_t(entry.offset), SEEK_SET);
-      std::unique_ptr<uint8_t[]> audData(new uint8_t[entry.decompSz]);
-      fread(audData.get(), 1, entry.decompSz, fp);
+      /* Groups reference the audio data in place, either inside the file mapping or one shared buffer */
+      std::shared_ptr<MappedFile> map = MappedFile::Map(fp);
+      std::shared_ptr<const void> backing;
+      uint8_t* audData;
+      if (map && entry.offset + entry.decompSz <= map->size()) {
+        audData = map->data() + entry.offset;
+        backing = map;
+      } else {
+        std::shared_ptr<uint8_t[]> buf(new uint8_t[entry.decompSz]);
+        FSeek(fp, int64_t(entry.offset), SEEK_SET);
+        fread(buf.get(), 1, entry.decompSz, fp);
+        audData = buf.get();
+        backing = std::move(buf);
+      }
 
-      uint32_t indexOff = SBig(*reinterpret_cast<uint32_t*>(audData.get() + 4));
-      uint32_t groupCount = SBig(*reinterpret_cast<uint32_t*>(audData.get() + indexOff));
-      const uint32_t* groupOffs = reinterpret_cast<const uint32_t*>(audData.get() + indexOff + 4);
+      uint32_t indexOff = SBig(*reinterpret_cast<uint32_t*>(audData + 4));
+      uint32_t groupCount = SBig(*reinterpret_cast<uint32_t*>(audData + indexOff));
+      const uint32_t* groupOffs = reinterpret_cast<const uint32_t*>(audData + indexOff + 4);
 
       for (uint32_t j = 0; j < groupCount; ++j) {
-        const uint8_t* groupData = audData.get() + SBig(groupOffs[j]);
+        const uint8_t* groupData = audData + SBig(groupOffs[j]);
         RS23GroupHead head = *reinterpret_cast<const RS23GroupHead*>(groupData);
         head.swapBig();
 
-        std::unique_ptr<uint8_t[]> pool(new uint8_t[head.poolLen]);
-        memmove(pool.get(), audData.get() + head.poolOff, head.poolLen);
-
-        std::unique_ptr<uint8_t[]> proj(new uint8_t[head.projLen]);
-        memmove(proj.get(), audData.get() + head.projOff, head.projLen);
-
-        std::unique_ptr<uint8_t[]> sdir(new uint8_t[head.sdirLen]);
-        memmove(sdir.get(), audData.get() + head.sdirOff, head.sdirLen);
-
-        std::unique_ptr<uint8_t[]> samp(new uint8_t[head.sampLen]);
-        memmove(samp.get(), audData.get() + head.sampOff, head.sampLen);
-
         if (head.projLen && head.poolLen && head.sdirLen && head.sampLen) {
+          GroupChunk pool = BorrowChunk(audData, head.poolOff, head.poolLen);
+          GroupChunk proj = BorrowChunk(audData, head.projOff, head.projLen);
+          GroupChunk sdir = BorrowChunk(audData, head.sdirOff, head.sdirLen);
+          GroupChunk samp = BorrowChunk(audData, head.sampOff, head.sampLen);
+
           std::string name = fmt::format(FMT_STRING("GroupFile{:02d}"), j);
-          ret.emplace_back(std::move(name),
-              IntrusiveAudioGroupData{proj.release(), head.projLen, pool.release(), head.poolLen,
-                                      sdir.release(), head.sdirLen, samp.release(), head.sampLen,
-                                      GCNDataTag{}});
+          ret.emplace_back(std::move(name), MakeGroupData(backing, proj, pool, sdir, samp, GCNDataTag{}));
         }
       }
 
@@ -1471,37 +1508,38 @@ static std::vector<std::pair<std::string, IntrusiveAudioGroupData>> LoadRS3(FILE
     fread(&entry, 1, 160, fp);
     entry.swapBig();
     if (!strncmp("data", entry.name, 128)) {
-      FSeek(fp, int64_t(entry.offset), SEEK_SET);
-      std::unique_ptr<uint8_t[]> audData(new uint8_t[entry.decompSz]);
-      fread(audData.get(), 1, entry.decompSz, fp);
+      /* Groups reference the audio data in place, either inside the file mapping or one shared buffer */
+      std::shared_ptr<MappedFile> map = MappedFile::Map(fp);
+      std::shared_ptr<const void> backing;
+      uint8_t* audData;
+      if (map && entry.offset + entry.decompSz <= map->size()) {
+        audData = map->data() + entry.offset;
+        backing = map;
+      } else {
+        std::shared_ptr<uint8_t[]> buf(new uint8_t[entry.decompSz]);
+        FSeek(fp, int64_t(entry.offset), SEEK_SET);
+        fread(buf.get(), 1, entry.decompSz, fp);
+        audData = buf.get();
+        backing = std::move(buf);
+      }
 
-      uint32_t indexOff = SBig(*reinterpret_cast<uint32_t*>(audData.get() + 4));
-      uint32_t groupCount = SBig(*reinterpret_cast<uint32_t*>(audData.get() + indexOff));
-      const uint32_t* groupOffs = reinterpret_cast<const uint32_t*>(audData.get() + indexOff + 4);
+      uint32_t indexOff = SBig(*reinterpret_cast<uint32_t*>(audData + 4));
+      uint32_t groupCount = SBig(*reinterpret_cast<uint32_t*>(audData + indexOff));
+      const uint32_t* groupOffs = reinterpret_cast<const uint32_t*>(audData + indexOff + 4);
 
       for (uint32_t j = 0; j < groupCount; ++j) {
-        const uint8_t* groupData = audData.get() + SBig(groupOffs[j]);
+        const uint8_t* groupData = audData + SBig(groupOffs[j]);
         RS23GroupHead head = *reinterpret_cast<const RS23GroupHead*>(groupData);
         head.swapBig();
 
-        std::unique_ptr<uint8_t[]> pool(new uint8_t[head.poolLen]);
-        memmove(pool.get(), audData.get() + head.poolOff, head.poolLen);
-
-        std::unique_ptr<uint8_t[]> proj(new uint8_t[head.projLen]);
-        memmove(proj.get(), audData.get() + head.projOff, head.projLen);
-
-        std::unique_ptr<uint8_t[]> sdir(new uint8_t[head.sdirLen]);
-        memmove(sdir.get(), audData.get() + head.sdirOff, head.sdirLen);
-
-        std::unique_ptr<uint8_t[]> samp(new uint8_t[head.sampLen]);
-        memmove(samp.get(), audData.get() + head.sampOff, head.sampLen);
-
         if (head.projLen && head.poolLen && head.sdirLen && head.sampLen) {
+          GroupChunk pool = BorrowChunk(audData, head.poolOff, head.poolLen);
+          GroupChunk proj = BorrowChunk(audData, head.projOff, head.projLen);
+          GroupChunk sdir = BorrowChunk(audData, head.sdirOff, head.sdirLen);
+          GroupChunk samp = BorrowChunk(audData, head.sampOff, head.sampLen);
+
           std::string name = fmt::format(FMT_STRING("GroupFile{:02d}"), j);
-          ret.emplace_back(std::move(name),
-              IntrusiveAudioGroupData{proj.release(), head.projLen, pool.release(), head.poolLen,
-                                      sdir.release(), head.sdirLen, samp.release(), head.sampLen,
-                                      GCNDataTag{}});
+          ret.emplace_back(std::move(name), MakeGroupData(backing, proj, pool, sdir, samp, GCNDataTag{}));
         }
       }
 
@@ -1732,6 +1770,17 @@ ContainerRegistry::Type ContainerRegistry::DetectContainerType(const char* path)
   return Type::Invalid;
 }
 
+IntrusiveAudioGroupData ContainerRegistry::MakeRawGroupData(std::shared_ptr<const void> backing, unsigned char* proj,
+                                                            size_t projSz, unsigned char* pool, size_t poolSz,
+                                                            unsigned char* sdir, size_t sdirSz, unsigned char* samp,
+                                                            size_t sampSz) {
+  GroupChunk projChunk = BorrowChunk(proj, 0, projSz);
+  GroupChunk poolChunk = BorrowChunk(pool, 0, poolSz);
+  GroupChunk sdirChunk = BorrowChunk(sdir, 0, sdirSz);
+  GroupChunk sampChunk = BorrowChunk(samp, 0, sampSz);
+  return MakeDetectedGroupData(std::move(backing), projChunk, poolChunk, sdirChunk, sampChunk);
+}
+
 std::vector<std::pair<std::string, IntrusiveAudioGroupData>> ContainerRegistry::LoadContainer(const char* path) {
   Type typeOut;
   return LoadContainer(path, typeOut);
@@ -1801,49 +1850,36 @@ std::vector<std::pair<std::string, IntrusiveAudioGroupData>> ContainerRegistry::
     }
     fclose(fp);
 
-    fp = FOpen(projPath.c_str(), "rb");
-    size_t projLen = FileLength(fp);
-    if (!projLen)
+    /* Map each chunk file whole; fall back to reading it when mapping is unavailable */
+    std::array<std::shared_ptr<MappedFile>, 4> maps;
+    auto loadChunkFile = [](const std::string& chunkPath, std::shared_ptr<MappedFile>& mapOut) {
+      GroupChunk ret;
+      FILE* chunkFp = FOpen(chunkPath.c_str(), "rb");
+      if (!chunkFp)
+        return ret;
+      size_t len = FileLength(chunkFp);
+      if (len) {
+        mapOut = MappedFile::Map(chunkFp);
+        ret = ReadChunk(chunkFp, mapOut.get(), len);
+      }
+      fclose(chunkFp);
       return ret;
-    std::unique_ptr<uint8_t[]> proj(new uint8_t[projLen]);
-    fread(proj.get(), 1, projLen, fp);
-
-    fp = FOpen(poolPath.c_str(), "rb");
-    size_t poolLen = FileLength(fp);
-    if (!poolLen)
+    };
+    GroupChunk proj = loadChunkFile(projPath, maps[0]);
+    if (!proj.m_size)
       return ret;
-    std::unique_ptr<uint8_t[]> pool(new uint8_t[poolLen]);
-    fread(pool.get(), 1, poolLen, fp);
-
-    fp = FOpen(sdirPath.c_str(), "rb");
-    size_t sdirLen = FileLength(fp);
-    if (!sdirLen)
+    GroupChunk pool = loadChunkFile(poolPath, maps[1]);
+    if (!pool.m_size)
       return ret;
-    std::unique_ptr<uint8_t[]> sdir(new uint8_t[sdirLen]);
-    fread(sdir.get(), 1, sdirLen, fp);
-
-    fp = FOpen(sampPath.c_str(), "rb");
-    size_t sampLen = FileLength(fp);
-    if (!sampLen)
+    GroupChunk sdir = loadChunkFile(sdirPath, maps[2]);
+    if (!sdir.m_size)
       return ret;
-    std::unique_ptr<uint8_t[]> samp(new uint8_t[sampLen]);
-    fread(samp.get(), 1, sampLen, fp);
-
-    fclose(fp);
+    GroupChunk samp = loadChunkFile(sampPath, maps[3]);
+    if (!samp.m_size)
+      return ret;
+    auto backing = std::make_shared<std::array<std::shared_ptr<MappedFile>, 4>>(std::move(maps));
 
-    /* SDIR-based format detection */
-    if (*reinterpret_cast<uint32_t*>(sdir.get() + 8) == 0x0)
-      ret.emplace_back(baseName,
-                       IntrusiveAudioGroupData{proj.release(), projLen, pool.release(), poolLen, sdir.release(),
-                                               sdirLen, samp.release(), sampLen, GCNDataTag{}});
-    else if (sdir[9] == 0x0)
-      ret.emplace_back(baseName,
-                       IntrusiveAudioGroupData{proj.release(), projLen, pool.release(), poolLen, sdir.release(),
-                                               sdirLen, samp.release(), sampLen, false, N64DataTag{}});
-    else
-      ret.emplace_back(baseName,
-                       IntrusiveAudioGroupData{proj.release(), projLen, pool.release(), poolLen, sdir.release(),
-                                               sdirLen, samp.release(), sampLen, false, PCDataTag{}});
+    ret.emplace_back(baseName, MakeDetectedGroupData(backing, proj, pool, sdir, samp));
 
     typeOut = Type::Raw4;
     return ret;
@@ -0,0 +1,225 @@
+#include "amuse/DecodedSampleCache.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "amuse/DSPCodec.hpp"
+#include "amuse/N64MusyXCodec.hpp"
+
+namespace amuse {
+
+bool DecodedSampleCache::IsCacheable(const SampleEntryData& ent) {
+  if (ent.m_looseData || !ent.getNumSamples())
+    return false;
+  return ent.isFormatDSP() || ent.getSampleFormat() == SampleFormat::N64;
+}
+
+std::shared_ptr<DecodedSamplePCM> DecodedSampleCache::Decode(const SampleEntryData& ent, const unsigned char* data) {
+  auto ret = std::make_shared<DecodedSamplePCM>();
+  const bool looped = ent.isLooped();
+  const uint32_t loopEnd = looped ? ent.m_loopStartSample + ent.m_loopLengthSamples : 0;
+  const uint32_t numSamples = std::max(ent.getNumSamples(), loopEnd);
+  ret->m_pcm.resize(numSamples);
+  ret->m_loopStart = looped ? ent.m_loopStartSample : 0;
+
+  if (ent.isFormatDSP()) {
+    int16_t prev1 = 0;
+    int16_t prev2 = 0;
+    DSPDecompressFrames(ret->m_pcm.data(), data, ent.m_ADPCMParms.dsp.m_coefs, &prev1, &prev2, 0, numSamples);
+
+    /* Voices reload the loop history at every turnover, so later passes may differ from the first */
+    if (looped) {
+      const uint32_t loopStart = ent.m_loopStartSample;
+      ret->m_loopPcm.resize(ent.m_loopLengthSamples);
+      prev1 = ent.m_ADPCMParms.dsp.m_hist1;
+      prev2 = ent.m_ADPCMParms.dsp.m_hist2;
+      DSPDecompressFrames(ret->m_loopPcm.data(), data + 8 * (loopStart / 14), ent.m_ADPCMParms.dsp.m_coefs, &prev1,
+                          &prev2, loopStart % 14, ent.m_loopLengthSamples);
+      if (!memcmp(ret->m_loopPcm.data(), ret->m_pcm.data() + loopStart, ent.m_loopLengthSamples * sizeof(int16_t)))
+        ret->m_loopPcm = std::vector<int16_t>();
+    }
+  } else if (ent.getSampleFormat() == SampleFormat::N64) {
+    /* VADPCM frames carry no predictor state across boundaries; one pass serves every loop iteration */
+    N64MusyXDecompressFrames(ret->m_pcm.data(), data + sizeof(ent.m_ADPCMParms.vadpcm), ent.m_ADPCMParms.vadpcm.m_coefs,
+                             0, numSamples);
+  }
+
+  return ret;
+}
+
+DecodedSampleCache::DecodedSampleCache(size_t budgetBytes) : m_budget(budgetBytes) {
+  m_requests.reserve(MaxPendingFills);
+  m_filled.reserve(MaxPendingFills);
+}
+
+DecodedSampleCache::~DecodedSampleCache() {
+  {
+    std::unique_lock lk(m_fillLock);
+    m_fillRunning = false;
+  }
+  m_fillCv.notify_one();
+  if (m_fillThread.joinable())
+    m_fillThread.join();
+}
+
+void DecodedSampleCache::_evictToBudget() {
+  while (m_stats.m_residentBytes > m_budget && !m_lru.empty()) {
+    auto& [key, pcm] = m_lru.back();
+    m_stats.m_residentBytes -= pcm->getByteSize();
+    m_index.erase(key);
+    m_lru.pop_back();
+    ++m_stats.m_evictions;
+  }
+}
+
+void DecodedSampleCache::_requestFill(const Key& key, const ObjToken<SampleEntryData>& ent) {
+  if (m_numPending == MaxPendingFills ||
+      std::find(m_pending.cbegin(), m_pending.cbegin() + m_numPending, key) != m_pending.cbegin() + m_numPending)
+    return;
+  /* Never wait on the fill thread; a busy handoff leaves the request to the sample's next start */
+  std::unique_lock lk(m_fillLock, std::try_to_lock);
+  if (!lk)
+    return;
+  m_requests.push_back({key, ent});
+  m_pending[m_numPending++] = key;
+  if (!m_fillThread.joinable())
+    m_fillThread = std::thread(&DecodedSampleCache::_fillProc, this);
+  lk.unlock();
+  m_fillCv.notify_one();
+}
+
+void DecodedSampleCache::_publishFills() {
+  if (!m_hasFilled.load(std::memory_order_acquire))
+    return;
+  std::unique_lock lk(m_fillLock, std::try_to_lock);
+  if (!lk)
+    return;
+  for (FilledSample& filled : m_filled) {
+    const Key key = filled.m_lru.front().first;
+    const size_t bytes = filled.m_lru.front().second->getByteSize();
+    auto pending = std::find(m_pending.begin(), m_pending.begin() + m_numPending, key);
+    if (pending != m_pending.begin() + m_numPending)
+      *pending = m_pending[--m_numPending];
+    if (bytes > m_budget / 8 || m_index.contains(key))
+      continue;
+    m_lru.splice(m_lru.begin(), filled.m_lru);
+    m_index.insert(std::move(filled.m_indexNode));
+    m_stats.m_residentBytes += bytes;
+    ++m_stats.m_fills;
+  }
+  m_filled.clear();
+  m_hasFilled.store(false, std::memory_order_relaxed);
+  lk.unlock();
+  _evictToBudget();
+}
+
+void DecodedSampleCache::_dropPending(const unsigned char* begin, const unsigned char* end) {
+  for (size_t i = 0; i < m_numPending;) {
+    if (m_pending[i].m_data >= begin && m_pending[i].m_data < end)
+      m_pending[i] = m_pending[--m_numPending];
+    else
+      ++i;
+  }
+}
+
+void DecodedSampleCache::_fillProc() {
+  std::unique_lock lk(m_fillLock);
+  for (;;) {
+    m_fillCv.wait(lk, [this]() { return !m_fillRunning || !m_requests.empty(); });
+    if (!m_fillRunning)
+      return;
+    FillRequest req = std::move(m_requests.front());
+    m_requests.erase(m_requests.begin());
+    m_fillingData = req.m_key.m_data;
+    m_fillingKey = req.m_key;
+    lk.unlock();
+
+    FilledSample filled;
+    filled.m_lru.emplace_back(req.m_key, Decode(*req.m_ent, req.m_key.m_data));
+    Index node;
+    node.emplace(req.m_key, filled.m_lru.begin());
+    filled.m_indexNode = node.extract(node.begin());
+    req.m_ent.reset();
+
+    lk.lock();
+    m_fillingData = nullptr;
+    m_filled.push_back(std::move(filled));
+    m_hasFilled.store(true, std::memory_order_release);
+    m_fillDoneCv.notify_all();
+  }
+}
+
+std::shared_ptr<const DecodedSamplePCM> DecodedSampleCache::acquire(SampleId id, const ObjToken<SampleEntryData>& ent,
+                                                                    const unsigned char* data) {
+  if (!IsCacheable(*ent))
+    return {};
+
+  _publishFills();
+  const Key key{data, id};
+  auto search = m_index.find(key);
+  if (search != m_index.end()) {
+    m_lru.splice(m_lru.begin(), m_lru, search->second);
+    ++m_stats.m_hits;
+    return search->second->second;
+  }
+
+  const size_t loopLength = ent->isLooped() && ent->isFormatDSP() ? ent->m_loopLengthSamples : 0;
+  const size_t estBytes = (ent->getNumSamples() + loopLength) * sizeof(int16_t);
+  if (estBytes > m_budget / 8) {
+    ++m_stats.m_bypasses;
+    return {};
+  }
+  ++m_stats.m_misses;
+  _requestFill(key, ent);
+  return {};
+}
+
+void DecodedSampleCache::purge(const unsigned char* begin, const unsigned char* end) {
+  auto inRange = [begin, end](const unsigned char* data) { return data >= begin && data < end; };
+  {
+    std::unique_lock lk(m_fillLock);
+    std::erase_if(m_requests, [&](const FillRequest& req) { return inRange(req.m_key.m_data); });
+    m_fillDoneCv.wait(lk, [&]() { return !m_fillingData || !inRange(m_fillingData); });
+    std::erase_if(m_filled, [&](const FilledSample& filled) { return inRange(filled.m_lru.front().first.m_data); });
+  }
+  _dropPending(begin, end);
+
+  for (auto it = m_lru.begin(); it != m_lru.end();) {
+    if (inRange(it->first.m_data)) {
+      m_stats.m_residentBytes -= it->second->getByteSize();
+      m_index.erase(it->first);
+      it = m_lru.erase(it);
+      continue;
+    }
+    ++it;
+  }
+}
+
+void DecodedSampleCache::clear() {
+  {
+    /* Only a decode already under way is still published */
+    std::unique_lock lk(m_fillLock);
+    m_requests.clear();
+    m_filled.clear();
+    m_hasFilled.store(false, std::memory_order_relaxed);
+    m_numPending = 0;
+    if (m_fillingData)
+      m_pending[m_numPending++] = m_fillingKey;
+  }
+  m_lru.clear();
+  m_index.clear();
+  m_stats.m_residentBytes = 0;
+}
+
+void DecodedSampleCache::setBudget(size_t budgetBytes) {
+  m_budget = budgetBytes;
+  _evictToBudget();
+}
+
+DecodedSampleCache::Stats DecodedSampleCache::getStats() const {
+  Stats ret = m_stats;
+  ret.m_entryCount = m_lru.size();
+  return ret;
+}
+
+} // namespace amuse
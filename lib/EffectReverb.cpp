@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cmath>
 
+#include "amuse/CPUFeatures.hpp"
 #include "amuse/IBackendVoice.hpp"
 
 namespace amuse {
@@ -52,6 +53,288 @@ void ReverbDelayLine::setdelay(int32_t delay) {
     x4_outPoint += x8_length;
 }
 
+void ReverbDelayLanes::allocate(int32_t delay) {
+  delay += 2;
+  x8_length = delay;
+  xc_inputs = std::make_unique<ReverbLanes[]>(delay);
+  x10_lastInput = {};
+  setdelay(delay / 2);
+  x0_inPoint = 0;
+  x4_outPoint = 0;
+}
+
+void ReverbDelayLanes::setdelay(int32_t delay) {
+  x4_outPoint = x0_inPoint - delay;
+  while (x4_outPoint < 0)
+    x4_outPoint += x8_length;
+}
+
+/* The reverb kernels below run every channel in its own SIMD lane through delay-line segments that
+ * do not wrap. A line's out-point trails its in-point by the tap delay, so a segment no longer than
+ * that delay never reads a position it wrote; outputs are therefore read before inputs are written
+ * within each frame. The arithmetic of each lane matches the original per-channel loops exactly.
+ * Kernels are instantiated for 2, 4 and 8 active lanes so stereo output does not pay for eight. */
+
+/** Stores the first `Lanes` lanes of a frame; inactive lanes keep their (silent) state */
+template <size_t Lanes>
+static AMUSE_FORCEINLINE void StoreLanes(ReverbLanes& dst, const ReverbLanes& src) {
+  for (size_t c = 0; c < Lanes; ++c)
+    dst[c] = src[c];
+}
+
+/** Comb and all-pass state of the standard reverb for one segment */
+struct ReverbStdSegment {
+  std::array<ReverbDelayLanes, 2>& m_combs;
+  std::array<ReverbDelayLanes, 2>& m_allPass;
+  const std::array<ReverbLanes, 2>& m_combCoefs;
+  ReverbLanes& m_lpLastOut;
+  ReverbLanes* m_preDelay; /**< Pre-delay positions of this segment, or null */
+  float m_allPassCoef;
+  float m_damping;
+  float m_dampWet;
+  float m_dampDry;
+};
+
+/** Replaces the dry frames with the mixed output of the standard reverb */
+template <size_t Lanes>
+static AMUSE_FORCEINLINE void ReverbStdSegmentT(const ReverbStdSegment& seg, ReverbLanes* frames, int32_t count) {
+  ReverbDelayLanes& c0 = seg.m_combs[0];
+  ReverbDelayLanes& c1 = seg.m_combs[1];
+  ReverbDelayLanes& ap0 = seg.m_allPass[0];
+  ReverbDelayLanes& ap1 = seg.m_allPass[1];
+  ReverbLanes* c0In = &c0.xc_inputs[c0.x0_inPoint];
+  ReverbLanes* c1In = &c1.xc_inputs[c1.x0_inPoint];
+  ReverbLanes* ap0In = &ap0.xc_inputs[ap0.x0_inPoint];
+  ReverbLanes* ap1In = &ap1.xc_inputs[ap1.x0_inPoint];
+  const ReverbLanes* c0Out = &c0.xc_inputs[c0.x4_outPoint];
+  const ReverbLanes* c1Out = &c1.xc_inputs[c1.x4_outPoint];
+  const ReverbLanes* ap0Out = &ap0.xc_inputs[ap0.x4_outPoint];
+  const ReverbLanes* ap1Out = &ap1.xc_inputs[ap1.x4_outPoint];
+  const ReverbLanes k0 = seg.m_combCoefs[0];
+  const ReverbLanes k1 = seg.m_combCoefs[1];
+  ReverbLanes last0 = c0.x10_lastInput;
+  ReverbLanes last1 = c1.x10_lastInput;
+  ReverbLanes lastAP0 = ap0.x10_lastInput;
+  ReverbLanes lastAP1 = ap1.x10_lastInput;
+  ReverbLanes lpLastOut = seg.m_lpLastOut;
+  const float allPassCoef = seg.m_allPassCoef;
+
+  for (int32_t s = 0; s < count; ++s) {
+    const ReverbLanes dry = frames[s];
+
+    /* Pre-delay stage */
+    ReverbLanes input = dry;
+    if (seg.m_preDelay) {
+      input = seg.m_preDelay[s];
+      seg.m_preDelay[s] = dry;
+    }
+
+    const ReverbLanes out0 = c0Out[s];
+    const ReverbLanes out1 = c1Out[s];
+    const ReverbLanes outAP0 = ap0Out[s];
+    const ReverbLanes outAP1 = ap1Out[s];
+    ReverbLanes in0, in1, inAP0, inAP1, wet;
+    for (size_t c = 0; c < Lanes; ++c) {
+      /* Comb filter stage */
+      in0[c] = k0[c] * last0[c] + input[c];
+      in1[c] = k1[c] * last1[c] + input[c];
+      last0[c] = out0[c];
+      last1[c] = out1[c];
+
+      /* All-pass filter stage */
+      inAP0[c] = allPassCoef * lastAP0[c] + last0[c] + last1[c];
+      const float lowPass = -(allPassCoef * inAP0[c] - lastAP0[c]);
+      lastAP0[c] = outAP0[c];
+
+      lpLastOut[c] = seg.m_damping * lpLastOut[c] + lowPass * 0.3f;
+      inAP1[c] = allPassCoef * lastAP1[c] + lpLastOut[c];
+      const float allPass = -(allPassCoef * inAP1[c] - lastAP1[c]);
+      lastAP1[c] = outAP1[c];
+
+      /* Mix out */
+      wet[c] = seg.m_dampWet * allPass + seg.m_dampDry * dry[c];
+    }
+    StoreLanes<Lanes>(c0In[s], in0);
+    StoreLanes<Lanes>(c1In[s], in1);
+    StoreLanes<Lanes>(ap0In[s], inAP0);
+    StoreLanes<Lanes>(ap1In[s], inAP1);
+    StoreLanes<Lanes>(frames[s], wet);
+  }
+
+  c0.x10_lastInput = last0;
+  c1.x10_lastInput = last1;
+  ap0.x10_lastInput = lastAP0;
+  ap1.x10_lastInput = lastAP1;
+  seg.m_lpLastOut = lpLastOut;
+}
+
+/** Comb and all-pass state of the high-quality reverb for one segment */
+struct ReverbHiSegment {
+  std::array<ReverbDelayLanes, 3>& m_combs;
+  std::array<ReverbDelayLanes, 2>& m_allPass;
+  const std::array<ReverbLanes, 3>& m_combCoefs;
+  ReverbLanes& m_lpLastOut;
+  ReverbLanes* m_preDelay; /**< Pre-delay positions of this segment, or null */
+  float m_allPassCoef;
+  float m_damping;
+};
+
+/** Computes the low-pass output of the high-quality reverb for each dry frame into `lowPassed`;
+ *  the per-channel low-pass delay lines are applied afterwards */
+template <size_t Lanes>
+static AMUSE_FORCEINLINE void ReverbHiSegmentT(const ReverbHiSegment& seg, const ReverbLanes* frames,
+                                               ReverbLanes* lowPassed, int32_t count) {
+  ReverbDelayLanes& c0 = seg.m_combs[0];
+  ReverbDelayLanes& c1 = seg.m_combs[1];
+  ReverbDelayLanes& c2 = seg.m_combs[2];
+  ReverbDelayLanes& ap0 = seg.m_allPass[0];
+  ReverbDelayLanes& ap1 = seg.m_allPass[1];
+  ReverbLanes* c0In = &c0.xc_inputs[c0.x0_inPoint];
+  ReverbLanes* c1In = &c1.xc_inputs[c1.x0_inPoint];
+  ReverbLanes* c2In = &c2.xc_inputs[c2.x0_inPoint];
+  ReverbLanes* ap0In = &ap0.xc_inputs[ap0.x0_inPoint];
+  ReverbLanes* ap1In = &ap1.xc_inputs[ap1.x0_inPoint];
+  const ReverbLanes* c0Out = &c0.xc_inputs[c0.x4_outPoint];
+  const ReverbLanes* c1Out = &c1.xc_inputs[c1.x4_outPoint];
+  const ReverbLanes* c2Out = &c2.xc_inputs[c2.x4_outPoint];
+  const ReverbLanes* ap0Out = &ap0.xc_inputs[ap0.x4_outPoint];
+  const ReverbLanes* ap1Out = &ap1.xc_inputs[ap1.x4_outPoint];
+  const ReverbLanes k0 = seg.m_combCoefs[0];
+  const ReverbLanes k1 = seg.m_combCoefs[1];
+  const ReverbLanes k2 = seg.m_combCoefs[2];
+  ReverbLanes last0 = c0.x10_lastInput;
+  ReverbLanes last1 = c1.x10_lastInput;
+  ReverbLanes last2 = c2.x10_lastInput;
+  ReverbLanes lastAP0 = ap0.x10_lastInput;
+  ReverbLanes lastAP1 = ap1.x10_lastInput;
+  ReverbLanes lpLastOut = seg.m_lpLastOut;
+  const float allPassCoef = seg.m_allPassCoef;
+
+  for (int32_t s = 0; s < count; ++s) {
+    const ReverbLanes& dry = frames[s];
+
+    /* Pre-delay stage */
+    ReverbLanes input = dry;
+    if (seg.m_preDelay) {
+      input = seg.m_preDelay[s];
+      seg.m_preDelay[s] = dry;
+    }
+
+    const ReverbLanes out0 = c0Out[s];
+    const ReverbLanes out1 = c1Out[s];
+    const ReverbLanes out2 = c2Out[s];
+    const ReverbLanes outAP0 = ap0Out[s];
+    const ReverbLanes outAP1 = ap1Out[s];
+    ReverbLanes in0, in1, in2, inAP0, inAP1;
+    for (size_t c = 0; c < Lanes; ++c) {
+      /* Comb filter stage */
+      in0[c] = k0[c] * last0[c] + input[c];
+      in1[c] = k1[c] * last1[c] + input[c];
+      in2[c] = k2[c] * last2[c] + input[c];
+      last0[c] = out0[c];
+      last1[c] = out1[c];
+      last2[c] = out2[c];
+
+      /* All-pass filter stage */
+      inAP0[c] = allPassCoef * lastAP0[c] + last0[c] + last1[c] + last2[c];
+      inAP1[c] = allPassCoef * lastAP1[c] - (allPassCoef * inAP0[c] - lastAP0[c]);
+      const float lowPass = -(allPassCoef * inAP1[c] - lastAP1[c]);
+      lastAP0[c] = outAP0[c];
+      lastAP1[c] = outAP1[c];
+
+      lpLastOut[c] = seg.m_damping * lpLastOut[c] + lowPass * 0.3f;
+    }
+    StoreLanes<Lanes>(c0In[s], in0);
+    StoreLanes<Lanes>(c1In[s], in1);
+    StoreLanes<Lanes>(c2In[s], in2);
+    StoreLanes<Lanes>(ap0In[s], inAP0);
+    StoreLanes<Lanes>(ap1In[s], inAP1);
+    lowPassed[s] = lpLastOut;
+  }
+
+  c0.x10_lastInput = last0;
+  c1.x10_lastInput = last1;
+  c2.x10_lastInput = last2;
+  ap0.x10_lastInput = lastAP0;
+  ap1.x10_lastInput = lastAP1;
+  seg.m_lpLastOut = lpLastOut;
+}
+
+template <size_t Lanes>
+static void ReverbStdSegmentScalar(const ReverbStdSegment& seg, ReverbLanes* frames, int32_t count) {
+  ReverbStdSegmentT<Lanes>(seg, frames, count);
+}
+
+template <size_t Lanes>
+static void ReverbHiSegmentScalar(const ReverbHiSegment& seg, const ReverbLanes* frames, ReverbLanes* lowPassed,
+                                  int32_t count) {
+  ReverbHiSegmentT<Lanes>(seg, frames, lowPassed, count);
+}
+
+#if AMUSE_X86
+/* Up to eight lanes fit one AVX register */
+template <size_t Lanes>
+AMUSE_TARGET("avx2")
+static void ReverbStdSegmentAVX2(const ReverbStdSegment& seg, ReverbLanes* frames, int32_t count) {
+  ReverbStdSegmentT<Lanes>(seg, frames, count);
+}
+
+template <size_t Lanes>
+AMUSE_TARGET("avx2")
+static void ReverbHiSegmentAVX2(const ReverbHiSegment& seg, const ReverbLanes* frames, ReverbLanes* lowPassed,
+                                int32_t count) {
+  ReverbHiSegmentT<Lanes>(seg, frames, lowPassed, count);
+}
+#endif
+
+namespace {
+using ReverbStdKernel = void (*)(const ReverbStdSegment&, ReverbLanes*, int32_t);
+using ReverbHiKernel = void (*)(const ReverbHiSegment&, const ReverbLanes*, ReverbLanes*, int32_t);
+
+/** Kernels indexed by ReverbLaneClass */
+struct ReverbKernelSelection {
+  std::array<ReverbStdKernel, 3> m_std{ReverbStdSegmentScalar<2>, ReverbStdSegmentScalar<4>,
+                                       ReverbStdSegmentScalar<8>};
+  std::array<ReverbHiKernel, 3> m_hi{ReverbHiSegmentScalar<2>, ReverbHiSegmentScalar<4>, ReverbHiSegmentScalar<8>};
+  const char* m_name = "scalar";
+
+  ReverbKernelSelection() {
+#if AMUSE_X86
+    if (GetCPUFeatures().avx2) {
+      m_std = {ReverbStdSegmentAVX2<2>, ReverbStdSegmentAVX2<4>, ReverbStdSegmentAVX2<8>};
+      m_hi = {ReverbHiSegmentAVX2<2>, ReverbHiSegmentAVX2<4>, ReverbHiSegmentAVX2<8>};
+      m_name = "avx2";
+    }
+#endif
+  }
+};
+
+/** Smallest kernel width covering `chanCount` channels */
+size_t ReverbLaneClass(unsigned chanCount) { return chanCount <= 2 ? 0 : chanCount <= 4 ? 1 : 2; }
+
+const ReverbKernelSelection& GetReverbKernels() {
+  static const ReverbKernelSelection Selection;
+  return Selection;
+}
+
+/** Reverb kernels work on at most one MusyX processing block of frames at a time */
+constexpr int32_t ReverbSegmentFrames = 160;
+
+/** Pre-delay buffers wrap one position early, as in the original effect */
+int32_t PreDelayWrap(int32_t preDelayTime) { return std::max(preDelayTime - 1, 1); }
+
+template <typename T>
+void LoadReverbFrames(ReverbLanes* frames, const T* audio, unsigned chanCount, int32_t count) {
+  for (int32_t s = 0; s < count; ++s) {
+    frames[s] = {};
+    for (unsigned c = 0; c < chanCount; ++c)
+      frames[s][c] = audio[s * chanCount + c];
+  }
+}
+} // namespace
+
+const char* ReverbKernelsISA() { return GetReverbKernels().m_name; }
+
 EffectReverbStd::EffectReverbStd(float coloration, float mix, float time, float damping, float preDelay)
 : x140_x1c8_coloration(std::clamp(coloration, 0.f, 1.f))
 , x144_x1cc_mix(std::clamp(mix, 0.f, 1.f))
@@ -79,21 +362,19 @@ template <typename T>
 void EffectReverbStdImp<T>::_update() {
   float timeSamples = x148_x1d0_time * m_sampleRate;
   double rateRatio = m_sampleRate / NativeSampleRate;
-  for (size_t c = 0; c < NumChannels; ++c) {
-    for (size_t t = 0; t < x78_C[c].size(); ++t) {
-      ReverbDelayLine& combLine = x78_C[c][t];
-      size_t tapDelay = CTapDelays[t] * rateRatio;
-      combLine.allocate(tapDelay);
-      combLine.setdelay(tapDelay);
-      xf4_combCoef[c][t] = std::pow(10.f, tapDelay * -3.f / timeSamples);
-    }
+  for (size_t t = 0; t < x78_C.size(); ++t) {
+    ReverbDelayLanes& combLine = x78_C[t];
+    size_t tapDelay = CTapDelays[t] * rateRatio;
+    combLine.allocate(tapDelay);
+    combLine.setdelay(tapDelay);
+    xf4_combCoef[t].fill(std::pow(10.f, tapDelay * -3.f / timeSamples));
+  }
 
-    for (size_t t = 0; t < x0_AP[c].size(); ++t) {
-      ReverbDelayLine& allPassLine = x0_AP[c][t];
-      size_t tapDelay = APTapDelays[t] * rateRatio;
-      allPassLine.allocate(tapDelay);
-      allPassLine.setdelay(tapDelay);
-    }
+  for (size_t t = 0; t < x0_AP.size(); ++t) {
+    ReverbDelayLanes& allPassLine = x0_AP[t];
+    size_t tapDelay = APTapDelays[t] * rateRatio;
+    allPassLine.allocate(tapDelay);
+    allPassLine.setdelay(tapDelay);
   }
 
   xf0_allPassCoef = x140_x1c8_coloration;
@@ -105,19 +386,12 @@ void EffectReverbStdImp<T>::_update() {
 
   x11c_damping = 1.f - (x11c_damping * 0.8f + 0.05);
 
-  if (x150_x1d8_preDelay != 0.f) {
-    x120_preDelayTime = m_sampleRate * x150_x1d8_preDelay;
-    for (size_t i = 0; i < NumChannels; ++i) {
-      x124_preDelayLine[i] = std::make_unique<float[]>(x120_preDelayTime);
-      x130_preDelayPtr[i] = x124_preDelayLine[i].get();
-    }
-  } else {
-    x120_preDelayTime = 0;
-    for (auto& delayLine : x124_preDelayLine) {
-      delayLine.reset();
-    }
-    x130_preDelayPtr.fill(nullptr);
-  }
+  x120_preDelayTime = x150_x1d8_preDelay != 0.f ? int32_t(m_sampleRate * x150_x1d8_preDelay) : 0;
+  if (x120_preDelayTime != 0)
+    x124_preDelayLine = std::make_unique<ReverbLanes[]>(x120_preDelayTime);
+  else
+    x124_preDelayLine.reset();
+  x130_preDelayPos = 0;
 
   m_dirty = false;
 }
@@ -129,94 +403,47 @@ void EffectReverbStdImp<T>::applyEffect(T* audio, size_t frameCount, const Chann
 
   const float dampWet = x118_level * 0.6f;
   const float dampDry = 0.6f - dampWet;
-
-  for (size_t f = 0; f < frameCount; f += 160) {
-    for (unsigned c = 0; c < chanMap.m_channelCount; ++c) {
-      const auto& combCoefs = xf4_combCoef[c];
-      float& lpLastOut = x10c_lpLastout[c];
-      float* preDelayLine = x124_preDelayLine[c].get();
-      float* preDelayPtr = x130_preDelayPtr[c];
-      float* lastPreDelaySamp = &preDelayLine[x120_preDelayTime - 1];
-
-      auto& linesC = x78_C[c];
-      auto& linesAP = x0_AP[c];
-
-      const int procSamples = std::min(size_t(160), frameCount - f);
-      for (int s = 0; s < procSamples; ++s) {
-        const float sample = audio[s * chanMap.m_channelCount + c];
-
-        /* Pre-delay stage */
-        float sample2 = sample;
-        if (x120_preDelayTime != 0) {
-          sample2 = *preDelayPtr;
-          *preDelayPtr = sample;
-          preDelayPtr += 1;
-          if (preDelayPtr == lastPreDelaySamp)
-            preDelayPtr = preDelayLine;
-        }
-
-        /* Comb filter stage */
-        linesC[0].xc_inputs[linesC[0].x0_inPoint] = combCoefs[0] * linesC[0].x10_lastInput + sample2;
-        linesC[0].x0_inPoint += 1;
-
-        linesC[1].xc_inputs[linesC[1].x0_inPoint] = combCoefs[1] * linesC[1].x10_lastInput + sample2;
-        linesC[1].x0_inPoint += 1;
-
-        linesC[0].x10_lastInput = linesC[0].xc_inputs[linesC[0].x4_outPoint];
-        linesC[0].x4_outPoint += 1;
-
-        linesC[1].x10_lastInput = linesC[1].xc_inputs[linesC[1].x4_outPoint];
-        linesC[1].x4_outPoint += 1;
-
-        if (linesC[0].x0_inPoint == linesC[0].x8_length)
-          linesC[0].x0_inPoint = 0;
-
-        if (linesC[1].x0_inPoint == linesC[1].x8_length)
-          linesC[1].x0_inPoint = 0;
-
-        if (linesC[0].x4_outPoint == linesC[0].x8_length)
-          linesC[0].x4_outPoint = 0;
-
-        if (linesC[1].x4_outPoint == linesC[1].x8_length)
-          linesC[1].x4_outPoint = 0;
-
-        /* All-pass filter stage */
-        linesAP[0].xc_inputs[linesAP[0].x0_inPoint] =
-            xf0_allPassCoef * linesAP[0].x10_lastInput + linesC[0].x10_lastInput + linesC[1].x10_lastInput;
-        const float lowPass =
-            -(xf0_allPassCoef * linesAP[0].xc_inputs[linesAP[0].x0_inPoint] - linesAP[0].x10_lastInput);
-        linesAP[0].x0_inPoint += 1;
-
-        linesAP[0].x10_lastInput = linesAP[0].xc_inputs[linesAP[0].x4_outPoint];
-        linesAP[0].x4_outPoint += 1;
-
-        if (linesAP[0].x0_inPoint == linesAP[0].x8_length)
-          linesAP[0].x0_inPoint = 0;
-
-        if (linesAP[0].x4_outPoint == linesAP[0].x8_length)
-          linesAP[0].x4_outPoint = 0;
-
-        lpLastOut = x11c_damping * lpLastOut + lowPass * 0.3f;
-        linesAP[1].xc_inputs[linesAP[1].x0_inPoint] = xf0_allPassCoef * linesAP[1].x10_lastInput + lpLastOut;
-        const float allPass =
-            -(xf0_allPassCoef * linesAP[1].xc_inputs[linesAP[1].x0_inPoint] - linesAP[1].x10_lastInput);
-        linesAP[1].x0_inPoint += 1;
-
-        linesAP[1].x10_lastInput = linesAP[1].xc_inputs[linesAP[1].x4_outPoint];
-        linesAP[1].x4_outPoint += 1;
-
-        if (linesAP[1].x0_inPoint == linesAP[1].x8_length)
-          linesAP[1].x0_inPoint = 0;
-
-        if (linesAP[1].x4_outPoint == linesAP[1].x8_length)
-          linesAP[1].x4_outPoint = 0;
-
-        /* Mix out */
-        audio[s * chanMap.m_channelCount + c] = ClampFull<T>(dampWet * allPass + dampDry * sample);
-      }
-      x130_preDelayPtr[c] = preDelayPtr;
+  const unsigned chanCount = chanMap.m_channelCount;
+  const auto kernel = GetReverbKernels().m_std[ReverbLaneClass(chanCount)];
+  const int32_t preDelayWrap = PreDelayWrap(x120_preDelayTime);
+
+  ReverbLanes frames[ReverbSegmentFrames];
+  for (size_t f = 0; f < frameCount;) {
+    /* Largest run over which no delay line wraps */
+    int32_t count = int32_t(std::min(size_t(ReverbSegmentFrames), frameCount - f));
+    for (const ReverbDelayLanes& line : x78_C)
+      count = line.contiguous(count);
+    for (const ReverbDelayLanes& line : x0_AP)
+      count = line.contiguous(count);
+    if (x120_preDelayTime != 0)
+      count = std::min(count, preDelayWrap - x130_preDelayPos);
+
+    LoadReverbFrames(frames, audio, chanCount, count);
+    const ReverbStdSegment seg{x78_C,
+                               x0_AP,
+                               xf4_combCoef,
+                               x10c_lpLastout,
+                               x120_preDelayTime != 0 ? &x124_preDelayLine[x130_preDelayPos] : nullptr,
+                               xf0_allPassCoef,
+                               x11c_damping,
+                               dampWet,
+                               dampDry};
+    kernel(seg, frames, count);
+    for (int32_t s = 0; s < count; ++s)
+      for (unsigned c = 0; c < chanCount; ++c)
+        audio[s * chanCount + c] = ClampFull<T>(frames[s][c]);
+
+    for (ReverbDelayLanes& line : x78_C)
+      line.advance(count);
+    for (ReverbDelayLanes& line : x0_AP)
+      line.advance(count);
+    if (x120_preDelayTime != 0) {
+      x130_preDelayPos += count;
+      if (x130_preDelayPos == preDelayWrap)
+        x130_preDelayPos = 0;
     }
-    audio += chanMap.m_channelCount * 160;
+    audio += count * chanCount;
+    f += count;
   }
 }
 
@@ -238,22 +465,22 @@ void EffectReverbHiImp<T>::_update() {
   const float timeSamples = x148_x1d0_time * m_sampleRate;
   const double rateRatio = m_sampleRate / NativeSampleRate;
 
-  for (size_t c = 0; c < NumChannels; ++c) {
-    for (size_t t = 0; t < xb4_C[c].size(); ++t) {
-      ReverbDelayLine& combLine = xb4_C[c][t];
-      const size_t tapDelay = CTapDelays[t] * rateRatio;
-      combLine.allocate(tapDelay);
-      combLine.setdelay(tapDelay);
-      x16c_combCoef[c][t] = std::pow(10.f, tapDelay * -3.f / timeSamples);
-    }
+  for (size_t t = 0; t < xb4_C.size(); ++t) {
+    ReverbDelayLanes& combLine = xb4_C[t];
+    const size_t tapDelay = CTapDelays[t] * rateRatio;
+    combLine.allocate(tapDelay);
+    combLine.setdelay(tapDelay);
+    x16c_combCoef[t].fill(std::pow(10.f, tapDelay * -3.f / timeSamples));
+  }
 
-    for (size_t t = 0; t < x0_AP[c].size(); ++t) {
-      ReverbDelayLine& allPassLine = x0_AP[c][t];
-      const size_t tapDelay = APTapDelays[t] * rateRatio;
-      allPassLine.allocate(tapDelay);
-      allPassLine.setdelay(tapDelay);
-    }
+  for (size_t t = 0; t < x0_AP.size(); ++t) {
+    ReverbDelayLanes& allPassLine = x0_AP[t];
+    const size_t tapDelay = APTapDelays[t] * rateRatio;
+    allPassLine.allocate(tapDelay);
+    allPassLine.setdelay(tapDelay);
+  }
 
+  for (size_t c = 0; c < NumChannels; ++c) {
     ReverbDelayLine& lpLine = x78_LP[c];
     const size_t tapDelay = LPTapDelays[c] * rateRatio;
     lpLine.allocate(tapDelay);
@@ -269,142 +496,90 @@ void EffectReverbHiImp<T>::_update() {
 
   x1a0_damping = 1.f - (x1a0_damping * 0.8f + 0.05);
 
-  if (x150_x1d8_preDelay != 0.f) {
-    x1a4_preDelayTime = m_sampleRate * x150_x1d8_preDelay;
-    for (size_t i = 0; i < NumChannels; ++i) {
-      x1ac_preDelayLine[i] = std::make_unique<float[]>(x1a4_preDelayTime);
-      x1b8_preDelayPtr[i] = x1ac_preDelayLine[i].get();
-    }
-  } else {
-    x1a4_preDelayTime = 0;
-    for (auto& delayLine : x1ac_preDelayLine) {
-      delayLine.reset();
-    }
-    x1b8_preDelayPtr.fill(nullptr);
-  }
+  x1a4_preDelayTime = x150_x1d8_preDelay != 0.f ? int32_t(m_sampleRate * x150_x1d8_preDelay) : 0;
+  if (x1a4_preDelayTime != 0)
+    x1ac_preDelayLine = std::make_unique<ReverbLanes[]>(x1a4_preDelayTime);
+  else
+    x1ac_preDelayLine.reset();
+  x1b8_preDelayPos = 0;
 
   x1a8_internalCrosstalk = x1dc_crosstalk;
   m_dirty = false;
 }
 
 template <typename T>
-void EffectReverbHiImp<T>::_handleReverb(T* audio, int c, int chanCount, int sampleCount) {
+void EffectReverbHiImp<T>::_handleReverb(T* audio, int chanCount, int sampleCount) {
   const float dampWet = x19c_level * 0.6f;
   const float dampDry = 0.6f - dampWet;
-
-  const auto& combCoefs = x16c_combCoef[c];
-  float& lpLastOut = x190_lpLastout[c];
-  float* preDelayLine = x1ac_preDelayLine[c].get();
-  float* preDelayPtr = x1b8_preDelayPtr[c];
-  float* lastPreDelaySamp = &preDelayLine[x1a4_preDelayTime - 1];
-
-  auto& linesC = xb4_C[c];
-  auto& linesAP = x0_AP[c];
-  ReverbDelayLine& lineLP = x78_LP[c];
-
   const float allPassCoef = x168_allPassCoef;
-  const float damping = x1a0_damping;
-  const int32_t preDelayTime = x1a4_preDelayTime;
-
-  for (int s = 0; s < sampleCount; ++s) {
-    const float sample = audio[s * chanCount + c];
+  const auto kernel = GetReverbKernels().m_hi[ReverbLaneClass(chanCount)];
+  const int32_t preDelayWrap = PreDelayWrap(x1a4_preDelayTime);
+
+  ReverbLanes frames[ReverbSegmentFrames];
+  ReverbLanes lowPassed[ReverbSegmentFrames];
+  for (int f = 0; f < sampleCount;) {
+    /* Largest run over which no shared delay line wraps */
+    int32_t count = std::min(ReverbSegmentFrames, sampleCount - f);
+    for (const ReverbDelayLanes& line : xb4_C)
+      count = line.contiguous(count);
+    for (const ReverbDelayLanes& line : x0_AP)
+      count = line.contiguous(count);
+    if (x1a4_preDelayTime != 0)
+      count = std::min(count, preDelayWrap - x1b8_preDelayPos);
+
+    LoadReverbFrames(frames, audio, chanCount, count);
+    const ReverbHiSegment seg{xb4_C,
+                              x0_AP,
+                              x16c_combCoef,
+                              x190_lpLastout,
+                              x1a4_preDelayTime != 0 ? &x1ac_preDelayLine[x1b8_preDelayPos] : nullptr,
+                              allPassCoef,
+                              x1a0_damping};
+    kernel(seg, frames, lowPassed, count);
+
+    /* Per-channel low-pass delay lines have their own lengths; run each in its own wrap-free runs */
+    for (int c = 0; c < chanCount; ++c) {
+      ReverbDelayLine& lineLP = x78_LP[c];
+      float lastInput = lineLP.x10_lastInput;
+      for (int32_t s = 0; s < count;) {
+        const int32_t run =
+            std::min({count - s, lineLP.x8_length - lineLP.x0_inPoint, lineLP.x8_length - lineLP.x4_outPoint});
+        float* lpIn = &lineLP.xc_inputs[lineLP.x0_inPoint];
+        const float* lpOut = &lineLP.xc_inputs[lineLP.x4_outPoint];
+        for (int32_t i = 0; i < run; ++i) {
+          const float lineOut = lpOut[i];
+          const float lineIn = allPassCoef * lastInput + lowPassed[s + i][c];
+          lpIn[i] = lineIn;
+          const float allPass = -(allPassCoef * lineIn - lastInput);
+          lastInput = lineOut;
+
+          /* Mix out */
+          audio[(s + i) * chanCount + c] = ClampFull<T>(dampWet * allPass + dampDry * frames[s + i][c]);
+        }
 
-    /* Pre-delay stage */
-    float sample2 = sample;
-    if (preDelayTime != 0) {
-      sample2 = *preDelayPtr;
-      *preDelayPtr = sample;
-      preDelayPtr += 1;
-      if (preDelayPtr == lastPreDelaySamp)
-        preDelayPtr = preDelayLine;
+        lineLP.x0_inPoint += run;
+        if (lineLP.x0_inPoint == lineLP.x8_length)
+          lineLP.x0_inPoint = 0;
+        lineLP.x4_outPoint += run;
+        if (lineLP.x4_outPoint == lineLP.x8_length)
+          lineLP.x4_outPoint = 0;
+        s += run;
+      }
+      lineLP.x10_lastInput = lastInput;
     }
 
-    /* Comb filter stage */
-    linesC[0].xc_inputs[linesC[0].x0_inPoint] = combCoefs[0] * linesC[0].x10_lastInput + sample2;
-    linesC[0].x0_inPoint += 1;
-
-    linesC[1].xc_inputs[linesC[1].x0_inPoint] = combCoefs[1] * linesC[1].x10_lastInput + sample2;
-    linesC[1].x0_inPoint += 1;
-
-    linesC[2].xc_inputs[linesC[2].x0_inPoint] = combCoefs[2] * linesC[2].x10_lastInput + sample2;
-    linesC[2].x0_inPoint += 1;
-
-    linesC[0].x10_lastInput = linesC[0].xc_inputs[linesC[0].x4_outPoint];
-    linesC[0].x4_outPoint += 1;
-
-    linesC[1].x10_lastInput = linesC[1].xc_inputs[linesC[1].x4_outPoint];
-    linesC[1].x4_outPoint += 1;
-
-    linesC[2].x10_lastInput = linesC[2].xc_inputs[linesC[2].x4_outPoint];
-    linesC[2].x4_outPoint += 1;
-
-    if (linesC[0].x0_inPoint == linesC[0].x8_length)
-      linesC[0].x0_inPoint = 0;
-
-    if (linesC[1].x0_inPoint == linesC[1].x8_length)
-      linesC[1].x0_inPoint = 0;
-
-    if (linesC[2].x0_inPoint == linesC[2].x8_length)
-      linesC[2].x0_inPoint = 0;
-
-    if (linesC[0].x4_outPoint == linesC[0].x8_length)
-      linesC[0].x4_outPoint = 0;
-
-    if (linesC[1].x4_outPoint == linesC[1].x8_length)
-      linesC[1].x4_outPoint = 0;
-
-    if (linesC[2].x4_outPoint == linesC[2].x8_length)
-      linesC[2].x4_outPoint = 0;
-
-    /* All-pass filter stage */
-    linesAP[0].xc_inputs[linesAP[0].x0_inPoint] = allPassCoef * linesAP[0].x10_lastInput + linesC[0].x10_lastInput +
-                                                  linesC[1].x10_lastInput + linesC[2].x10_lastInput;
-
-    linesAP[1].xc_inputs[linesAP[1].x0_inPoint] =
-        allPassCoef * linesAP[1].x10_lastInput -
-        (allPassCoef * linesAP[0].xc_inputs[linesAP[0].x0_inPoint] - linesAP[0].x10_lastInput);
-
-    const float lowPass = -(allPassCoef * linesAP[1].xc_inputs[linesAP[1].x0_inPoint] - linesAP[1].x10_lastInput);
-    linesAP[0].x0_inPoint += 1;
-    linesAP[1].x0_inPoint += 1;
-
-    if (linesAP[0].x0_inPoint == linesAP[0].x8_length)
-      linesAP[0].x0_inPoint = 0;
-
-    if (linesAP[1].x0_inPoint == linesAP[1].x8_length)
-      linesAP[1].x0_inPoint = 0;
-
-    linesAP[0].x10_lastInput = linesAP[0].xc_inputs[linesAP[0].x4_outPoint];
-    linesAP[0].x4_outPoint += 1;
-
-    linesAP[1].x10_lastInput = linesAP[1].xc_inputs[linesAP[1].x4_outPoint];
-    linesAP[1].x4_outPoint += 1;
-
-    if (linesAP[0].x4_outPoint == linesAP[0].x8_length)
-      linesAP[0].x4_outPoint = 0;
-
-    if (linesAP[1].x4_outPoint == linesAP[1].x8_length)
-      linesAP[1].x4_outPoint = 0;
-
-    lpLastOut = damping * lpLastOut + lowPass * 0.3f;
-    lineLP.xc_inputs[lineLP.x0_inPoint] = allPassCoef * lineLP.x10_lastInput + lpLastOut;
-    const float allPass = -(allPassCoef * lineLP.xc_inputs[lineLP.x0_inPoint] - lineLP.x10_lastInput);
-    lineLP.x0_inPoint += 1;
-
-    lineLP.x10_lastInput = lineLP.xc_inputs[lineLP.x4_outPoint];
-    lineLP.x4_outPoint += 1;
-
-    if (lineLP.x0_inPoint == lineLP.x8_length)
-      lineLP.x0_inPoint = 0;
-
-    if (lineLP.x4_outPoint == lineLP.x8_length)
-      lineLP.x4_outPoint = 0;
-
-    /* Mix out */
-    audio[s * chanCount + c] = ClampFull<T>(dampWet * allPass + dampDry * sample);
+    for (ReverbDelayLanes& line : xb4_C)
+      line.advance(count);
+    for (ReverbDelayLanes& line : x0_AP)
+      line.advance(count);
+    if (x1a4_preDelayTime != 0) {
+      x1b8_preDelayPos += count;
+      if (x1b8_preDelayPos == preDelayWrap)
+        x1b8_preDelayPos = 0;
+    }
+    audio += count * chanCount;
+    f += count;
   }
-
-  x1b8_preDelayPtr[c] = preDelayPtr;
 }
 
 template <typename T>
@@ -426,17 +601,12 @@ void EffectReverbHiImp<T>::applyEffect(T* audio, size_t frameCount, const Channe
   if (m_dirty)
     _update();
 
-  for (size_t f = 0; f < frameCount; f += 160) {
-    size_t blockSamples = std::min(size_t(160), frameCount - f);
-    for (unsigned i = 0; i < chanMap.m_channelCount; ++i) {
-      if (i == 0 && x1a8_internalCrosstalk != 0.f) {
-        float crossWet = x1a8_internalCrosstalk * 0.5;
-        _doCrosstalk(audio, crossWet, 1.f - crossWet, chanMap.m_channelCount, blockSamples);
-      }
-      _handleReverb(audio, i, chanMap.m_channelCount, blockSamples);
-    }
-    audio += chanMap.m_channelCount * 160;
+  /* Crosstalk only mixes within each frame, so it may run over the whole buffer ahead of the reverb */
+  if (chanMap.m_channelCount != 0 && x1a8_internalCrosstalk != 0.f) {
+    float crossWet = x1a8_internalCrosstalk * 0.5;
+    _doCrosstalk(audio, crossWet, 1.f - crossWet, chanMap.m_channelCount, int(frameCount));
   }
+  _handleReverb(audio, chanMap.m_channelCount, int(frameCount));
 }
 
 template class EffectReverbStdImp<int16_t>;
@@ -1,122 +1,500 @@
 #include "amuse/Emitter.hpp"
 
+#include <algorithm>
+
+#include "amuse/CPUFeatures.hpp"
 #include "amuse/Engine.hpp"
 #include "amuse/Listener.hpp"
 #include "amuse/Voice.hpp"
+#include "amuse/VolumeTable.hpp"
 
 namespace amuse {
 static constexpr Vector3f Delta(const Vector3f& a, const Vector3f& b) {
   return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
 }
 
-Emitter::~Emitter() = default;
+namespace {
+/** Listener state shared by every emitter of a batch */
+struct ListenerFrame {
+  Vector3f m_pos;
+  Vector3f m_dir;
+  Vector3f m_heading;
+  Vector3f m_right;
+  float m_frontDiff;
+  float m_backDiff;
+  float m_soundSpeed;
+};
 
-Emitter::Emitter(Engine& engine, const AudioGroup& group, ObjToken<Voice> vox, float maxDist, float minVol,
-                 float falloff, bool doppler)
-: Entity(engine, group, vox->getGroupId(), vox->getObjectId())
-, m_vox(vox)
-, m_maxDist(maxDist)
-, m_minVol(std::clamp(minVol, 0.f, 1.f))
-, m_falloff(std::clamp(falloff, -1.f, 1.f))
-, m_doppler(doppler) {}
-
-void Emitter::_destroy() {
-  Entity::_destroy();
-  m_vox->kill();
-}
+using ColumnPtrs = std::array<const float*, EmitterBatch::NumColumns>;
+using TermPtrs = std::array<float*, EmitterBatch::NumTerms>;
+using CoefPtrs = std::array<float*, 8>;
 
-float Emitter::_attenuationCurve(float dist) const {
-  if (dist > m_maxDist)
+float AttenuationCurve(float dist, float maxDist, float falloff) {
+  if (dist > maxDist)
     return 0.f;
-  float t = dist / m_maxDist;
-  if (m_falloff >= 0.f) {
-    return 1.f - (m_falloff * t * t + (1.f - m_falloff) * t);
+  float t = dist / maxDist;
+  if (falloff >= 0.f) {
+    return 1.f - (falloff * t * t + (1.f - falloff) * t);
   } else {
     float omt = 1.f - t;
-    return 1.f - ((1.f + m_falloff) * t - (1.f - omt * omt) * m_falloff);
+    return 1.f - ((1.f + falloff) * t - (1.f - omt * omt) * falloff);
   }
 }
 
-void Emitter::_update() {
-  if (!m_dirty) {
-    /* Ensure that all listeners are also not dirty */
-    bool dirty = false;
-    for (auto& listener : m_engine.m_activeListeners) {
-      if (listener->m_dirty) {
-        dirty = true;
-        break;
-      }
+/** Distance attenuation (ahead of the volume table), pans and doppler shift of emitters [begin, end) */
+void SpatializeRange(const ColumnPtrs& cols, const ListenerFrame& listener, size_t begin, size_t end,
+                     const TermPtrs& terms) {
+  using enum EmitterBatch::Column;
+  using enum EmitterBatch::Term;
+  for (size_t i = begin; i < end; ++i) {
+    const Vector3f pos{cols[PosX][i], cols[PosY][i], cols[PosZ][i]};
+    const Vector3f listenerToEmitter = Delta(pos, listener.m_pos);
+    const float dist = Length(listenerToEmitter);
+    const float panDist = Dot(listenerToEmitter, listener.m_right);
+    terms[FrontPan][i] = std::clamp(panDist / listener.m_frontDiff, -1.f, 1.f);
+    terms[BackPan][i] = std::clamp(panDist / listener.m_backDiff, -1.f, 1.f);
+    const float spanDist = -Dot(listenerToEmitter, listener.m_heading);
+    terms[Span][i] = std::clamp(spanDist > 0.f ? spanDist / listener.m_backDiff : spanDist / listener.m_frontDiff,
+                                -1.f, 1.f);
+
+    const float att = AttenuationCurve(dist, cols[MaxDist][i], cols[Falloff][i]);
+    terms[Attenuation][i] = (cols[MaxVol][i] - cols[MinVol][i]) * att + cols[MinVol][i];
+
+    /* Positive values indicate emitter and listener closing in */
+    const Vector3f dir{cols[DirX][i], cols[DirY][i], cols[DirZ][i]};
+    const Vector3f dirDelta = Delta(dir, listener.m_dir);
+    const Vector3f posDelta = Normalize(Delta(listener.m_pos, pos));
+    const float deltaSpeed = Dot(dirDelta, posDelta);
+    terms[Doppler][i] = listener.m_soundSpeed != 0.f ? deltaSpeed / listener.m_soundSpeed : 0.f;
+  }
+}
+
+/** Take the maximum of each channel's panned level across listeners; `terms` hold volume-table attenuation */
+template <AudioChannelSet Set>
+void AccumulatePanRange(const TermPtrs& terms, float volume, size_t begin, size_t end, const CoefPtrs& coefs) {
+  using enum EmitterBatch::Term;
+  for (size_t i = begin; i < end; ++i) {
+    const float att = terms[Attenuation][i];
+    if (att > FLT_EPSILON) {
+      const std::array<float, 8> thisCoefs = Voice::PanLaw(Set, terms[FrontPan][i], terms[BackPan][i], terms[Span][i]);
+      for (size_t c = 0; c < coefs.size(); ++c)
+        coefs[c][i] = std::max(coefs[c][i], thisCoefs[c] * att * volume);
     }
-    if (!dirty)
-      return;
   }
+}
 
-  std::array<float, 8> coefs{};
-  double avgDopplerRatio = 0.0;
+void SpatializeScalar(const ColumnPtrs& cols, const ListenerFrame& listener, size_t count, const TermPtrs& terms) {
+  SpatializeRange(cols, listener, 0, count, terms);
+}
 
-  for (auto& listener : m_engine.m_activeListeners) {
-    const Vector3f listenerToEmitter = Delta(m_pos, listener->m_pos);
-    const float dist = Length(listenerToEmitter);
-    const float panDist = Dot(listenerToEmitter, listener->m_right);
-    const float frontPan = std::clamp(panDist / listener->m_frontDiff, -1.f, 1.f);
-    const float backPan = std::clamp(panDist / listener->m_backDiff, -1.f, 1.f);
-    const float spanDist = -Dot(listenerToEmitter, listener->m_heading);
-    const float span =
-        std::clamp(spanDist > 0.f ? spanDist / listener->m_backDiff : spanDist / listener->m_frontDiff, -1.f, 1.f);
-
-    /* Calculate attenuation */
-    float att = _attenuationCurve(dist);
-    att = (m_maxVol - m_minVol) * att + m_minVol;
-    att = m_attCache.getVolume(att, false);
-    if (att > FLT_EPSILON) {
-      /* Apply pan law */
-      const std::array<float, 8> thisCoefs = m_vox->_panLaw(frontPan, backPan, span);
+template <AudioChannelSet Set>
+void AccumulatePanScalar(const TermPtrs& terms, float volume, size_t count, const CoefPtrs& coefs) {
+  AccumulatePanRange<Set>(terms, volume, 0, count, coefs);
+}
 
-      /* Take maximum coefficient across listeners */
-      for (size_t i = 0; i < coefs.size(); ++i) {
-        coefs[i] = std::max(coefs[i], thisCoefs[i] * att * listener->m_volume);
-      }
+#if AMUSE_X86
+/* Eight emitters per iteration, operation for operation as the scalar path so results are bit-identical */
+AMUSE_TARGET("avx2") AMUSE_FORCEINLINE __m256 Negate(__m256 v) { return _mm256_xor_ps(v, _mm256_set1_ps(-0.f)); }
+
+AMUSE_TARGET("avx2") AMUSE_FORCEINLINE __m256 Abs(__m256 v) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), v); }
+
+AMUSE_TARGET("avx2") AMUSE_FORCEINLINE __m256 Dot(__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz) {
+  return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)), _mm256_mul_ps(az, bz));
+}
+
+/** std::clamp(v, -1.f, 1.f); operand order passes NaN through the same way */
+AMUSE_TARGET("avx2") AMUSE_FORCEINLINE __m256 ClampUnit(__m256 v) {
+  return _mm256_min_ps(_mm256_set1_ps(1.f), _mm256_max_ps(_mm256_set1_ps(-1.f), v));
+}
+
+/** `cond ? v : 0.f` of a comparison against zero */
+AMUSE_TARGET("avx2") AMUSE_FORCEINLINE __m256 SelectOrZero(__m256 cond, __m256 v) { return _mm256_and_ps(cond, v); }
+
+AMUSE_TARGET("avx2") AMUSE_FORCEINLINE __m256 HalfRange(__m256 v) {
+  const __m256 half = _mm256_set1_ps(0.5f);
+  return _mm256_add_ps(_mm256_mul_ps(v, half), half);
+}
+
+AMUSE_TARGET("avx2")
+void SpatializeAVX2(const ColumnPtrs& cols, const ListenerFrame& listener, size_t count, const TermPtrs& terms) {
+  using enum EmitterBatch::Column;
+  using enum EmitterBatch::Term;
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.f);
+  const __m256 epsilon = _mm256_set1_ps(FLT_EPSILON);
+  const __m256 lpx = _mm256_set1_ps(listener.m_pos[0]);
+  const __m256 lpy = _mm256_set1_ps(listener.m_pos[1]);
+  const __m256 lpz = _mm256_set1_ps(listener.m_pos[2]);
+  const __m256 frontDiff = _mm256_set1_ps(listener.m_frontDiff);
+  const __m256 backDiff = _mm256_set1_ps(listener.m_backDiff);
+  const __m256 soundSpeed = _mm256_set1_ps(listener.m_soundSpeed);
+  const bool doppler = listener.m_soundSpeed != 0.f;
+
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256 px = _mm256_loadu_ps(cols[PosX] + i);
+    const __m256 py = _mm256_loadu_ps(cols[PosY] + i);
+    const __m256 pz = _mm256_loadu_ps(cols[PosZ] + i);
+    const __m256 dx = _mm256_sub_ps(px, lpx);
+    const __m256 dy = _mm256_sub_ps(py, lpy);
+    const __m256 dz = _mm256_sub_ps(pz, lpz);
+
+    /* Length(): zero when every component is within epsilon */
+    const __m256 tiny = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(Abs(dx), epsilon, _CMP_LE_OQ),
+                                                    _mm256_cmp_ps(Abs(dy), epsilon, _CMP_LE_OQ)),
+                                      _mm256_cmp_ps(Abs(dz), epsilon, _CMP_LE_OQ));
+    const __m256 dist = _mm256_andnot_ps(tiny, _mm256_sqrt_ps(Dot(dx, dy, dz, dx, dy, dz)));
+
+    const __m256 panDist = Dot(dx, dy, dz, _mm256_set1_ps(listener.m_right[0]), _mm256_set1_ps(listener.m_right[1]),
+                               _mm256_set1_ps(listener.m_right[2]));
+    _mm256_storeu_ps(terms[FrontPan] + i, ClampUnit(_mm256_div_ps(panDist, frontDiff)));
+    _mm256_storeu_ps(terms[BackPan] + i, ClampUnit(_mm256_div_ps(panDist, backDiff)));
+    const __m256 spanDist =
+        Negate(Dot(dx, dy, dz, _mm256_set1_ps(listener.m_heading[0]), _mm256_set1_ps(listener.m_heading[1]),
+                   _mm256_set1_ps(listener.m_heading[2])));
+    _mm256_storeu_ps(terms[Span] + i, ClampUnit(_mm256_blendv_ps(_mm256_div_ps(spanDist, frontDiff),
+                                                                 _mm256_div_ps(spanDist, backDiff),
+                                                                 _mm256_cmp_ps(spanDist, zero, _CMP_GT_OQ))));
+
+    /* Both falloff shapes of AttenuationCurve, selected per lane */
+    const __m256 maxDist = _mm256_loadu_ps(cols[MaxDist] + i);
+    const __m256 falloff = _mm256_loadu_ps(cols[Falloff] + i);
+    const __m256 t = _mm256_div_ps(dist, maxDist);
+    const __m256 omt = _mm256_sub_ps(one, t);
+    const __m256 convex = _mm256_sub_ps(
+        one, _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(falloff, t), t), _mm256_mul_ps(_mm256_sub_ps(one, falloff), t)));
+    const __m256 concave =
+        _mm256_sub_ps(one, _mm256_sub_ps(_mm256_mul_ps(_mm256_add_ps(one, falloff), t),
+                                         _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(omt, omt)), falloff)));
+    __m256 att = _mm256_blendv_ps(concave, convex, _mm256_cmp_ps(falloff, zero, _CMP_GE_OQ));
+    att = _mm256_andnot_ps(_mm256_cmp_ps(dist, maxDist, _CMP_GT_OQ), att);
+    const __m256 minVol = _mm256_loadu_ps(cols[MinVol] + i);
+    att = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(cols[MaxVol] + i), minVol), att), minVol);
+    _mm256_storeu_ps(terms[Attenuation] + i, att);
+
+    if (doppler) {
+      /* Normalize(listener - emitter) has the same length as the listener-to-emitter vector */
+      const __m256 zeroDist = _mm256_cmp_ps(dist, zero, _CMP_EQ_OQ);
+      const __m256 nx = _mm256_andnot_ps(zeroDist, _mm256_div_ps(_mm256_sub_ps(lpx, px), dist));
+      const __m256 ny = _mm256_andnot_ps(zeroDist, _mm256_div_ps(_mm256_sub_ps(lpy, py), dist));
+      const __m256 nz = _mm256_andnot_ps(zeroDist, _mm256_div_ps(_mm256_sub_ps(lpz, pz), dist));
+      const __m256 ddx = _mm256_sub_ps(_mm256_loadu_ps(cols[DirX] + i), _mm256_set1_ps(listener.m_dir[0]));
+      const __m256 ddy = _mm256_sub_ps(_mm256_loadu_ps(cols[DirY] + i), _mm256_set1_ps(listener.m_dir[1]));
+      const __m256 ddz = _mm256_sub_ps(_mm256_loadu_ps(cols[DirZ] + i), _mm256_set1_ps(listener.m_dir[2]));
+      _mm256_storeu_ps(terms[Doppler] + i, _mm256_div_ps(Dot(ddx, ddy, ddz, nx, ny, nz), soundSpeed));
+    } else {
+      _mm256_storeu_ps(terms[Doppler] + i, zero);
     }
+  }
+  SpatializeRange(cols, listener, i, count, terms);
+}
 
-    /* Calculate doppler */
-    if (m_doppler) {
-      /* Positive values indicate emitter and listener closing in */
-      const Vector3f dirDelta = Delta(m_dir, listener->m_dir);
-      const Vector3f posDelta = Normalize(Delta(listener->m_pos, m_pos));
-      const float deltaSpeed = Dot(dirDelta, posDelta);
-      if (listener->m_soundSpeed != 0.f) {
-        avgDopplerRatio += 1.0 + deltaSpeed / listener->m_soundSpeed;
-      } else {
-        avgDopplerRatio += 1.0;
-      }
+template <AudioChannelSet Set>
+AMUSE_TARGET("avx2")
+void AccumulatePanAVX2(const TermPtrs& terms, float volume, size_t count, const CoefPtrs& coefs) {
+  using enum EmitterBatch::Term;
+  const __m256 one = _mm256_set1_ps(1.f);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 vol = _mm256_set1_ps(volume);
+
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256 att = _mm256_loadu_ps(terms[Attenuation] + i);
+    const __m256 audible = _mm256_cmp_ps(att, _mm256_set1_ps(FLT_EPSILON), _CMP_GT_OQ);
+    if (_mm256_testz_ps(audible, audible))
+      continue;
+    const __m256 front = _mm256_loadu_ps(terms[FrontPan] + i);
+    const __m256 back = _mm256_loadu_ps(terms[BackPan] + i);
+    const __m256 span = _mm256_loadu_ps(terms[Span] + i);
+
+    /* Voice::PanLaw, channels the set leaves silent are skipped */
+    __m256 levels[8];
+    size_t channels;
+    if constexpr (Set == AudioChannelSet::Quad) {
+      const __m256 frontSpan = HalfRange(Negate(span));
+      const __m256 backSpan = HalfRange(span);
+      levels[0] = _mm256_sqrt_ps(_mm256_mul_ps(HalfRange(Negate(front)), frontSpan));
+      levels[1] = _mm256_sqrt_ps(_mm256_mul_ps(HalfRange(front), frontSpan));
+      levels[2] = _mm256_sqrt_ps(_mm256_mul_ps(HalfRange(Negate(back)), backSpan));
+      levels[3] = _mm256_sqrt_ps(_mm256_mul_ps(HalfRange(back), backSpan));
+      channels = 4;
+    } else if constexpr (Set == AudioChannelSet::Surround51) {
+      const __m256 frontSpan = HalfRange(Negate(span));
+      const __m256 backSpan = HalfRange(span);
+      const __m256 left = SelectOrZero(_mm256_cmp_ps(front, zero, _CMP_LE_OQ), Negate(front));
+      const __m256 right = SelectOrZero(_mm256_cmp_ps(front, zero, _CMP_GE_OQ), front);
+      levels[0] = _mm256_sqrt_ps(_mm256_mul_ps(left, frontSpan));
+      levels[1] = _mm256_sqrt_ps(_mm256_mul_ps(right, frontSpan));
+      levels[2] = _mm256_sqrt_ps(_mm256_mul_ps(HalfRange(Negate(back)), backSpan));
+      levels[3] = _mm256_sqrt_ps(_mm256_mul_ps(HalfRange(back), backSpan));
+      levels[4] = _mm256_sqrt_ps(_mm256_mul_ps(_mm256_sub_ps(one, Abs(front)), frontSpan));
+      levels[5] = _mm256_set1_ps(0.25f);
+      channels = 6;
+    } else if constexpr (Set == AudioChannelSet::Surround71) {
+      const __m256 frontSpan = SelectOrZero(_mm256_cmp_ps(span, zero, _CMP_LE_OQ), Negate(span));
+      const __m256 backSpan = SelectOrZero(_mm256_cmp_ps(span, zero, _CMP_GE_OQ), span);
+      const __m256 sideSpan = _mm256_sub_ps(one, Abs(span));
+      const __m256 left = SelectOrZero(_mm256_cmp_ps(front, zero, _CMP_LE_OQ), Negate(front));
+      const __m256 right = SelectOrZero(_mm256_cmp_ps(front, zero, _CMP_GE_OQ), front);
+      const __m256 backLeft = HalfRange(Negate(back));
+      const __m256 backRight = HalfRange(back);
+      levels[0] = _mm256_sqrt_ps(_mm256_mul_ps(left, frontSpan));
+      levels[1] = _mm256_sqrt_ps(_mm256_mul_ps(right, frontSpan));
+      levels[2] = _mm256_sqrt_ps(_mm256_mul_ps(backLeft, backSpan));
+      levels[3] = _mm256_sqrt_ps(_mm256_mul_ps(backRight, backSpan));
+      levels[4] = _mm256_sqrt_ps(_mm256_mul_ps(_mm256_sub_ps(one, Abs(front)), frontSpan));
+      levels[5] = _mm256_set1_ps(0.25f);
+      levels[6] = _mm256_sqrt_ps(_mm256_mul_ps(backLeft, sideSpan));
+      levels[7] = _mm256_sqrt_ps(_mm256_mul_ps(backRight, sideSpan));
+      channels = 8;
+    } else {
+      levels[0] = _mm256_sqrt_ps(HalfRange(Negate(front)));
+      levels[1] = _mm256_sqrt_ps(HalfRange(front));
+      channels = 2;
+    }
+
+    for (size_t c = 0; c < channels; ++c) {
+      const __m256 prev = _mm256_loadu_ps(coefs[c] + i);
+      const __m256 level = _mm256_mul_ps(_mm256_mul_ps(levels[c], att), vol);
+      _mm256_storeu_ps(coefs[c] + i, _mm256_blendv_ps(prev, _mm256_max_ps(level, prev), audible));
     }
   }
+  AccumulatePanRange<Set>(terms, volume, i, count, coefs);
+}
+#endif
+
+using SpatializeKernel = void (*)(const ColumnPtrs&, const ListenerFrame&, size_t, const TermPtrs&);
+using PanKernel = void (*)(const TermPtrs&, float, size_t, const CoefPtrs&);
+
+/** Pan kernels indexed by PanLawIndex */
+struct SpatialKernelSelection {
+  SpatializeKernel m_spatialize = SpatializeScalar;
+  std::array<PanKernel, 4> m_pan{AccumulatePanScalar<AudioChannelSet::Stereo>,
+                                 AccumulatePanScalar<AudioChannelSet::Quad>,
+                                 AccumulatePanScalar<AudioChannelSet::Surround51>,
+                                 AccumulatePanScalar<AudioChannelSet::Surround71>};
 
-  if (m_engine.m_activeListeners.size() != 0) {
-    m_vox->setChannelCoefs(coefs);
-    if (m_doppler) {
-      m_vox->m_dopplerRatio = avgDopplerRatio / float(m_engine.m_activeListeners.size());
-      m_vox->m_pitchDirty = true;
+  SpatialKernelSelection() {
+#if AMUSE_X86
+    if (GetCPUFeatures().avx2) {
+      m_spatialize = SpatializeAVX2;
+      m_pan = {AccumulatePanAVX2<AudioChannelSet::Stereo>, AccumulatePanAVX2<AudioChannelSet::Quad>,
+               AccumulatePanAVX2<AudioChannelSet::Surround51>, AccumulatePanAVX2<AudioChannelSet::Surround71>};
     }
+#endif
   }
+};
 
-  m_dirty = false;
+/** Voice::PanLaw treats every set other than these as Stereo */
+size_t PanLawIndex(AudioChannelSet set) {
+  switch (set) {
+  case AudioChannelSet::Quad:
+    return 1;
+  case AudioChannelSet::Surround51:
+    return 2;
+  case AudioChannelSet::Surround71:
+    return 3;
+  default:
+    return 0;
+  }
 }
 
-void Emitter::setVectors(const float* pos, const float* dir) {
-  for (size_t i = 0; i < m_pos.size(); ++i) {
-    if (!std::isnan(pos[i])) {
-      m_pos[i] = pos[i];
-    } else {
-      m_pos[i] = 0.f;
+const SpatialKernelSelection& GetSpatialKernels() {
+  static const SpatialKernelSelection Selection;
+  return Selection;
+}
+} // namespace
+
+void EmitterBatch::_add(Emitter& em, float maxDist, float minVol, float falloff) {
+  em.m_batchSlot = m_emitters.size();
+  m_emitters.push_back(&em);
+  for (std::vector<float>& column : m_columns)
+    column.push_back(0.f);
+  m_columns[MaxDist].back() = maxDist;
+  m_columns[MaxVol].back() = 1.f;
+  m_columns[MinVol].back() = minVol;
+  m_columns[Falloff].back() = falloff;
+  _markDirty(em);
+}
+
+void EmitterBatch::_remove(Emitter& em) {
+  /* Move the last slot into the vacated one */
+  const size_t slot = em.m_batchSlot;
+  const size_t last = m_emitters.size() - 1;
+  if (slot != last) {
+    m_emitters[slot] = m_emitters[last];
+    m_emitters[slot]->m_batchSlot = slot;
+    for (std::vector<float>& column : m_columns)
+      column[slot] = column[last];
+  }
+  m_emitters.pop_back();
+  for (std::vector<float>& column : m_columns)
+    column.pop_back();
+
+  if (em.m_dirty) {
+    auto it = std::find(m_dirty.begin(), m_dirty.end(), &em);
+    *it = m_dirty.back();
+    m_dirty.pop_back();
+    em.m_dirty = false;
+  }
+
+  if (em.m_virtualIdx != SIZE_MAX) {
+    m_virtual[em.m_virtualIdx] = m_virtual.back();
+    m_virtual[em.m_virtualIdx]->m_virtualIdx = em.m_virtualIdx;
+    m_virtual.pop_back();
+    em.m_virtualIdx = SIZE_MAX;
+  }
+}
+
+void EmitterBatch::_markDirty(Emitter& em) {
+  if (!em.m_dirty) {
+    em.m_dirty = true;
+    m_dirty.push_back(&em);
+  }
+}
+
+void EmitterBatch::_update(const SlotMap<ObjToken<Listener>>& listeners, AudioChannelSet set) {
+  bool listenerDirty = false;
+  for (const ObjToken<Listener>& listener : listeners)
+    listenerDirty |= listener->m_dirty;
+
+  /* A changed listener affects every emitter; otherwise gather just the queued ones */
+  Emitter* const* emitters = m_emitters.data();
+  const Columns* columns = &m_columns;
+  size_t count = m_emitters.size();
+  if (!listenerDirty) {
+    count = m_dirty.size();
+    emitters = m_dirty.data();
+    columns = &m_gathered;
+    for (size_t c = 0; c < NumColumns; ++c) {
+      m_gathered[c].resize(count);
+      for (size_t i = 0; i < count; ++i)
+        m_gathered[c][i] = m_columns[c][m_dirty[i]->m_batchSlot];
     }
-    if (!std::isnan(dir[i])) {
-      m_dir[i] = dir[i];
-    } else {
-      m_dir[i] = 0.f;
+  }
+
+  if (count != 0 && !listeners.empty()) {
+    ColumnPtrs cols;
+    for (size_t c = 0; c < NumColumns; ++c)
+      cols[c] = (*columns)[c].data();
+    TermPtrs terms;
+    for (size_t t = 0; t < NumTerms; ++t) {
+      m_terms[t].resize(count);
+      terms[t] = m_terms[t].data();
+    }
+    CoefPtrs coefs;
+    for (size_t c = 0; c < m_coefs.size(); ++c) {
+      m_coefs[c].assign(count, 0.f);
+      coefs[c] = m_coefs[c].data();
     }
+    m_dopplerSums.assign(count, 0.0);
+
+    const SpatialKernelSelection& kernels = GetSpatialKernels();
+    const PanKernel pan = kernels.m_pan[PanLawIndex(set)];
+    for (const ObjToken<Listener>& listener : listeners) {
+      const ListenerFrame frame{listener->m_pos,       listener->m_dir,      listener->m_heading,
+                                listener->m_right,     listener->m_frontDiff, listener->m_backDiff,
+                                listener->m_soundSpeed};
+      kernels.m_spatialize(cols, frame, count, terms);
+      for (size_t i = 0; i < count; ++i) {
+        terms[Attenuation][i] = LookupVolume(terms[Attenuation][i]);
+        m_dopplerSums[i] += 1.0 + terms[Doppler][i];
+      }
+      pan(terms, listener->m_volume, count, coefs);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+      std::array<float, 8> levels;
+      for (size_t c = 0; c < levels.size(); ++c)
+        levels[c] = coefs[c][i];
+
+      /* Emitters that fall below the threshold give up their backend voice until they are heard again */
+      Emitter& em = *emitters[i];
+      if (m_virtualThreshold >= 0.f && *std::max_element(levels.begin(), levels.end()) <= m_virtualThreshold)
+        _virtualize(em);
+      else if (em.m_virtualIdx != SIZE_MAX)
+        _materialize(em, levels);
+      em._setLevels(levels, m_dopplerSums[i] / float(listeners.size()));
+    }
+  }
+
+  for (Emitter* em : m_dirty)
+    em->m_dirty = false;
+  m_dirty.clear();
+}
+
+void EmitterBatch::_virtualize(Emitter& em) {
+  if (em.m_virtualIdx != SIZE_MAX)
+    return;
+  em.m_virtualIdx = m_virtual.size();
+  m_virtual.push_back(&em);
+  em.m_vox->_virtualize();
+}
+
+void EmitterBatch::_materialize(Emitter& em, const std::array<float, 8>& coefs) {
+  m_virtual[em.m_virtualIdx] = m_virtual.back();
+  m_virtual[em.m_virtualIdx]->m_virtualIdx = em.m_virtualIdx;
+  m_virtual.pop_back();
+  em.m_virtualIdx = SIZE_MAX;
+  em.m_vox->_materialize(coefs);
+}
+
+void EmitterBatch::_advanceVirtual(double dt) {
+  for (size_t i = 0; i < m_virtual.size(); ++i)
+    m_virtual[i]->m_vox->_advanceVirtual(dt);
+}
+
+void EmitterBatch::_setVirtualThreshold(float level) {
+  if (level == m_virtualThreshold)
+    return;
+
+  /* Re-evaluate every emitter against the new threshold on the next update */
+  m_virtualThreshold = level;
+  for (Emitter* em : m_emitters)
+    _markDirty(*em);
+}
+
+Emitter::~Emitter() = default;
+
+Emitter::Emitter(Engine& engine, const AudioGroup& group, ObjToken<Voice> vox, float maxDist, float minVol,
+                 float falloff, bool doppler)
+: Entity(engine, group, vox->getGroupId(), vox->getObjectId()), m_vox(vox), m_doppler(doppler) {
+  m_engine.m_emitterBatch._add(*this, maxDist, std::clamp(minVol, 0.f, 1.f), std::clamp(falloff, -1.f, 1.f));
+}
+
+void Emitter::_destroy() {
+  Entity::_destroy();
+  m_engine.m_emitterBatch._remove(*this);
+  m_vox->kill();
+}
+
+void Emitter::_setLevels(const std::array<float, 8>& coefs, double dopplerRatio) {
+  m_vox->setChannelCoefs(coefs);
+  if (m_doppler) {
+    m_vox->m_dopplerRatio = dopplerRatio;
+    m_vox->m_pitchDirty = true;
   }
-  m_dirty = true;
+}
+
+void Emitter::setVectors(const float* pos, const float* dir) {
+  if (m_destroyed)
+    return;
+
+  EmitterBatch& batch = m_engine.m_emitterBatch;
+  for (size_t i = 0; i < 3; ++i) {
+    batch.m_columns[EmitterBatch::PosX + i][m_batchSlot] = std::isnan(pos[i]) ? 0.f : pos[i];
+    batch.m_columns[EmitterBatch::DirX + i][m_batchSlot] = std::isnan(dir[i]) ? 0.f : dir[i];
+  }
+  batch._markDirty(*this);
+}
+
+void Emitter::setMaxVol(float maxVol) {
+  if (m_destroyed)
+    return;
+
+  EmitterBatch& batch = m_engine.m_emitterBatch;
+  batch.m_columns[EmitterBatch::MaxVol][m_batchSlot] = std::clamp(maxVol, 0.f, 1.f);
+  batch._markDirty(*this);
 }
 
 } // namespace amuse
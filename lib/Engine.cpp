@@ -1,5 +1,6 @@
 #include "amuse/Engine.hpp"
 
+#include <algorithm>
 #include <array>
 
 #include "amuse/AudioGroup.hpp"
@@ -26,8 +27,17 @@ Engine::~Engine() {
     vox->_destroy();
 }
 
-Engine::Engine(IBackendVoiceAllocator& backend, AmplitudeMode ampMode)
-: m_backend(backend), m_ampMode(ampMode), m_defaultStudio(_allocateStudio(true)) {
+Engine::Engine(IBackendVoiceAllocator& backend, AmplitudeMode ampMode, size_t voicePoolCapacity)
+: m_backend(backend)
+, m_ampMode(ampMode)
+, m_defaultStudio(_allocateStudio(true))
+, m_voicePool(std::make_shared<VoicePool>(voicePoolCapacity)) {
+  m_activeVoices.reserve(voicePoolCapacity);
+  m_voicesByVid.reserve(voicePoolCapacity);
+  m_freeVids.reserve(voicePoolCapacity);
+  m_stealQueue.reserve(voicePoolCapacity);
+  m_voiceNodeSpares.resize(voicePoolCapacity);
+  m_backend.reserveVoices(voicePoolCapacity);
   m_defaultStudio->getAuxA().makeReverbStd(0.5f, 0.8f, 3.0f, 0.5f, 0.1f);
   m_defaultStudio->getAuxB().makeChorus(15, 0, 500);
   m_defaultStudioReady = true;
@@ -53,30 +63,184 @@ std::pair<AudioGroup*, const SFXGroupIndex*> Engine::_findSFXGroup(GroupId group
   return {};
 }
 
-std::list<ObjToken<Voice>>::iterator Engine::_allocateVoice(const AudioGroup& group, GroupId groupId, double sampleRate,
-                                                            bool dynamicPitch, bool emitter, ObjToken<Studio> studio) {
-  auto it =
-      m_activeVoices.emplace(m_activeVoices.end(), MakeObj<Voice>(*this, group, groupId, m_nextVid++, emitter, studio));
-  m_activeVoices.back()->m_backendVoice = m_backend.allocateVoice(*m_activeVoices.back(), sampleRate, dynamicPitch);
-  m_activeVoices.back()->m_backendVoice->setChannelLevels(studio->getMaster().m_backendSubmix.get(), FullLevels, false);
-  m_activeVoices.back()->m_backendVoice->setChannelLevels(studio->getAuxA().m_backendSubmix.get(), FullLevels, false);
-  m_activeVoices.back()->m_backendVoice->setChannelLevels(studio->getAuxB().m_backendSubmix.get(), FullLevels, false);
+ObjToken<Voice> Engine::_makeVoice(const AudioGroup& group, GroupId groupId, bool emitter, ObjToken<Studio> studio) {
+  /* Freed VoiceIds are recycled LIFO so ids stay compact without rescanning live voices */
+  int vid;
+  if (!m_freeVids.empty()) {
+    vid = m_freeVids.back();
+    m_freeVids.pop_back();
+  } else {
+    vid = int(m_voicesByVid.size());
+    m_voicesByVid.emplace_back();
+  }
+  ObjToken<Voice> ret = std::allocate_shared<Voice>(VoicePool::Allocator<Voice>(m_voicePool), *this, group, groupId,
+                                                    vid, emitter, std::move(studio));
+  m_voicesByVid[vid] = ret;
+  ++m_numVoices;
+  return ret;
+}
+
+void Engine::_releaseVoiceId(int vid) {
+  m_voicesByVid[vid].reset();
+  m_freeVids.push_back(vid);
+  --m_numVoices;
+}
+
+std::list<ObjToken<Voice>>::iterator Engine::_emplaceVoice(std::list<ObjToken<Voice>>& list, ObjToken<Voice>&& vox) {
+  if (m_voiceNodeSpares.empty()) {
+    ++m_voiceNodeMisses;
+    return list.emplace(list.end(), std::move(vox));
+  }
+  auto it = m_voiceNodeSpares.begin();
+  list.splice(list.end(), m_voiceNodeSpares, it);
+  *it = std::move(vox);
   return it;
 }
 
-std::list<ObjToken<Sequencer>>::iterator Engine::_allocateSequencer(const AudioGroup& group, GroupId groupId,
-                                                                    SongId setupId, ObjToken<Studio> studio) {
+std::list<ObjToken<Voice>>::iterator Engine::_eraseVoice(std::list<ObjToken<Voice>>& list,
+                                                         std::list<ObjToken<Voice>>::iterator it) {
+  auto next = std::next(it);
+  it->reset();
+  m_voiceNodeSpares.splice(m_voiceNodeSpares.end(), list, it);
+  return next;
+}
+
+bool Engine::_StealsBefore(const Voice* a, const Voice* b) {
+  if (a->m_priority.m_priority != b->m_priority.m_priority)
+    return a->m_priority.m_priority < b->m_priority.m_priority;
+  return a->m_startSerial < b->m_startSerial;
+}
+
+void Engine::_siftStealQueue(size_t idx) {
+  Voice* vox = m_stealQueue[idx];
+  auto place = [this](size_t i, Voice* v) {
+    m_stealQueue[i] = v;
+    v->m_stealIdx = i;
+  };
+  while (idx > 0) {
+    const size_t parent = (idx - 1) / 2;
+    if (!_StealsBefore(vox, m_stealQueue[parent]))
+      break;
+    place(idx, m_stealQueue[parent]);
+    idx = parent;
+  }
+  for (;;) {
+    size_t child = idx * 2 + 1;
+    if (child >= m_stealQueue.size())
+      break;
+    if (child + 1 < m_stealQueue.size() && _StealsBefore(m_stealQueue[child + 1], m_stealQueue[child]))
+      ++child;
+    if (!_StealsBefore(m_stealQueue[child], vox))
+      break;
+    place(idx, m_stealQueue[child]);
+    idx = child;
+  }
+  place(idx, vox);
+}
+
+bool Engine::_admitVoice(const AudioGroup& group, const VoicePriority& prio, const Voice* parent) {
+  /* Per-object limit first; the object's own weakest voice makes way (re-triggering at equal priority).
+   * A child voice inherits its parent's limit but never counts or steals the parent starting it. */
+  if (prio.isLimited()) {
+    for (;;) {
+      size_t count = 0;
+      Voice* victim = nullptr;
+      for (Voice* vox : m_stealQueue) {
+        if (vox == parent || &vox->getAudioGroup() != &group || !vox->m_priority.isLimited() ||
+            vox->m_priority.m_limitId != prio.m_limitId)
+          continue;
+        ++count;
+        if (!victim || _StealsBefore(vox, victim))
+          victim = vox;
+      }
+      if (count < prio.m_maxVoices)
+        break;
+      if (victim->m_priority.m_priority > prio.m_priority) {
+        ++m_stealStats.m_rejections;
+        return false;
+      }
+      if (victim->m_voxState == VoiceState::Dead) {
+        _untrackVoice(*victim);
+      } else {
+        victim->_steal();
+        ++m_stealStats.m_limitSteals;
+      }
+    }
+  }
+
+  if (m_maxVoices) {
+    while (m_stealQueue.size() >= m_maxVoices) {
+      Voice* victim = m_stealQueue.front();
+      if (victim->m_priority.m_priority > prio.m_priority) {
+        ++m_stealStats.m_rejections;
+        return false;
+      }
+      if (victim->m_voxState == VoiceState::Dead) {
+        _untrackVoice(*victim);
+      } else {
+        victim->_steal();
+        ++m_stealStats.m_steals;
+      }
+    }
+  }
+
+  return true;
+}
+
+void Engine::_trackVoice(Voice& vox, const VoicePriority& prio) {
+  vox.m_priority = prio;
+  vox.m_startSerial = m_nextStartSerial++;
+  vox.m_stealIdx = m_stealQueue.size();
+  m_stealQueue.push_back(&vox);
+  _siftStealQueue(vox.m_stealIdx);
+}
+
+void Engine::_untrackVoice(Voice& vox) {
+  const size_t idx = vox.m_stealIdx;
+  if (idx == SIZE_MAX)
+    return;
+  vox.m_stealIdx = SIZE_MAX;
+  Voice* last = m_stealQueue.back();
+  m_stealQueue.pop_back();
+  if (idx < m_stealQueue.size()) {
+    m_stealQueue[idx] = last;
+    last->m_stealIdx = idx;
+    _siftStealQueue(idx);
+  }
+}
+
+void Engine::_updateVoicePriority(Voice& vox) {
+  if (vox.m_stealIdx != SIZE_MAX)
+    _siftStealQueue(vox.m_stealIdx);
+}
+
+ObjToken<Voice> Engine::_allocateVoice(const AudioGroup& group, GroupId groupId, double sampleRate, bool dynamicPitch,
+                                       bool emitter, ObjToken<Studio> studio, const VoicePriority& prio) {
+  if (!_admitVoice(group, prio))
+    return {};
+  ObjToken<Voice> ret = _makeVoice(group, groupId, emitter, studio);
+  ret->m_engineSlot = m_activeVoices.emplace(ret);
+  _trackVoice(*ret, prio);
+  ret->_allocateBackendVoice(sampleRate, dynamicPitch);
+  ret->m_backendVoice->setChannelLevels(studio->getMaster().m_backendSubmix.get(), FullLevels, false);
+  ret->m_backendVoice->setChannelLevels(studio->getAuxA().m_backendSubmix.get(), FullLevels, false);
+  ret->m_backendVoice->setChannelLevels(studio->getAuxB().m_backendSubmix.get(), FullLevels, false);
+  return ret;
+}
+
+ObjToken<Sequencer> Engine::_allocateSequencer(const AudioGroup& group, GroupId groupId, SongId setupId,
+                                               ObjToken<Studio> studio) {
   const SongGroupIndex* songGroup = group.getProj().getSongGroupIndex(groupId);
   if (songGroup) {
     amuse::ObjToken<Sequencer> tok = MakeObj<Sequencer>(*this, group, groupId, songGroup, setupId, studio);
-    auto it = m_activeSequencers.emplace(m_activeSequencers.end(), tok);
-    return it;
+    m_activeSequencers.emplace(tok);
+    return tok;
   }
   const SFXGroupIndex* sfxGroup = group.getProj().getSFXGroupIndex(groupId);
   if (sfxGroup) {
     amuse::ObjToken<Sequencer> tok = MakeObj<Sequencer>(*this, group, groupId, sfxGroup, studio);
-    auto it = m_activeSequencers.emplace(m_activeSequencers.end(), tok);
-    return it;
+    m_activeSequencers.emplace(tok);
+    return tok;
   }
   return {};
 }
@@ -89,7 +253,15 @@ ObjToken<Studio> Engine::_allocateStudio(bool mainOut) {
   return ret;
 }
 
-std::list<ObjToken<Voice>>::iterator Engine::_destroyVoice(std::list<ObjToken<Voice>>::iterator it) {
+void Engine::_destroyVoice(Voice& vox) {
+  assert(this == &vox.getEngine());
+  if (vox.m_destroyed)
+    return;
+  vox._destroy();
+  m_activeVoices.erase(vox.m_engineSlot);
+}
+
+SlotMap<ObjToken<Voice>>::iterator Engine::_destroyVoice(SlotMap<ObjToken<Voice>>::iterator it) {
   assert(this == &(*it)->getEngine());
   if ((*it)->m_destroyed)
     return m_activeVoices.begin();
@@ -97,7 +269,7 @@ std::list<ObjToken<Voice>>::iterator Engine::_destroyVoice(std::list<ObjToken<Vo
   return m_activeVoices.erase(it);
 }
 
-std::list<ObjToken<Sequencer>>::iterator Engine::_destroySequencer(std::list<ObjToken<Sequencer>>::iterator it) {
+SlotMap<ObjToken<Sequencer>>::iterator Engine::_destroySequencer(SlotMap<ObjToken<Sequencer>>::iterator it) {
   assert(this == &(*it)->getEngine());
   if ((*it)->m_destroyed)
     return m_activeSequencers.begin();
@@ -143,8 +315,8 @@ void Engine::_on5MsInterval(IBackendVoiceAllocator& engine, double dt) {
     m_midiReader->pumpReader(dt);
   for (ObjToken<Sequencer>& seq : m_activeSequencers)
     seq->advance(dt);
-  for (ObjToken<Emitter>& emitter : m_activeEmitters)
-    emitter->_update();
+  m_emitterBatch._update(m_activeListeners, m_channelSet);
+  m_emitterBatch._advanceVirtual(dt);
   for (ObjToken<Listener>& listener : m_activeListeners)
     listener->m_dirty = false;
 }
@@ -152,17 +324,18 @@ void Engine::_on5MsInterval(IBackendVoiceAllocator& engine, double dt) {
 void Engine::_onPumpCycleComplete(IBackendVoiceAllocator& engine) {
   _bringOutYourDead();
 
-  /* Determine lowest available free vid */
-  int maxVid = -1;
-  for (ObjToken<Voice>& vox : m_activeVoices)
-    maxVid = std::max(maxVid, vox->maxVid());
-  m_nextVid = maxVid + 1;
+  const uint64_t misses = m_voicePool->getHeapAllocations() + m_voiceNodeMisses;
+  m_lastPumpPoolMisses = misses - m_pumpPoolMissBase;
+  m_pumpPoolMissBase = misses;
 }
 
 AudioGroup* Engine::_addAudioGroup(const AudioGroupData& data, std::unique_ptr<AudioGroup>&& grp) {
   AudioGroup* ret = grp.get();
   m_audioGroups.emplace(std::make_pair(&data, std::move(grp)));
 
+  /* Decompress lazily loaded samples now rather than on the first voice */
+  ret->getSampData();
+
   /* setup SFX index for contained objects */
   for (const auto& [groupID, groupIndex] : ret->getProj().sfxGroups()) {
     const SFXGroupIndex& sfxGroup = *groupIndex;
@@ -180,6 +353,11 @@ const AudioGroup* Engine::addAudioGroup(const AudioGroupData& data) {
   return _addAudioGroup(data, std::make_unique<AudioGroup>(data));
 }
 
+const AudioGroup* Engine::addAudioGroup(const AudioGroupData& data, std::unique_ptr<AudioGroup>&& group) {
+  removeAudioGroup(data);
+  return _addAudioGroup(data, std::move(group));
+}
+
 /** Remove audio group from engine */
 void Engine::removeAudioGroup(const AudioGroupData& data) {
   auto search = m_audioGroups.find(&data);
@@ -226,9 +404,21 @@ void Engine::removeAudioGroup(const AudioGroupData& data) {
     }
   }
 
+  const unsigned char* samp = grp->getSampData();
+  m_sampleCache.purge(samp, samp + data.getSampSize());
   m_audioGroups.erase(search);
 }
 
+void Engine::setMaxVoices(size_t maxVoices) {
+  m_maxVoices = maxVoices;
+  if (!m_maxVoices)
+    return;
+  while (m_stealQueue.size() > m_maxVoices) {
+    m_stealQueue.front()->_steal();
+    ++m_stealStats.m_steals;
+  }
+}
+
 /** Create new Studio within engine */
 ObjToken<Studio> Engine::addStudio(bool mainOut) { return _allocateStudio(mainOut); }
 
@@ -243,19 +433,23 @@ ObjToken<Voice> Engine::fxStart(SFXId sfxId, float vol, float pan, ObjToken<Stud
   if (!grp)
     return {};
 
-  std::list<ObjToken<Voice>>::iterator ret =
-      _allocateVoice(*grp, std::get<1>(search->second), NativeSampleRate, true, false, smx);
+  ObjToken<Voice> ret =
+      _allocateVoice(*grp, std::get<1>(search->second), NativeSampleRate, true, false, smx,
+                     Voice::_PagePriority(*grp, entry->objId, entry->defKey,
+                                          {entry->priority, entry->objId.id, entry->maxVoices}));
+  if (!ret)
+    return {};
 
-  if (!(*ret)->loadPageObject(entry->objId, 1000.f, entry->defKey, entry->defVel, 0)) {
-    _destroyVoice(ret);
+  if (!ret->loadPageObject(entry->objId, 1000.f, entry->defKey, entry->defVel, 0)) {
+    _destroyVoice(*ret);
     return {};
   }
 
-  (*ret)->setVolume(vol);
+  ret->setVolume(vol);
   float evalPan = pan != 0.f ? pan : ((entry->panning - 64.f) / 63.f);
   evalPan = std::clamp(evalPan, -1.f, 1.f);
-  (*ret)->setPan(evalPan);
-  return *ret;
+  ret->setPan(evalPan);
+  return ret;
 }
 
 /** Start soundFX playing from explicit group data (for editor use) */
@@ -265,19 +459,24 @@ ObjToken<Voice> Engine::fxStart(const AudioGroup* group, GroupId groupId, SFXId
   if (sfxIdx) {
     auto search = sfxIdx->m_sfxEntries.find(sfxId);
     if (search != sfxIdx->m_sfxEntries.cend()) {
-      std::list<ObjToken<Voice>>::iterator ret = _allocateVoice(*group, groupId, NativeSampleRate, true, false, smx);
-
       auto& entry = search->second;
-      if (!(*ret)->loadPageObject(entry.objId, 1000.f, entry.defKey, entry.defVel, 0)) {
-        _destroyVoice(ret);
+      ObjToken<Voice> ret =
+          _allocateVoice(*group, groupId, NativeSampleRate, true, false, smx,
+                         Voice::_PagePriority(*group, entry.objId, entry.defKey,
+                                              {entry.priority, entry.objId.id, entry.maxVoices}));
+      if (!ret)
+        return {};
+
+      if (!ret->loadPageObject(entry.objId, 1000.f, entry.defKey, entry.defVel, 0)) {
+        _destroyVoice(*ret);
         return {};
       }
 
-      (*ret)->setVolume(vol);
+      ret->setVolume(vol);
       float evalPan = pan != 0.f ? pan : ((entry.panning - 64.f) / 63.f);
       evalPan = std::clamp(evalPan, -1.f, 1.f);
-      (*ret)->setPan(evalPan);
-      return *ret;
+      ret->setPan(evalPan);
+      return ret;
     }
   }
 
@@ -290,16 +489,18 @@ ObjToken<Voice> Engine::macroStart(const AudioGroup* group, SoundMacroId id, uin
   if (!group)
     return {};
 
-  std::list<ObjToken<Voice>>::iterator ret = _allocateVoice(*group, {}, NativeSampleRate, true, false, smx);
+  ObjToken<Voice> ret = _allocateVoice(*group, {}, NativeSampleRate, true, false, smx);
+  if (!ret)
+    return {};
 
-  if (!(*ret)->loadMacroObject(id, 0, 1000.f, key, vel, mod)) {
-    _destroyVoice(ret);
+  if (!ret->loadMacroObject(id, 0, 1000.f, key, vel, mod)) {
+    _destroyVoice(*ret);
     return {};
   }
 
-  (*ret)->setVolume(1.f);
-  (*ret)->setPan(0.f);
-  return *ret;
+  ret->setVolume(1.f);
+  ret->setPan(0.f);
+  return ret;
 }
 
 /** Start SoundMacro object playing directly (for editor use) */
@@ -308,16 +509,18 @@ ObjToken<Voice> Engine::macroStart(const AudioGroup* group, const SoundMacro* ma
   if (!group)
     return {};
 
-  std::list<ObjToken<Voice>>::iterator ret = _allocateVoice(*group, {}, NativeSampleRate, true, false, smx);
+  ObjToken<Voice> ret = _allocateVoice(*group, {}, NativeSampleRate, true, false, smx);
+  if (!ret)
+    return {};
 
-  if (!(*ret)->loadMacroObject(macro, 0, 1000.f, key, vel, mod)) {
-    _destroyVoice(ret);
+  if (!ret->loadMacroObject(macro, 0, 1000.f, key, vel, mod)) {
+    _destroyVoice(*ret);
     return {};
   }
 
-  (*ret)->setVolume(1.f);
-  (*ret)->setPan(0.f);
-  return *ret;
+  ret->setVolume(1.f);
+  ret->setPan(0.f);
+  return ret;
 }
 
 /** Start PageObject node playing directly (for editor use) */
@@ -326,14 +529,17 @@ ObjToken<Voice> Engine::pageObjectStart(const AudioGroup* group, ObjectId id, ui
   if (!group)
     return {};
 
-  std::list<ObjToken<Voice>>::iterator ret = _allocateVoice(*group, {}, NativeSampleRate, true, false, smx);
+  ObjToken<Voice> ret =
+      _allocateVoice(*group, {}, NativeSampleRate, true, false, smx, Voice::_PagePriority(*group, id, key, {}));
+  if (!ret)
+    return {};
 
-  if (!(*ret)->loadPageObject(id, 1000.f, key, vel, mod)) {
-    _destroyVoice(ret);
+  if (!ret->loadPageObject(id, 1000.f, key, vel, mod)) {
+    _destroyVoice(*ret);
     return {};
   }
 
-  return *ret;
+  return ret;
 }
 
 /** Start soundFX playing from loaded audio groups, attach to positional emitter */
@@ -348,33 +554,35 @@ ObjToken<Emitter> Engine::addEmitter(const float* pos, const float* dir, float m
   if (!grp)
     return {};
 
-  std::list<ObjToken<Voice>>::iterator vox =
-      _allocateVoice(*grp, std::get<1>(search->second), NativeSampleRate, true, true, smx);
+  ObjToken<Voice> vox =
+      _allocateVoice(*grp, std::get<1>(search->second), NativeSampleRate, true, true, smx,
+                     Voice::_PagePriority(*grp, entry->objId, entry->defKey,
+                                          {entry->priority, entry->objId.id, entry->maxVoices}));
+  if (!vox)
+    return {};
 
-  if (!(*vox)->loadPageObject(entry->objId, 1000.f, entry->defKey, entry->defVel, 0)) {
-    _destroyVoice(vox);
+  if (!vox->loadPageObject(entry->objId, 1000.f, entry->defKey, entry->defVel, 0)) {
+    _destroyVoice(*vox);
     return {};
   }
 
-  auto emitIt = m_activeEmitters.emplace(m_activeEmitters.end(),
-                                         MakeObj<Emitter>(*this, *grp, *vox, maxDist, minVol, falloff, doppler));
-  Emitter& ret = *(*emitIt);
+  ObjToken<Emitter> ret = MakeObj<Emitter>(*this, *grp, vox, maxDist, minVol, falloff, doppler);
+  m_activeEmitters.emplace(ret);
 
-  ret.getVoice()->setPan(entry->panning);
-  ret.setVectors(pos, dir);
-  ret.setMaxVol(maxVol);
+  ret->getVoice()->setPan(entry->panning);
+  ret->setVectors(pos, dir);
+  ret->setMaxVol(maxVol);
 
-  return *emitIt;
+  return ret;
 }
 
 /** Build listener and add to engine's listener list */
 ObjToken<Listener> Engine::addListener(const float* pos, const float* dir, const float* heading, const float* up,
                                        float frontDiff, float backDiff, float soundSpeed, float volume) {
-  auto listenerIt =
-      m_activeListeners.emplace(m_activeListeners.end(), MakeObj<Listener>(volume, frontDiff, backDiff, soundSpeed));
-  Listener& ret = *(*listenerIt);
-  ret.setVectors(pos, dir, heading, up);
-  return *listenerIt;
+  ObjToken<Listener> ret = MakeObj<Listener>(volume, frontDiff, backDiff, soundSpeed);
+  m_activeListeners.emplace(ret);
+  ret->setVectors(pos, dir, heading, up);
+  return ret;
 }
 
 /** Remove listener from engine's listener list */
@@ -392,21 +600,21 @@ ObjToken<Sequencer> Engine::seqPlay(GroupId groupId, SongId songId, const unsign
                                     ObjToken<Studio> smx) {
   std::pair<AudioGroup*, const SongGroupIndex*> songGrp = _findSongGroup(groupId);
   if (songGrp.second) {
-    std::list<ObjToken<Sequencer>>::iterator ret = _allocateSequencer(*songGrp.first, groupId, songId, smx);
-    if (!*ret)
+    ObjToken<Sequencer> ret = _allocateSequencer(*songGrp.first, groupId, songId, smx);
+    if (!ret)
       return {};
 
     if (arrData)
-      (*ret)->playSong(arrData, loop);
-    return *ret;
+      ret->playSong(arrData, loop);
+    return ret;
   }
 
   std::pair<AudioGroup*, const SFXGroupIndex*> sfxGrp = _findSFXGroup(groupId);
   if (sfxGrp.second) {
-    std::list<ObjToken<Sequencer>>::iterator ret = _allocateSequencer(*sfxGrp.first, groupId, songId, smx);
-    if (!*ret)
+    ObjToken<Sequencer> ret = _allocateSequencer(*sfxGrp.first, groupId, songId, smx);
+    if (!ret)
       return {};
-    return *ret;
+    return ret;
   }
 
   return {};
@@ -416,21 +624,21 @@ ObjToken<Sequencer> Engine::seqPlay(const AudioGroup* group, GroupId groupId, So
                                     const unsigned char* arrData, bool loop, ObjToken<Studio> smx) {
   const SongGroupIndex* sgIdx = group->getProj().getSongGroupIndex(groupId);
   if (sgIdx) {
-    std::list<ObjToken<Sequencer>>::iterator ret = _allocateSequencer(*group, groupId, songId, smx);
-    if (!*ret)
+    ObjToken<Sequencer> ret = _allocateSequencer(*group, groupId, songId, smx);
+    if (!ret)
       return {};
 
     if (arrData)
-      (*ret)->playSong(arrData, loop);
-    return *ret;
+      ret->playSong(arrData, loop);
+    return ret;
   }
 
   const SFXGroupIndex* sfxIdx = group->getProj().getSFXGroupIndex(groupId);
   if (sfxIdx) {
-    std::list<ObjToken<Sequencer>>::iterator ret = _allocateSequencer(*group, groupId, songId, smx);
-    if (!*ret)
+    ObjToken<Sequencer> ret = _allocateSequencer(*group, groupId, songId, smx);
+    if (!ret)
       return {};
-    return *ret;
+    return ret;
   }
 
   return {};
@@ -441,19 +649,9 @@ void Engine::setVolume(float vol) { m_masterVolume = vol; }
 
 /** Find voice from VoiceId */
 ObjToken<Voice> Engine::findVoice(int vid) {
-  for (ObjToken<Voice>& vox : m_activeVoices) {
-    ObjToken<Voice> ret = vox->_findVoice(vid, vox);
-    if (ret)
-      return ret;
-  }
-
-  for (ObjToken<Sequencer>& seq : m_activeSequencers) {
-    ObjToken<Voice> ret = seq->findVoice(vid);
-    if (ret)
-      return ret;
-  }
-
-  return {};
+  if (vid < 0 || size_t(vid) >= m_voicesByVid.size())
+    return {};
+  return m_voicesByVid[vid];
 }
 
 /** Stop all voices in `kg`, stops immediately (no KeyOff) when `flag` set */
@@ -485,11 +683,4 @@ void Engine::sendMacroMessage(ObjectId macroId, int32_t val) {
   for (ObjToken<Sequencer>& seq : m_activeSequencers)
     seq->sendMacroMessage(macroId, val);
 }
-
-size_t Engine::getNumTotalActiveVoices() const {
-  size_t ret = 0;
-  for (const auto& vox : m_activeVoices)
-    ret += vox->getTotalVoices();
-  return ret;
-}
 } // namespace amuse
@@ -0,0 +1,67 @@
+#include "amuse/MappedFile.hpp"
+
+#include "amuse/Common.hpp"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <io.h>
+#endif
+
+namespace amuse {
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+  if (m_data)
+    munmap(m_data, m_size);
+#else
+  if (m_data)
+    UnmapViewOfFile(m_data);
+  if (m_mapping)
+    CloseHandle(m_mapping);
+#endif
+}
+
+std::shared_ptr<MappedFile> MappedFile::Map(FILE* fp) {
+  if (!fp)
+    return {};
+  std::shared_ptr<MappedFile> ret(new MappedFile);
+
+#ifndef _WIN32
+  const int fd = fileno(fp);
+  struct stat st;
+  if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size <= 0)
+    return {};
+  /* Private writable mapping so in-place fixups stay local to this process */
+  void* data = mmap(nullptr, size_t(st.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED)
+    return {};
+  ret->m_data = static_cast<unsigned char*>(data);
+  ret->m_size = size_t(st.st_size);
+#else
+  HANDLE file = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(fp)));
+  LARGE_INTEGER size;
+  if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size) || size.QuadPart <= 0)
+    return {};
+  ret->m_mapping = CreateFileMappingW(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+  if (!ret->m_mapping)
+    return {};
+  ret->m_data = static_cast<unsigned char*>(MapViewOfFile(ret->m_mapping, FILE_MAP_COPY, 0, 0, 0));
+  if (!ret->m_data)
+    return {};
+  ret->m_size = size_t(size.QuadPart);
+#endif
+
+  return ret;
+}
+
+} // namespace amuse
@@ -1,5 +1,8 @@
 #include "amuse/N64MusyXCodec.hpp"
 
+#include "amuse/CPUFeatures.hpp"
+
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 
@@ -131,3 +134,212 @@ unsigned N64MusyXDecompressFrameRanged(int16_t* out, const uint8_t* in, const in
   memmove(out, final + firstSample, samples * 2);
   return samples;
 }
+
+#pragma mark Multi-frame decoder
+
+/* Within each 32-sample half-frame, the four groups of (6, 8, 8, 8) samples depend on the
+ * previous group only through its last two outputs, and every output of a group is a fixed
+ * linear combination of the group's predicted samples and that history pair. The SIMD paths
+ * expand each predictor's codebook once into a matrix of int16 coefficient pairs and evaluate a
+ * whole group with five pairwise multiply-adds per output lane; the arithmetic shift and
+ * saturating pack reproduce adpcm_decode_upto_8_samples exactly. */
+
+static constexpr unsigned N64FrameSamples = 64;
+static constexpr unsigned N64FrameBytes = 40;
+
+unsigned N64MusyXDecompressFramesScalar(int16_t* out, const uint8_t* in, const int16_t coefs[8][2][8],
+                                        unsigned firstSample, unsigned sampleCount) {
+  in += N64FrameBytes * (firstSample / N64FrameSamples);
+  firstSample %= N64FrameSamples;
+
+  unsigned ret = 0;
+  while (ret < sampleCount) {
+    const unsigned thisSamples = std::min(N64FrameSamples - firstSample, sampleCount - ret);
+    if (firstSample)
+      N64MusyXDecompressFrameRanged(out, in, coefs, firstSample, thisSamples);
+    else
+      N64MusyXDecompressFrame(out, in, coefs, thisSamples);
+    out += thisSamples;
+    ret += thisSamples;
+    firstSample = 0;
+    in += N64FrameBytes;
+  }
+  return ret;
+}
+
+#if AMUSE_X86
+namespace {
+/** Per-predictor group matrix; pair column p < 4 multiplies predicted samples (2p, 2p+1),
+ *  column 4 multiplies the (l1, l2) history pair. Each column holds 8 lanes of int16 pairs. */
+struct N64GroupMatrix {
+  alignas(32) int16_t m_cols[5][16];
+};
+
+struct N64GroupMatrices {
+  N64GroupMatrix m_mats[8];
+  const int16_t (*m_coefs)[2][8];
+  unsigned m_built = 0;
+
+  explicit N64GroupMatrices(const int16_t coefs[8][2][8]) : m_coefs(coefs) {}
+
+  const N64GroupMatrix& get(unsigned pred) {
+    N64GroupMatrix& mat = m_mats[pred];
+    if (m_built & (1u << pred))
+      return mat;
+    const int16_t* book1 = m_coefs[pred][0];
+    const int16_t* book2 = m_coefs[pred][1];
+    for (unsigned i = 0; i < 8; ++i) {
+      for (unsigned j = 0; j < 8; ++j) {
+        int16_t c = 0;
+        if (i == j)
+          c = 2048;
+        else if (i > j)
+          c = book2[i - 1 - j];
+        mat.m_cols[j / 2][i * 2 + j % 2] = c;
+      }
+      mat.m_cols[4][i * 2] = book1[i];
+      mat.m_cols[4][i * 2 + 1] = book2[i];
+    }
+    m_built |= 1u << pred;
+    return mat;
+  }
+};
+} // namespace
+
+/* Predicted samples of one half-frame; the first two lanes (from the control byte) are unused */
+AMUSE_TARGET("sse4.1") static inline void ExpandHalfFrame(int16_t src[32], const uint8_t* nibbles) {
+  const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(nibbles));
+  const __m128i shift = _mm_cvtsi32_si128((nibbles[0] % 0x80) & 0xf);
+  const __m128i hiMask = _mm_set1_epi16(int16_t(0xf000));
+  __m128i* dst = reinterpret_cast<__m128i*>(src);
+  for (unsigned h = 0; h < 2; ++h) {
+    const __m128i wide = _mm_cvtepu8_epi16(h ? _mm_srli_si128(bytes, 8) : bytes);
+    const __m128i hi = _mm_and_si128(_mm_slli_epi16(wide, 8), hiMask);
+    const __m128i lo = _mm_slli_epi16(wide, 12);
+    _mm_storeu_si128(dst + h * 2, _mm_sra_epi16(_mm_unpacklo_epi16(hi, lo), shift));
+    _mm_storeu_si128(dst + h * 2 + 1, _mm_sra_epi16(_mm_unpackhi_epi16(hi, lo), shift));
+  }
+}
+
+static AMUSE_FORCEINLINE int32_t LoadPair(const int16_t* p) {
+  int32_t ret;
+  memcpy(&ret, p, 4);
+  return ret;
+}
+
+AMUSE_TARGET("sse4.1")
+static inline void DecodeGroupSSE41(int16_t* out, const int16_t* src, const N64GroupMatrix& mat) {
+  const __m128i* cols = reinterpret_cast<const __m128i*>(mat.m_cols);
+  __m128i hist = _mm_set1_epi32(LoadPair(out - 2));
+  __m128i acc0 = _mm_madd_epi16(hist, cols[8]);
+  __m128i acc1 = _mm_madd_epi16(hist, cols[9]);
+  for (unsigned p = 0; p < 4; ++p) {
+    const __m128i pair = _mm_set1_epi32(LoadPair(src + p * 2));
+    acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(pair, cols[p * 2]));
+    acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(pair, cols[p * 2 + 1]));
+  }
+  const __m128i res = _mm_packs_epi32(_mm_srai_epi32(acc0, 11), _mm_srai_epi32(acc1, 11));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out), res);
+}
+
+AMUSE_TARGET("avx2")
+static inline void DecodeGroupAVX2(int16_t* out, const int16_t* src, const N64GroupMatrix& mat) {
+  const __m256i* cols = reinterpret_cast<const __m256i*>(mat.m_cols);
+  __m256i acc = _mm256_madd_epi16(_mm256_set1_epi32(LoadPair(out - 2)), cols[4]);
+  for (unsigned p = 0; p < 4; ++p)
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_set1_epi32(LoadPair(src + p * 2)), cols[p]));
+  acc = _mm256_srai_epi32(acc, 11);
+  const __m128i res = _mm_packs_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out), res);
+}
+
+using N64GroupDecode = void (*)(int16_t* out, const int16_t* src, const N64GroupMatrix& mat);
+
+/* The first group of each half stores two scratch lanes that the second group overwrites */
+template <N64GroupDecode Decode>
+static AMUSE_FORCEINLINE void DecodeFrameT(int16_t out[64], const uint8_t* in, N64GroupMatrices& mats) {
+  for (unsigned h = 0; h < 2; ++h) {
+    const uint8_t* nibbles = in + 8 + h * 16;
+    alignas(16) int16_t src[32];
+    ExpandHalfFrame(src, nibbles);
+    const N64GroupMatrix& mat = mats.get(((nibbles[0] % 0x80) & 0xf0) >> 4);
+    int16_t* half = out + h * 32;
+    half[0] = int16_t((in[h * 4] << 8) | in[h * 4 + 1]);
+    half[1] = int16_t((in[h * 4 + 2] << 8) | in[h * 4 + 3]);
+    Decode(half + 2, src + 2, mat);
+    Decode(half + 8, src + 8, mat);
+    Decode(half + 16, src + 16, mat);
+    Decode(half + 24, src + 24, mat);
+  }
+}
+
+template <N64GroupDecode Decode>
+static AMUSE_FORCEINLINE unsigned N64MusyXDecompressFramesT(int16_t* out, const uint8_t* in,
+                                                            const int16_t coefs[8][2][8], unsigned firstSample,
+                                                            unsigned sampleCount) {
+  in += N64FrameBytes * (firstSample / N64FrameSamples);
+  firstSample %= N64FrameSamples;
+
+  N64GroupMatrices mats(coefs);
+  unsigned ret = 0;
+  while (ret < sampleCount) {
+    const unsigned thisSamples = std::min(N64FrameSamples - firstSample, sampleCount - ret);
+    if (thisSamples == N64FrameSamples) {
+      DecodeFrameT<Decode>(out, in, mats);
+    } else {
+      int16_t frame[N64FrameSamples];
+      DecodeFrameT<Decode>(frame, in, mats);
+      memcpy(out, frame + firstSample, thisSamples * 2);
+    }
+    out += thisSamples;
+    ret += thisSamples;
+    firstSample = 0;
+    in += N64FrameBytes;
+  }
+  return ret;
+}
+
+AMUSE_TARGET("sse4.1")
+static unsigned N64MusyXDecompressFramesSSE41(int16_t* out, const uint8_t* in, const int16_t coefs[8][2][8],
+                                              unsigned firstSample, unsigned sampleCount) {
+  return N64MusyXDecompressFramesT<DecodeGroupSSE41>(out, in, coefs, firstSample, sampleCount);
+}
+
+AMUSE_TARGET("avx2")
+static unsigned N64MusyXDecompressFramesAVX2(int16_t* out, const uint8_t* in, const int16_t coefs[8][2][8],
+                                             unsigned firstSample, unsigned sampleCount) {
+  return N64MusyXDecompressFramesT<DecodeGroupAVX2>(out, in, coefs, firstSample, sampleCount);
+}
+#endif
+
+namespace {
+struct N64DecoderSelection {
+  decltype(&N64MusyXDecompressFramesScalar) m_func = N64MusyXDecompressFramesScalar;
+  const char* m_name = "scalar";
+
+  N64DecoderSelection() {
+#if AMUSE_X86
+    const amuse::CPUFeatures& features = amuse::GetCPUFeatures();
+    if (features.avx2) {
+      m_func = N64MusyXDecompressFramesAVX2;
+      m_name = "avx2";
+    } else if (features.sse41) {
+      m_func = N64MusyXDecompressFramesSSE41;
+      m_name = "sse4.1";
+    }
+#endif
+  }
+};
+
+const N64DecoderSelection& GetN64Decoder() {
+  static const N64DecoderSelection Selection;
+  return Selection;
+}
+} // namespace
+
+unsigned N64MusyXDecompressFrames(int16_t* out, const uint8_t* in, const int16_t coefs[8][2][8],
+                                  unsigned firstSample, unsigned sampleCount) {
+  return GetN64Decoder().m_func(out, in, coefs, firstSample, sampleCount);
+}
+
+const char* N64MusyXDecompressFramesISA() { return GetN64Decoder().m_name; }
@@ -0,0 +1,390 @@
+#include "amuse/OfflineBackend.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include "amuse/Common.hpp"
+#include "amuse/Engine.hpp"
+#include "amuse/Submix.hpp"
+#include "amuse/Voice.hpp"
+
+namespace amuse {
+
+OfflineBackendVoice::OfflineBackendVoice(OfflineBackendVoiceAllocator& parent, Voice& clientVox, double sampleRate,
+                                         bool dynamicPitch)
+: m_parent(parent), m_clientVox(clientVox), m_sampleRate(sampleRate), m_dynamicPitch(dynamicPitch) {
+  if (m_parent.m_spareBuffers.empty() || m_parent.m_spareNodes.empty())
+    m_parent.reserveVoices(m_parent.m_voices.size() + 1);
+  auto& spare = m_parent.m_spareBuffers.back();
+  m_sends = std::move(spare.m_sends);
+  m_srcBuf = std::move(spare.m_srcBuf);
+  m_resampBuf = std::move(spare.m_resampBuf);
+  m_parent.m_spareBuffers.pop_back();
+  m_parentIt = m_parent.m_spareNodes.begin();
+  *m_parentIt = this;
+  m_parent.m_voices.splice(m_parent.m_voices.end(), m_parent.m_spareNodes, m_parentIt);
+}
+
+OfflineBackendVoice::~OfflineBackendVoice() {
+  /* Voices may be torn down from within the mix loop (e.g. keygroup kills issued by macros);
+   * leave a hole for the allocator to sweep once the loop is done */
+  *m_parentIt = nullptr;
+  if (!m_parent.m_mixing)
+    m_parent.m_spareNodes.splice(m_parent.m_spareNodes.end(), m_parent.m_voices, m_parentIt);
+
+  resetChannelLevels();
+  m_parent.m_spareBuffers.push_back({std::move(m_sends), std::move(m_srcBuf), std::move(m_resampBuf)});
+}
+
+static VoicePool& HandlePool() {
+  /* Never destroyed, so handles released during static teardown remain valid */
+  static VoicePool* pool = new VoicePool();
+  return *pool;
+}
+
+void* OfflineBackendVoice::operator new(size_t sz) { return HandlePool().allocate(sz); }
+
+void OfflineBackendVoice::operator delete(void* ptr, size_t sz) { HandlePool().deallocate(ptr, sz); }
+
+void OfflineBackendVoice::resetSampleRate(double sampleRate) { m_sampleRate = sampleRate; }
+
+void OfflineBackendVoice::resetChannelLevels() {
+  for (SubmixSend& send : m_sends)
+    m_parent.m_spareRouteBufs.push_back(std::move(send.m_routeBuf));
+  m_sends.clear();
+}
+
+void OfflineBackendVoice::setChannelLevels(IBackendSubmix* submix, const std::array<float, 8>& coefs, bool slew) {
+  auto* smx = static_cast<OfflineBackendSubmix*>(submix);
+  auto search =
+      std::find_if(m_sends.begin(), m_sends.end(), [smx](const SubmixSend& send) { return send.m_submix == smx; });
+  if (search == m_sends.end()) {
+    std::vector<float> routeBuf;
+    if (!m_parent.m_spareRouteBufs.empty()) {
+      routeBuf = std::move(m_parent.m_spareRouteBufs.back());
+      m_parent.m_spareRouteBufs.pop_back();
+    } else {
+      routeBuf.reserve(m_parent.m_5msFrames);
+    }
+    search = m_sends.insert(m_sends.end(), SubmixSend{smx, {}, {}, std::move(routeBuf)});
+  }
+  search->m_targetCoefs = coefs;
+  if (!slew)
+    search->m_curCoefs = coefs;
+}
+
+void OfflineBackendVoice::setPitchRatio(double ratio, bool) {
+  if (m_dynamicPitch)
+    m_pitchRatio = ratio;
+}
+
+void OfflineBackendVoice::start() { m_running = true; }
+
+void OfflineBackendVoice::stop() { m_running = false; }
+
+void OfflineBackendVoice::_pumpControl(double dt) { m_clientVox.preSupplyAudio(dt); }
+
+void OfflineBackendVoice::_renderAudio(size_t frames, double dt) {
+  const double step = m_sampleRate * m_pitchRatio / m_parent.m_sampleRate;
+
+  /* Pre-walk the resampler so exactly the consumed source samples are requested from the voice */
+  size_t srcCount = m_resampPrimed ? 0 : 2;
+  double phase = m_resampPhase;
+  for (size_t f = 0; f < frames; ++f) {
+    phase += step;
+    const double whole = std::floor(phase);
+    srcCount += size_t(whole);
+    phase -= whole;
+  }
+
+  m_srcBuf.resize(srcCount);
+  if (srcCount)
+    m_clientVox.supplyAudio(srcCount, m_srcBuf.data());
+
+  size_t srcIdx = 0;
+  if (!m_resampPrimed) {
+    m_resampLast = m_srcBuf[0];
+    m_resampNext = m_srcBuf[1];
+    m_resampPhase = 0.0;
+    m_resampPrimed = true;
+    srcIdx = 2;
+  }
+
+  m_resampBuf.resize(frames);
+  for (size_t f = 0; f < frames; ++f) {
+    m_resampBuf[f] = (m_resampLast + (m_resampNext - m_resampLast) * float(m_resampPhase)) / 32768.f;
+    m_resampPhase += step;
+    const double whole = std::floor(m_resampPhase);
+    m_resampPhase -= whole;
+    for (size_t i = 0; i < size_t(whole); ++i) {
+      m_resampLast = m_resampNext;
+      m_resampNext = m_srcBuf[srcIdx++];
+    }
+  }
+
+  for (SubmixSend& send : m_sends) {
+    send.m_routeBuf.resize(frames);
+    m_clientVox.routeAudio(frames, dt, send.m_submix->m_busId, m_resampBuf.data(), send.m_routeBuf.data());
+  }
+}
+
+void OfflineBackendVoice::_mixSends(size_t frames) {
+  const ChannelMap& chanMap = m_parent.m_chanMap;
+  for (SubmixSend& send : m_sends) {
+    float* out = send.m_submix->m_buffer.data();
+    const float* in = send.m_routeBuf.data();
+    const bool slewing = send.m_curCoefs != send.m_targetCoefs;
+    for (unsigned c = 0; c < chanMap.m_channelCount; ++c) {
+      const size_t coefIdx = size_t(chanMap.m_channels[c]);
+      const float cur = send.m_curCoefs[coefIdx];
+      const float target = send.m_targetCoefs[coefIdx];
+      if (slewing) {
+        const float inc = (target - cur) / float(frames);
+        for (size_t f = 0; f < frames; ++f)
+          out[f * chanMap.m_channelCount + c] += in[f] * (cur + inc * float(f + 1));
+      } else if (cur != 0.f) {
+        for (size_t f = 0; f < frames; ++f)
+          out[f * chanMap.m_channelCount + c] += in[f] * cur;
+      }
+    }
+    send.m_curCoefs = send.m_targetCoefs;
+  }
+}
+
+OfflineBackendSubmix::OfflineBackendSubmix(OfflineBackendVoiceAllocator& parent, Submix& clientSmx, bool mainOut,
+                                           int busId)
+: m_parent(parent), m_clientSmx(clientSmx), m_mainOut(mainOut), m_busId(busId) {
+  m_buffer.resize(m_parent.m_5msFrames * m_parent.m_chanMap.m_channelCount);
+  m_parentIt = m_parent.m_submixes.insert(m_parent.m_submixes.end(), this);
+}
+
+OfflineBackendSubmix::~OfflineBackendSubmix() {
+  for (OfflineBackendSubmix* smx : m_parent.m_submixes)
+    std::erase_if(smx->m_sends, [this](const auto& send) { return send.first == this; });
+  m_parent.m_submixes.erase(m_parentIt);
+}
+
+void OfflineBackendSubmix::setSendLevel(IBackendSubmix* submix, float level, bool) {
+  auto* smx = static_cast<OfflineBackendSubmix*>(submix);
+  auto search =
+      std::find_if(m_sends.begin(), m_sends.end(), [smx](const auto& send) { return send.first == smx; });
+  if (search == m_sends.end())
+    m_sends.emplace_back(smx, level);
+  else
+    search->second = level;
+}
+
+double OfflineBackendSubmix::getSampleRate() const { return m_parent.m_sampleRate; }
+
+SubmixFormat OfflineBackendSubmix::getSampleFormat() const { return SubmixFormat::Float; }
+
+OfflineBackendVoiceAllocator::OfflineBackendVoiceAllocator(double sampleRate, unsigned chCount)
+: m_sampleRate(sampleRate), m_5msFrames(size_t(sampleRate * 5.0 / 1000.0)) {
+  switch (chCount) {
+  case 2:
+  default:
+    m_chanSet = AudioChannelSet::Stereo;
+    m_chanMap = {2, {AudioChannel::FrontLeft, AudioChannel::FrontRight}};
+    break;
+  case 4:
+    m_chanSet = AudioChannelSet::Quad;
+    m_chanMap = {4, {AudioChannel::FrontLeft, AudioChannel::FrontRight, AudioChannel::RearLeft,
+                     AudioChannel::RearRight}};
+    break;
+  case 6:
+    m_chanSet = AudioChannelSet::Surround51;
+    m_chanMap = {6, {AudioChannel::FrontLeft, AudioChannel::FrontRight, AudioChannel::FrontCenter, AudioChannel::LFE,
+                     AudioChannel::RearLeft, AudioChannel::RearRight}};
+    break;
+  case 8:
+    m_chanSet = AudioChannelSet::Surround71;
+    m_chanMap = {8, {AudioChannel::FrontLeft, AudioChannel::FrontRight, AudioChannel::FrontCenter, AudioChannel::LFE,
+                     AudioChannel::RearLeft, AudioChannel::RearRight, AudioChannel::SideLeft,
+                     AudioChannel::SideRight}};
+    break;
+  }
+}
+
+std::unique_ptr<IBackendVoice> OfflineBackendVoiceAllocator::allocateVoice(Voice& clientVox, double sampleRate,
+                                                                           bool dynamicPitch) {
+  return std::make_unique<OfflineBackendVoice>(*this, clientVox, sampleRate, dynamicPitch);
+}
+
+void OfflineBackendVoiceAllocator::reserveVoices(size_t count) {
+  /* Size buffers for every send and for pitch ratios up to 8, so a voice recycling them never grows them on the
+   * mixing thread; counts cover voices playing (m_voices) and spare alike */
+  const size_t live = m_voices.size();
+  const size_t spares = count > live ? count - live : 0;
+  m_spareBuffers.reserve(std::max(count, m_spareBuffers.capacity()));
+  while (m_spareBuffers.size() < spares) {
+    SpareVoiceBuffers& buffers = m_spareBuffers.emplace_back();
+    buffers.m_sends.reserve(OfflineBackendVoice::MaxSends);
+    buffers.m_srcBuf.reserve(m_5msFrames * 8 + 2);
+    buffers.m_resampBuf.reserve(m_5msFrames);
+  }
+  m_spareRouteBufs.reserve(std::max(count * OfflineBackendVoice::MaxSends, m_spareRouteBufs.capacity()));
+  while (m_spareRouteBufs.size() < spares * OfflineBackendVoice::MaxSends)
+    m_spareRouteBufs.emplace_back().reserve(m_5msFrames);
+  while (m_spareNodes.size() < spares)
+    m_spareNodes.push_back(nullptr);
+  m_renderVoices.reserve(count);
+}
+
+std::unique_ptr<IBackendSubmix> OfflineBackendVoiceAllocator::allocateSubmix(Submix& clientSmx, bool mainOut,
+                                                                             int busId) {
+  return std::make_unique<OfflineBackendSubmix>(*this, clientSmx, mainOut, busId);
+}
+
+std::vector<std::pair<std::string, std::string>> OfflineBackendVoiceAllocator::enumerateMIDIDevices() { return {}; }
+
+std::unique_ptr<IMIDIReader> OfflineBackendVoiceAllocator::allocateMIDIReader(Engine&) { return {}; }
+
+AudioChannelSet OfflineBackendVoiceAllocator::getAvailableSet() { return m_chanSet; }
+
+void OfflineBackendVoiceAllocator::setVolume(float vol) { m_volume = vol; }
+
+void OfflineBackendVoiceAllocator::setCallbackInterface(Engine* engine) { m_cbInterface = engine; }
+
+void OfflineBackendVoiceAllocator::setRenderThreads(unsigned threadCount) {
+  if (threadCount == 0)
+    threadCount = WorkerPool::HardwareThreads();
+  if (threadCount > 1)
+    m_renderPool = std::make_unique<WorkerPool>(threadCount);
+  else
+    m_renderPool.reset();
+}
+
+void OfflineBackendVoiceAllocator::pumpAndMixVoices(float* dataOut) {
+  const size_t frames = m_5msFrames;
+  const size_t samples = frames * m_chanMap.m_channelCount;
+  const double dt = double(frames) / m_sampleRate;
+
+  if (m_cbInterface)
+    m_cbInterface->_on5MsInterval(*this, dt);
+
+  for (OfflineBackendSubmix* smx : m_submixes)
+    std::fill(smx->m_buffer.begin(), smx->m_buffer.end(), 0.f);
+
+  /* Voices allocated during the control loop are appended and picked up in this same interval */
+  m_mixing = true;
+  for (OfflineBackendVoice* vox : m_voices)
+    if (vox && vox->m_running)
+      vox->_pumpControl(dt);
+  m_mixing = false;
+  for (auto it = m_voices.begin(); it != m_voices.end();) {
+    auto next = std::next(it);
+    if (!*it)
+      m_spareNodes.splice(m_spareNodes.end(), m_voices, it);
+    it = next;
+  }
+
+  m_renderVoices.clear();
+  for (OfflineBackendVoice* vox : m_voices)
+    if (vox->m_running)
+      m_renderVoices.push_back(vox);
+
+  /* The decode stage only touches voice-local state, so voices may render in any order on any thread */
+  if (m_renderPool)
+    m_renderPool->parallelFor(m_renderVoices.size(),
+                              [&](size_t i) { m_renderVoices[i]->_renderAudio(frames, dt); });
+  else
+    for (OfflineBackendVoice* vox : m_renderVoices)
+      vox->_renderAudio(frames, dt);
+
+  /* Reduce in voice order so float accumulation is identical regardless of thread count */
+  for (OfflineBackendVoice* vox : m_renderVoices)
+    vox->_mixSends(frames);
+
+  /* Effects run in allocation order; auxiliary sends only feed submixes processed later */
+  std::fill(dataOut, dataOut + samples, 0.f);
+  for (OfflineBackendSubmix* smx : m_submixes) {
+    if (smx->m_clientSmx.canApplyEffect())
+      smx->m_clientSmx.applyEffect(smx->m_buffer.data(), frames, m_chanMap);
+    for (const auto& [dest, level] : smx->m_sends)
+      for (size_t i = 0; i < samples; ++i)
+        dest->m_buffer[i] += smx->m_buffer[i] * level;
+    if (smx->m_mainOut)
+      for (size_t i = 0; i < samples; ++i)
+        dataOut[i] += smx->m_buffer[i];
+  }
+
+  if (m_volume != 1.f)
+    for (size_t i = 0; i < samples; ++i)
+      dataOut[i] *= m_volume;
+
+  if (m_cbInterface)
+    m_cbInterface->_onPumpCycleComplete(*this);
+}
+
+void OfflineBackendVoiceAllocator::pumpAndMixVoices(int16_t* dataOut) {
+  const size_t samples = m_5msFrames * m_chanMap.m_channelCount;
+  thread_local std::vector<float> mixBuf;
+  mixBuf.resize(samples);
+  pumpAndMixVoices(mixBuf.data());
+  for (size_t i = 0; i < samples; ++i)
+    dataOut[i] = int16_t(std::clamp(mixBuf[i] * 32768.f, -32768.f, 32767.f));
+}
+
+static void WriteLE(FILE* fp, uint32_t val, int bytes) {
+  uint8_t buf[4];
+  for (int i = 0; i < bytes; ++i)
+    buf[i] = uint8_t(val >> (i * 8));
+  fwrite(buf, 1, bytes, fp);
+}
+
+void OfflinePCMWriter::_writeHeader() {
+  const uint32_t dataBytes = uint32_t(std::min<uint64_t>(m_dataBytes, UINT32_MAX - 36));
+  fwrite("RIFF", 1, 4, m_fp);
+  WriteLE(m_fp, 36 + dataBytes, 4);
+  fwrite("WAVEfmt ", 1, 8, m_fp);
+  WriteLE(m_fp, 16, 4);
+  WriteLE(m_fp, 1, 2);
+  WriteLE(m_fp, m_channelCount, 2);
+  WriteLE(m_fp, m_sampleRate, 4);
+  WriteLE(m_fp, m_sampleRate * m_channelCount * 2, 4);
+  WriteLE(m_fp, m_channelCount * 2, 2);
+  WriteLE(m_fp, 16, 2);
+  fwrite("data", 1, 4, m_fp);
+  WriteLE(m_fp, dataBytes, 4);
+}
+
+bool OfflinePCMWriter::open(const char* path, uint32_t sampleRate, uint16_t channelCount, bool raw) {
+  close();
+  m_fp = FOpen(path, "wb");
+  if (!m_fp)
+    return false;
+  m_raw = raw;
+  m_sampleRate = sampleRate;
+  m_channelCount = channelCount;
+  m_dataBytes = 0;
+  if (!m_raw)
+    _writeHeader();
+  return true;
+}
+
+void OfflinePCMWriter::write(const int16_t* data, size_t frameCount) {
+  if (!m_fp)
+    return;
+  const size_t samples = frameCount * m_channelCount;
+  if constexpr (std::endian::native == std::endian::little) {
+    fwrite(data, 2, samples, m_fp);
+  } else {
+    for (size_t i = 0; i < samples; ++i)
+      WriteLE(m_fp, uint16_t(data[i]), 2);
+  }
+  m_dataBytes += samples * 2;
+}
+
+void OfflinePCMWriter::close() {
+  if (!m_fp)
+    return;
+  if (!m_raw) {
+    fseek(m_fp, 0, SEEK_SET);
+    _writeHeader();
+  }
+  fclose(m_fp);
+  m_fp = nullptr;
+}
+
+} // namespace amuse
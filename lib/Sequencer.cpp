@@ -1,18 +1,54 @@
 #include "amuse/Sequencer.hpp"
 
+#include <algorithm>
 #include <map>
+#include <memory>
 
 #include "amuse/Engine.hpp"
 #include "amuse/Voice.hpp"
 
 namespace amuse {
 
+void Sequencer::ChannelState::_setChanVox(uint8_t note, ObjToken<Voice> vox) {
+  auto search = m_chanVoxs.find(note);
+  if (search != m_chanVoxs.end()) {
+    search->second = std::move(vox);
+  } else if (m_spareVoxNodes.empty()) {
+    m_chanVoxs.emplace(note, std::move(vox));
+  } else {
+    auto node = std::move(m_spareVoxNodes.back());
+    m_spareVoxNodes.pop_back();
+    node.key() = note;
+    node.mapped() = std::move(vox);
+    m_chanVoxs.insert(std::move(node));
+  }
+}
+
+std::unordered_map<uint8_t, ObjToken<Voice>>::iterator
+Sequencer::ChannelState::_eraseChanVox(std::unordered_map<uint8_t, ObjToken<Voice>>::iterator it) {
+  auto next = std::next(it);
+  auto node = m_chanVoxs.extract(it);
+  node.mapped().reset();
+  m_spareVoxNodes.push_back(std::move(node));
+  return next;
+}
+
+void Sequencer::ChannelState::_addKeyoffVox(ObjToken<Voice> vox) {
+  if (std::find(m_keyoffVoxs.cbegin(), m_keyoffVoxs.cend(), vox) == m_keyoffVoxs.cend())
+    m_keyoffVoxs.push_back(std::move(vox));
+}
+
+std::vector<ObjToken<Voice>>::iterator
+Sequencer::ChannelState::_eraseKeyoffVox(std::vector<ObjToken<Voice>>::iterator it) {
+  return m_keyoffVoxs.erase(it);
+}
+
 void Sequencer::ChannelState::_bringOutYourDead() {
   for (auto it = m_chanVoxs.begin(); it != m_chanVoxs.end();) {
     Voice* vox = it->second.get();
     vox->_bringOutYourDead();
     if (vox->_isRecursivelyDead()) {
-      it = m_chanVoxs.erase(it);
+      it = _eraseChanVox(it);
       continue;
     }
     ++it;
@@ -22,13 +58,11 @@ void Sequencer::ChannelState::_bringOutYourDead() {
     Voice* vox = it->get();
     vox->_bringOutYourDead();
     if (vox->_isRecursivelyDead()) {
-      it = m_keyoffVoxs.erase(it);
+      it = _eraseKeyoffVox(it);
       continue;
     }
     ++it;
   }
-  std::unordered_set<ObjToken<Voice>> newSet = m_keyoffVoxs;
-  m_keyoffVoxs = newSet;
 }
 
 void Sequencer::_bringOutYourDead() {
@@ -74,6 +108,8 @@ Sequencer::Sequencer(Engine& engine, const AudioGroup& group, GroupId groupId, c
 Sequencer::ChannelState::~ChannelState() = default;
 
 Sequencer::ChannelState::ChannelState(Sequencer& parent, uint8_t chanId) : m_parent(&parent), m_chanId(chanId) {
+  /* A channel can hold at most every voice of the engine in release */
+  m_keyoffVoxs.reserve(m_parent->m_engine.getVoicePoolStats().m_capacity);
   if (m_parent->m_songGroup) {
     if (m_parent->m_midiSetup) {
       m_setup = &m_parent->m_midiSetup[chanId];
@@ -186,8 +222,10 @@ ObjToken<Voice> Sequencer::ChannelState::keyOn(uint8_t note, uint8_t velocity) {
   if (ObjToken<Voice> lastVoice = m_lastVoice) {
     uint8_t lastNote = lastVoice->getLastNote();
     if (lastVoice->doPortamento(note)) {
-      m_chanVoxs.erase(lastNote);
-      m_chanVoxs[note] = lastVoice;
+      auto lastSearch = m_chanVoxs.find(lastNote);
+      if (lastSearch != m_chanVoxs.end())
+        _eraseChanVox(lastSearch);
+      _setChanVox(note, lastVoice);
       return lastVoice;
     }
   }
@@ -199,49 +237,51 @@ ObjToken<Voice> Sequencer::ChannelState::keyOn(uint8_t note, uint8_t velocity) {
       m_lastVoice.reset();
     keySearch->second->keyOff();
     keySearch->second->setPedal(false);
-    m_keyoffVoxs.emplace(keySearch->second);
-    m_chanVoxs.erase(keySearch);
-  }
-
-  std::list<ObjToken<Voice>>::iterator ret = m_parent->m_engine._allocateVoice(
-      m_parent->m_audioGroup, m_parent->m_groupId, NativeSampleRate, true, false, m_parent->m_studio);
-  if (*ret) {
-    m_chanVoxs[note] = *ret;
-    (*ret)->installCtrlValues(m_ctrlVals.data());
-
-    ObjectId oid;
-    bool res;
-    if (m_parent->m_songGroup) {
-      oid = m_page->objId;
-      res = (*ret)->loadPageObject(oid, m_ticksPerSec, note, velocity, m_ctrlVals[1]);
-    } else if (m_parent->m_sfxMappings.size()) {
-      size_t lookupIdx = note % m_parent->m_sfxMappings.size();
-      const SFXGroupIndex::SFXEntry* sfxEntry = m_parent->m_sfxMappings[lookupIdx];
-      oid = sfxEntry->objId;
-      note = sfxEntry->defKey;
-      res = (*ret)->loadPageObject(oid, m_ticksPerSec, note, velocity, m_ctrlVals[1]);
-    } else
-      return {};
+    _addKeyoffVox(keySearch->second);
+    _eraseChanVox(keySearch);
+  }
+
+  ObjectId oid;
+  uint8_t playNote = note;
+  VoicePriority prio;
+  if (m_parent->m_songGroup) {
+    oid = m_page->objId;
+    prio = {m_page->priority, oid, m_page->maxVoices};
+  } else if (m_parent->m_sfxMappings.size()) {
+    size_t lookupIdx = note % m_parent->m_sfxMappings.size();
+    const SFXGroupIndex::SFXEntry* sfxEntry = m_parent->m_sfxMappings[lookupIdx];
+    oid = sfxEntry->objId;
+    playNote = sfxEntry->defKey;
+    prio = {sfxEntry->priority, oid, sfxEntry->maxVoices};
+  } else
+    return {};
+  prio = Voice::_PagePriority(m_parent->m_audioGroup, oid, playNote, prio);
+
+  ObjToken<Voice> ret = m_parent->m_engine._allocateVoice(m_parent->m_audioGroup, m_parent->m_groupId, NativeSampleRate,
+                                                          true, false, m_parent->m_studio, prio);
+  if (ret) {
+    _setChanVox(note, ret);
+    ret->installCtrlValues(m_ctrlVals.data());
 
-    if (!res) {
-      m_parent->m_engine._destroyVoice(ret);
+    if (!ret->loadPageObject(oid, m_ticksPerSec, playNote, velocity, m_ctrlVals[1])) {
+      m_parent->m_engine._destroyVoice(*ret);
       return {};
     }
-    (*ret)->setVolume(m_parent->m_curVol * m_curVol);
-    (*ret)->setReverbVol(m_ctrlVals[0x5b] / 127.f);
-    (*ret)->setAuxBVol(m_ctrlVals[0x5d] / 127.f);
-    (*ret)->setPan(m_curPan);
-    (*ret)->setPitchWheel(m_curPitchWheel);
+    ret->setVolume(m_parent->m_curVol * m_curVol);
+    ret->setReverbVol(m_ctrlVals[0x5b] / 127.f);
+    ret->setAuxBVol(m_ctrlVals[0x5d] / 127.f);
+    ret->setPan(m_curPan);
+    ret->setPitchWheel(m_curPitchWheel);
     if (m_pitchWheelRange != -1)
-      (*ret)->setPitchWheelRange(m_pitchWheelRange, m_pitchWheelRange);
+      ret->setPitchWheelRange(m_pitchWheelRange, m_pitchWheelRange);
 
     if (m_ctrlVals[64] > 64)
-      (*ret)->setPedal(true);
+      ret->setPedal(true);
 
-    m_lastVoice = *ret;
+    m_lastVoice = ret;
   }
 
-  return *ret;
+  return ret;
 }
 
 ObjToken<Voice> Sequencer::keyOn(uint8_t chan, uint8_t note, uint8_t velocity) {
@@ -264,8 +304,8 @@ void Sequencer::ChannelState::keyOff(uint8_t note, uint8_t velocity) {
   if ((m_lastVoice && m_lastVoice->isDestroyed()) || keySearch->second == m_lastVoice)
     m_lastVoice.reset();
   keySearch->second->keyOff();
-  m_keyoffVoxs.emplace(keySearch->second);
-  m_chanVoxs.erase(keySearch);
+  _addKeyoffVox(keySearch->second);
+  _eraseChanVox(keySearch);
 }
 
 void Sequencer::keyOff(uint8_t chan, uint8_t note, uint8_t velocity) {
@@ -406,8 +446,8 @@ void Sequencer::ChannelState::allOff() {
     if (it->second == m_lastVoice)
       m_lastVoice.reset();
     it->second->keyOff();
-    m_keyoffVoxs.emplace(it->second);
-    it = m_chanVoxs.erase(it);
+    _addKeyoffVox(it->second);
+    it = _eraseChanVox(it);
   }
 }
 
@@ -459,12 +499,12 @@ void Sequencer::ChannelState::killKeygroup(uint8_t kg, bool now) {
         m_lastVoice.reset();
       if (now) {
         vox->kill();
-        it = m_chanVoxs.erase(it);
+        it = _eraseChanVox(it);
         continue;
       }
       vox->keyOff();
-      m_keyoffVoxs.emplace(it->second);
-      it = m_chanVoxs.erase(it);
+      _addKeyoffVox(it->second);
+      it = _eraseChanVox(it);
       continue;
     }
     ++it;
@@ -475,7 +515,7 @@ void Sequencer::ChannelState::killKeygroup(uint8_t kg, bool now) {
       Voice* vox = it->get();
       if (vox->m_keygroup == kg) {
         vox->kill();
-        it = m_keyoffVoxs.erase(it);
+        it = _eraseKeyoffVox(it);
         continue;
       }
       ++it;
@@ -537,6 +577,94 @@ void Sequencer::playSong(const unsigned char* arrData, bool loop, bool dieOnEnd)
   m_state = SequencerState::Playing;
 }
 
+void Sequencer::_rewindSong() {
+  m_songState.initialize(m_arrData, m_songState.isLooping());
+  for (size_t i = 0; i < m_chanStates.size(); ++i)
+    if (m_chanStates[i])
+      static_cast<ChannelControls&>(m_chanStates[i]) = ChannelState(*this, uint8_t(i));
+  setTempo(m_songState.getInitialTempo() * 384 / 60.0);
+}
+
+const Sequencer::SeekIndex::Checkpoint* Sequencer::SeekIndex::_find(const unsigned char* arrData, bool loop,
+                                                                    uint32_t tick) const {
+  if (arrData != m_arrData || loop != m_loop)
+    return nullptr;
+  auto it = std::upper_bound(m_checkpoints.cbegin(), m_checkpoints.cend(), tick,
+                             [](uint32_t t, const Checkpoint& cp) { return t < cp.m_song.m_tick; });
+  if (it == m_checkpoints.cbegin())
+    return nullptr;
+  return &*std::prev(it);
+}
+
+bool Sequencer::seekSong(uint32_t tick, const SeekIndex* index) {
+  if (!m_arrData)
+    return false;
+  allOff(true);
+
+  /* Tracks wrapped into their loop must not be restored past their target */
+  const SeekIndex::Checkpoint* cp =
+      index ? index->_find(m_arrData, m_songState.isLooping(), m_songState.wrapTick(tick)) : nullptr;
+  const bool fastForward = m_songState.canFastForward(tick);
+  if (cp && (!fastForward || cp->m_song.m_tick > m_songState.getTick())) {
+    m_songState.restoreCheckpoint(cp->m_song);
+    for (size_t i = 0; i < m_chanStates.size(); ++i) {
+      ChannelState& chan = m_chanStates[i];
+      if (cp->m_chanAllocated[i]) {
+        if (!chan)
+          chan = ChannelState(*this, uint8_t(i));
+        static_cast<ChannelControls&>(chan) = cp->m_chans[i];
+      } else {
+        if (chan)
+          static_cast<ChannelControls&>(chan) = ChannelState(*this, uint8_t(i));
+        chan.m_ticksPerSec = cp->m_chans[i].m_ticksPerSec;
+      }
+    }
+  } else if (!fastForward) {
+    _rewindSong();
+  }
+
+  if (m_songState.seek(*this, tick)) {
+    m_arrData = nullptr;
+    m_state = SequencerState::Interactive;
+    return false;
+  }
+  m_state = SequencerState::Playing;
+  return true;
+}
+
+Sequencer::SeekIndex Sequencer::buildSeekIndex() const {
+  SeekIndex ret;
+  if (!m_arrData)
+    return ret;
+
+  /* Replay the arrangement on a scratch sequencer without voices; the playing song is left untouched */
+  std::unique_ptr<Sequencer> scratch;
+  if (m_songGroup)
+    scratch = std::make_unique<Sequencer>(m_engine, m_audioGroup, m_groupId, m_songGroup, SongId(), ObjToken<Studio>());
+  else
+    scratch = std::make_unique<Sequencer>(m_engine, m_audioGroup, m_groupId, m_sfxGroup, ObjToken<Studio>());
+  scratch->m_midiSetup = m_midiSetup;
+  scratch->playSong(m_arrData, m_songState.isLooping(), false);
+
+  ret.m_arrData = m_arrData;
+  ret.m_loop = m_songState.isLooping();
+  const std::vector<uint32_t> ticks = scratch->m_songState.getRegionTicks();
+  ret.m_checkpoints.reserve(ticks.size());
+  for (uint32_t tick : ticks) {
+    if (scratch->m_songState.seek(*scratch, tick))
+      break;
+    SeekIndex::Checkpoint& cp = ret.m_checkpoints.emplace_back();
+    cp.m_song = scratch->m_songState.getCheckpoint();
+    for (size_t i = 0; i < m_chanStates.size(); ++i) {
+      cp.m_chans[i] = scratch->m_chanStates[i];
+      cp.m_chanAllocated[i] = bool(scratch->m_chanStates[i]);
+    }
+  }
+
+  scratch->_destroy();
+  return ret;
+}
+
 void Sequencer::stopSong(float fadeTime, bool now) {
   if (fadeTime == 0.f) {
     allOff(now);
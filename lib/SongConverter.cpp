@@ -3,7 +3,9 @@
 #include <algorithm>
 #include <array>
 #include <cstdlib>
-#include <map>
+#include <cstring>
+#include <utility>
+#include <vector>
 
 #include "amuse/Common.hpp"
 #include "amuse/SongState.hpp"
@@ -63,28 +65,38 @@ struct Event {
   Event(PitchEvent, uint8_t chan, int pBend) : m_type(Type::Pitch), channel(chan), pitchBend(pBend) {}
 };
 
+/** Event timeline sorted by tick; events sharing a tick keep the order they were added in */
+using EventList = std::vector<std::pair<int, Event>>;
+
+static void SortEvents(EventList& events) {
+  std::stable_sort(events.begin(), events.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+}
+
 class MIDIDecoder {
+  /** Held note awaiting its note-off, as region and event index into m_results */
+  struct NoteRef {
+    int m_region = -1;
+    size_t m_event = 0;
+  };
+
   int m_tick = 0;
-  std::vector<std::multimap<int, Event>> m_results[16];
-  std::multimap<int, int> m_tempos;
-  std::array<std::multimap<int, Event>::iterator, 128> m_notes[16];
+  std::vector<EventList> m_results[16]; /**< Appended in tick order, so already sorted */
+  std::vector<std::pair<int, int>> m_tempos;
+  std::array<NoteRef, 128> m_notes[16];
   int m_minLoopStart[16];
   int m_minLoopEnd[16];
 
-  bool isEmptyIterator(int chan, std::multimap<int, Event>::iterator it) const {
-    for (const auto& res : m_results[chan])
-      if (res.end() == it)
-        return true;
-    return false;
-  }
-
   void _addRegionChange(int chan) {
     auto& results = m_results[chan];
     results.reserve(2);
     results.emplace_back();
-    if (results.size() == 1)
-      for (size_t i = 0; i < 128; ++i)
-        m_notes[chan][i] = results.back().end();
+  }
+
+  std::pair<int, Event>* _heldNote(int chan, uint8_t note) {
+    const NoteRef& ref = m_notes[chan][note];
+    if (ref.m_region < 0)
+      return nullptr;
+    return &m_results[chan][ref.m_region][ref.m_event];
   }
 
   uint8_t m_status = 0;
@@ -147,7 +159,7 @@ public:
         case 0x51: {
           uint32_t tempo = 0;
           memcpy(&reinterpret_cast<uint8_t*>(&tempo)[1], &*it, 3);
-          m_tempos.emplace(m_tick, 60000000 / SBig(tempo));
+          m_tempos.emplace_back(m_tick, 60000000 / SBig(tempo));
           [[fallthrough]];
         }
         default:
@@ -168,7 +180,7 @@ public:
           _addRegionChange(chan);
         }
 
-        std::multimap<int, Event>& res = results.back();
+        EventList& res = results.back();
 
         switch (Status(m_status & 0xf0)) {
         case Status::NoteOff: {
@@ -180,10 +192,9 @@ public:
           b = *it++;
 
           uint8_t notenum = clamp7(a);
-          std::multimap<int, Event>::iterator note = m_notes[chan][notenum];
-          if (!isEmptyIterator(chan, note)) {
+          if (auto* note = _heldNote(chan, notenum)) {
             note->second.length = m_tick - note->first;
-            m_notes[chan][notenum] = res.end();
+            m_notes[chan][notenum] = {};
           }
           break;
         }
@@ -197,14 +208,15 @@ public:
 
           uint8_t notenum = clamp7(a);
           uint8_t vel = clamp7(b);
-          std::multimap<int, Event>::iterator note = m_notes[chan][notenum];
-          if (!isEmptyIterator(chan, note))
+          if (auto* note = _heldNote(chan, notenum))
             note->second.length = m_tick - note->first;
 
-          if (vel != 0)
-            m_notes[chan][notenum] = res.emplace(m_tick, Event{NoteEvent{}, chan, notenum, vel, 0});
-          else
-            m_notes[chan][notenum] = res.end();
+          if (vel != 0) {
+            m_notes[chan][notenum] = {int(results.size() - 1), res.size()};
+            res.emplace_back(m_tick, Event{NoteEvent{}, chan, notenum, vel, 0});
+          } else {
+            m_notes[chan][notenum] = {};
+          }
 
           break;
         }
@@ -229,14 +241,14 @@ public:
           else if (a == 0x67)
             m_minLoopEnd[chan] = std::min(m_tick, m_minLoopEnd[chan]);
           else
-            res.emplace(m_tick, Event{CtrlEvent{}, chan, clamp7(a), clamp7(b), 0});
+            res.emplace_back(m_tick, Event{CtrlEvent{}, chan, clamp7(a), clamp7(b), 0});
           break;
         }
         case Status::ProgramChange: {
           if (it == end)
             break;
           a = *it++;
-          res.emplace(m_tick, Event{ProgEvent{}, chan, a});
+          res.emplace_back(m_tick, Event{ProgEvent{}, chan, a});
           break;
         }
         case Status::ChannelPressure: {
@@ -252,7 +264,7 @@ public:
           if (it == end)
             break;
           b = *it++;
-          res.emplace(m_tick, Event{PitchEvent{}, chan, clamp7(b) * 128 + clamp7(a)});
+          res.emplace_back(m_tick, Event{PitchEvent{}, chan, clamp7(b) * 128 + clamp7(a)});
           break;
         }
         case Status::SysEx: {
@@ -306,8 +318,8 @@ public:
     return it;
   }
 
-  std::vector<std::multimap<int, Event>>& getResults(int chan) { return m_results[chan]; }
-  std::multimap<int, int>& getTempos() { return m_tempos; }
+  std::vector<EventList>& getResults(int chan) { return m_results[chan]; }
+  std::vector<std::pair<int, int>>& getTempos() { return m_tempos; }
   int getMinLoopStart(int chan) const { return m_minLoopStart[chan]; }
   int getMinLoopEnd(int chan) const { return m_minLoopEnd[chan]; }
 };
@@ -580,25 +592,26 @@ std::vector<uint8_t> SongConverter::SongToMIDI(const unsigned char* data, int& v
   for (SongState::Track& trk : song.m_tracks) {
     if (trk) {
       MIDIEncoder encoder;
-      std::multimap<int, Event> allEvents;
+      EventList allEvents;
+      EventList events;
 
       /* Iterate all regions */
       while (trk.m_nextRegion->indexValid(song.m_bigEndian)) {
-        std::multimap<int, Event> events;
+        events.clear();
         trk.advanceRegion();
         uint32_t regStart = song.m_bigEndian ? SBig(trk.m_curRegion->m_startTick) : trk.m_curRegion->m_startTick;
 
         /* Initial program change */
         if (trk.m_curRegion->m_progNum != 0xff)
-          events.emplace(regStart, Event{ProgEvent{}, trk.m_midiChan, trk.m_curRegion->m_progNum});
+          events.emplace_back(regStart, Event{ProgEvent{}, trk.m_midiChan, trk.m_curRegion->m_progNum});
 
         /* Update continuous pitch data */
         if (trk.m_pitchWheelData) {
           while (true) {
             /* Update pitch */
             trk.m_pitchVal += trk.m_nextPitchDelta;
-            events.emplace(regStart + trk.m_nextPitchTick,
-                           Event{PitchEvent{}, trk.m_midiChan, std::clamp(trk.m_pitchVal + 0x2000, 0, 0x4000)});
+            events.emplace_back(regStart + trk.m_nextPitchTick,
+                                Event{PitchEvent{}, trk.m_midiChan, std::clamp(trk.m_pitchVal + 0x2000, 0, 0x4000)});
             if (trk.m_pitchWheelData[0] != 0x80 || trk.m_pitchWheelData[1] != 0x00) {
               auto delta = DecodeDelta(trk.m_pitchWheelData);
               trk.m_nextPitchTick += delta.first;
@@ -614,8 +627,8 @@ std::vector<uint8_t> SongConverter::SongToMIDI(const unsigned char* data, int& v
           while (true) {
             /* Update modulation */
             trk.m_modVal += trk.m_nextModDelta;
-            events.emplace(regStart + trk.m_nextModTick,
-                           Event{CtrlEvent{}, trk.m_midiChan, 1, uint8_t(std::clamp(trk.m_modVal / 128, 0, 127)), 0});
+            const auto modVal = uint8_t(std::clamp(trk.m_modVal / 128, 0, 127));
+            events.emplace_back(regStart + trk.m_nextModTick, Event{CtrlEvent{}, trk.m_midiChan, 1, modVal, 0});
             if (trk.m_modWheelData[0] != 0x80 || trk.m_modWheelData[1] != 0x00) {
               auto delta = DecodeDelta(trk.m_modWheelData);
               trk.m_nextModTick += delta.first;
@@ -639,12 +652,13 @@ std::vector<uint8_t> SongConverter::SongToMIDI(const unsigned char* data, int& v
               /* Control change */
               uint8_t val = trk.m_data[0] & 0x7f;
               uint8_t ctrl = trk.m_data[1] & 0x7f;
-              events.emplace(regStart + trk.m_eventWaitCountdown, Event{CtrlEvent{}, trk.m_midiChan, ctrl, val, 0});
+              events.emplace_back(regStart + trk.m_eventWaitCountdown,
+                                  Event{CtrlEvent{}, trk.m_midiChan, ctrl, val, 0});
               trk.m_data += 2;
             } else if (trk.m_data[0] & 0x80) {
               /* Program change */
               uint8_t prog = trk.m_data[0] & 0x7f;
-              events.emplace(regStart + trk.m_eventWaitCountdown, Event{ProgEvent{}, trk.m_midiChan, prog});
+              events.emplace_back(regStart + trk.m_eventWaitCountdown, Event{ProgEvent{}, trk.m_midiChan, prog});
               trk.m_data += 2;
             } else {
               /* Note */
@@ -652,8 +666,8 @@ std::vector<uint8_t> SongConverter::SongToMIDI(const unsigned char* data, int& v
               uint8_t vel = trk.m_data[1] & 0x7f;
               uint16_t length = (song.m_bigEndian ? SBig(*reinterpret_cast<const uint16_t*>(trk.m_data + 2))
                                                   : *reinterpret_cast<const uint16_t*>(trk.m_data + 2));
-              events.emplace(regStart + trk.m_eventWaitCountdown,
-                             Event{NoteEvent{}, trk.m_midiChan, note, vel, length});
+              events.emplace_back(regStart + trk.m_eventWaitCountdown,
+                                  Event{NoteEvent{}, trk.m_midiChan, note, vel, length});
               trk.m_data += 4;
             }
 
@@ -675,17 +689,18 @@ std::vector<uint8_t> SongConverter::SongToMIDI(const unsigned char* data, int& v
                                                     : *reinterpret_cast<const uint16_t*>(trk.m_data));
                 uint8_t note = trk.m_data[2] & 0x7f;
                 uint8_t vel = trk.m_data[3] & 0x7f;
-                events.emplace(regStart + trk.m_eventWaitCountdown,
-                               Event{NoteEvent{}, trk.m_midiChan, note, vel, length});
+                events.emplace_back(regStart + trk.m_eventWaitCountdown,
+                                    Event{NoteEvent{}, trk.m_midiChan, note, vel, length});
               } else if (trk.m_data[2] & 0x80 && trk.m_data[3] & 0x80) {
                 /* Control change */
                 uint8_t val = trk.m_data[2] & 0x7f;
                 uint8_t ctrl = trk.m_data[3] & 0x7f;
-                events.emplace(regStart + trk.m_eventWaitCountdown, Event{CtrlEvent{}, trk.m_midiChan, ctrl, val, 0});
+                events.emplace_back(regStart + trk.m_eventWaitCountdown,
+                                    Event{CtrlEvent{}, trk.m_midiChan, ctrl, val, 0});
               } else if (trk.m_data[2] & 0x80) {
                 /* Program change */
                 uint8_t prog = trk.m_data[2] & 0x7f;
-                events.emplace(regStart + trk.m_eventWaitCountdown, Event{ProgEvent{}, trk.m_midiChan, prog});
+                events.emplace_back(regStart + trk.m_eventWaitCountdown, Event{ProgEvent{}, trk.m_midiChan, prog});
               }
               trk.m_data += 4;
             }
@@ -700,13 +715,14 @@ std::vector<uint8_t> SongConverter::SongToMIDI(const unsigned char* data, int& v
         }
 
         /* Merge events */
-        allEvents.insert(events.begin(), events.end());
+        SortEvents(events);
+        allEvents.insert(allEvents.end(), events.begin(), events.end());
 
         /* Resolve key-off events */
         for (auto& pair : events) {
           if (pair.second.m_type == Event::Type::Note) {
-            auto it = allEvents.emplace(pair.first + pair.second.length, pair.second);
-            it->second.endEvent = true;
+            allEvents.emplace_back(pair.first + pair.second.length, pair.second);
+            allEvents.back().second.endEvent = true;
           }
         }
       }
@@ -714,13 +730,15 @@ std::vector<uint8_t> SongConverter::SongToMIDI(const unsigned char* data, int& v
       /* Add loop events */
       if (!loopsAdded && trk.m_nextRegion->indexLoop(song.m_bigEndian) != -1) {
         uint32_t loopEnd = song.m_bigEndian ? SBig(trk.m_nextRegion->m_startTick) : trk.m_nextRegion->m_startTick;
-        allEvents.emplace(trk.m_loopStartTick, Event{CtrlEvent{}, trk.m_midiChan, 0x66, 0, 0});
-        allEvents.emplace(loopEnd, Event{CtrlEvent{}, trk.m_midiChan, 0x67, 0, 0});
+        allEvents.emplace_back(trk.m_loopStartTick, Event{CtrlEvent{}, trk.m_midiChan, 0x66, 0, 0});
+        allEvents.emplace_back(loopEnd, Event{CtrlEvent{}, trk.m_midiChan, 0x67, 0, 0});
         if (!(song.m_header.m_initialTempo & 0x80000000))
           loopsAdded = true;
       }
 
       /* Emit MIDI events */
+      SortEvents(allEvents);
+      encoder.getResult().reserve(allEvents.size() * 4 + 4);
       int lastTime = 0;
       for (auto& pair : allEvents) {
         encoder._sendContinuedValue(pair.first - lastTime);
@@ -839,27 +857,31 @@ std::vector<uint8_t> SongConverter::MIDIToSong(const std::vector<uint8_t>& data,
   int loopEnd[16];
   int loopChanCount = 0;
   {
-    int loopChanIdx = -1;
-    for (int c = 0; c < 16; ++c) {
-      loopStart[c] = INT_MAX;
-      loopEnd[c] = INT_MAX;
-      std::vector<uint8_t>::const_iterator tmpIt = it;
-      for (int i = 0; i < header.count; ++i) {
-        if (memcmp(&*tmpIt, "MTrk", 4))
-          return {};
-        tmpIt += 4;
-        uint32_t length = SBig(*reinterpret_cast<const uint32_t*>(&*tmpIt));
-        tmpIt += 4;
-
-        std::vector<uint8_t>::const_iterator begin = tmpIt;
-        std::vector<uint8_t>::const_iterator end = tmpIt + length;
-        tmpIt = end;
-
-        MIDIDecoder dec;
-        dec.receiveBytes(begin, end);
+    /* Each track is decoded once, collecting the loop points of all channels it addresses */
+    std::fill(std::begin(loopStart), std::end(loopStart), INT_MAX);
+    std::fill(std::begin(loopEnd), std::end(loopEnd), INT_MAX);
+    std::vector<uint8_t>::const_iterator tmpIt = it;
+    for (int i = 0; i < header.count; ++i) {
+      if (memcmp(&*tmpIt, "MTrk", 4))
+        return {};
+      tmpIt += 4;
+      uint32_t length = SBig(*reinterpret_cast<const uint32_t*>(&*tmpIt));
+      tmpIt += 4;
+
+      std::vector<uint8_t>::const_iterator begin = tmpIt;
+      std::vector<uint8_t>::const_iterator end = tmpIt + length;
+      tmpIt = end;
+
+      MIDIDecoder dec;
+      dec.receiveBytes(begin, end);
+      for (int c = 0; c < 16; ++c) {
         loopStart[c] = std::min(dec.getMinLoopStart(c), loopStart[c]);
         loopEnd[c] = std::min(dec.getMinLoopEnd(c), loopEnd[c]);
       }
+    }
+
+    int loopChanIdx = -1;
+    for (int c = 0; c < 16; ++c) {
       if (loopStart[c] == INT_MAX || loopEnd[c] == INT_MAX) {
         loopStart[c] = INT_MAX;
         loopEnd[c] = INT_MAX;
@@ -891,7 +913,7 @@ std::vector<uint8_t> SongConverter::MIDIToSong(const std::vector<uint8_t>& data,
       MIDIDecoder dec;
       dec.receiveBytes(begin, end);
 
-      std::multimap<int, int>& tempos = dec.getTempos();
+      std::vector<std::pair<int, int>>& tempos = dec.getTempos();
       if (tempos.size() == 1)
         initTempo = tempos.begin()->second;
       else if (tempos.size() > 1) {
@@ -925,7 +947,7 @@ std::vector<uint8_t> SongConverter::MIDIToSong(const std::vector<uint8_t>& data,
     dec.receiveBytes(begin, end, tmpLoopStart, tmpLoopEnd);
 
     for (int c = 0; c < 16; ++c) {
-      std::vector<std::multimap<int, Event>>& results = dec.getResults(c);
+      std::vector<EventList>& results = dec.getResults(c);
       bool didChanInit = false;
       int lastEventTick = 0;
       for (auto& chanRegion : results) {
@@ -1206,7 +1228,7 @@ std::vector<uint8_t> SongConverter::MIDIToSong(const std::vector<uint8_t>& data,
     uint32_t regIdxOff = head.m_regionIdxOff;
     if (big)
       head.swapToBig();
-    *reinterpret_cast<SongState::Header*>(&*ret.insert(ret.cend(), headSz, 0)) = head;
+    memcpy(&*ret.insert(ret.cend(), headSz, 0), &head, headSz);
 
     for (size_t i = 0; i < 64; ++i) {
       if (i >= trackRegionIdxArr.size()) {
@@ -1285,7 +1307,7 @@ std::vector<uint8_t> SongConverter::MIDIToSong(const std::vector<uint8_t>& data,
     uint32_t chanMapOff = head.m_chanMapOff;
     if (big)
       head.swapToBig();
-    *reinterpret_cast<SongState::Header*>(&*ret.insert(ret.cend(), headSz, 0)) = head;
+    memcpy(&*ret.insert(ret.cend(), headSz, 0), &head, headSz);
 
     for (SongState::TrackRegion& reg : regionBuf)
       *reinterpret_cast<SongState::TrackRegion*>(&*ret.insert(ret.cend(), 12, 0)) = reg;
@@ -1,6 +1,9 @@
 #include "amuse/SongState.hpp"
 
+#include <algorithm>
+#include <bitset>
 #include <cmath>
+#include <functional>
 
 #include "amuse/Common.hpp"
 #include "amuse/Sequencer.hpp"
@@ -85,12 +88,9 @@ void SongState::Track::Header::swapBig() {
 
 SongState::Track::Track(SongState& parent, uint8_t midiChan, uint32_t loopStart, const TrackRegion* regions,
                         uint32_t tempo)
-: m_parent(&parent)
-, m_midiChan(midiChan)
-, m_initRegion(regions)
-, m_nextRegion(regions)
-, m_loopStartTick(loopStart)
-, m_tempo(tempo) {
+: m_parent(&parent), m_midiChan(midiChan), m_initRegion(regions), m_loopStartTick(loopStart) {
+  m_nextRegion = regions;
+  m_tempo = tempo;
   resetTempo();
 }
 
@@ -148,6 +148,23 @@ void SongState::Track::setRegion(const TrackRegion* region) {
 
 void SongState::Track::advanceRegion() { setRegion(m_nextRegion); }
 
+void SongState::Track::scheduleNoteOff(uint8_t note, uint16_t length) {
+  /* Zero-length notes are released by the caller; a retriggered note supersedes its pending release,
+   * whose heap entry is then skipped as stale */
+  if (length == 0) {
+    m_noteOffTicks[note] = 0;
+    return;
+  }
+  m_noteOffTicks[note] = m_noteClock + length;
+  m_noteOffHeap.emplace_back(m_noteOffTicks[note], note);
+  std::push_heap(m_noteOffHeap.begin(), m_noteOffHeap.end(), std::greater<>());
+}
+
+void SongState::Track::clearNoteOffs() {
+  m_noteOffTicks.fill(0);
+  m_noteOffHeap.clear();
+}
+
 int SongState::DetectVersion(const unsigned char* ptr, bool& isBig) {
   isBig = ptr[0] == 0;
   Header header = *reinterpret_cast<const Header*>(ptr);
@@ -372,6 +389,10 @@ bool SongState::Track::advance(Sequencer& seq, double dt) {
   }
 
   m_remDt -= ticks / ticksPerSecond;
+  return advanceTicks(seq, ticks, false);
+}
+
+bool SongState::Track::advanceTicks(Sequencer& seq, uint32_t ticks, bool seeking) {
   uint32_t endTick = m_curTick + ticks;
 
   /* Advance region if needed */
@@ -385,12 +406,22 @@ bool SongState::Track::advance(Sequencer& seq, double dt) {
   }
 
   /* Stop finished notes */
-  for (int i = 0; i < 128; ++i) {
-    if (m_remNoteLengths[i] > 0) {
-      m_remNoteLengths[i] -= ticks;
-      if (m_remNoteLengths[i] <= 0)
-        seq.keyOff(m_midiChan, i, 0);
+  m_noteClock += ticks;
+  if (!m_noteOffHeap.empty() && m_noteOffHeap.front().first <= m_noteClock) {
+    /* Release in ascending note order, as the per-note scan this replaces did */
+    std::bitset<128> expired;
+    while (!m_noteOffHeap.empty() && m_noteOffHeap.front().first <= m_noteClock) {
+      auto [offTick, note] = m_noteOffHeap.front();
+      std::pop_heap(m_noteOffHeap.begin(), m_noteOffHeap.end(), std::greater<>());
+      m_noteOffHeap.pop_back();
+      if (m_noteOffTicks[note] == offTick) {
+        m_noteOffTicks[note] = 0;
+        expired.set(note);
+      }
     }
+    for (int i = 0; i < 128; ++i)
+      if (expired[i])
+        seq.keyOff(m_midiChan, i, 0);
   }
 
   if (m_data != nullptr) {
@@ -493,11 +524,13 @@ bool SongState::Track::advance(Sequencer& seq, double dt) {
           uint8_t vel = m_data[1] & 0x7f;
           uint16_t length = (m_parent->m_bigEndian ? SBig(*reinterpret_cast<const uint16_t*>(m_data + 2))
                                                    : *reinterpret_cast<const uint16_t*>(m_data + 2));
-          seq.keyOn(m_midiChan, note, vel);
-          if (length == 0) {
-            seq.keyOff(m_midiChan, note, 0);
+          if (!seeking) {
+            seq.keyOn(m_midiChan, note, vel);
+            if (length == 0) {
+              seq.keyOff(m_midiChan, note, 0);
+            }
+            scheduleNoteOff(note, length);
           }
-          m_remNoteLengths[note] = length;
           m_data += 4;
         }
 
@@ -528,11 +561,13 @@ bool SongState::Track::advance(Sequencer& seq, double dt) {
                                                    : *reinterpret_cast<const uint16_t*>(m_data));
           uint8_t note = m_data[2] & 0x7f;
           uint8_t vel = m_data[3] & 0x7f;
-          seq.keyOn(m_midiChan, note, vel);
-          if (length == 0) {
-            seq.keyOff(m_midiChan, note, 0);
+          if (!seeking) {
+            seq.keyOn(m_midiChan, note, vel);
+            if (length == 0) {
+              seq.keyOff(m_midiChan, note, 0);
+            }
+            scheduleNoteOff(note, length);
           }
-          m_remNoteLengths[note] = length;
         } else {
           /* Special event: key byte has bit 7 set.
            * Match the original MusyX SDK HandleEvent (seq.c) encoding:
@@ -596,6 +631,157 @@ bool SongState::Track::advance(Sequencer& seq, double dt) {
   return false;
 }
 
+uint32_t SongState::Track::wrapTick(uint32_t tick) const {
+  if (!m_parent->m_loop) {
+    return tick;
+  }
+
+  const TrackRegion* region = m_initRegion;
+  while (region->indexValid(m_parent->m_bigEndian)) {
+    ++region;
+  }
+  if (region->indexLoop(m_parent->m_bigEndian) == -1) {
+    return tick;
+  }
+
+  uint32_t loopEndTick = (m_parent->m_bigEndian ? SBig(region->m_startTick) : region->m_startTick);
+  if (tick <= loopEndTick) {
+    return tick;
+  }
+  if (loopEndTick <= m_loopStartTick) {
+    return loopEndTick;
+  }
+  /* Each pass covers (loop start, loop end] as the first pass does, so a whole number of passes lands on the
+   * loop end with its state rather than on the loop start */
+  return m_loopStartTick + 1 + (tick - loopEndTick - 1) % (loopEndTick - m_loopStartTick);
+}
+
+bool SongState::Track::seek(Sequencer& seq, uint32_t tick) {
+  m_remDt = 0.0;
+  clearNoteOffs();
+
+  /* Turn over every tempo change up to the target at once; only the last one is audible */
+  while ((m_tempoPtr != nullptr) && m_tempoPtr->m_tick != 0xffffffff) {
+    TempoChange change = *m_tempoPtr;
+    if (m_parent->m_bigEndian) {
+      change.swapBig();
+    }
+    if (change.m_tick > tick) {
+      break;
+    }
+    m_tempo = change.m_tempo & 0x7fffffff;
+    seq.setTempo(m_midiChan, m_tempo * 384 / 60.0);
+    ++m_tempoPtr;
+  }
+
+  /* Step region by region; a single advance would jump straight into the last region,
+   * skipping the commands of the ones in between */
+  bool done = m_data == nullptr && m_nextRegion->indexDone(m_parent->m_bigEndian, m_parent->m_loop);
+  while (!done && m_curTick < tick) {
+    uint32_t stepEnd = tick;
+    for (const TrackRegion* region = m_nextRegion; region->indexValid(m_parent->m_bigEndian); ++region) {
+      uint32_t regTick = (m_parent->m_bigEndian ? SBig(region->m_startTick) : region->m_startTick);
+      if (regTick > m_curTick) {
+        stepEnd = std::min(stepEnd, regTick);
+        break;
+      }
+    }
+    done = advanceTicks(seq, stepEnd - m_curTick, true);
+  }
+
+  /* Finished tracks keep counting ticks during playback; land them on the target whichever way it was reached */
+  if (done && m_curTick < tick) {
+    m_curTick = tick;
+  }
+  return done;
+}
+
+uint32_t SongState::getTick() const {
+  uint32_t ret = 0;
+  for (const Track& trk : m_tracks) {
+    if (trk) {
+      ret = std::max(ret, trk.m_curTick);
+    }
+  }
+  return ret;
+}
+
+std::vector<uint32_t> SongState::getRegionTicks() const {
+  std::vector<uint32_t> ret;
+  for (const Track& trk : m_tracks) {
+    if (trk) {
+      for (const TrackRegion* region = trk.m_initRegion; region->indexValid(m_bigEndian); ++region) {
+        ret.push_back(m_bigEndian ? SBig(region->m_startTick) : region->m_startTick);
+      }
+    }
+  }
+  std::sort(ret.begin(), ret.end());
+  ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+  return ret;
+}
+
+uint32_t SongState::wrapTick(uint32_t tick) const {
+  uint32_t ret = tick;
+  for (const Track& trk : m_tracks) {
+    if (trk) {
+      ret = std::min(ret, trk.wrapTick(tick));
+    }
+  }
+  return ret;
+}
+
+bool SongState::canFastForward(uint32_t tick) const {
+  if (m_songState == SongPlayState::Stopped) {
+    return false;
+  }
+  for (const Track& trk : m_tracks) {
+    if (trk && trk.m_curTick > trk.wrapTick(tick)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SongState::seek(Sequencer& seq, uint32_t tick) {
+  if (m_songState == SongPlayState::Stopped) {
+    return true;
+  }
+
+  bool done = true;
+  for (Track& trk : m_tracks) {
+    if (trk) {
+      done &= trk.seek(seq, trk.wrapTick(tick));
+    }
+  }
+
+  if (done) {
+    m_songState = SongPlayState::Stopped;
+  }
+  return done;
+}
+
+SongState::Checkpoint SongState::getCheckpoint() const {
+  Checkpoint ret;
+  ret.m_tick = getTick();
+  ret.m_songState = m_songState;
+  for (size_t i = 0; i < m_tracks.size(); ++i) {
+    ret.m_tracks[i] = m_tracks[i];
+  }
+  return ret;
+}
+
+void SongState::restoreCheckpoint(const Checkpoint& checkpoint) {
+  m_songState = checkpoint.m_songState;
+  for (size_t i = 0; i < m_tracks.size(); ++i) {
+    Track& trk = m_tracks[i];
+    if (trk) {
+      static_cast<TrackCursor&>(trk) = checkpoint.m_tracks[i];
+      trk.m_remDt = 0.0;
+      trk.clearNoteOffs();
+    }
+  }
+}
+
 bool SongState::advance(Sequencer& seq, double dt) {
   /* Stopped */
   if (m_songState == SongPlayState::Stopped) {
@@ -3,7 +3,6 @@
 #include <cmath>
 #include <cstring>
 #include <numbers>
-#include <iostream>
 
 #include "amuse/AudioGroup.hpp"
 #include "amuse/AudioGroupPool.hpp"
@@ -158,68 +157,113 @@ unsigned int SoundMacro::ICmd::DoFluid(MacroExecContext& ctx, fluid_voice_t*) co
 
 namespace amuse {
 
+static SoundMacroState::Evaluator::Source ComponentSource(uint8_t midiCtrl, SoundMacroState::Evaluator::VarType varType) {
+  using Source = SoundMacroState::Evaluator::Source;
+  if (varType == SoundMacroState::Evaluator::VarType::Var)
+    return Source::Var;
+  if (varType != SoundMacroState::Evaluator::VarType::Ctrl)
+    return Source::None;
+  switch (midiCtrl) {
+  case 128:
+    return Source::PitchWheel;
+  case 129:
+    return Source::Aftertouch;
+  case 130:
+    return Source::LFO1;
+  case 131:
+    return Source::LFO2;
+  case 132:
+    return Source::SurroundPan;
+  case 133:
+    return Source::InitKey;
+  case 134:
+    return Source::InitVel;
+  case 135:
+    return Source::ExecTime;
+  default:
+    return Source::Ctrl;
+  }
+}
+
+SoundMacroState::Evaluator::Component::Component(uint8_t midiCtrl, float scale, Combine combine, VarType varType)
+: m_midiCtrl(midiCtrl)
+, m_scale(scale)
+, m_combine(combine)
+, m_varType(varType)
+, m_source(ComponentSource(midiCtrl, varType)) {}
+
 void SoundMacroState::Evaluator::addComponent(uint8_t midiCtrl, float scale, Combine combine, VarType varType) {
-  m_comps.push_back({midiCtrl, scale, combine, varType});
+  /* Anything other than Add or Mult replaces the running value, so earlier terms can never contribute;
+   * this also keeps formulas from growing when a looping macro re-issues its *_SELECT commands */
+  if (combine != Combine::Add && combine != Combine::Mult) {
+    m_spill.clear();
+    m_numComps = 0;
+  }
+  const Component comp(midiCtrl, scale, combine, varType);
+  if (m_numComps < InlineComponents) {
+    m_inline[m_numComps] = comp;
+  } else {
+    if (m_numComps == InlineComponents)
+      m_spill.assign(m_inline.cbegin(), m_inline.cend());
+    m_spill.push_back(comp);
+  }
+  if (++m_numComps == 1)
+    m_timeVarying = false;
+  m_timeVarying |= comp.m_source == Source::LFO1 || comp.m_source == Source::LFO2;
 }
 
 float SoundMacroState::Evaluator::evaluate(double time, const Voice& vox, const SoundMacroState& st) const {
   float value = 0.f;
 
   /* Iterate each component */
-  for (auto it = m_comps.cbegin(); it != m_comps.cend(); ++it) {
-    const Component& comp = *it;
+  const Component* comps = _components();
+  for (size_t i = 0; i < m_numComps; ++i) {
+    const Component& comp = comps[i];
     float thisValue = 0.f;
 
     /* Load selected data */
-    if (comp.m_varType == VarType::Ctrl) {
-      switch (comp.m_midiCtrl) {
-      case 128:
-        /* Pitchbend */
-        thisValue = (vox.getPitchWheel() * 0.5f + 0.5f) * 127.f;
-        break;
-      case 129:
-        /* Aftertouch */
-        thisValue = vox.getAftertouch();
-        break;
-      case 130:
-        /* LFO1 */
-        if (vox.m_lfoPeriods[0])
-          thisValue = (std::sin(time / vox.m_lfoPeriods[0] * 2.f * std::numbers::pi_v<float>) * 0.5f + 0.5f) * 127.f;
-        break;
-      case 131:
-        /* LFO2 */
-        if (vox.m_lfoPeriods[1])
-          thisValue = (std::sin(time / vox.m_lfoPeriods[1] * 2.f * std::numbers::pi_v<float>) * 0.5f + 0.5f) * 127.f;
-        break;
-      case 132:
-        /* Surround panning */
-        thisValue = (vox.m_curSpan * 0.5f + 0.5f) * 127.f;
-        std::cerr<< "Surround: " << thisValue << "\n";
-        break;
-      case 133:
-        /* Macro-starting key */
-        thisValue = st.m_initKey;
-        break;
-      case 134:
-        /* Macro-starting velocity */
-        thisValue = st.m_initVel;
-        break;
-      case 135:
-        /* Time since macro-start (ms) */
-        thisValue = std::clamp(float(st.m_execTime * 1000.f), 0.f, 16383.f);
-        break;
-      default:
-        thisValue = vox.getCtrlValue(comp.m_midiCtrl);
-        break;
-      }
-    } else if (comp.m_varType == VarType::Var)
+    switch (comp.m_source) {
+    case Source::Ctrl:
+      thisValue = vox.getCtrlValue(comp.m_midiCtrl);
+      break;
+    case Source::PitchWheel:
+      thisValue = (vox.getPitchWheel() * 0.5f + 0.5f) * 127.f;
+      break;
+    case Source::Aftertouch:
+      thisValue = vox.getAftertouch();
+      break;
+    case Source::LFO1:
+      if (vox.m_lfoPeriods[0])
+        thisValue = (std::sin(time / vox.m_lfoPeriods[0] * 2.f * std::numbers::pi_v<float>) * 0.5f + 0.5f) * 127.f;
+      break;
+    case Source::LFO2:
+      if (vox.m_lfoPeriods[1])
+        thisValue = (std::sin(time / vox.m_lfoPeriods[1] * 2.f * std::numbers::pi_v<float>) * 0.5f + 0.5f) * 127.f;
+      break;
+    case Source::SurroundPan:
+      thisValue = (vox.m_curSpan * 0.5f + 0.5f) * 127.f;
+      break;
+    case Source::InitKey:
+      thisValue = st.m_initKey;
+      break;
+    case Source::InitVel:
+      thisValue = st.m_initVel;
+      break;
+    case Source::ExecTime:
+      thisValue = std::clamp(float(st.m_execTime * 1000.f), 0.f, 16383.f);
+      break;
+    case Source::Var:
       thisValue = st.m_variables[comp.m_midiCtrl & 0x1f];
+      break;
+    default:
+      break;
+    }
 
     /* Apply scale */
     thisValue *= comp.m_scale;
 
     /* Combine */
-    if (it != m_comps.cbegin()) {
+    if (i != 0) {
       switch (comp.m_combine) {
       case Combine::Add:
         value += thisValue;
@@ -515,7 +559,7 @@ const SoundMacro::CmdIntrospection SoundMacro::CmdPlayMacro::Introspective = {
      {FIELD_HEAD(SoundMacro::CmdPlayMacro, priority), "Priority"sv, 0, 127, 50},
      {FIELD_HEAD(SoundMacro::CmdPlayMacro, maxVoices), "Max Voices"sv, 0, 255, 255}}}};
 bool SoundMacro::CmdPlayMacro::Do(SoundMacroState& st, Voice& vox) const {
-  ObjToken<Voice> sibVox = vox.startChildMacro(addNote, macro.id, macroStep.step);
+  ObjToken<Voice> sibVox = vox.startChildMacro(addNote, macro.id, macroStep.step, {priority, macro.id, maxVoices});
   if (sibVox)
     st.m_lastPlayMacroVid = sibVox->vid();
 
@@ -1224,7 +1268,10 @@ const SoundMacro::CmdIntrospection SoundMacro::CmdSetPriority::Introspective = {
     "Set Priority"sv,
     "Sets the priority of the current voice."sv,
     {{{FIELD_HEAD(SoundMacro::CmdSetPriority, prio), "Priority"sv, 0, 254, 50}}}};
-bool SoundMacro::CmdSetPriority::Do(SoundMacroState& st, Voice& vox) const { return false; }
+bool SoundMacro::CmdSetPriority::Do(SoundMacroState& st, Voice& vox) const {
+  vox.setPriority(prio);
+  return false;
+}
 unsigned int SoundMacro::CmdSetPriority::DoFluid(MacroExecContext& ctx, fluid_voice_t* fvox) const
 {
   // per-voice priority is not supported by fluidsynth
@@ -1237,7 +1284,10 @@ const SoundMacro::CmdIntrospection SoundMacro::CmdAddPriority::Introspective = {
     "Add Priority"sv,
     "Adds to the priority of the current voice."sv,
     {{{FIELD_HEAD(SoundMacro::CmdAddPriority, prio), "Priority"sv, -255, 255, 1}}}};
-bool SoundMacro::CmdAddPriority::Do(SoundMacroState& st, Voice& vox) const { return false; }
+bool SoundMacro::CmdAddPriority::Do(SoundMacroState& st, Voice& vox) const {
+  vox.setPriority(vox.getPriority() + prio);
+  return false;
+}
 unsigned int SoundMacro::CmdAddPriority::DoFluid(MacroExecContext& ctx, fluid_voice_t* fvox) const
 {
   // per-voice priority is not supported by fluidsynth
@@ -1824,12 +1874,15 @@ bool SoundMacroState::advance(Voice& vox, double dt) {
       }
     }
 
-    /* Load next command based on counter */
-    const SoundMacro::ICmd& cmd = std::get<1>(m_pc.back())->getCmd(std::get<2>(m_pc.back())++);
-
-    /* Perform function of command */
-    if (cmd.Do(*this, vox))
+    /* Load next command based on counter and perform its function */
+    const SoundMacro* macro = std::get<1>(m_pc.back());
+    const int pc = std::get<2>(m_pc.back())++;
+    if (const SoundMacro::Program* prog = macro->program()) {
+      if (prog->exec(pc, *this, vox))
+        return true;
+    } else if (macro->getCmd(pc).Do(*this, vox)) {
       return true;
+    }
   }
 
   m_execTime += dt;
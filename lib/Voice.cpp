@@ -5,6 +5,7 @@
 
 #include "amuse/AudioGroup.hpp"
 #include "amuse/Common.hpp"
+#include "amuse/CPUFeatures.hpp"
 #include "amuse/DSPCodec.hpp"
 #include "amuse/Engine.hpp"
 #include "amuse/IBackendVoice.hpp"
@@ -15,6 +16,11 @@
 
 namespace amuse {
 
+/** Control period of AmplitudeMode::BlockCurve in samples */
+constexpr uint32_t BlockCurveSamples = 32;
+constexpr uint32_t BlockCurveKnots = 4;
+constexpr uint32_t BlockCurveKnotSpacing = BlockCurveSamples / BlockCurveKnots;
+
 float Voice::VolumeCache::getVolume(float vol, bool dls) {
   if (vol != m_curVolLUTKey || dls != m_curDLS) {
     m_curVolLUTKey = vol;
@@ -29,6 +35,8 @@ float Voice::VolumeCache::getVolume(float vol, bool dls) {
 
 void Voice::_destroy() {
   Entity::_destroy();
+  m_engine._untrackVoice(*this);
+  m_engine._releaseVoiceId(m_vid);
 
   for (auto& vox : m_childVoices)
     vox->_destroy();
@@ -38,6 +46,18 @@ void Voice::_destroy() {
   m_curSample.reset();
 }
 
+void Voice::_steal() {
+  if (m_destroyed || m_stolen)
+    return;
+
+  /* Fade through the 5ms user-volume slew; preSupplyAudio kills the voice once silent */
+  m_stolen = true;
+  m_targetUserVol = 0.f;
+  m_engine._untrackVoice(*this);
+  for (ObjToken<Voice>& vox : m_childVoices)
+    vox->_steal();
+}
+
 Voice::~Voice() {
   // fprintf(stderr, "DEALLOC %d\n", m_vid);
 }
@@ -74,6 +94,7 @@ bool Voice::_checkSamplePos(bool& looped) {
     if (m_curSample->isLooped()) {
       /* Turn over looped sample */
       m_curSamplePos = m_curSample->m_loopStartSample;
+      m_decodedLoopPass = true;
       if (m_curFormat == SampleFormat::DSP) {
         m_prev1 = m_curSample->m_ADPCMParms.dsp.m_hist1;
         m_prev2 = m_curSample->m_ADPCMParms.dsp.m_hist2;
@@ -83,6 +104,7 @@ bool Voice::_checkSamplePos(bool& looped) {
       /* Notify sample end */
       _macroSampleEnd();
       m_curSample = nullptr;
+      m_curDecoded.reset();
       return true;
     }
   }
@@ -91,6 +113,7 @@ bool Voice::_checkSamplePos(bool& looped) {
   if (m_volAdsr.isComplete(*this)) {
     _macroSampleEnd();
     m_curSample = nullptr;
+    m_curDecoded.reset();
     return true;
   }
 
@@ -116,7 +139,9 @@ void Voice::_setTotalPitch(int32_t cents, bool slew) {
   const int32_t interval = std::clamp(cents, 0, 12700) - m_curSample->getPitch() * 100;
   const double ratio = std::exp2(interval / 1200.0) * m_dopplerRatio;
   m_sampleRate = m_curSample->m_sampleRate * ratio;
-  m_backendVoice->setPitchRatio(ratio, slew);
+  m_backendPitchRatio = ratio;
+  if (m_backendVoice)
+    m_backendVoice->setPitchRatio(ratio, slew);
 }
 
 bool Voice::_isRecursivelyDead() {
@@ -153,21 +178,24 @@ ObjToken<Voice> Voice::_findVoice(int vid, ObjToken<Voice> thisPtr) {
   return {};
 }
 
-std::unique_ptr<int8_t[]>& Voice::_ensureCtrlVals() {
-  if (m_ctrlValsSelf) {
-    return m_ctrlValsSelf;
+std::list<ObjToken<Voice>>::iterator Voice::_allocateVoice(double sampleRate, bool dynamicPitch,
+                                                           const VoicePriority& prio) {
+  if (m_stolen || !m_engine._admitVoice(m_audioGroup, prio, this))
+    return m_childVoices.end();
+  /* Admission may have stolen this very voice */
+  if (m_stolen)
+    return m_childVoices.end();
+  auto it = m_engine._emplaceVoice(m_childVoices, m_engine._makeVoice(m_audioGroup, m_groupId, m_emitter, m_studio));
+  m_engine._trackVoice(**it, prio);
+  Voice& child = **it;
+  if (m_virtual) {
+    /* Children of a virtual voice start virtual and get their backend voice once the parent resumes */
+    child.m_backendSampleRate = sampleRate;
+    child.m_dynamicPitch = dynamicPitch;
+    child.m_virtual = true;
+  } else {
+    child._allocateBackendVoice(sampleRate, dynamicPitch);
   }
-
-  m_ctrlValsSelf = std::make_unique<int8_t[]>(134);
-  return m_ctrlValsSelf;
-}
-
-std::list<ObjToken<Voice>>::iterator Voice::_allocateVoice(double sampleRate, bool dynamicPitch) {
-  amuse::ObjToken<Voice> tok =
-      MakeObj<Voice>(m_engine, m_audioGroup, m_groupId, m_engine.m_nextVid++, m_emitter, m_studio);
-  auto it = m_childVoices.emplace(m_childVoices.end(), tok);
-  m_childVoices.back()->m_backendVoice =
-      m_engine.getBackend().allocateVoice(*m_childVoices.back(), sampleRate, dynamicPitch);
   return it;
 }
 
@@ -176,48 +204,118 @@ std::list<ObjToken<Voice>>::iterator Voice::_destroyVoice(std::list<ObjToken<Voi
     return m_childVoices.begin();
 
   (*it)->_destroy();
-  return m_childVoices.erase(it);
+  return m_engine._eraseVoice(m_childVoices, it);
 }
 
-template <typename T>
-static T ApplyVolume(float vol, T samp) {
-  return samp * vol;
+void Voice::_allocateBackendVoice(double sampleRate, bool dynamicPitch) {
+  m_backendSampleRate = sampleRate;
+  m_dynamicPitch = dynamicPitch;
+  m_backendVoice = m_engine.getBackend().allocateVoice(*this, sampleRate, dynamicPitch);
 }
 
-void Voice::_procSamplePre(int16_t& samp) {
-  double dt = 0.0;
+void Voice::_virtualize() {
+  if (m_destroyed || m_virtual)
+    return;
 
-  /* Block linearized will use a larger `dt` for amplitude sampling;
-   * significantly reducing the processing expense */
-  switch (m_engine.m_ampMode) {
-  case AmplitudeMode::PerSample:
-    m_voiceSamples += 1;
-    dt = 1.0 / m_sampleRate;
-    break;
-  case AmplitudeMode::BlockLinearized: {
-    uint32_t rem = m_voiceSamples % 160;
-    m_voiceSamples += 1;
-    dt = m_sampleRate * 160;
-    if (rem != 0) {
-      /* Lerp within 160-sample block */
-      const float t = rem / 160.f;
-      const float l = std::clamp(m_lastLevel * (1.f - t) + m_nextLevel * t, 0.f, 1.f);
+  /* The resampler's fractional phase goes with the backend voice; playback resumes on a whole sample */
+  m_virtual = true;
+  m_virtualPhase = 0.0;
+  m_backendVoice.reset();
+  for (ObjToken<Voice>& vox : m_childVoices)
+    vox->_virtualize();
+}
 
-      /* Apply total volume to sample using decibel scale */
-      samp = ApplyVolume(m_lerpedCache.getVolume(l * m_engine.m_masterVolume, m_dlsVol), samp);
-      return;
+void Voice::_materialize(const std::array<float, 8>& coefs) {
+  if (m_destroyed || !m_virtual)
+    return;
+
+  m_virtual = false;
+  _allocateBackendVoice(m_backendSampleRate, m_dynamicPitch);
+  m_backendVoice->setPitchRatio(m_backendPitchRatio, false);
+  m_backendVoice->setChannelLevels(m_studio->getMaster().m_backendSubmix.get(), coefs, false);
+  m_backendVoice->setChannelLevels(m_studio->getAuxA().m_backendSubmix.get(), coefs, false);
+  m_backendVoice->setChannelLevels(m_studio->getAuxB().m_backendSubmix.get(), coefs, false);
+
+  /* Skipped control periods leave a stale block curve; hold the current level until the next period */
+  if (m_engine.m_ampMode == AmplitudeMode::BlockCurve)
+    m_gainCurve.fill(m_nextLevelCache.getVolume(m_nextLevel * m_engine.m_masterVolume, m_dlsVol));
+
+  if (m_voxState != VoiceState::Dead)
+    m_backendVoice->start();
+  for (ObjToken<Voice>& vox : m_childVoices)
+    vox->_materialize(coefs);
+}
+
+void Voice::_advanceVirtual(double dt) {
+  if (m_destroyed)
+    return;
+
+  /* Stand in for the backend pump: run the macro, then consume what the resampler would have read */
+  if (m_voxState != VoiceState::Dead) {
+    preSupplyAudio(dt);
+    if (!m_destroyed && m_voxState != VoiceState::Dead) {
+      m_virtualPhase += m_sampleRate * dt;
+      const double whole = std::floor(m_virtualPhase);
+      m_virtualPhase -= whole;
+      if (whole > 0.0)
+        _skipSamples(uint32_t(whole));
+    }
+  }
+
+  for (ObjToken<Voice>& vox : m_childVoices)
+    vox->_advanceVirtual(dt);
+}
+
+void Voice::_skipSamples(uint32_t count) {
+  if (!m_curSample) {
+    _macroSampleEnd();
+    return;
+  }
+
+  /* supplyAudio without decoding: position, loop turnover, sample end and the amplitude envelope */
+  const double dt = 1.0 / m_sampleRate;
+  while (count && m_curSample) {
+    const uint32_t steps = std::min(count, m_lastSamplePos - std::min(m_curSamplePos, m_lastSamplePos));
+    if (steps) {
+      /* Streamed DSP carries its decoder history along so resuming never replays the sample */
+      if (m_curFormat == SampleFormat::DSP && !m_curDecoded) {
+        for (uint32_t pos = m_curSamplePos, end = m_curSamplePos + steps; pos < end;) {
+          const uint32_t block = pos / 14;
+          const uint32_t last = std::min(14u, end - block * 14);
+          DSPDecompressFrameRangedStateOnly(m_curSampleData + 8 * block, m_curSample->m_ADPCMParms.dsp.m_coefs,
+                                            &m_prev1, &m_prev2, pos % 14, last);
+          pos = block * 14 + last;
+        }
+      }
+      m_curSamplePos += steps;
+      m_voiceSamples += steps;
+      _advanceLevel(dt, steps);
+      count -= steps;
     }
 
-    dt = 160.0 / m_sampleRate;
-    break;
+    bool looped;
+    if (_checkSamplePos(looped) || (looped && m_curSamplePos >= m_lastSamplePos))
+      break;
   }
+
+  if (m_voxState == VoiceState::Dead) {
+    m_curSample.reset();
+    m_curDecoded.reset();
   }
+}
+
+template <typename T>
+static T ApplyVolume(float vol, T samp) {
+  return samp * vol;
+}
 
-  m_voiceTime += dt;
+void Voice::_advanceLevel(double dt, uint32_t steps) {
+  const double totalDt = dt * steps;
+  m_voiceTime += totalDt;
 
   /* Process active envelope */
   if (m_envelopeTime >= 0.0) {
-    m_envelopeTime += dt;
+    m_envelopeTime += totalDt;
     const float start = m_envelopeStart;
     const float end = m_envelopeEnd;
     float t = std::clamp(float(m_envelopeTime / m_envelopeDur), 0.f, 1.f);
@@ -236,11 +334,11 @@ void Voice::_procSamplePre(int16_t& samp) {
   /* Dynamically evaluate per-sample SoundMacro parameters */
 
   /* Process user volume slew */
-  if (m_engine.m_ampMode == AmplitudeMode::PerSample) {
+  if (m_engine.m_ampMode != AmplitudeMode::BlockLinearized) {
     if (m_targetUserVol != m_curUserVol) {
       float samplesPer5Ms = m_sampleRate * 5.f / 1000.f;
       if (samplesPer5Ms > 1.f) {
-        float adjRate = 1.f / samplesPer5Ms;
+        float adjRate = float(steps) / samplesPer5Ms;
         if (m_targetUserVol < m_curUserVol) {
           m_curUserVol -= adjRate;
           if (m_targetUserVol > m_curUserVol)
@@ -256,7 +354,10 @@ void Voice::_procSamplePre(int16_t& samp) {
   } else
     m_curUserVol = m_targetUserVol;
 
-  /* Factor in ADSR envelope state */
+  /* Factor in ADSR envelope state; the envelope reports its level at the start of each advance,
+   * so multi-step advances land on the same level the last of `steps` single advances would */
+  if (steps > 1)
+    m_volAdsr.advance(dt * (steps - 1), *this);
   float adsr = m_volAdsr.advance(dt, *this);
   m_lastLevel = m_nextLevel;
   m_nextLevel = m_curUserVol * m_curVol * m_envelopeVol * adsr * (m_state.m_curVel / 127.f);
@@ -282,31 +383,136 @@ void Voice::_procSamplePre(int16_t& samp) {
   }
 
   m_nextLevel = std::clamp(m_nextLevel, 0.f, 1.f);
+}
+
+void Voice::_procSamplePre(int16_t& samp) {
+  double dt = 0.0;
+
+  /* Block linearized will use a larger `dt` for amplitude sampling;
+   * significantly reducing the processing expense */
+  switch (m_engine.m_ampMode) {
+  case AmplitudeMode::PerSample:
+    m_voiceSamples += 1;
+    dt = 1.0 / m_sampleRate;
+    break;
+  case AmplitudeMode::BlockLinearized: {
+    uint32_t rem = m_voiceSamples % 160;
+    m_voiceSamples += 1;
+    dt = m_sampleRate * 160;
+    if (rem != 0) {
+      /* Lerp within 160-sample block */
+      const float t = rem / 160.f;
+      const float l = std::clamp(m_lastLevel * (1.f - t) + m_nextLevel * t, 0.f, 1.f);
+
+      /* Apply total volume to sample using decibel scale */
+      samp = ApplyVolume(m_lerpedCache.getVolume(l * m_engine.m_masterVolume, m_dlsVol), samp);
+      return;
+    }
+
+    dt = 160.0 / m_sampleRate;
+    break;
+  }
+  case AmplitudeMode::BlockCurve:
+    /* Gain curves are applied a block at a time by _procSamplesPre */
+    assert(false && "BlockCurve samples are not processed individually");
+    return;
+  }
+
+  _advanceLevel(dt, 1);
 
   /* Apply total volume to sample using decibel scale */
   samp = ApplyVolume(m_nextLevelCache.getVolume(m_nextLevel * m_engine.m_masterVolume, m_dlsVol), samp);
 }
 
-template <typename T>
-T Voice::_procSampleMaster(double time, T samp) {
+/* Multiplies a block of samples by a per-sample gain curve, truncating like ApplyVolume */
+static void ApplyGainCurve(int16_t* data, const float* gain, uint32_t count) {
+  uint32_t i = 0;
+#if AMUSE_SSE2
+  for (; i + 8 <= count; i += 8) {
+    const __m128i samps = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(samps, samps), 16);
+    const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(samps, samps), 16);
+    const __m128 scaledLo = _mm_mul_ps(_mm_cvtepi32_ps(lo), _mm_loadu_ps(gain + i));
+    const __m128 scaledHi = _mm_mul_ps(_mm_cvtepi32_ps(hi), _mm_loadu_ps(gain + i + 4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i),
+                     _mm_packs_epi32(_mm_cvttps_epi32(scaledLo), _mm_cvttps_epi32(scaledHi)));
+  }
+#endif
+  for (; i < count; ++i)
+    data[i] = ApplyVolume(gain[i], data[i]);
+}
+
+void Voice::_procSamplesPre(int16_t* data, uint32_t count) {
+  if (m_engine.m_ampMode != AmplitudeMode::BlockCurve) {
+    for (uint32_t i = 0; i < count; ++i) {
+      ++m_curSamplePos;
+      _procSamplePre(data[i]);
+    }
+    return;
+  }
+
+  static_assert(std::tuple_size_v<decltype(m_gainCurve)> == BlockCurveSamples);
+  m_curSamplePos += count;
+  while (count) {
+    const uint32_t rem = m_voiceSamples % BlockCurveSamples;
+    if (rem == 0) {
+      /* Evaluate the level reached at the end of the coming control period */
+      const double dt = 1.0 / m_sampleRate;
+      float levelStep;
+      if (m_voiceSamples == 0) {
+        /* Anchor the first period on its first sample so note onsets are not smeared */
+        _advanceLevel(dt, 1);
+        _advanceLevel(dt, BlockCurveSamples - 1);
+        levelStep = (m_nextLevel - m_lastLevel) / float(BlockCurveSamples - 1);
+        m_lastLevel -= levelStep;
+      } else {
+        _advanceLevel(dt, BlockCurveSamples);
+        levelStep = (m_nextLevel - m_lastLevel) / float(BlockCurveSamples);
+      }
+
+      /* The level moves linearly across the period; sample its decibel mapping at evenly spaced
+       * knots and ramp the gain between them so the curve follows the volume table */
+      if (levelStep == 0.f) {
+        m_gainCurve.fill(m_nextLevelCache.getVolume(m_nextLevel * m_engine.m_masterVolume, m_dlsVol));
+      } else {
+        float knot = m_nextLevelCache.getVolume(m_lastLevel * m_engine.m_masterVolume, m_dlsVol);
+        for (uint32_t k = 0; k < BlockCurveKnots; ++k) {
+          const float level = m_lastLevel + levelStep * float((k + 1) * BlockCurveKnotSpacing);
+          const float nextKnot = m_nextLevelCache.getVolume(level * m_engine.m_masterVolume, m_dlsVol);
+          const float step = (nextKnot - knot) / float(BlockCurveKnotSpacing);
+          for (uint32_t j = 0; j < BlockCurveKnotSpacing; ++j)
+            m_gainCurve[k * BlockCurveKnotSpacing + j] = knot + step * float(j + 1);
+          knot = nextKnot;
+        }
+      }
+    }
+
+    const uint32_t procCount = std::min(count, BlockCurveSamples - rem);
+    ApplyGainCurve(data, m_gainCurve.data() + rem, procCount);
+
+    m_voiceSamples += procCount;
+    data += procCount;
+    count -= procCount;
+  }
+}
+
+float Voice::_masterGain(double time) {
   const float evalVol = m_state.m_volumeSel ? (m_state.m_volumeSel.evaluate(time, *this, m_state) / 127.f) : 1.f;
-  return ApplyVolume(m_masterCache.getVolume(std::clamp(evalVol, 0.f, 1.f), m_dlsVol), samp);
+  return m_masterCache.getVolume(std::clamp(evalVol, 0.f, 1.f), m_dlsVol);
 }
 
-template <typename T>
-T Voice::_procSampleAuxA(double time, T samp) {
+float Voice::_auxAGain(double time) {
   float evalVol = m_state.m_volumeSel ? (m_state.m_volumeSel.evaluate(time, *this, m_state) / 127.f) : 1.f;
   evalVol *= m_state.m_reverbSel ? (m_state.m_reverbSel.evaluate(time, *this, m_state) / 127.f) : m_curReverbVol;
   evalVol += m_state.m_preAuxASel ? (m_state.m_preAuxASel.evaluate(time, *this, m_state) / 127.f) : 0.f;
-  return ApplyVolume(m_auxACache.getVolume(std::clamp(evalVol, 0.f, 1.f), m_dlsVol), samp);
+  return m_auxACache.getVolume(std::clamp(evalVol, 0.f, 1.f), m_dlsVol);
 }
 
-template <typename T>
-T Voice::_procSampleAuxB(double time, T samp) {
+float Voice::_auxBGain(double time) {
   float evalVol = m_state.m_volumeSel ? (m_state.m_volumeSel.evaluate(time, *this, m_state) / 127.f) : 1.f;
   evalVol *= m_state.m_postAuxB ? (m_state.m_postAuxB.evaluate(time, *this, m_state) / 127.f) : m_curAuxBVol;
   evalVol += m_state.m_preAuxBSel ? (m_state.m_preAuxBSel.evaluate(time, *this, m_state) / 127.f) : 0.f;
-  return ApplyVolume(m_auxBCache.getVolume(std::clamp(evalVol, 0.f, 1.f), m_dlsVol), samp);
+  return m_auxBCache.getVolume(std::clamp(evalVol, 0.f, 1.f), m_dlsVol);
 }
 
 uint32_t Voice::_GetBlockSampleCount(SampleFormat fmt) {
@@ -331,6 +537,11 @@ static float TriangleWave(float t) {
 }
 
 void Voice::preSupplyAudio(double dt) {
+  if (m_stolen && (m_curUserVol == 0.f || !m_curSample)) {
+    kill();
+    return;
+  }
+
   /* Process SoundMacro; bootstrapping sample if needed */
   bool dead = m_state.advance(*this, dt);
 
@@ -461,7 +672,8 @@ void Voice::preSupplyAudio(double dt) {
   if (dead && (!m_curSample || m_voxState == VoiceState::KeyOff) && m_sampleEndTrap.macroId == 0xffff &&
       m_messageTrap.macroId == 0xffff && (!m_curSample || (m_curSample && m_volAdsr.isComplete(*this)))) {
     m_voxState = VoiceState::Dead;
-    m_backendVoice->stop();
+    if (m_backendVoice)
+      m_backendVoice->stop();
   }
 }
 
@@ -483,14 +695,21 @@ size_t Voice::supplyAudio(size_t samples, int16_t* data) {
 
         switch (m_curFormat) {
         case SampleFormat::DSP: {
-          decSamples =
-              DSPDecompressFrameRanged(data, m_curSampleData + 8 * block, m_curSample->m_ADPCMParms.dsp.m_coefs,
-                                       &m_prev1, &m_prev2, rem, remCount);
+          remCount = std::min(samplesRem, std::min((block + 1) * blockSampleCount, m_lastSamplePos) - m_curSamplePos);
+          if (m_curDecoded)
+            decSamples = _copyDecoded(data, remCount);
+          else
+            decSamples = DSPDecompressFrames(data, m_curSampleData + 8 * block, m_curSample->m_ADPCMParms.dsp.m_coefs,
+                                             &m_prev1, &m_prev2, rem, remCount);
           break;
         }
         case SampleFormat::N64: {
-          decSamples = N64MusyXDecompressFrameRanged(data, m_curSampleData + 256 + 40 * block,
-                                                     m_curSample->m_ADPCMParms.vadpcm.m_coefs, rem, remCount);
+          remCount = std::min(samplesRem, std::min((block + 1) * blockSampleCount, m_lastSamplePos) - m_curSamplePos);
+          if (m_curDecoded)
+            decSamples = _copyDecoded(data, remCount);
+          else
+            decSamples = N64MusyXDecompressFrames(data, m_curSampleData + 256 + 40 * block,
+                                                  m_curSample->m_ADPCMParms.vadpcm.m_coefs, rem, remCount);
           break;
         }
         case SampleFormat::PCM: {
@@ -513,11 +732,8 @@ size_t Voice::supplyAudio(size_t samples, int16_t* data) {
           return samples;
         }
 
-        /* Per-sample processing */
-        for (uint32_t i = 0; i < decSamples; ++i) {
-          ++m_curSamplePos;
-          _procSamplePre(data[i]);
-        }
+        /* Amplitude processing */
+        _procSamplesPre(data, decSamples);
 
         samplesRem -= decSamples;
         data += decSamples;
@@ -538,13 +754,22 @@ size_t Voice::supplyAudio(size_t samples, int16_t* data) {
 
         switch (m_curFormat) {
         case SampleFormat::DSP: {
-          decSamples = DSPDecompressFrame(data, m_curSampleData + 8 * block, m_curSample->m_ADPCMParms.dsp.m_coefs,
-                                          &m_prev1, &m_prev2, remCount);
+          /* Decode every whole frame up to the request or sample end in one call */
+          remCount = std::min(samplesRem, m_lastSamplePos - m_curSamplePos);
+          if (m_curDecoded)
+            decSamples = _copyDecoded(data, remCount);
+          else
+            decSamples = DSPDecompressFrames(data, m_curSampleData + 8 * block, m_curSample->m_ADPCMParms.dsp.m_coefs,
+                                             &m_prev1, &m_prev2, 0, remCount);
           break;
         }
         case SampleFormat::N64: {
-          decSamples = N64MusyXDecompressFrame(data, m_curSampleData + 256 + 40 * block,
-                                               m_curSample->m_ADPCMParms.vadpcm.m_coefs, remCount);
+          remCount = std::min(samplesRem, m_lastSamplePos - m_curSamplePos);
+          if (m_curDecoded)
+            decSamples = _copyDecoded(data, remCount);
+          else
+            decSamples = N64MusyXDecompressFrames(data, m_curSampleData + 256 + 40 * block,
+                                                  m_curSample->m_ADPCMParms.vadpcm.m_coefs, 0, remCount);
           break;
         }
         case SampleFormat::PCM: {
@@ -567,10 +792,26 @@ size_t Voice::supplyAudio(size_t samples, int16_t* data) {
           return samples;
         }
 
-        /* Per-sample processing */
-        for (uint32_t i = 0; i < decSamples; ++i) {
-          ++m_curSamplePos;
-          _procSamplePre(data[i]);
+        /* Amplitude processing; multi-frame ADPCM batches still observe sample end at each frame boundary */
+        for (uint32_t i = 0; i < decSamples;) {
+          uint32_t procCount = decSamples - i;
+          if (blockSampleCount > 1) {
+            uint32_t toBoundary = blockSampleCount - m_curSamplePos % blockSampleCount;
+            if (m_engine.m_ampMode == AmplitudeMode::BlockCurve) {
+              /* The block-curve envelope only advances at control period starts, so only the first
+               * frame boundary after the next period start can observe a completed ADSR */
+              const uint32_t toPeriod = (BlockCurveSamples - m_voiceSamples % BlockCurveSamples) % BlockCurveSamples;
+              if (toPeriod >= toBoundary)
+                toBoundary += (toPeriod - toBoundary) / blockSampleCount * blockSampleCount + blockSampleCount;
+            }
+            procCount = std::min(procCount, toBoundary);
+          }
+          _procSamplesPre(data + i, procCount);
+          i += procCount;
+          if (i < decSamples && _checkSamplePos(looped)) {
+            memset(data + i, 0, sizeof(int16_t) * (samplesRem - i));
+            return samples;
+          }
         }
 
         samplesRem -= decSamples;
@@ -590,79 +831,64 @@ size_t Voice::supplyAudio(size_t samples, int16_t* data) {
     memset(data, 0, sizeof(int16_t) * samples);
   }
 
-  if (m_voxState == VoiceState::Dead)
+  if (m_voxState == VoiceState::Dead) {
     m_curSample.reset();
+    m_curDecoded.reset();
+  }
 
   return samples;
 }
 
-void Voice::routeAudio(size_t frames, double dt, int busId, int16_t* in, int16_t* out) {
-  dt /= double(frames);
+uint32_t Voice::_copyDecoded(int16_t* data, uint32_t count) const {
+  const int16_t* src = m_decodedLoopPass
+                           ? m_curDecoded->getLoopPass() + (m_curSamplePos - m_curDecoded->m_loopStart)
+                           : m_curDecoded->m_pcm.data() + m_curSamplePos;
+  memmove(data, src, count * sizeof(int16_t));
+  return count;
+}
 
+template <typename T>
+void Voice::_routeAudio(size_t frames, double dt, int busId, const T* in, T* out) {
+  float (Voice::*gain)(double);
+  bool timeVarying = m_state.m_volumeSel.isTimeVarying();
   switch (busId) {
   case 0:
-  default: {
-    for (uint32_t i = 0; i < frames; ++i)
-      out[i] = _procSampleMaster(dt * i + m_voiceTime, in[i]);
+  default:
+    gain = &Voice::_masterGain;
     break;
-  }
-  case 1: {
-    for (uint32_t i = 0; i < frames; ++i)
-      out[i] = _procSampleAuxA(dt * i + m_voiceTime, in[i]);
+  case 1:
+    gain = &Voice::_auxAGain;
+    timeVarying |= m_state.m_reverbSel.isTimeVarying() || m_state.m_preAuxASel.isTimeVarying();
     break;
-  }
-  case 2: {
-    for (uint32_t i = 0; i < frames; ++i)
-      out[i] = _procSampleAuxB(dt * i + m_voiceTime, in[i]);
+  case 2:
+    gain = &Voice::_auxBGain;
+    timeVarying |= m_state.m_postAuxB.isTimeVarying() || m_state.m_preAuxBSel.isTimeVarying();
     break;
   }
+
+  /* Controllers and macro state only change between blocks; only LFO terms need per-sample evaluation */
+  if (!timeVarying) {
+    const float vol = (this->*gain)(m_voiceTime);
+    for (size_t i = 0; i < frames; ++i)
+      out[i] = ApplyVolume(vol, in[i]);
+    return;
   }
-}
 
-void Voice::routeAudio(size_t frames, double dt, int busId, int32_t* in, int32_t* out) {
   dt /= double(frames);
+  for (size_t i = 0; i < frames; ++i)
+    out[i] = ApplyVolume((this->*gain)(dt * i + m_voiceTime), in[i]);
+}
 
-  switch (busId) {
-  case 0:
-  default: {
-    for (uint32_t i = 0; i < frames; ++i)
-      out[i] = _procSampleMaster(dt * i + m_voiceTime, in[i]);
-    break;
-  }
-  case 1: {
-    for (uint32_t i = 0; i < frames; ++i)
-      out[i] = _procSampleAuxA(dt * i + m_voiceTime, in[i]);
-    break;
-  }
-  case 2: {
-    for (uint32_t i = 0; i < frames; ++i)
-      out[i] = _procSampleAuxB(dt * i + m_voiceTime, in[i]);
-    break;
-  }
-  }
+void Voice::routeAudio(size_t frames, double dt, int busId, int16_t* in, int16_t* out) {
+  _routeAudio(frames, dt, busId, in, out);
 }
 
-void Voice::routeAudio(size_t frames, double dt, int busId, float* in, float* out) {
-  dt /= double(frames);
+void Voice::routeAudio(size_t frames, double dt, int busId, int32_t* in, int32_t* out) {
+  _routeAudio(frames, dt, busId, in, out);
+}
 
-  switch (busId) {
-  case 0:
-  default: {
-    for (uint32_t i = 0; i < frames; ++i)
-      out[i] = _procSampleMaster(dt * i + m_voiceTime, in[i]);
-    break;
-  }
-  case 1: {
-    for (uint32_t i = 0; i < frames; ++i)
-      out[i] = _procSampleAuxA(dt * i + m_voiceTime, in[i]);
-    break;
-  }
-  case 2: {
-    for (uint32_t i = 0; i < frames; ++i)
-      out[i] = _procSampleAuxB(dt * i + m_voiceTime, in[i]);
-    break;
-  }
-  }
+void Voice::routeAudio(size_t frames, double dt, int busId, float* in, float* out) {
+  _routeAudio(frames, dt, busId, in, out);
 }
 
 int Voice::maxVid() const {
@@ -673,8 +899,10 @@ int Voice::maxVid() const {
 }
 
 ObjToken<Voice> Voice::_startChildMacro(ObjectId macroId, int macroStep, double ticksPerSec, uint8_t midiKey,
-                                        uint8_t midiVel, uint8_t midiMod, bool pushPc) {
-  std::list<ObjToken<Voice>>::iterator vox = _allocateVoice(NativeSampleRate, true);
+                                        uint8_t midiVel, uint8_t midiMod, const VoicePriority& prio, bool pushPc) {
+  std::list<ObjToken<Voice>>::iterator vox = _allocateVoice(NativeSampleRate, true, prio);
+  if (vox == m_childVoices.end())
+    return {};
   if (!(*vox)->loadMacroObject(macroId, macroStep, ticksPerSec, midiKey, midiVel, midiMod, pushPc)) {
     _destroyVoice(vox);
     return {};
@@ -688,8 +916,12 @@ ObjToken<Voice> Voice::_startChildMacro(ObjectId macroId, int macroStep, double
 }
 
 ObjToken<Voice> Voice::startChildMacro(int8_t addNote, ObjectId macroId, int macroStep) {
+  return startChildMacro(addNote, macroId, macroStep, m_priority);
+}
+
+ObjToken<Voice> Voice::startChildMacro(int8_t addNote, ObjectId macroId, int macroStep, const VoicePriority& prio) {
   return _startChildMacro(macroId, macroStep, 1000.0, m_state.m_initKey + addNote, m_state.m_initVel,
-                          m_state.m_initMod);
+                          m_state.m_initMod, prio);
 }
 
 bool Voice::_loadSoundMacro(SoundMacroId id, const SoundMacro* macroData, int macroStep, double ticksPerSec,
@@ -705,7 +937,8 @@ bool Voice::_loadSoundMacro(SoundMacroId id, const SoundMacro* macroData, int ma
   }
 
   m_voxState = VoiceState::Playing;
-  m_backendVoice->start();
+  if (m_backendVoice)
+    m_backendVoice->start();
   return true;
 }
 
@@ -726,17 +959,28 @@ bool Voice::_loadKeymap(const Keymap* keymap, double ticksPerSec, uint8_t midiKe
 
 bool Voice::_loadLayer(const std::vector<LayerMapping>& layer, double ticksPerSec, uint8_t midiKey, uint8_t midiVel,
                        uint8_t midiMod, bool pushPc) {
+  /* This voice was admitted with the first matching mapping's offset (see _PagePriority) */
   bool ret = false;
+  int basePriority = m_priority.m_priority;
+  for (const LayerMapping& mapping : layer) {
+    if (midiKey >= mapping.keyLo && midiKey <= mapping.keyHi) {
+      basePriority -= mapping.prioOffset;
+      break;
+    }
+  }
   for (const LayerMapping& mapping : layer) {
     if (midiKey >= mapping.keyLo && midiKey <= mapping.keyHi) {
       uint8_t mappingKey = midiKey + mapping.transpose;
+      const int priority = std::clamp(basePriority + mapping.prioOffset, 0, 255);
       if (m_voxState != VoiceState::Playing) {
         ret |= loadMacroObject(mapping.macro.id, 0, ticksPerSec, mappingKey, midiVel, midiMod, pushPc);
         m_curUserVol = m_targetUserVol = mapping.volume / 127.f;
         _setPan((mapping.pan - 64) / 64.f);
         _setSurroundPan((mapping.span - 64) / 64.f);
       } else {
-        ObjToken<Voice> vox = _startChildMacro(mapping.macro.id, 0, ticksPerSec, mappingKey, midiVel, midiMod, pushPc);
+        ObjToken<Voice> vox = _startChildMacro(mapping.macro.id, 0, ticksPerSec, mappingKey, midiVel, midiMod,
+                                               {uint8_t(priority), m_priority.m_limitId, m_priority.m_maxVoices},
+                                               pushPc);
         if (vox) {
           vox->m_curUserVol = vox->m_targetUserVol = mapping.volume / 127.f;
           vox->_setPan((mapping.pan - 64) / 64.f);
@@ -772,6 +1016,25 @@ bool Voice::loadMacroObject(const SoundMacro* macro, int macroStep, double ticks
   return false;
 }
 
+VoicePriority Voice::_PagePriority(const AudioGroup& group, ObjectId objectId, uint8_t midiKey, VoicePriority prio) {
+  int offset = 0;
+  if (objectId.id & 0x8000) {
+    if (const std::vector<LayerMapping>* layer = group.getPool().layer(objectId)) {
+      for (const LayerMapping& mapping : *layer) {
+        if (midiKey >= mapping.keyLo && midiKey <= mapping.keyHi) {
+          offset = mapping.prioOffset;
+          break;
+        }
+      }
+    }
+  } else if (objectId.id & 0x4000) {
+    if (const Keymap* keymap = group.getPool().keymap(objectId))
+      offset = keymap[midiKey].prioOffset;
+  }
+  prio.m_priority = uint8_t(std::clamp(prio.m_priority + offset, 0, 255));
+  return prio;
+}
+
 bool Voice::loadPageObject(ObjectId objectId, double ticksPerSec, uint8_t midiKey, uint8_t midiVel, uint8_t midiMod) {
   if (m_destroyed)
     return false;
@@ -847,7 +1110,9 @@ void Voice::startSample(SampleId sampId, int32_t offset) {
     m_curPitch = m_curSample->getPitch();
     m_pitchDirty = true;
     _setPitchWheel(m_curPitchWheel);
-    m_backendVoice->resetSampleRate(m_curSample->m_sampleRate);
+    m_backendSampleRate = m_curSample->m_sampleRate;
+    if (m_backendVoice)
+      m_backendVoice->resetSampleRate(m_backendSampleRate);
     m_needsSlew = false;
 
     const int32_t numSamples = m_curSample->getNumSamples();
@@ -863,6 +1128,7 @@ void Voice::startSample(SampleId sampId, int32_t offset) {
     m_curSamplePos = offset;
     m_prev1 = 0;
     m_prev2 = 0;
+    m_decodedLoopPass = false;
 
     m_curFormat = m_curSample->getSampleFormat();
     if (m_curFormat == SampleFormat::DSP_DRUM)
@@ -876,8 +1142,14 @@ void Voice::startSample(SampleId sampId, int32_t offset) {
     bool looped;
     _checkSamplePos(looped);
 
+    /* Serve shared PCM from the engine's cache when the voice starts on the first pass;
+     * a start that immediately turns over seeds the DSP history differently and is streamed */
+    m_curDecoded.reset();
+    if (m_curSample && !looped)
+      m_curDecoded = m_engine.m_sampleCache.acquire(sampId, m_curSample, m_curSampleData);
+
     /* Seek DSPADPCM state if needed */
-    if (m_curSample && m_curSamplePos && m_curFormat == SampleFormat::DSP) {
+    if (m_curSample && !m_curDecoded && m_curSamplePos && m_curFormat == SampleFormat::DSP) {
       uint32_t block = m_curSamplePos / 14;
       uint32_t rem = m_curSamplePos % 14;
       for (uint32_t b = 0; b < block; ++b)
@@ -891,10 +1163,13 @@ void Voice::startSample(SampleId sampId, int32_t offset) {
   }
 }
 
-void Voice::stopSample() { m_curSample.reset(); }
+void Voice::stopSample() {
+  m_curSample.reset();
+  m_curDecoded.reset();
+}
 
 void Voice::setVolume(float vol) {
-  if (m_destroyed)
+  if (m_destroyed || m_stolen)
     return;
 
   m_targetUserVol = std::clamp(vol, 0.f, 1.f);
@@ -903,10 +1178,14 @@ void Voice::setVolume(float vol) {
 }
 
 std::array<float, 8> Voice::_panLaw(float frontPan, float backPan, float totalSpan) const {
+  return PanLaw(m_engine.m_channelSet, frontPan, backPan, totalSpan);
+}
+
+std::array<float, 8> Voice::PanLaw(AudioChannelSet set, float frontPan, float backPan, float totalSpan) {
   std::array<float, 8> coefs{};
 
   /* -3dB panning law for various channel configs */
-  switch (m_engine.m_channelSet) {
+  switch (set) {
   case AudioChannelSet::Stereo:
   default:
     /* Left */
@@ -1052,6 +1331,8 @@ void Voice::setSurroundPan(float span) {
 }
 
 void Voice::_setChannelCoefs(const std::array<float, 8>& coefs) {
+  if (!m_backendVoice)
+    return;
   m_backendVoice->setChannelLevels(m_studio->getMaster().m_backendSubmix.get(), coefs, true);
   m_backendVoice->setChannelLevels(m_studio->getAuxA().m_backendSubmix.get(), coefs, true);
   m_backendVoice->setChannelLevels(m_studio->getAuxB().m_backendSubmix.get(), coefs, true);
@@ -1187,8 +1468,12 @@ void Voice::setPitchFrequency(uint32_t hz, uint16_t fine) {
     return;
 
   m_sampleRate = hz + fine / 65536.0;
-  m_backendVoice->setPitchRatio(1.0, false);
-  m_backendVoice->resetSampleRate(m_sampleRate);
+  m_backendPitchRatio = 1.0;
+  m_backendSampleRate = m_sampleRate;
+  if (m_backendVoice) {
+    m_backendVoice->setPitchRatio(1.0, false);
+    m_backendVoice->resetSampleRate(m_sampleRate);
+  }
 }
 
 void Voice::setPitchAdsr(ObjectId adsrId, int32_t cents) {
@@ -1315,12 +1600,18 @@ size_t Voice::getTotalVoices() const {
   return ret;
 }
 
+void Voice::setPriority(int priority) {
+  m_priority.m_priority = uint8_t(std::clamp(priority, 0, 255));
+  m_engine._updateVoicePriority(*this);
+}
+
 void Voice::kill() {
   if (m_destroyed)
     return;
 
   m_voxState = VoiceState::Dead;
-  m_backendVoice->stop();
+  if (m_backendVoice)
+    m_backendVoice->stop();
   for (const ObjToken<Voice>& vox : m_childVoices)
     vox->kill();
 }
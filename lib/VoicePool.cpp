@@ -0,0 +1,57 @@
+#include "amuse/VoicePool.hpp"
+
+#include <algorithm>
+#include <new>
+
+namespace amuse {
+
+bool VoicePool::_ownsBlock(const void* ptr) const {
+  const std::byte* p = static_cast<const std::byte*>(ptr);
+  return m_slab && p >= m_slab.get() && p < m_slab.get() + m_capacity * m_blockSize;
+}
+
+void* VoicePool::allocate(size_t bytes) {
+  {
+    std::unique_lock lk(m_lock);
+    if (!m_slab && m_capacity) {
+      /* First allocation fixes the block size; carve the whole slab into the free list */
+      m_blockSize = (bytes + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+      m_slab.reset(new std::byte[m_capacity * m_blockSize]);
+      ++m_heapAllocations;
+      for (size_t i = m_capacity; i-- > 0;)
+        m_freeList = new (m_slab.get() + i * m_blockSize) FreeBlock{m_freeList};
+    }
+    if (bytes <= m_blockSize && m_freeList) {
+      FreeBlock* block = m_freeList;
+      m_freeList = block->m_next;
+      m_peakInUse = std::max(m_peakInUse, ++m_inUse);
+      return block;
+    }
+    ++m_heapAllocations;
+  }
+  return ::operator new(bytes);
+}
+
+void VoicePool::deallocate(void* ptr, size_t bytes) {
+  {
+    std::unique_lock lk(m_lock);
+    if (_ownsBlock(ptr)) {
+      m_freeList = new (ptr) FreeBlock{m_freeList};
+      --m_inUse;
+      return;
+    }
+  }
+  ::operator delete(ptr, bytes);
+}
+
+uint64_t VoicePool::getHeapAllocations() const {
+  std::unique_lock lk(m_lock);
+  return m_heapAllocations;
+}
+
+VoicePool::Stats VoicePool::getStats() const {
+  std::unique_lock lk(m_lock);
+  return {m_capacity, m_inUse, m_peakInUse, m_heapAllocations};
+}
+
+} // namespace amuse
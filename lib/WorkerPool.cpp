@@ -0,0 +1,90 @@
+#include "amuse/WorkerPool.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace amuse {
+
+WorkerPool::WorkerPool(unsigned threadCount) {
+  if (threadCount == 0)
+    threadCount = HardwareThreads();
+  m_threads.reserve(threadCount - 1);
+  for (unsigned i = 1; i < threadCount; ++i)
+    m_threads.emplace_back(&WorkerPool::_workerProc, this);
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::unique_lock lk(m_lock);
+    m_running = false;
+  }
+  m_startCv.notify_all();
+  for (std::thread& thr : m_threads)
+    thr.join();
+}
+
+unsigned WorkerPool::HardwareThreads() { return std::max(1u, std::thread::hardware_concurrency()); }
+
+void WorkerPool::_drainJobs() {
+  for (size_t idx = m_nextIdx++; idx < m_jobCount; idx = m_nextIdx++) {
+    try {
+      (*m_job)(idx);
+    } catch (...) {
+      std::unique_lock lk(m_lock);
+      if (!m_exception)
+        m_exception = std::current_exception();
+    }
+  }
+}
+
+void WorkerPool::_workerProc() {
+  uint64_t seenGeneration = 0;
+  while (true) {
+    {
+      std::unique_lock lk(m_lock);
+      m_startCv.wait(lk, [&]() { return !m_running || m_generation != seenGeneration; });
+      if (!m_running)
+        return;
+      seenGeneration = m_generation;
+    }
+
+    _drainJobs();
+
+    std::unique_lock lk(m_lock);
+    if (--m_busyWorkers == 0)
+      m_doneCv.notify_one();
+  }
+}
+
+void WorkerPool::parallelFor(size_t count, const std::function<void(size_t)>& func) {
+  if (m_threads.empty() || count <= 1) {
+    for (size_t i = 0; i < count; ++i)
+      func(i);
+    return;
+  }
+
+  {
+    std::unique_lock lk(m_lock);
+    m_job = &func;
+    m_jobCount = count;
+    m_nextIdx = 0;
+    m_busyWorkers = m_threads.size();
+    m_exception = nullptr;
+    ++m_generation;
+  }
+  m_startCv.notify_all();
+
+  _drainJobs();
+
+  std::exception_ptr exception;
+  {
+    std::unique_lock lk(m_lock);
+    m_doneCv.wait(lk, [this]() { return m_busyWorkers == 0; });
+    m_job = nullptr;
+    exception = std::exchange(m_exception, nullptr);
+  }
+  if (exception)
+    std::rethrow_exception(exception);
+}
+
+} // namespace amuse